@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+#include <remill/BC/Compiler.h>
+#include <remill/BC/Util.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+DEFINE_string(bc_in, "",
+              "Path to the bitcode of lifted code, e.g. as produced by "
+              "remill-lift --bc_out.");
+DEFINE_string(obj_dir, "",
+              "Directory into which one object file per partition is "
+              "written.");
+DEFINE_uint64(num_partitions, 0,
+              "Number of partitions compiled in parallel. Zero means one per "
+              "hardware thread.");
+DEFINE_string(cpu, "",
+              "Target CPU. Defaults to the host CPU when compiling for the host "
+              "architecture, and to a generic CPU otherwise.");
+DEFINE_string(features, "", "Target features, e.g. +avx2.");
+DEFINE_uint64(opt_level, 2, "Code generation optimization level (0-3).");
+DEFINE_string(runtime, "",
+              "Comma-separated list of objects or libraries implementing the "
+              "Remill runtime intrinsics, e.g. __remill_read_memory_8, that "
+              "are linked into --link_out.");
+DEFINE_string(link_out, "",
+              "Path of a shared library to link from the compiled partitions "
+              "and --runtime.");
+DEFINE_string(linker, "cc", "Compiler driver used to link --link_out.");
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Link `objects` and `--runtime` into the shared library `--link_out`.
+static bool LinkSharedLibrary(const std::vector<std::string> &objects) {
+  auto linker = llvm::sys::findProgramByName(FLAGS_linker);
+  if (!linker) {
+    LOG(ERROR) << "Unable to find linker " << FLAGS_linker;
+    return false;
+  }
+
+  std::vector<llvm::StringRef> args = {*linker, "-shared", "-o",
+                                       FLAGS_link_out};
+  args.insert(args.end(), objects.begin(), objects.end());
+
+  llvm::SmallVector<llvm::StringRef, 4> runtime;
+  llvm::StringRef(FLAGS_runtime).split(runtime, ',', -1, false);
+  args.insert(args.end(), runtime.begin(), runtime.end());
+
+  std::string error;
+  const auto ret =
+      llvm::sys::ExecuteAndWait(*linker, args, {}, {}, 0, 0, &error);
+  if (ret) {
+    LOG(ERROR) << "Linking " << FLAGS_link_out << " failed: "
+               << (error.empty() ? "exit status " + std::to_string(ret)
+                                 : error);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_bc_in.empty()) {
+    std::cerr << "Please specify the bitcode to compile with --bc_in."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (FLAGS_obj_dir.empty()) {
+    std::cerr << "Please specify an output directory with --obj_dir."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (FLAGS_opt_level > 3) {
+    std::cerr << "--opt_level must be between 0 and 3." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  llvm::LLVMContext context;
+
+  auto start = std::chrono::steady_clock::now();
+  auto module = remill::LoadModuleFromFile(&context, FLAGS_bc_in);
+  const auto load_seconds = SecondsSince(start);
+
+  remill::CompileOptions options;
+  options.num_partitions = static_cast<unsigned>(FLAGS_num_partitions);
+  options.cpu = FLAGS_cpu;
+  options.features = FLAGS_features;
+  options.opt_level = static_cast<llvm::CodeGenOpt::Level>(FLAGS_opt_level);
+
+  remill::CompileStatistics stats;
+  auto objects = remill::CompileModule(*module, options, &stats);
+  if (!objects) {
+    return EXIT_FAILURE;
+  }
+
+  start = std::chrono::steady_clock::now();
+  std::error_code ec;
+  std::filesystem::create_directories(FLAGS_obj_dir, ec);
+
+  std::vector<std::string> object_paths;
+  for (size_t i = 0; i < objects->size(); ++i) {
+    const auto path = (std::filesystem::path(FLAGS_obj_dir) /
+                       ("part_" + std::to_string(i) + ".o"))
+                          .string();
+    llvm::raw_fd_ostream os(path, ec);
+    if (ec) {
+      LOG(ERROR) << "Unable to open " << path << ": " << ec.message();
+      return EXIT_FAILURE;
+    }
+    os << (*objects)[i];
+    os.close();
+    if (os.has_error()) {
+      LOG(ERROR) << "Unable to write " << path << ": "
+                 << os.error().message();
+      os.clear_error();
+      return EXIT_FAILURE;
+    }
+    object_paths.push_back(path);
+  }
+  const auto write_seconds = SecondsSince(start);
+
+  double link_seconds = 0;
+  if (!FLAGS_link_out.empty()) {
+    start = std::chrono::steady_clock::now();
+    if (!LinkSharedLibrary(object_paths)) {
+      return EXIT_FAILURE;
+    }
+    link_seconds = SecondsSince(start);
+  }
+
+  std::cerr << "Compiled " << stats.num_functions << " functions into "
+            << stats.num_partitions << " objects (" << stats.num_object_bytes
+            << " bytes)" << std::endl
+            << "Stage times (s): load " << load_seconds << ", split "
+            << stats.split_seconds << ", codegen " << stats.codegen_seconds
+            << ", write " << write_seconds << ", link " << link_seconds
+            << std::endl;
+  return EXIT_SUCCESS;
+}
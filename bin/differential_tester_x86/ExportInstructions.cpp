@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Exports a corpus of unique instruction encodings, for consumption by
+// `lift-and-compare`, by linearly sweeping the executable sections of a set
+// of ELF files with Remill's own decoders.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Object/ELFObjectFile.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/OS/OS.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+DEFINE_string(arch, "x86", "Architecture of the code being swept.");
+DEFINE_string(os, "linux", "Operating system of the code being swept.");
+DEFINE_string(out_dir, "", "Directory into which corpus shards are written.");
+DEFINE_string(out_name, "insn_file",
+              "Prefix of the corpus shards. Shard N is written to "
+              "<out_dir>/<out_name>_N.json.");
+DEFINE_uint64(num_shards, 1, "Number of corpus shards to write.");
+DEFINE_uint64(num_workers, 0,
+              "Number of threads sweeping files. Zero means one per hardware "
+              "thread.");
+
+namespace {
+
+// Set of encodings seen by any worker. The set is split into independently
+// locked stripes so that workers rarely contend with each other.
+class EncodingSet {
+ public:
+  // Returns `true` if `bytes` had not been seen before.
+  bool Insert(std::string_view bytes) {
+    auto &stripe = stripes[std::hash<std::string_view>{}(bytes) % kNumStripes];
+    std::lock_guard<std::mutex> locker(stripe.lock);
+    return stripe.encodings.emplace(bytes).second;
+  }
+
+  // Distribute all encodings across `num_shards` shards. Each encoding always
+  // lands in the same shard, and each shard is sorted, so that the corpus is
+  // reproducible.
+  std::vector<std::vector<std::string>> Shard(size_t num_shards) {
+    std::vector<std::vector<std::string>> shards(num_shards);
+    for (auto &stripe : stripes) {
+      for (auto &bytes : stripe.encodings) {
+        shards[std::hash<std::string>{}(bytes) % num_shards].push_back(bytes);
+      }
+      stripe.encodings.clear();
+    }
+    for (auto &shard : shards) {
+      std::sort(shard.begin(), shard.end());
+    }
+    return shards;
+  }
+
+ private:
+  static constexpr size_t kNumStripes = 64;
+
+  struct Stripe {
+    std::mutex lock;
+    std::unordered_set<std::string> encodings;
+  };
+
+  Stripe stripes[kNumStripes];
+};
+
+// Serializes the initialization of architectures across workers.
+std::mutex gArchInitLock;
+
+class SweepWorker {
+ public:
+  explicit SweepWorker(EncodingSet &encodings_) : encodings(encodings_) {
+    std::lock_guard<std::mutex> locker(gArchInitLock);
+    arch = remill::Arch::Get(context, FLAGS_os, FLAGS_arch);
+    CHECK(arch) << "Unable to create architecture " << FLAGS_arch;
+  }
+
+  void Run(const std::vector<std::filesystem::path> &files,
+           std::atomic<size_t> &next_file) {
+    for (auto i = next_file++; i < files.size(); i = next_file++) {
+      SweepFile(files[i]);
+    }
+  }
+
+  uint64_t num_decoded{0};
+  uint64_t num_bytes{0};
+
+ private:
+  void SweepFile(const std::filesystem::path &path) {
+    auto maybe_buffer = llvm::MemoryBuffer::getFile(
+        path.string(), false /* IsText */, false /* RequiresNullTerminator */);
+    if (!maybe_buffer) {
+      LOG(WARNING) << "Unable to open " << path << ": "
+                   << maybe_buffer.getError().message();
+      return;
+    }
+
+    auto maybe_obj = llvm::object::ObjectFile::createObjectFile(
+        (*maybe_buffer)->getMemBufferRef());
+    if (!maybe_obj) {
+      llvm::consumeError(maybe_obj.takeError());
+      DLOG(INFO) << "Skipping non-object file " << path;
+      return;
+    }
+
+    if (!llvm::isa<llvm::object::ELFObjectFileBase>(maybe_obj->get())) {
+      DLOG(INFO) << "Skipping non-ELF file " << path;
+      return;
+    }
+
+    for (const auto &section : (*maybe_obj)->sections()) {
+      if (!section.isText() || section.isVirtual()) {
+        continue;
+      }
+
+      auto contents = section.getContents();
+      if (!contents) {
+        llvm::consumeError(contents.takeError());
+        continue;
+      }
+
+      SweepSection(section.getAddress(), *contents);
+    }
+  }
+
+  // Decode one instruction after the next, starting at the beginning of
+  // `code`. Bytes that fail to decode are skipped one at a time.
+  void SweepSection(uint64_t address, llvm::StringRef code) {
+    const auto context = arch->CreateInitialContext();
+    const auto min_align = std::max<uint64_t>(
+        1u, arch->MinInstructionAlign(context));
+    const auto max_size =
+        arch->MaxInstructionSize(context, false /* permit_fuse_idioms */);
+
+    remill::Instruction inst;
+    for (size_t offset = 0; offset < code.size();) {
+      const auto bytes = code.substr(offset, max_size);
+      inst.Reset();
+      if (arch->DecodeInstruction(address + offset, bytes, inst, context) &&
+          inst.IsValid() && !inst.bytes.empty()) {
+        ++num_decoded;
+        if (seen.insert(inst.bytes).second) {
+          encodings.Insert(inst.bytes);
+        }
+        offset += inst.bytes.size();
+      } else {
+        offset += min_align;
+      }
+    }
+
+    num_bytes += code.size();
+  }
+
+  EncodingSet &encodings;
+  llvm::LLVMContext context;
+  remill::Arch::ArchPtr arch;
+
+  // Encodings seen by this worker, checked before `encodings` so that common
+  // instructions don't need to take any locks.
+  std::unordered_set<std::string> seen;
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::SetUsageMessage(std::string(argv[0]) +
+                          " [options] <file or directory>...");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_out_dir.empty()) {
+    LOG(FATAL) << "Must provide an output directory with --out_dir";
+  }
+
+  if (!FLAGS_num_shards) {
+    LOG(FATAL) << "--num_shards must be at least one";
+  }
+
+  if (remill::GetOSName(FLAGS_os) == remill::kOSInvalid ||
+      remill::GetArchName(FLAGS_arch) == remill::kArchInvalid) {
+    LOG(FATAL) << "Invalid OS " << FLAGS_os << " or architecture "
+               << FLAGS_arch;
+  }
+
+  // Collect every regular file named on the command line, or found beneath a
+  // directory named on the command line.
+  std::vector<std::filesystem::path> files;
+  for (auto i = 1; i < argc; ++i) {
+    std::error_code ec;
+    if (std::filesystem::is_directory(argv[i], ec)) {
+      for (const auto &entry :
+           std::filesystem::recursive_directory_iterator(argv[i], ec)) {
+        if (entry.is_regular_file(ec)) {
+          files.push_back(entry.path());
+        }
+      }
+    } else if (std::filesystem::is_regular_file(argv[i], ec)) {
+      files.emplace_back(argv[i]);
+    } else {
+      LOG(WARNING) << "Skipping " << argv[i];
+    }
+  }
+
+  if (files.empty()) {
+    LOG(FATAL) << "No input files to sweep";
+  }
+
+  auto num_workers = static_cast<unsigned>(FLAGS_num_workers);
+  if (!num_workers) {
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_workers = std::min<unsigned>(num_workers, files.size());
+
+  LOG(INFO) << "Sweeping " << files.size() << " files with " << num_workers
+            << " workers";
+
+  EncodingSet encodings;
+  std::atomic<size_t> next_file{0};
+  std::vector<std::unique_ptr<SweepWorker>> workers;
+  std::vector<std::thread> threads;
+  for (auto i = 0u; i < num_workers; ++i) {
+    workers.emplace_back(new SweepWorker(encodings));
+  }
+  for (auto &worker : workers) {
+    threads.emplace_back(
+        [&worker, &files, &next_file] { worker->Run(files, next_file); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  uint64_t num_decoded = 0;
+  uint64_t num_bytes = 0;
+  for (const auto &worker : workers) {
+    num_decoded += worker->num_decoded;
+    num_bytes += worker->num_bytes;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(FLAGS_out_dir, ec);
+
+  size_t num_unique = 0;
+  auto shards = encodings.Shard(FLAGS_num_shards);
+  for (size_t i = 0; i < shards.size(); ++i) {
+    const auto path = std::filesystem::path(FLAGS_out_dir) /
+                      (FLAGS_out_name + "_" + std::to_string(i) + ".json");
+    llvm::raw_fd_ostream os(path.string(), ec);
+    if (ec) {
+      LOG(FATAL) << "Unable to open " << path << ": " << ec.message();
+    }
+
+    llvm::json::OStream json(os, 4);
+    json.array([&] {
+      for (const auto &bytes : shards[i]) {
+        json.value(llvm::toHex(bytes, true /* LowerCase */));
+      }
+    });
+    os << "\n";
+    num_unique += shards[i].size();
+  }
+
+  LOG(INFO) << "Decoded " << num_decoded << " instructions from " << num_bytes
+            << " bytes of code; wrote " << num_unique
+            << " unique encodings across " << shards.size() << " shards";
+  return EXIT_SUCCESS;
+}
@@ -41,8 +41,19 @@
 #include <remill/OS/OS.h>
 #include <test_runner/TestRunner.h>
 
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <functional>
+#include <optional>
 #include <random>
+#include <utility>
 
 #include "Whitelist.h"
 #include "gtest/gtest.h"
@@ -54,6 +65,22 @@ DEFINE_string(repro_file, "", "File to output failing test cases");
 DEFINE_string(whitelist, "", "File listing instruction states not to check");
 DEFINE_bool(should_dump_functions, false, "Dump each function version");
 DEFINE_bool(stop_on_fail, false, "Stop on first failure");
+DEFINE_uint64(batch_size, 0,
+              "Number of random states to run through each lifted "
+              "instruction per JIT compiled call. Zero means one state per "
+              "call.");
+DEFINE_uint64(num_workers, 0,
+              "Number of forked worker processes running test cases. Zero "
+              "means run every test case in this process.");
+DEFINE_uint64(test_timeout, 0,
+              "Seconds after which a worker running a single test case is "
+              "killed and the test case is counted as failed. Zero means no "
+              "timeout. Only used with --num_workers.");
+DEFINE_string(x87_stack_semantics, "",
+              "Path to x86 semantics built without REMILL_X87_ROTATING_STACK. "
+              "If given, each instruction is lifted with the x86 semantics "
+              "and with these, instead of with x86 and x86_sleigh, and the "
+              "x87 registers are compared in stack order.");
 
 
 struct InstructionFunction {
@@ -87,20 +114,38 @@ class DiffModule {
 class DifferentialModuleBuilder {
  private:
   std::unique_ptr<llvm::LLVMContext> context;
-  std::shared_ptr<llvm::Module> semantics_module;
+  std::shared_ptr<llvm::Module> semantics_module_1;
+  std::shared_ptr<llvm::Module> semantics_module_2;
 
   test_runner::LiftingTester l1;
   test_runner::LiftingTester l2;
   DifferentialModuleBuilder(std::unique_ptr<llvm::LLVMContext> context_,
-                            std::shared_ptr<llvm::Module> semantics_module_,
-
+                            std::shared_ptr<llvm::Module> semantics_module_1_,
+                            std::shared_ptr<llvm::Module> semantics_module_2_,
                             test_runner::LiftingTester l1_,
                             test_runner::LiftingTester l2_)
       : context(std::move(context_)),
-        semantics_module(std::move(semantics_module_)),
+        semantics_module_1(std::move(semantics_module_1_)),
+        semantics_module_2(std::move(semantics_module_2_)),
         l1(std::move(l1_)),
         l2(std::move(l2_)) {}
 
+  // Clone the module of `func`, and optimize the clone.
+  static std::unique_ptr<llvm::Module> CloneAndOptimize(llvm::Function *func) {
+    auto tst = func->getParent();
+
+    CHECK(remill::VerifyModule(tst));
+
+    auto cloned = llvm::CloneModule(*tst);
+
+    if (auto maybe_message = remill::VerifyModuleMsg(cloned.get())) {
+      LOG(FATAL) << *maybe_message;
+    }
+
+    remill::OptimizeBareModule(cloned);
+    return cloned;
+  }
+
  public:
   static DifferentialModuleBuilder
   Create(remill::OSName os_name_1, remill::ArchName arch_name_1,
@@ -116,12 +161,49 @@ class DifferentialModuleBuilder {
         test_runner::LiftingTester(semantics_module, os_name_1, arch_name_1);
     auto l2 =
         test_runner::LiftingTester(semantics_module, os_name_2, arch_name_2);
-    return DifferentialModuleBuilder(std::move(context),
-                                     std::move(semantics_module), std::move(l1),
+    return DifferentialModuleBuilder(std::move(context), semantics_module,
+                                     semantics_module, std::move(l1),
                                      std::move(l2));
   }
 
+  // Compare lifting with the default semantics of `arch_name` against lifting
+  // with the semantics in `semantics_file`.
+  static DifferentialModuleBuilder
+  CreateWithSemantics(remill::OSName os_name, remill::ArchName arch_name,
+                      const std::string &semantics_file) {
+    std::unique_ptr<llvm::LLVMContext> context =
+        std::make_unique<llvm::LLVMContext>();
+    auto tmp_arch_1 = remill::Arch::Build(context.get(), os_name, arch_name);
+    std::shared_ptr<llvm::Module> semantics_module_1 =
+        remill::LoadArchSemantics(tmp_arch_1.get());
+    tmp_arch_1->PrepareModule(semantics_module_1.get());
+
+    auto tmp_arch_2 = remill::Arch::Build(context.get(), os_name, arch_name);
+    std::shared_ptr<llvm::Module> semantics_module_2 =
+        remill::LoadModuleFromFile(context.get(), semantics_file);
+    tmp_arch_2->PrepareModule(semantics_module_2.get());
+
+    auto l1 =
+        test_runner::LiftingTester(semantics_module_1, os_name, arch_name);
+    auto l2 =
+        test_runner::LiftingTester(semantics_module_2, os_name, arch_name);
+    return DifferentialModuleBuilder(
+        std::move(context), std::move(semantics_module_1),
+        std::move(semantics_module_2), std::move(l1), std::move(l2));
+  }
+
  public:
+  const remill::Arch *GetArch() const {
+    return this->l1.GetArch().get();
+  }
+
+  // Do the semantics of the first and second lifter have a rotating x87
+  // stack?
+  std::pair<bool, bool> HasRotatingX87Stack(void) const {
+    return {remill::HasRotatingX87Stack(this->semantics_module_1.get()),
+            remill::HasRotatingX87Stack(this->semantics_module_2.get())};
+  }
+
   std::optional<DiffModule> build(std::string_view fname_f1,
                                   std::string_view fname_f2,
                                   std::string_view bytes, uint64_t address) {
@@ -144,20 +226,15 @@ class DifferentialModuleBuilder {
     }
 
 
-    auto tst = f1->getParent();
-
-    CHECK(remill::VerifyModule(tst));
-
-    auto cloned = llvm::CloneModule(*tst);
-
-    if (auto maybe_message = remill::VerifyModuleMsg(cloned.get())) {
-      LOG(FATAL) << *maybe_message;
-    }
-
-    remill::OptimizeBareModule(cloned);
-
+    auto cloned = CloneAndOptimize(f1);
     auto new_f1 =
         test_runner::CopyFunctionIntoNewModule(module.get(), f1, cloned);
+
+    // The functions are in different modules if they were lifted with
+    // different semantics.
+    if (f2->getParent() != f1->getParent()) {
+      cloned = CloneAndOptimize(f2);
+    }
     auto new_f2 =
         test_runner::CopyFunctionIntoNewModule(module.get(), f2, cloned);
 
@@ -175,6 +252,26 @@ std::string PrintState(X86State *state) {
   return "";
 }
 
+// Rotate the x87 registers of `state` from stack order, where `ST(i)` is
+// `st.elems[i]`, to the order of semantics with a rotating x87 stack, where
+// `ST(i)` is `st.elems[(TOP + i) % 8]`.
+static void ToRotatingX87Order(X86State &state) {
+  const auto st = state.st;
+  const auto top = state.x87.fxsave.swd.top;
+  for (auto i = 0u; i < 8u; ++i) {
+    state.st.elems[(top + i) % 8u] = st.elems[i];
+  }
+}
+
+// Undo `ToRotatingX87Order`.
+static void ToX87StackOrder(X86State &state) {
+  const auto st = state.st;
+  const auto top = state.x87.fxsave.swd.top;
+  for (auto i = 0u; i < 8u; ++i) {
+    state.st.elems[i] = st.elems[(top + i) % 8u];
+  }
+}
+
 struct DiffTestResult {
   std::string init_state_dump;
   std::string struct_dump1;
@@ -188,9 +285,18 @@ class ComparisonRunner {
   random_bytes_engine rbe;
   llvm::support::endianness endian;
 
+  // Whether the semantics of the first and second functions have a rotating
+  // x87 stack. States are in stack order outside of the lifted functions.
+  bool rotating_x87_1;
+  bool rotating_x87_2;
+
 
  public:
-  ComparisonRunner(llvm::support::endianness endian_) : endian(endian_) {}
+  ComparisonRunner(llvm::support::endianness endian_,
+                   std::pair<bool, bool> rotating_x87 = {false, false})
+      : endian(endian_),
+        rotating_x87_1(rotating_x87.first),
+        rotating_x87_2(rotating_x87.second) {}
 
  private:
   template <class T>
@@ -233,31 +339,63 @@ class ComparisonRunner {
     return ss.str();
   }
 
- public:
-  DiffTestResult
-  SingleCmpRun(size_t insn_length, llvm::Function *f1, llvm::Function *f2,
-               const std::vector<WhiteListInstruction> &whitelist,
-               std::string_view isel_name) {
+  // Put the x87 registers of the `num_states` states of the first and second
+  // functions into the order that their semantics expect.
+  void ToSemanticsX87Order(X86State *states1, X86State *states2,
+                           size_t num_states) {
+    for (size_t i = 0; i < num_states; ++i) {
+      if (this->rotating_x87_1) {
+        ToRotatingX87Order(states1[i]);
+      }
+      if (this->rotating_x87_2) {
+        ToRotatingX87Order(states2[i]);
+      }
+    }
+  }
+
+  // Undo `ToSemanticsX87Order`, so that `ST(i)` can be compared.
+  void FromSemanticsX87Order(X86State *states1, X86State *states2,
+                             size_t num_states) {
+    for (size_t i = 0; i < num_states; ++i) {
+      if (this->rotating_x87_1) {
+        ToX87StackOrder(states1[i]);
+      }
+      if (this->rotating_x87_2) {
+        ToX87StackOrder(states2[i]);
+      }
+    }
+  }
 
-    X86State func1_state{};
-    test_runner::RandomizeState(func1_state, this->rbe);
-    func1_state.addr.ds_base.dword = 0;
-    func1_state.addr.ss_base.dword = 0;
-    func1_state.addr.es_base.dword = 0;
-    func1_state.addr.cs_base.dword = 0;
-    func1_state.aflag.af = test_runner::random_boolean_flag(this->rbe);
-    func1_state.aflag.cf = test_runner::random_boolean_flag(this->rbe);
-    func1_state.aflag.df = test_runner::random_boolean_flag(this->rbe);
-    func1_state.aflag.of = test_runner::random_boolean_flag(this->rbe);
-    func1_state.aflag.pf = test_runner::random_boolean_flag(this->rbe);
-    func1_state.aflag.sf = test_runner::random_boolean_flag(this->rbe);
-    func1_state.aflag.zf = test_runner::random_boolean_flag(this->rbe);
+  // Produce a random initial state in which the segment bases are zero.
+  X86State RandomInitialState(std::string_view isel_name) {
+    X86State state{};
+    test_runner::RandomizeState(state, this->rbe);
+    state.addr.ds_base.dword = 0;
+    state.addr.ss_base.dword = 0;
+    state.addr.es_base.dword = 0;
+    state.addr.cs_base.dword = 0;
+    state.aflag.af = test_runner::random_boolean_flag(this->rbe);
+    state.aflag.cf = test_runner::random_boolean_flag(this->rbe);
+    state.aflag.df = test_runner::random_boolean_flag(this->rbe);
+    state.aflag.of = test_runner::random_boolean_flag(this->rbe);
+    state.aflag.pf = test_runner::random_boolean_flag(this->rbe);
+    state.aflag.sf = test_runner::random_boolean_flag(this->rbe);
+    state.aflag.zf = test_runner::random_boolean_flag(this->rbe);
 
     if (isel_name.rfind("REP_") != std::string::npos) {
       LOG(INFO) << "setting ecx to 1";
-      func1_state.gpr.rcx.dword = 1;
+      state.gpr.rcx.dword = 1;
     }
+    return state;
+  }
+
+ public:
+  DiffTestResult
+  SingleCmpRun(size_t insn_length, llvm::Function *f1, llvm::Function *f2,
+               const std::vector<WhiteListInstruction> &whitelist,
+               std::string_view isel_name) {
 
+    X86State func1_state = this->RandomInitialState(isel_name);
     X86State func2_state{};
 
     auto init_state = this->DumpState(&func1_state);
@@ -267,12 +405,14 @@ class ComparisonRunner {
     auto mem_handler =
         std::make_unique<test_runner::MemoryHandler>(this->endian);
     auto pc_fetch = [](X86State *st) { return st->gpr.rip.qword; };
+    this->ToSemanticsX87Order(&func1_state, &func2_state, 1u);
     test_runner::ExecuteLiftedFunction<X86State, uint64_t>(
         f1, insn_length, &func1_state, mem_handler.get(), pc_fetch);
     auto second_handler = std::make_unique<test_runner::MemoryHandler>(
         this->endian, mem_handler->GetUninitializedReads());
     test_runner::ExecuteLiftedFunction<X86State, uint64_t>(
         f2, insn_length, &func2_state, second_handler.get(), pc_fetch);
+    this->FromSemanticsX87Order(&func1_state, &func2_state, 1u);
 
 
     auto memory_state_eq =
@@ -298,6 +438,71 @@ class ComparisonRunner {
     return {init_state, this->DumpState(&func1_state),
             this->DumpState(&func2_state), are_equal};
   }
+
+  // Run `f1` and `f2` over `num_states` random states at once, and return
+  // the result of the first state on which they differ, if any.
+  std::optional<DiffTestResult>
+  BatchCmpRun(size_t num_states, llvm::Function *f1, llvm::Function *f2,
+              const remill::Register *pc_reg,
+              const std::vector<WhiteListInstruction> &whitelist,
+              std::string_view isel_name) {
+    std::vector<X86State> init_states;
+    for (size_t i = 0; i < num_states; ++i) {
+      init_states.push_back(this->RandomInitialState(isel_name));
+    }
+
+    std::vector<X86State> func1_states = init_states;
+    std::vector<X86State> func2_states = init_states;
+    this->ToSemanticsX87Order(func1_states.data(), func2_states.data(),
+                              num_states);
+
+    std::vector<std::unique_ptr<test_runner::MemoryHandler>> mem_handlers;
+    std::vector<test_runner::MemoryHandler *> handler_ptrs;
+    for (size_t i = 0; i < num_states; ++i) {
+      mem_handlers.push_back(
+          std::make_unique<test_runner::MemoryHandler>(this->endian));
+      handler_ptrs.push_back(mem_handlers.back().get());
+    }
+    test_runner::ExecuteLiftedFunctionBatch(f1, pc_reg, func1_states.data(),
+                                            handler_ptrs.data(), num_states);
+
+    // The second function must observe the same values for any memory that
+    // the first function read without writing.
+    std::vector<std::unique_ptr<test_runner::MemoryHandler>> second_handlers;
+    for (size_t i = 0; i < num_states; ++i) {
+      second_handlers.push_back(std::make_unique<test_runner::MemoryHandler>(
+          this->endian, mem_handlers[i]->GetUninitializedReads()));
+      handler_ptrs[i] = second_handlers.back().get();
+    }
+    test_runner::ExecuteLiftedFunctionBatch(f2, pc_reg, func2_states.data(),
+                                            handler_ptrs.data(), num_states);
+    this->FromSemanticsX87Order(func1_states.data(), func2_states.data(),
+                                num_states);
+
+    for (size_t i = 0; i < num_states; ++i) {
+      auto memory_state_eq =
+          mem_handlers[i]->GetMemory() == second_handlers[i]->GetMemory();
+      if (!memory_state_eq) {
+        LOG(ERROR) << "Memory state differs";
+        LOG(ERROR) << mem_handlers[i]->DumpState();
+        LOG(ERROR) << second_handlers[i]->DumpState();
+      }
+
+      for (const auto &it : whitelist) {
+        it.ApplyToInsn(isel_name, &func1_states[i]);
+        it.ApplyToInsn(isel_name, &func2_states[i]);
+      }
+
+      if (!memory_state_eq ||
+          std::memcmp(&func1_states[i], &func2_states[i], sizeof(X86State))) {
+        return DiffTestResult{this->DumpState(&init_states[i]),
+                              this->DumpState(&func1_states[i]),
+                              this->DumpState(&func2_states[i]), false};
+      }
+    }
+
+    return std::nullopt;
+  }
 };
 
 struct TestCase {
@@ -350,13 +555,41 @@ bool runTestCase(const TestCase &tc, DifferentialModuleBuilder &diffbuilder,
   auto end = diff_mod->GetModule()->getDataLayout().isBigEndian()
                  ? llvm::support::endianness::big
                  : llvm::support::endianness::little;
-  ComparisonRunner comp_runner(end);
+  ComparisonRunner comp_runner(end, diffbuilder.HasRotatingX87Stack());
 
   if (FLAGS_should_dump_functions) {
     LOG(INFO) << remill::LLVMThingToString(diff_mod->GetF<0>().llvm_function);
     LOG(INFO) << remill::LLVMThingToString(diff_mod->GetF<1>().llvm_function);
   }
 
+  auto report_difference = [&tc](const DiffTestResult &tc_result) {
+    LOG(ERROR) << "Difference in instruction" << std::hex << tc.addr << ": "
+               << llvm::toHex(tc.bytes);
+    LOG(INFO) << "Init state: " << tc_result.init_state_dump << std::endl;
+    LOG(INFO) << tc_result.struct_dump1 << std::endl;
+    LOG(INFO) << tc_result.struct_dump2 << std::endl;
+  };
+
+  // Run the iterations in batches, each of which is JIT compiled once.
+  if (FLAGS_batch_size) {
+    const auto arch = diffbuilder.GetArch();
+    const auto pc_reg =
+        arch->RegisterByName(arch->ProgramCounterRegisterName());
+    for (uint64_t i = 0; i < FLAGS_num_iterations; i += FLAGS_batch_size) {
+      const auto num_states =
+          std::min<uint64_t>(FLAGS_batch_size, FLAGS_num_iterations - i);
+      auto tc_result = comp_runner.BatchCmpRun(
+          num_states, diff_mod->GetF<0>().llvm_function,
+          diff_mod->GetF<1>().llvm_function, pc_reg, whitelist,
+          diff_mod->GetF<0>().isel_name);
+      if (tc_result) {
+        report_difference(*tc_result);
+        return false;
+      }
+    }
+    return true;
+  }
+
   for (uint64_t i = 0; i < FLAGS_num_iterations; i++) {
     auto tc_result = comp_runner.SingleCmpRun(
         tc.bytes.size(), diff_mod->GetF<0>().llvm_function,
@@ -364,18 +597,271 @@ bool runTestCase(const TestCase &tc, DifferentialModuleBuilder &diffbuilder,
         diff_mod->GetF<0>().isel_name);
 
     if (!tc_result.are_equal) {
-      LOG(ERROR) << "Difference in instruction" << std::hex << tc.addr << ": "
-                 << llvm::toHex(tc.bytes);
-      LOG(INFO) << "Init state: " << tc_result.init_state_dump << std::endl;
-      LOG(INFO) << tc_result.struct_dump1 << std::endl;
-      LOG(INFO) << tc_result.struct_dump2 << std::endl;
+      report_difference(tc_result);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static void WriteReproFile(const std::vector<TestCase> &failed_testcases) {
+  std::error_code ec;
+  llvm::raw_fd_ostream o(FLAGS_repro_file, ec);
+  if (ec) {
+    LOG(FATAL) << ec.message();
+  }
+
+  llvm::json::Array arr;
+  for (auto tc : failed_testcases) {
+    arr.push_back(llvm::toHex(tc.bytes));
+  }
+
+  llvm::json::operator<<(o, llvm::json::Value(std::move(arr)));
+}
+
+static bool ReadAll(int fd, void *data, size_t size) {
+  auto bytes = reinterpret_cast<char *>(data);
+  while (size) {
+    auto ret = read(fd, bytes, size);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret <= 0) {
       return false;
     }
+    bytes += ret;
+    size -= static_cast<size_t>(ret);
   }
+  return true;
+}
 
+static bool WriteAll(int fd, const void *data, size_t size) {
+  auto bytes = reinterpret_cast<const char *>(data);
+  while (size) {
+    auto ret = write(fd, bytes, size);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret <= 0) {
+      return false;
+    }
+    bytes += ret;
+    size -= static_cast<size_t>(ret);
+  }
   return true;
 }
 
+// A forked worker process. Workers are forked from the fully initialized
+// parent, so they start with warm semantics, and receive the indices of the
+// test cases to run over a pipe. A worker answers each index with one byte,
+// which is non-zero if the test case succeeded.
+struct TestWorker {
+  pid_t pid{-1};
+  int to_worker{-1};
+  int from_worker{-1};
+
+  // Index of the test case that the worker is running, if any.
+  std::optional<uint64_t> test_index;
+  std::chrono::steady_clock::time_point test_start;
+};
+
+// Fork a new worker into `worker`.
+static void SpawnTestWorker(TestWorker &worker,
+                            const std::vector<TestWorker> &workers,
+                            const std::vector<TestCase> &testcases,
+                            DifferentialModuleBuilder &diffbuilder,
+                            const std::vector<WhiteListInstruction> &whitelist) {
+  int to_worker[2] = {-1, -1};
+  int from_worker[2] = {-1, -1};
+  CHECK(!pipe(to_worker) && !pipe(from_worker))
+      << "Unable to create worker pipes: " << strerror(errno);
+
+  const auto pid = fork();
+  CHECK(pid >= 0) << "Unable to fork worker: " << strerror(errno);
+
+  if (!pid) {
+    for (const auto &other : workers) {
+      if (other.pid > 0) {
+        close(other.to_worker);
+        close(other.from_worker);
+      }
+    }
+    close(to_worker[1]);
+    close(from_worker[0]);
+
+    uint64_t index = 0;
+    while (ReadAll(to_worker[0], &index, sizeof(index))) {
+      const uint8_t succeeded =
+          runTestCase(testcases[index], diffbuilder, whitelist, index + 1);
+      if (!WriteAll(from_worker[1], &succeeded, sizeof(succeeded))) {
+        break;
+      }
+    }
+    _exit(0);
+  }
+
+  close(to_worker[0]);
+  close(from_worker[1]);
+  worker.pid = pid;
+  worker.to_worker = to_worker[1];
+  worker.from_worker = from_worker[0];
+  worker.test_index.reset();
+}
+
+// Kill `worker` if it is still running, and reap it.
+static void StopTestWorker(TestWorker &worker, bool kill_worker) {
+  if (worker.pid <= 0) {
+    return;
+  }
+  close(worker.to_worker);
+  close(worker.from_worker);
+  if (kill_worker) {
+    kill(worker.pid, SIGKILL);
+  }
+  while (waitpid(worker.pid, nullptr, 0) < 0 && errno == EINTR) {
+  }
+  worker.pid = -1;
+  worker.to_worker = -1;
+  worker.from_worker = -1;
+  worker.test_index.reset();
+}
+
+// Run `testcases` across `--num_workers` forked workers. A worker that
+// crashes, or that exceeds `--test_timeout` on a test case, is replaced with
+// a fresh one, and the test case that it was running is counted as failed.
+static void RunForkedTestCases(
+    const std::vector<TestCase> &testcases,
+    DifferentialModuleBuilder &diffbuilder,
+    const std::vector<WhiteListInstruction> &whitelist,
+    const std::function<void(const TestCase &)> &on_failure) {
+
+  // Writing to a crashed worker must not kill us.
+  signal(SIGPIPE, SIG_IGN);
+
+  const auto num_workers =
+      std::min<uint64_t>(FLAGS_num_workers, testcases.size());
+  const auto timeout = std::chrono::seconds(FLAGS_test_timeout);
+
+  std::vector<TestWorker> workers(num_workers);
+  std::vector<uint64_t> failed_indices;
+  uint64_t next_index = 0;
+  uint64_t num_done = 0;
+  bool stopping = false;
+
+  auto fail = [&](uint64_t index) {
+    failed_indices.push_back(index);
+    if (FLAGS_stop_on_fail) {
+      stopping = true;
+    }
+  };
+
+  // Give `worker` its next test case, or shut it down if there are none left.
+  auto dispatch = [&](TestWorker &worker) {
+    while (!stopping && next_index < testcases.size()) {
+      if (worker.pid <= 0) {
+        SpawnTestWorker(worker, workers, testcases, diffbuilder, whitelist);
+      }
+
+      const auto index = next_index++;
+      if (WriteAll(worker.to_worker, &index, sizeof(index))) {
+        worker.test_index = index;
+        worker.test_start = std::chrono::steady_clock::now();
+        return;
+      }
+
+      // The worker died between test cases; retry with a fresh one.
+      --next_index;
+      StopTestWorker(worker, true);
+    }
+    StopTestWorker(worker, false);
+  };
+
+  for (auto &worker : workers) {
+    dispatch(worker);
+  }
+
+  for (;;) {
+    std::vector<pollfd> fds;
+    std::vector<TestWorker *> busy;
+    int poll_timeout = -1;
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &worker : workers) {
+      if (worker.pid <= 0 || !worker.test_index) {
+        continue;
+      }
+      fds.push_back({worker.from_worker, POLLIN, 0});
+      busy.push_back(&worker);
+      if (FLAGS_test_timeout) {
+        const auto remaining = std::max<int64_t>(
+            0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                   worker.test_start + timeout - now)
+                   .count());
+        if (poll_timeout < 0 || remaining < poll_timeout) {
+          poll_timeout = static_cast<int>(remaining);
+        }
+      }
+    }
+
+    if (fds.empty()) {
+      break;
+    }
+
+    if (poll(fds.data(), fds.size(), poll_timeout) < 0) {
+      CHECK_EQ(errno, EINTR) << "Unable to poll workers: " << strerror(errno);
+      continue;
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+      auto &worker = *busy[i];
+      const auto index = *worker.test_index;
+
+      if (fds[i].revents) {
+        uint8_t succeeded = 0;
+        if (ReadAll(worker.from_worker, &succeeded, sizeof(succeeded))) {
+          worker.test_index.reset();
+          if (!succeeded) {
+            fail(index);
+          }
+        } else {
+          LOG(ERROR) << "Worker crashed on test case "
+                     << llvm::toHex(testcases[index].bytes);
+          StopTestWorker(worker, true);
+          fail(index);
+        }
+
+      } else if (FLAGS_test_timeout &&
+                 std::chrono::steady_clock::now() - worker.test_start >=
+                     timeout) {
+        LOG(ERROR) << "Worker timed out on test case "
+                   << llvm::toHex(testcases[index].bytes);
+        StopTestWorker(worker, true);
+        fail(index);
+
+      } else {
+        continue;
+      }
+
+      ++num_done;
+      if (stopping) {
+        for (auto &other : workers) {
+          StopTestWorker(other, true);
+        }
+        break;
+      }
+      dispatch(worker);
+    }
+  }
+
+  // Report failures in the order of the corpus, regardless of which worker
+  // found them first.
+  std::sort(failed_indices.begin(), failed_indices.end());
+  for (auto index : failed_indices) {
+    on_failure(testcases[index]);
+  }
+
+  LOG(INFO) << "Ran " << num_done << " test cases across " << num_workers
+            << " workers, " << failed_indices.size() << " failed";
+}
 
 int main(int argc, char **argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
@@ -431,40 +917,36 @@ int main(int argc, char **argv) {
     LOG(ERROR) << "Not using a whitelist";
   }
 
-  DifferentialModuleBuilder diffbuilder = DifferentialModuleBuilder::Create(
-      remill::OSName::kOSLinux, remill::ArchName::kArchX86,
-      remill::OSName::kOSLinux, remill::ArchName::kArchX86_SLEIGH);
-  uint64_t ctr = 0;
-
+  DifferentialModuleBuilder diffbuilder =
+      FLAGS_x87_stack_semantics.empty()
+          ? DifferentialModuleBuilder::Create(
+                remill::OSName::kOSLinux, remill::ArchName::kArchX86,
+                remill::OSName::kOSLinux, remill::ArchName::kArchX86_SLEIGH)
+          : DifferentialModuleBuilder::CreateWithSemantics(
+                remill::OSName::kOSLinux, remill::ArchName::kArchX86,
+                FLAGS_x87_stack_semantics);
   std::vector<TestCase> failed_testcases;
-  auto succeeded_tot = true;
-  for (auto tc : testcases) {
-    auto tc_succeeded = runTestCase(tc, diffbuilder, whitelist, ++ctr);
-    if (!tc_succeeded) {
-      succeeded_tot = false;
-      failed_testcases.push_back(tc);
+  auto on_failure = [&](const TestCase &tc) {
+    failed_testcases.push_back(tc);
+    if (!FLAGS_repro_file.empty()) {
+      WriteReproFile(failed_testcases);
     }
+  };
 
-    if (!FLAGS_repro_file.empty() && !tc_succeeded) {
-      std::error_code ec;
-      llvm::raw_fd_ostream o(FLAGS_repro_file, ec);
-      if (ec) {
-        LOG(FATAL) << ec.message();
-      }
+  if (FLAGS_num_workers) {
+    RunForkedTestCases(testcases, diffbuilder, whitelist, on_failure);
+    return failed_testcases.empty() ? 0 : 2;
+  }
 
-      llvm::json::Array arr;
-      for (auto tc : failed_testcases) {
-        arr.push_back(llvm::toHex(tc.bytes));
+  uint64_t ctr = 0;
+  for (auto tc : testcases) {
+    if (!runTestCase(tc, diffbuilder, whitelist, ++ctr)) {
+      on_failure(tc);
+      if (FLAGS_stop_on_fail) {
+        return 2;
       }
-
-      llvm::json::operator<<(o, llvm::json::Value(std::move(arr)));
-    }
-
-    if (!succeeded_tot && FLAGS_stop_on_fail) {
-      return 2;
     }
   }
 
-
-  return succeeded_tot ? 0 : 2;
+  return failed_testcases.empty() ? 0 : 2;
 }
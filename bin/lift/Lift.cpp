@@ -16,6 +16,9 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
@@ -27,21 +30,35 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <remill/Arch/Arch.h>
 #include <remill/Arch/Instruction.h>
 #include <remill/Arch/Name.h>
+#include <remill/Arch/Statistics.h>
 #include <remill/BC/ABI.h>
+#include <remill/BC/ElfImage.h>
 #include <remill/BC/IntrinsicTable.h>
 #include <remill/BC/Lifter.h>
 #include <remill/BC/Optimizer.h>
+#include <remill/BC/Profile.h>
+#include <remill/BC/TraceCache.h>
+#include <remill/BC/TraceChunkWriter.h>
+#include <remill/BC/TraceLifter.h>
 #include <remill/BC/Util.h>
 #include <remill/BC/Version.h>
 #include <remill/OS/OS.h>
 #include <remill/Version/Version.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -50,6 +67,18 @@
 #include <sstream>
 #include <string>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
 
 DEFINE_string(os, REMILL_OS,
               "Operating system name of the code being "
@@ -70,6 +99,11 @@ DEFINE_uint64(entry_address, 0,
 
 DEFINE_string(bytes, "", "Hex-encoded byte string to lift.");
 
+DEFINE_string(binary, "",
+              "Path to an ELF file to lift instead of --bytes. Every function "
+              "found in its symbol tables, along with its entry point, is "
+              "lifted.");
+
 DEFINE_string(ir_out, "", "Path to file where the LLVM IR should be saved.");
 DEFINE_string(bc_out, "",
               "Path to file where the LLVM bitcode should be "
@@ -80,58 +114,151 @@ DEFINE_string(slice_inputs, "",
 DEFINE_string(slice_outputs, "",
               "Comma-separated list of registers to treat as outputs.");
 
-using Memory = std::map<uint64_t, uint8_t>;
+DEFINE_string(trace_cache_dir, "",
+              "Directory of a persistent cache of lifted traces. Traces "
+              "found in the cache are not re-lifted.");
+DEFINE_uint64(trace_cache_max_size, 0,
+              "Maximum size, in bytes, of the lifted trace cache. Zero means "
+              "unbounded.");
+
+DEFINE_string(bc_chunk_dir, "",
+              "Directory into which lifted traces are streamed as a sequence "
+              "of optimized bitcode chunks, instead of accumulating them in "
+              "memory and writing them out through --bc_out/--ir_out.");
+DEFINE_uint64(traces_per_chunk, 256,
+              "Number of lifted traces to put into each bitcode chunk when "
+              "--bc_chunk_dir is used.");
+
+DEFINE_bool(eliminate_dead_stores, false,
+            "Remove stores into the State structure that are overwritten "
+            "before being read, both within and across lifted traces.");
+
+DEFINE_bool(scalarize_state, false,
+            "Keep registers in SSA values within each lifted trace, rather "
+            "than loading and storing them through the State structure.");
+
+DEFINE_bool(coalesce_memory_accesses, false,
+            "Merge adjacent narrow memory reads and writes in each lifted "
+            "trace into wider ones.");
+
+DEFINE_bool(recover_stack_frames, false,
+            "Keep the stack frame of each lifted trace in a local variable "
+            "instead of memory, if the frame doesn't escape the trace. This "
+            "needs --scalarize_state.");
+
+DEFINE_bool(recover_jump_tables, false,
+            "Recognize jump tables at indirect jumps on x86-64 and AArch64, "
+            "and lift them into switches.");
+
+DEFINE_string(instrument_counters, "none",
+              "Count executions of each lifted 'trace' or 'block' in the "
+              "__remill_trace_counters array, or 'none'.");
+DEFINE_bool(instrument_pcs, false,
+            "Call __remill_trace_pc with the program counter of each lifted "
+            "instruction before executing it.");
+DEFINE_string(profile_in, "",
+              "Path to a profile of trace execution counts, as written by "
+              "remill::WriteProfile. Only the hot traces are optimized.");
+DEFINE_double(hot_fraction, 0.99,
+              "Fraction of the executions in --profile_in that the optimized "
+              "hot traces must account for.");
+
+DEFINE_string(stats_out, "",
+              "Path to a file where statistics about decoding and lifting, "
+              "e.g. how often each ISEL is unsupported, are written.");
+DEFINE_string(stats_format, "json",
+              "Format of --stats_out, either 'json' or 'prometheus'.");
+
+DEFINE_string(output_context, "shared",
+              "LLVM context of the module that is saved by --ir_out and "
+              "--bc_out. 'shared' uses the lifting context. 'move' and "
+              "'bitcode' use a separate context, into which the lifted "
+              "functions are moved one at a time, or into which the lifted "
+              "module is round-tripped through bitcode, respectively. The "
+              "time taken by the transfer is logged.");
+
+DEFINE_bool(daemon, false,
+            "Run as a long-lived lifting server. Lift requests are read as "
+            "JSON lines from --daemon_socket, or from stdin, and responses "
+            "are written back as JSON lines.");
+DEFINE_string(daemon_socket, "",
+              "Path of a Unix domain socket on which --daemon mode accepts "
+              "connections. If empty, requests are read from stdin.");
+DEFINE_uint64(daemon_requests_per_context, 256,
+              "Number of requests that each --daemon worker handles before it "
+              "replaces its LLVM context, and everything in it, with a fresh "
+              "one. Zero means never.");
+DEFINE_uint64(daemon_workers, 0,
+              "Number of worker threads servicing requests in --daemon mode. "
+              "Zero means one per hardware thread.");
 
-// Unhexlify the data passed to `--bytes`, and fill in `memory` with each
-// such byte.
-static Memory UnhexlifyInputBytes(uint64_t addr_mask) {
-  Memory memory;
+using Memory = std::map<uint64_t, uint8_t>;
 
-  for (size_t i = 0; i < FLAGS_bytes.size(); i += 2) {
-    char nibbles[] = {FLAGS_bytes[i], FLAGS_bytes[i + 1], '\0'};
+// Unhexlify the data in `bytes`, and fill in `memory` with each such byte,
+// starting at `address`.
+static bool UnhexlifyInputBytes(const std::string &bytes, uint64_t address,
+                                uint64_t addr_mask, Memory &memory,
+                                std::ostream &err) {
+  for (size_t i = 0; i < bytes.size(); i += 2) {
+    char nibbles[] = {bytes[i], bytes[i + 1], '\0'};
     char *parsed_to = nullptr;
     auto byte_val = strtol(nibbles, &parsed_to, 16);
 
     if (parsed_to != &(nibbles[2])) {
-      std::cerr << "Invalid hex byte value '" << nibbles
-                << "' specified in --bytes." << std::endl;
-      exit(EXIT_FAILURE);
+      err << "Invalid hex byte value '" << nibbles
+          << "' specified in --bytes.";
+      return false;
     }
 
-    auto byte_addr = FLAGS_address + (i / 2);
+    auto byte_addr = address + (i / 2);
     auto masked_addr = byte_addr & addr_mask;
 
     // Make sure that if a really big number is specified for `--address`,
     // that we don't accidentally wrap around and start filling out low
     // byte addresses.
     if (masked_addr < byte_addr) {
-      std::cerr << "Too many bytes specified to --bytes, would result "
-                << "in a 32-bit overflow.";
-      exit(EXIT_FAILURE);
+      err << "Too many bytes specified to --bytes, would result "
+          << "in a 32-bit overflow.";
+      return false;
 
-    } else if (masked_addr < FLAGS_address) {
-      std::cerr << "Too many bytes specified to --bytes, would result "
-                << "in a 64-bit overflow.";
-      exit(EXIT_FAILURE);
+    } else if (masked_addr < address) {
+      err << "Too many bytes specified to --bytes, would result "
+          << "in a 64-bit overflow.";
+      return false;
     }
 
     memory[byte_addr] = static_cast<uint8_t>(byte_val);
   }
 
-  return memory;
+  return true;
 }
 
 class SimpleTraceManager : public remill::TraceManager {
  public:
   virtual ~SimpleTraceManager(void) = default;
 
-  explicit SimpleTraceManager(Memory &memory_) : memory(memory_) {}
+  // Reads one byte, returning `false` if there is none.
+  using ByteReader = std::function<bool(uint64_t, uint8_t *)>;
+
+  // `read_byte_` reads executable bytes of code. If `read_data_byte_` is
+  // empty, then only those bytes are readable as data.
+  explicit SimpleTraceManager(ByteReader read_byte_,
+                              ByteReader read_data_byte_ = nullptr)
+      : read_byte(std::move(read_byte_)),
+        read_data_byte(std::move(read_data_byte_)) {}
 
  protected:
   // Called when we have lifted, i.e. defined the contents, of a new trace.
   // The derived class is expected to do something useful with this.
   void SetLiftedTraceDefinition(uint64_t addr,
                                 llvm::Function *lifted_func) override {
+
+    // When streaming chunks, `lifted_func` has already been moved out of the
+    // lifting module, and will be freed along with its chunk. Remember the
+    // declaration that was left behind instead.
+    if (lifting_module && lifted_func->getParent() != lifting_module) {
+      lifted_func = lifting_module->getFunction(lifted_func->getName());
+    }
     traces[addr] = lifted_func;
   }
 
@@ -162,18 +289,25 @@ class SimpleTraceManager : public remill::TraceManager {
   // at address `addr` is executable and readable, and updates the byte
   // pointed to by `byte` with the read value.
   bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
-    auto byte_it = memory.find(addr);
-    if (byte_it != memory.end()) {
-      *byte = byte_it->second;
-      return true;
-    } else {
-      return false;
+    return read_byte(addr, byte);
+  }
+
+  // Try to read a byte of read-only data, e.g. an entry of a jump table.
+  bool TryReadDataByte(uint64_t addr, uint8_t *byte) override {
+    if (read_data_byte) {
+      return read_data_byte(addr, byte);
     }
+    return read_byte(addr, byte);
   }
 
  public:
-  Memory &memory;
+  ByteReader read_byte;
+  ByteReader read_data_byte;
   std::unordered_map<uint64_t, llvm::Function *> traces;
+
+  // Module into which traces are lifted. Only set when lifted traces are
+  // moved out of it as they are lifted.
+  llvm::Module *lifting_module{nullptr};
 };
 
 // Looks for calls to a function like `__remill_function_return`, and
@@ -219,86 +353,297 @@ static void SetVersion(void) {
   google::SetVersionString(ss.str());
 }
 
-int main(int argc, char *argv[]) {
-  SetVersion();
-  google::ParseCommandLineFlags(&argc, &argv, true);
-  google::InitGoogleLogging(argv[0]);
+// Describes one set of bytes to lift.
+struct LiftRequest {
+  std::string bytes;
+  uint64_t address{0};
+  uint64_t entry_address{0};
+  std::string slice_inputs;
+  std::string slice_outputs;
+};
+
+// Create a function named `slice` in `dest_module` whose arguments are the
+// registers named in `slice_inputs`, and which returns the registers named in
+// `slice_outputs` through pointer arguments, by calling `entry_trace`.
+static bool CreateSlice(const remill::Arch *arch, llvm::Module &dest_module,
+                        llvm::Function *entry_trace,
+                        const LiftRequest &request, std::ostream &err) {
+  auto &context = dest_module.getContext();
+  const auto mem_ptr_type = arch->MemoryPointerType();
 
+  llvm::SmallVector<llvm::StringRef, 4> input_reg_names;
+  llvm::SmallVector<llvm::StringRef, 4> output_reg_names;
+  llvm::StringRef(request.slice_inputs)
+      .split(input_reg_names, ',', -1, false /* KeepEmpty */);
+  llvm::StringRef(request.slice_outputs)
+      .split(output_reg_names, ',', -1, false /* KeepEmpty */);
 
-  if (FLAGS_bytes.empty()) {
-    std::cerr << "Please specify a sequence of hex bytes to --bytes."
-              << std::endl;
-    return EXIT_FAILURE;
+  if (input_reg_names.empty() && output_reg_names.empty()) {
+    err << "Empty lists passed to both --slice_inputs and --slice_outputs";
+    return false;
   }
 
-  if (FLAGS_bytes.size() % 2) {
-    std::cerr << "Please specify an even number of nibbles to --bytes."
-              << std::endl;
-    return EXIT_FAILURE;
+  // Use the registers to build a function prototype.
+  llvm::SmallVector<llvm::Type *, 8> arg_types;
+  arg_types.push_back(mem_ptr_type);
+
+  for (auto &reg_name : input_reg_names) {
+    const auto reg = arch->RegisterByName(reg_name.str());
+    if (!reg) {
+      err << "Invalid register name '" << reg_name.str()
+          << "' used in input slice list '" << request.slice_inputs << "'";
+      return false;
+    }
+
+    arg_types.push_back(reg->type);
   }
 
-  if (!FLAGS_entry_address) {
-    FLAGS_entry_address = FLAGS_address;
+  const auto first_output_reg_index = arg_types.size();
+
+  // Outputs are "returned" by pointer through arguments.
+  for (auto &reg_name : output_reg_names) {
+    const auto reg = arch->RegisterByName(reg_name.str());
+    if (!reg) {
+      err << "Invalid register name '" << reg_name.str()
+          << "' used in output slice list '" << request.slice_outputs << "'";
+      return false;
+    }
+
+    arg_types.push_back(llvm::PointerType::get(context, 0));
   }
 
-  // Make sure `--address` and `--entry_address` are in-bounds for the target
-  // architecture's address size.
-  llvm::LLVMContext context;
-  auto arch = remill::Arch::Get(context, FLAGS_os, FLAGS_arch);
-  const uint64_t addr_mask = ~0ULL >> (64UL - arch->address_size);
-  if (FLAGS_address != (FLAGS_address & addr_mask)) {
-    std::cerr << "Value " << std::hex << FLAGS_address
-              << " passed to --address does not fit into 32-bits. Did mean"
-              << " to specify a 64-bit architecture to --arch?" << std::endl;
-    return EXIT_FAILURE;
+  const auto state_type = arch->StateStructType();
+  const auto func_type =
+      llvm::FunctionType::get(mem_ptr_type, arg_types, false);
+  const auto func = llvm::Function::Create(
+      func_type, llvm::GlobalValue::ExternalLinkage, "slice", &dest_module);
+
+  // Store all of the function arguments (corresponding with specific registers)
+  // into the stack-allocated `State` structure.
+  auto entry = llvm::BasicBlock::Create(context, "", func);
+  llvm::IRBuilder<> ir(entry);
+
+  const auto state_ptr = ir.CreateAlloca(state_type);
+
+  const remill::Register *pc_reg =
+      arch->RegisterByName(arch->ProgramCounterRegisterName());
+
+  CHECK(pc_reg != nullptr)
+      << "Could not find the register in the state structure "
+      << "associated with the program counter.";
+
+  // Store the program counter into the state.
+  const auto pc_reg_ptr = pc_reg->AddressOf(state_ptr, entry);
+  const auto trace_pc =
+      llvm::ConstantInt::get(pc_reg->type, request.entry_address, false);
+  ir.SetInsertPoint(entry);
+  ir.CreateStore(trace_pc, pc_reg_ptr);
+
+  auto args_it = func->arg_begin();
+  for (auto &reg_name : input_reg_names) {
+    const auto reg = arch->RegisterByName(reg_name.str());
+    auto &arg = *++args_it;  // Pre-increment, as first arg is memory pointer.
+    arg.setName(reg_name);
+    CHECK_EQ(arg.getType(), reg->type);
+    auto reg_ptr = reg->AddressOf(state_ptr, entry);
+    ir.SetInsertPoint(entry);
+    ir.CreateStore(&arg, reg_ptr);
   }
 
-  if (FLAGS_entry_address != (FLAGS_entry_address & addr_mask)) {
-    std::cerr
-        << "Value " << std::hex << FLAGS_entry_address
-        << " passed to --entry_address does not fit into 32-bits. Did mean"
-        << " to specify a 64-bit architecture to --arch?" << std::endl;
-    return EXIT_FAILURE;
+  llvm::Value *mem_ptr = &*func->arg_begin();
+
+  llvm::Value *trace_args[remill::kNumBlockArgs] = {};
+  trace_args[remill::kStatePointerArgNum] = state_ptr;
+  trace_args[remill::kMemoryPointerArgNum] = mem_ptr;
+  trace_args[remill::kPCArgNum] = llvm::ConstantInt::get(
+      llvm::IntegerType::get(context, arch->address_size),
+      request.entry_address, false);
+
+  mem_ptr = ir.CreateCall(entry_trace, trace_args);
+
+  // Go read all output registers out of the state and store them
+  // into the output parameters.
+  args_it = func->arg_begin();
+  for (size_t i = 0, j = 0; i < func->arg_size(); ++i, ++args_it) {
+    if (i < first_output_reg_index) {
+      continue;
+    }
+
+    const auto &reg_name = output_reg_names[j++];
+    const auto reg = arch->RegisterByName(reg_name.str());
+    auto &arg = *args_it;
+    arg.setName(reg_name + "_output");
+
+    auto reg_ptr = reg->AddressOf(state_ptr, entry);
+    ir.SetInsertPoint(entry);
+    ir.CreateStore(ir.CreateLoad(reg->type, reg_ptr), &arg);
   }
 
-  std::unique_ptr<llvm::Module> module(remill::LoadArchSemantics(arch.get()));
+  // Return the memory pointer, so that all memory accesses are
+  // preserved.
+  ir.CreateRet(mem_ptr);
 
-  const auto mem_ptr_type = arch->MemoryPointerType();
+  // We want the stack-allocated `State` to be subject to scalarization
+  // and mem2reg, but to "encourage" that, we need to prevent the
+  // `alloca`d `State` from escaping.
+  MuteStateEscape(&dest_module, "__remill_error");
+  MuteStateEscape(&dest_module, "__remill_function_call");
+  MuteStateEscape(&dest_module, "__remill_function_return");
+  MuteStateEscape(&dest_module, "__remill_jump");
+  MuteStateEscape(&dest_module, "__remill_missing_block");
 
-  Memory memory = UnhexlifyInputBytes(addr_mask);
-  SimpleTraceManager manager(memory);
-  remill::IntrinsicTable intrinsics(module.get());
+  remill::OptimizationGuide guide = {};
+  guide.slp_vectorize = true;
+  guide.loop_vectorize = true;
 
+  if (auto verify_err = remill::VerifyModuleMsg(&dest_module)) {
+    err << "Unable to verify the slice: " << *verify_err;
+    return false;
+  }
+  remill::OptimizeBareModule(&dest_module, guide);
+  return true;
+}
 
-  auto inst_lifter = arch->DefaultLifter(intrinsics);
+// Transfer the lifted code in `module` into a new module belonging to
+// `context`, either by moving one function at a time across contexts, or by
+// round-tripping the whole module through bitcode.
+static std::unique_ptr<llvm::Module>
+TransferToContext(const remill::Arch *arch, llvm::Module &module,
+                  llvm::LLVMContext &context, bool via_bitcode) {
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<llvm::Module> dest_module;
+  size_t num_funcs = 0;
+
+  if (via_bitcode) {
+    llvm::SmallVector<char, 0> buff;
+    llvm::raw_svector_ostream os(buff);
+    llvm::WriteBitcodeToFile(module, os);
+    auto maybe_module = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(buff.data(), buff.size()),
+                              module.getName()),
+        context);
+    if (!maybe_module) {
+      LOG(ERROR) << "Unable to parse round-tripped bitcode: "
+                 << llvm::toString(maybe_module.takeError());
+      return nullptr;
+    }
+    dest_module = std::move(*maybe_module);
+    for (auto &func : *dest_module) {
+      num_funcs += !func.isDeclaration();
+    }
+
+  } else {
+    dest_module = std::make_unique<llvm::Module>(module.getName(), context);
+    arch->PrepareModuleDataLayout(dest_module.get());
 
-  remill::TraceLifter trace_lifter(arch.get(), manager);
+    std::vector<llvm::Function *> funcs;
+    for (auto &func : module) {
+      if (!func.isDeclaration()) {
+        funcs.push_back(&func);
+      }
+    }
+    for (auto func : funcs) {
+      remill::MoveFunctionIntoModule(func, dest_module.get());
+    }
+    num_funcs = funcs.size();
+  }
 
-  // Lift all discoverable traces starting from `--entry_address` into
-  // `module`.
-  trace_lifter.Lift(FLAGS_entry_address);
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  LOG(INFO) << "Transferred " << num_funcs << " functions to a separate "
+            << "context " << (via_bitcode ? "through bitcode" : "by moving")
+            << " in " << elapsed.count() << "ms";
+  return dest_module;
+}
+
+// Lift all discoverable traces starting from each of `entry_addresses` into
+// `module`, reading code through `manager`, and then move the lifted code into
+// `dest_module`. If `chunk_writer` is non-null, then lifted traces are instead
+// streamed into it, and `dest_module` is left untouched. If `request` asks for
+// a slice, then the slice calls the trace at `request.entry_address`.
+static bool LiftTraces(const remill::Arch *arch, llvm::Module *module,
+                       SimpleTraceManager &manager,
+                       const std::vector<uint64_t> &entry_addresses,
+                       const LiftRequest &request,
+                       remill::TraceCache *trace_cache,
+                       remill::TraceChunkWriter *chunk_writer,
+                       llvm::Module &dest_module, std::ostream &err) {
+  remill::TraceInstrumentation instrumentation;
+  instrumentation.trace_pcs = FLAGS_instrument_pcs;
+  if (FLAGS_instrument_counters == "trace") {
+    instrumentation.counters = remill::TraceInstrumentation::kTraceCounters;
+  } else if (FLAGS_instrument_counters == "block") {
+    instrumentation.counters = remill::TraceInstrumentation::kBlockCounters;
+  } else if (FLAGS_instrument_counters != "none") {
+    err << "Invalid value '" << FLAGS_instrument_counters
+        << "' passed to --instrument_counters.";
+    return false;
+  }
+
+  remill::TraceLifter trace_lifter(arch, manager, trace_cache,
+                                   instrumentation);
+  trace_lifter.SetRecoverJumpTables(FLAGS_recover_jump_tables);
+
+  if (chunk_writer) {
+    manager.lifting_module = module;
+    for (auto entry_address : entry_addresses) {
+      trace_lifter.Lift(entry_address,
+                        [=](uint64_t trace_addr, llvm::Function *trace) {
+                          chunk_writer->AddTrace(trace_addr, trace);
+                        });
+    }
+    return true;
+  }
+
+  for (auto entry_address : entry_addresses) {
+    trace_lifter.Lift(entry_address);
+  }
 
   // Optimize the module, but with a particular focus on only the functions
   // that we actually lifted.
   remill::OptimizationGuide guide = {};
-  remill::OptimizeModule(arch, module, manager.traces, guide);
-
-  // Create a new module in which we will move all the lifted functions. Prepare
-  // the module for code of this architecture, i.e. set the data layout, triple,
-  // etc.
-  llvm::Module dest_module("lifted_code", context);
-  arch->PrepareModuleDataLayout(&dest_module);
+  guide.eliminate_dead_stores = FLAGS_eliminate_dead_stores;
+  guide.scalarize_state = FLAGS_scalarize_state;
+  guide.coalesce_memory_accesses = FLAGS_coalesce_memory_accesses;
+  guide.recover_stack_frames = FLAGS_recover_stack_frames;
+  if (FLAGS_profile_in.empty()) {
+    remill::OptimizeModule(arch, module, manager.traces, guide);
+  } else {
+    auto profile = remill::ReadProfile(FLAGS_profile_in);
+    if (!profile) {
+      err << "Unable to read the profile passed to --profile_in.";
+      return false;
+    }
+    const auto hot_traces =
+        remill::SelectHotTraces(manager.traces, *profile, FLAGS_hot_fraction);
+    LOG(INFO) << "Optimizing " << hot_traces.size() << " of "
+              << manager.traces.size() << " traces";
+    remill::OptimizeModule(arch, module, hot_traces, guide);
+
+    // The cold traces still call the semantics, which have internal linkage
+    // and so can't be declared in `dest_module`. Inline them, but otherwise
+    // leave the cold traces unoptimized.
+    const std::unordered_set<llvm::Function *> hot_set(hot_traces.begin(),
+                                                       hot_traces.end());
+    for (const auto &[trace_addr, trace] : manager.traces) {
+      if (!hot_set.count(trace) && !remill::InlineInternalCalls(trace)) {
+        err << "Unable to inline the semantics of trace "
+            << trace->getName().str();
+        return false;
+      }
+    }
+  }
 
   llvm::Function *entry_trace = nullptr;
   const auto make_slice =
-      !FLAGS_slice_inputs.empty() || !FLAGS_slice_outputs.empty();
+      !request.slice_inputs.empty() || !request.slice_outputs.empty();
 
   // Move the lifted code into a new module. This module will be much smaller
   // because it won't be bogged down with all of the semantics definitions.
   // This is a good JITing strategy: optimize the lifted code in the semantics
   // module, move it to a new module, instrument it there, then JIT compile it.
   for (auto &lifted_entry : manager.traces) {
-    if (lifted_entry.first == FLAGS_entry_address) {
+    if (lifted_entry.first == request.entry_address) {
       entry_trace = lifted_entry.second;
     }
     remill::MoveFunctionIntoModule(lifted_entry.second, &dest_module);
@@ -313,142 +658,682 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  // Define the counters that the lifted code increments, so that a runtime
+  // can dump them with `remill::WriteProfile`.
+  if (instrumentation.counters != remill::TraceInstrumentation::kNoCounters) {
+    remill::DefineTraceCounters(&dest_module, trace_lifter.CounterAddresses());
+  }
+
   // We have a prototype, so go create a function that will call our entrypoint.
   if (make_slice) {
-    CHECK_NOTNULL(entry_trace);
+    if (!entry_trace) {
+      err << "Could not lift the trace at --entry_address";
+      return false;
+    }
+    return CreateSlice(arch, dest_module, entry_trace, request, err);
+  }
 
-    llvm::SmallVector<llvm::StringRef, 4> input_reg_names;
-    llvm::SmallVector<llvm::StringRef, 4> output_reg_names;
-    llvm::StringRef(FLAGS_slice_inputs)
-        .split(input_reg_names, ',', -1, false /* KeepEmpty */);
-    llvm::StringRef(FLAGS_slice_outputs)
-        .split(output_reg_names, ',', -1, false /* KeepEmpty */);
+  return true;
+}
 
-    CHECK(!(input_reg_names.empty() && output_reg_names.empty()))
-        << "Empty lists passed to both --slice_inputs and --slice_outputs";
+// Lift the bytes described by `request` into `module`, which contains the
+// semantics for `arch`, and then move the lifted code into `dest_module`. If
+// `chunk_writer` is non-null, then lifted traces are instead streamed into
+// it, and `dest_module` is left untouched.
+static bool LiftBytes(const remill::Arch *arch, llvm::Module *module,
+                      const LiftRequest &request,
+                      remill::TraceCache *trace_cache,
+                      remill::TraceChunkWriter *chunk_writer,
+                      llvm::Module &dest_module, std::ostream &err) {
+  if (request.bytes.empty()) {
+    err << "Please specify a sequence of hex bytes to --bytes.";
+    return false;
+  }
 
-    // Use the registers to build a function prototype.
-    llvm::SmallVector<llvm::Type *, 8> arg_types;
-    arg_types.push_back(mem_ptr_type);
+  if (request.bytes.size() % 2) {
+    err << "Please specify an even number of nibbles to --bytes.";
+    return false;
+  }
+
+  // Make sure `--address` and `--entry_address` are in-bounds for the target
+  // architecture's address size.
+  const uint64_t addr_mask = ~0ULL >> (64UL - arch->address_size);
+  if (request.address != (request.address & addr_mask)) {
+    err << "Value " << std::hex << request.address << std::dec
+        << " passed to --address does not fit into 32-bits. Did mean"
+        << " to specify a 64-bit architecture to --arch?";
+    return false;
+  }
+
+  if (request.entry_address != (request.entry_address & addr_mask)) {
+    err << "Value " << std::hex << request.entry_address << std::dec
+        << " passed to --entry_address does not fit into 32-bits. Did mean"
+        << " to specify a 64-bit architecture to --arch?";
+    return false;
+  }
 
-    for (auto &reg_name : input_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      CHECK(reg != nullptr)
-          << "Invalid register name '" << reg_name.str()
-          << "' used in input slice list '" << FLAGS_slice_inputs << "'";
+  Memory memory;
+  if (!UnhexlifyInputBytes(request.bytes, request.address, addr_mask, memory,
+                           err)) {
+    return false;
+  }
 
-      arg_types.push_back(reg->type);
+  SimpleTraceManager manager([&memory](uint64_t addr, uint8_t *byte) {
+    auto byte_it = memory.find(addr);
+    if (byte_it != memory.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
     }
+  });
 
-    const auto first_output_reg_index = arg_types.size();
+  return LiftTraces(arch, module, manager, {request.entry_address}, request,
+                    trace_cache, chunk_writer, dest_module, err);
+}
+
+// Returns `true` if an ELF file whose `e_machine` is `machine` contains code
+// for `arch`.
+static bool IsElfMachineOf(uint16_t machine, const remill::Arch *arch) {
+  switch (machine) {
+    case llvm::ELF::EM_386: return arch->IsX86();
+    case llvm::ELF::EM_X86_64: return arch->IsAMD64();
+    case llvm::ELF::EM_ARM:
+      return arch->IsAArch32() ||
+             arch->arch_name == remill::kArchThumb2LittleEndian;
+    case llvm::ELF::EM_AARCH64:
+      return arch->IsAArch64() ||
+             arch->arch_name == remill::kArchAArch64LittleEndian_SLEIGH;
+    case llvm::ELF::EM_SPARC:
+    case llvm::ELF::EM_SPARC32PLUS:
+      return arch->IsSPARC32() ||
+             arch->arch_name == remill::kArchSparc32_SLEIGH;
+    case llvm::ELF::EM_SPARCV9: return arch->IsSPARC64();
+    case llvm::ELF::EM_PPC: return arch->IsPPC();
+    default: return false;
+  }
+}
 
-    // Outputs are "returned" by pointer through arguments.
-    for (auto &reg_name : output_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      CHECK(reg != nullptr)
-          << "Invalid register name '" << reg_name.str()
-          << "' used in output slice list '" << FLAGS_slice_outputs << "'";
+// Lift every function of the ELF file at `path` into `module`, which contains
+// the semantics for `arch`, and then move the lifted code into `dest_module`,
+// or stream it into `chunk_writer`. On 32-bit ARM, only the functions whose
+// mode (ARM or Thumb) matches `arch` are lifted, as every trace is decoded in
+// the initial context of `arch`.
+static bool LiftBinary(const remill::Arch *arch, llvm::Module *module,
+                       const std::string &path,
+                       remill::TraceCache *trace_cache,
+                       remill::TraceChunkWriter *chunk_writer,
+                       llvm::Module &dest_module, std::ostream &err) {
+  remill::ElfImage elf(path);
+  if (!elf.IsValid()) {
+    err << "Unable to load ELF file " << path << " passed to --binary.";
+    return false;
+  }
+
+  if (!IsElfMachineOf(elf.Machine(), arch) ||
+      elf.IsLittleEndian() != arch->MemoryAccessIsLittleEndian()) {
+    err << "ELF file " << path << " with machine " << elf.Machine()
+        << " does not contain code for --arch "
+        << remill::GetArchName(arch->arch_name) << ".";
+    return false;
+  }
 
-      arg_types.push_back(llvm::PointerType::get(context, 0));
+  const auto lift_thumb = arch->arch_name == remill::kArchThumb2LittleEndian;
+  std::vector<uint64_t> trace_heads;
+  for (auto addr : elf.TraceHeads()) {
+    if (elf.IsThumb(addr) == lift_thumb) {
+      trace_heads.push_back(addr);
     }
+  }
 
-    const auto state_type = arch->StateStructType();
-    const auto func_type =
-        llvm::FunctionType::get(mem_ptr_type, arg_types, false);
-    const auto func = llvm::Function::Create(
-        func_type, llvm::GlobalValue::ExternalLinkage, "slice", &dest_module);
+  if (const auto num_skipped = elf.TraceHeads().size() - trace_heads.size()) {
+    LOG(WARNING) << "Skipping " << num_skipped << " "
+                 << (lift_thumb ? "ARM" : "Thumb") << " functions of " << path
+                 << "; lift them with --arch "
+                 << (lift_thumb ? "aarch32" : "thumb2");
+  }
 
-    // Store all of the function arguments (corresponding with specific registers)
-    // into the stack-allocated `State` structure.
-    auto entry = llvm::BasicBlock::Create(context, "", func);
-    llvm::IRBuilder<> ir(entry);
+  if (trace_heads.empty()) {
+    err << "No functions found in executable segments of " << path;
+    return false;
+  }
 
-    const auto state_ptr = ir.CreateAlloca(state_type);
+  LOG(INFO) << "Lifting " << trace_heads.size() << " functions from " << path;
 
-    const remill::Register *pc_reg =
-        arch->RegisterByName(arch->ProgramCounterRegisterName());
+  SimpleTraceManager manager(
+      [&elf](uint64_t addr, uint8_t *byte) {
+        return elf.TryReadExecutableByte(addr, byte);
+      },
+      [&elf](uint64_t addr, uint8_t *byte) {
+        return elf.TryReadDataByte(addr, byte);
+      });
 
-    CHECK(pc_reg != nullptr)
-        << "Could not find the register in the state structure "
-        << "associated with the program counter.";
+  LiftRequest request;
+  request.entry_address = elf.EntryPoint();
+  return LiftTraces(arch, module, manager, trace_heads, request, trace_cache,
+                    chunk_writer, dest_module, err);
+}
 
-    // Store the program counter into the state.
-    const auto pc_reg_ptr = pc_reg->AddressOf(state_ptr, entry);
-    const auto trace_pc =
-        llvm::ConstantInt::get(pc_reg->type, FLAGS_entry_address, false);
-    ir.SetInsertPoint(entry);
-    ir.CreateStore(trace_pc, pc_reg_ptr);
-
-    auto args_it = func->arg_begin();
-    for (auto &reg_name : input_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      auto &arg = *++args_it;  // Pre-increment, as first arg is memory pointer.
-      arg.setName(reg_name);
-      CHECK_EQ(arg.getType(), reg->type);
-      auto reg_ptr = reg->AddressOf(state_ptr, entry);
-      ir.SetInsertPoint(entry);
-      ir.CreateStore(&arg, reg_ptr);
-    }
-
-    llvm::Value *mem_ptr = &*func->arg_begin();
-
-    llvm::Value *trace_args[remill::kNumBlockArgs] = {};
-    trace_args[remill::kStatePointerArgNum] = state_ptr;
-    trace_args[remill::kMemoryPointerArgNum] = mem_ptr;
-    trace_args[remill::kPCArgNum] = llvm::ConstantInt::get(
-        llvm::IntegerType::get(context, arch->address_size),
-        FLAGS_entry_address, false);
-
-    mem_ptr = ir.CreateCall(entry_trace, trace_args);
-
-    // Go read all output registers out of the state and store them
-    // into the output parameters.
-    args_it = func->arg_begin();
-    for (size_t i = 0, j = 0; i < func->arg_size(); ++i, ++args_it) {
-      if (i < first_output_reg_index) {
+namespace {
+
+// One decoded request of `--daemon` mode, along with where to send the
+// response.
+struct DaemonJob {
+  std::string line;
+  std::function<void(const std::string &)> reply;
+};
+
+// Queue of pending requests, shared by all daemon workers.
+class DaemonQueue {
+ public:
+  void Push(DaemonJob job) {
+    {
+      std::unique_lock<std::mutex> locker(lock);
+      jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+  }
+
+  // Returns `false` once the queue is closed and drained.
+  bool Pop(DaemonJob &job) {
+    std::unique_lock<std::mutex> locker(lock);
+    cv.wait(locker, [this] { return closed || !jobs.empty(); });
+    if (jobs.empty()) {
+      return false;
+    }
+    job = std::move(jobs.front());
+    jobs.pop_front();
+    return true;
+  }
+
+  void Close(void) {
+    {
+      std::unique_lock<std::mutex> locker(lock);
+      closed = true;
+    }
+    cv.notify_all();
+  }
+
+ private:
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<DaemonJob> jobs;
+  bool closed{false};
+};
+
+// Serializes the initialization of architectures and semantics modules
+// across workers.
+std::mutex gArchInitLock;
+
+// A daemon worker. Each worker owns its own LLVM context, and keeps a warm
+// `Arch` and pristine semantics module for every architecture that it has
+// been asked to lift. Every request lifts into a fresh clone of the pristine
+// module, so that requests never observe each other's traces.
+class DaemonWorker {
+ public:
+  void Run(DaemonQueue &queue) {
+    DaemonJob job;
+    while (queue.Pop(job)) {
+      job.reply(HandleRequest(job.line));
+
+      // Types and constants are never freed from an LLVM context, so start
+      // over with a fresh context every so often.
+      if (FLAGS_daemon_requests_per_context &&
+          ++num_requests >= FLAGS_daemon_requests_per_context) {
+        num_requests = 0;
+        archs.clear();
+        context = std::make_unique<llvm::LLVMContext>();
+      }
+    }
+  }
+
+ private:
+  struct WarmArch {
+    remill::Arch::ArchPtr arch;
+    std::unique_ptr<llvm::Module> semantics;
+    std::unique_ptr<remill::TraceCache> trace_cache;
+  };
+
+  WarmArch *GetWarmArch(const std::string &os, const std::string &arch_name,
+                        std::ostream &err) {
+    auto &warm = archs[os + ":" + arch_name];
+    if (warm.arch) {
+      return &warm;
+    }
+
+    if (remill::GetOSName(os) == remill::kOSInvalid) {
+      err << "Invalid OS name '" << os << "'";
+      return nullptr;
+    }
+
+    if (remill::GetArchName(arch_name) == remill::kArchInvalid) {
+      err << "Invalid architecture name '" << arch_name << "'";
+      return nullptr;
+    }
+
+    std::unique_lock<std::mutex> locker(gArchInitLock);
+    warm.arch = remill::Arch::Get(*context, os, arch_name);
+    if (!warm.arch) {
+      err << "Unable to create architecture '" << arch_name << "'";
+      return nullptr;
+    }
+    warm.semantics = remill::LoadArchSemantics(warm.arch.get());
+    if (!FLAGS_trace_cache_dir.empty()) {
+      warm.trace_cache = std::make_unique<remill::TraceCache>(
+          warm.arch.get(), warm.semantics.get(), FLAGS_trace_cache_dir,
+          FLAGS_trace_cache_max_size);
+    }
+    return &warm;
+  }
+
+  // Parse the JSON request in `line`, lift it, and return the JSON response.
+  std::string HandleRequest(const std::string &line) {
+    llvm::json::Object response;
+    std::stringstream err;
+    if (!HandleRequest(line, response, err)) {
+      response["error"] = err.str();
+    }
+
+    std::string out;
+    llvm::raw_string_ostream os(out);
+    os << llvm::json::Value(std::move(response));
+    os.flush();
+    return out;
+  }
+
+  bool HandleRequest(const std::string &line, llvm::json::Object &response,
+                     std::ostream &err) {
+    auto parsed = llvm::json::parse(line);
+    if (!parsed) {
+      err << "Invalid JSON request: " << llvm::toString(parsed.takeError());
+      return false;
+    }
+
+    auto obj = parsed->getAsObject();
+    if (!obj) {
+      err << "Request must be a JSON object";
+      return false;
+    }
+
+    if (auto id = obj->get("id")) {
+      response["id"] = *id;
+    }
+
+    auto get_string = [=](llvm::StringRef key, const std::string &def) {
+      if (auto val = obj->getString(key)) {
+        return val->str();
+      }
+      return def;
+    };
+
+    // Addresses may be given as JSON numbers, or as strings (e.g. `"0x1000"`)
+    // when they don't fit in a signed 64-bit integer.
+    auto get_address = [=, &err](llvm::StringRef key, uint64_t def,
+                                 uint64_t &out) {
+      out = def;
+      if (auto num = obj->getInteger(key)) {
+        out = static_cast<uint64_t>(*num);
+      } else if (auto str = obj->getString(key)) {
+        if (str->getAsInteger(0, out)) {
+          err << "Invalid address '" << str->str() << "' for '" << key.str()
+              << "'";
+          return false;
+        }
+      }
+      return true;
+    };
+
+    LiftRequest request;
+    request.bytes = get_string("bytes", "");
+    request.slice_inputs = get_string("slice_inputs", "");
+    request.slice_outputs = get_string("slice_outputs", "");
+    if (!get_address("address", 0, request.address) ||
+        !get_address("entry_address", request.address,
+                     request.entry_address)) {
+      return false;
+    }
+
+    const auto format = get_string("format", "ir");
+    if (format != "ir" && format != "bc") {
+      err << "Invalid format '" << format << "'; expected 'ir' or 'bc'";
+      return false;
+    }
+
+    auto warm = GetWarmArch(get_string("os", FLAGS_os),
+                            get_string("arch", FLAGS_arch), err);
+    if (!warm) {
+      return false;
+    }
+
+    auto module = llvm::CloneModule(*warm->semantics);
+    llvm::Module dest_module("lifted_code", *context);
+    warm->arch->PrepareModuleDataLayout(&dest_module);
+
+    if (!LiftBytes(warm->arch.get(), module.get(), request,
+                   warm->trace_cache.get(), nullptr, dest_module, err)) {
+      return false;
+    }
+
+    std::string out;
+    llvm::raw_string_ostream os(out);
+    if (format == "bc") {
+      llvm::WriteBitcodeToFile(dest_module, os);
+      os.flush();
+      response["bc"] = llvm::toHex(out, true /* LowerCase */);
+    } else {
+      dest_module.print(os, nullptr);
+      os.flush();
+      response["ir"] = std::move(out);
+    }
+    return true;
+  }
+
+  // NOTE: `archs` refer to `context`, so they must be destroyed first.
+  std::unique_ptr<llvm::LLVMContext> context{
+      std::make_unique<llvm::LLVMContext>()};
+  std::unordered_map<std::string, WarmArch> archs;
+  uint64_t num_requests{0};
+};
+
+}  // namespace
+
+// Read newline-delimited requests from `fd` and push them onto `queue`.
+// Responses are written back to `out_fd`, which is closed with `close_fd`
+// once every response has been written.
+static void ReadDaemonRequests(int fd, int out_fd, DaemonQueue &queue,
+                               std::function<void(void)> close_fd) {
+  struct Output {
+    ~Output(void) {
+      close_fd();
+    }
+    std::mutex lock;
+    int fd;
+    std::function<void(void)> close_fd;
+  };
+
+  auto output = std::make_shared<Output>();
+  output->fd = out_fd;
+  output->close_fd = std::move(close_fd);
+
+  // NOTE: `SIGPIPE` is ignored in `--daemon` mode, so a client that
+  //       goes away only makes this fail.
+  auto reply = [output](const std::string &response) {
+    std::unique_lock<std::mutex> locker(output->lock);
+    std::string data = response + "\n";
+    for (size_t i = 0; i < data.size();) {
+      auto ret = write(output->fd, &(data[i]), data.size() - i);
+      if (ret <= 0) {
+        if (ret < 0 && errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      i += static_cast<size_t>(ret);
+    }
+  };
+
+  std::string pending;
+  char buff[4096];
+  for (;;) {
+    auto ret = read(fd, buff, sizeof(buff));
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret <= 0) {
+      break;
+    }
+
+    pending.append(buff, static_cast<size_t>(ret));
+    for (auto nl = pending.find('\n'); nl != std::string::npos;
+         nl = pending.find('\n')) {
+      auto line = pending.substr(0, nl);
+      pending.erase(0, nl + 1);
+      if (!llvm::StringRef(line).trim().empty()) {
+        queue.Push({std::move(line), reply});
+      }
+    }
+  }
+
+  if (!llvm::StringRef(pending).trim().empty()) {
+    queue.Push({std::move(pending), reply});
+  }
+}
+
+// Run as a lifting server, until stdin is closed or, if `--daemon_socket` is
+// used, forever.
+static int RunDaemon(void) {
+  auto num_workers = static_cast<unsigned>(FLAGS_daemon_workers);
+  if (!num_workers) {
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+#ifndef _WIN32
+
+  // Don't let a client that closes its end before reading its responses kill
+  // the daemon.
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  // The threads that read from connections are detached, and so they share
+  // ownership of the queue.
+  auto queue = std::make_shared<DaemonQueue>();
+  std::vector<std::thread> workers;
+  for (auto i = 0u; i < num_workers; ++i) {
+    workers.emplace_back([queue] { DaemonWorker().Run(*queue); });
+  }
+
+  if (FLAGS_daemon_socket.empty()) {
+    ReadDaemonRequests(0 /* stdin */, 1 /* stdout */, *queue, [] {});
+    queue->Close();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    return EXIT_SUCCESS;
+  }
+
+#ifdef _WIN32
+  LOG(ERROR) << "--daemon_socket is not supported on Windows";
+  queue->Close();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return EXIT_FAILURE;
+#else
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (FLAGS_daemon_socket.size() >= sizeof(addr.sun_path)) {
+    LOG(ERROR) << "Socket path " << FLAGS_daemon_socket << " is too long";
+    return EXIT_FAILURE;
+  }
+  FLAGS_daemon_socket.copy(addr.sun_path, FLAGS_daemon_socket.size());
+
+  const auto listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(FLAGS_daemon_socket.c_str());
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ||
+      listen(listen_fd, SOMAXCONN)) {
+    LOG(ERROR) << "Unable to listen on " << FLAGS_daemon_socket << ": "
+               << strerror(errno);
+    return EXIT_FAILURE;
+  }
+
+  LOG(INFO) << "Listening on " << FLAGS_daemon_socket << " with "
+            << num_workers << " workers";
+
+  for (;;) {
+    const auto conn_fd = accept(listen_fd, nullptr, nullptr);
+    if (conn_fd < 0) {
+      if (errno == EINTR) {
         continue;
       }
+      LOG(ERROR) << "Unable to accept connection: " << strerror(errno);
+      break;
+    }
+
+    std::thread([conn_fd, queue] {
+      ReadDaemonRequests(conn_fd, conn_fd, *queue,
+                         [conn_fd] { close(conn_fd); });
+    }).detach();
+  }
+
+  close(listen_fd);
+  queue->Close();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return EXIT_FAILURE;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+  SetVersion();
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_daemon) {
+    return RunDaemon();
+  }
+
+  if (!FLAGS_entry_address) {
+    FLAGS_entry_address = FLAGS_address;
+  }
 
-      const auto &reg_name = output_reg_names[j++];
-      const auto reg = arch->RegisterByName(reg_name.str());
-      auto &arg = *args_it;
-      arg.setName(reg_name + "_output");
+  if (!FLAGS_binary.empty()) {
+    if (!FLAGS_bytes.empty()) {
+      std::cerr << "--binary cannot be combined with --bytes." << std::endl;
+      return EXIT_FAILURE;
+    }
 
-      auto reg_ptr = reg->AddressOf(state_ptr, entry);
-      ir.SetInsertPoint(entry);
-      ir.CreateStore(ir.CreateLoad(reg->type, reg_ptr), &arg);
+    if (!FLAGS_slice_inputs.empty() || !FLAGS_slice_outputs.empty()) {
+      std::cerr << "--binary cannot be combined with --slice_inputs "
+                << "or --slice_outputs." << std::endl;
+      return EXIT_FAILURE;
     }
+  }
+
+  LiftRequest request;
+  request.bytes = FLAGS_bytes;
+  request.address = FLAGS_address;
+  request.entry_address = FLAGS_entry_address;
+  request.slice_inputs = FLAGS_slice_inputs;
+  request.slice_outputs = FLAGS_slice_outputs;
+
+  llvm::LLVMContext context;
+  auto arch = remill::Arch::Get(context, FLAGS_os, FLAGS_arch);
+  std::unique_ptr<llvm::Module> module(remill::LoadArchSemantics(arch.get()));
+
+  std::unique_ptr<remill::TraceCache> trace_cache;
+  if (!FLAGS_trace_cache_dir.empty()) {
+    trace_cache = std::make_unique<remill::TraceCache>(
+        arch.get(), module.get(), FLAGS_trace_cache_dir,
+        FLAGS_trace_cache_max_size);
+  }
+
+  std::shared_ptr<remill::LiftingStatistics> lifting_stats;
+  if (!FLAGS_stats_out.empty()) {
+    if (FLAGS_stats_format != "json" && FLAGS_stats_format != "prometheus") {
+      std::cerr << "Invalid value '" << FLAGS_stats_format
+                << "' passed to --stats_format." << std::endl;
+      return EXIT_FAILURE;
+    }
+    lifting_stats = std::make_shared<remill::LiftingStatistics>();
+    arch->SetStatistics(lifting_stats);
+  }
+
+  // Stream each trace out into a bitcode chunk as soon as it is lifted, so
+  // that the whole program never has to be held in memory at once.
+  std::unique_ptr<remill::TraceChunkWriter> chunk_writer;
+  if (!FLAGS_bc_chunk_dir.empty()) {
+    if (!FLAGS_slice_inputs.empty() || !FLAGS_slice_outputs.empty()) {
+      std::cerr << "--bc_chunk_dir cannot be combined with --slice_inputs "
+                << "or --slice_outputs." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // The counter array is defined in the output module, and is sized by the
+    // total number of counters across all traces.
+    if (FLAGS_instrument_counters != "none") {
+      std::cerr << "--bc_chunk_dir cannot be combined with "
+                << "--instrument_counters." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    chunk_writer = std::make_unique<remill::TraceChunkWriter>(
+        arch.get(), FLAGS_bc_chunk_dir, FLAGS_traces_per_chunk);
+  }
 
-    // Return the memory pointer, so that all memory accesses are
-    // preserved.
-    ir.CreateRet(mem_ptr);
+  // Create a new module in which we will move all the lifted functions. Prepare
+  // the module for code of this architecture, i.e. set the data layout, triple,
+  // etc.
+  llvm::Module dest_module("lifted_code", context);
+  arch->PrepareModuleDataLayout(&dest_module);
 
-    // We want the stack-allocated `State` to be subject to scalarization
-    // and mem2reg, but to "encourage" that, we need to prevent the
-    // `alloca`d `State` from escaping.
-    MuteStateEscape(&dest_module, "__remill_error");
-    MuteStateEscape(&dest_module, "__remill_function_call");
-    MuteStateEscape(&dest_module, "__remill_function_return");
-    MuteStateEscape(&dest_module, "__remill_jump");
-    MuteStateEscape(&dest_module, "__remill_missing_block");
+  const auto lifted =
+      FLAGS_binary.empty()
+          ? LiftBytes(arch.get(), module.get(), request, trace_cache.get(),
+                      chunk_writer.get(), dest_module, std::cerr)
+          : LiftBinary(arch.get(), module.get(), FLAGS_binary,
+                       trace_cache.get(), chunk_writer.get(), dest_module,
+                       std::cerr);
+  if (!lifted) {
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
 
-    guide.slp_vectorize = true;
-    guide.loop_vectorize = true;
+  if (trace_cache) {
+    const auto stats = trace_cache->Statistics();
+    LOG(INFO) << "Trace cache: " << stats.num_hits << " hits, "
+              << stats.num_misses << " misses, " << stats.num_stale
+              << " stale, " << stats.num_stores << " stores, "
+              << stats.num_evictions << " evictions (hit rate "
+              << stats.HitRate() << ")";
+  }
 
-    CHECK(remill::VerifyModule(&dest_module));
-    remill::OptimizeBareModule(&dest_module, guide);
+  if (lifting_stats) {
+    std::ofstream os(FLAGS_stats_out);
+    os << (FLAGS_stats_format == "json" ? lifting_stats->ToJSON()
+                                        : lifting_stats->ToPrometheus());
+    if (!os) {
+      LOG(ERROR) << "Could not save lifting statistics to "
+                 << FLAGS_stats_out;
+    }
+  }
+
+  if (chunk_writer) {
+    const auto flushed = chunk_writer->Flush();
+    LOG(INFO) << "Wrote " << chunk_writer->ChunkPaths().size()
+              << " bitcode chunks to " << FLAGS_bc_chunk_dir;
+    return flushed ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  llvm::Module *out_module = &dest_module;
+  llvm::LLVMContext out_context;
+  std::unique_ptr<llvm::Module> transferred_module;
+  if (FLAGS_output_context != "shared") {
+    if (FLAGS_output_context != "move" && FLAGS_output_context != "bitcode") {
+      std::cerr << "Invalid value '" << FLAGS_output_context
+                << "' passed to --output_context." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    transferred_module =
+        TransferToContext(arch.get(), dest_module, out_context,
+                          FLAGS_output_context == "bitcode");
+    if (!transferred_module) {
+      return EXIT_FAILURE;
+    }
+    out_module = transferred_module.get();
   }
 
   int ret = EXIT_SUCCESS;
 
   if (!FLAGS_ir_out.empty()) {
-    if (!remill::StoreModuleIRToFile(&dest_module, FLAGS_ir_out, true)) {
+    if (!remill::StoreModuleIRToFile(out_module, FLAGS_ir_out, true)) {
       LOG(ERROR) << "Could not save LLVM IR to " << FLAGS_ir_out;
       ret = EXIT_FAILURE;
     }
   }
   if (!FLAGS_bc_out.empty()) {
-    if (!remill::StoreModuleToFile(&dest_module, FLAGS_bc_out, true)) {
+    if (!remill::StoreModuleToFile(out_module, FLAGS_bc_out, true)) {
       LOG(ERROR) << "Could not save LLVM bitcode to " << FLAGS_bc_out;
       ret = EXIT_FAILURE;
     }
@@ -146,6 +146,18 @@ function(add_runtime target_name)
     message(SEND_ERROR "Missing address size.")
   endif()
 
+  if(REMILL_VECTOR_SEMANTICS)
+    list(APPEND definition_list "-DREMILL_VECTOR_SEMANTICS")
+  endif()
+
+  if(REMILL_X87_ROTATING_STACK)
+    list(APPEND definition_list "-DREMILL_X87_ROTATING_STACK")
+  endif()
+
+  if(REMILL_SPARC_WINDOW_BANK)
+    list(APPEND definition_list "-DREMILL_SPARC_WINDOW_BANK")
+  endif()
+
   if("${source_file_list}" STREQUAL "")
     message(SEND_ERROR "No source files specified.")
   endif()
@@ -30,4 +30,5 @@ cmake_dependent_option(REMILL_ENABLE_TESTING_X86 "Build your tests" ON "REMILL_E
 cmake_dependent_option(REMILL_ENABLE_TESTING_AARCH64 "Build your tests" ON "REMILL_ENABLE_TESTING;can_enable_testing_aarch64" OFF)
 cmake_dependent_option(REMILL_ENABLE_TESTING_SLEIGH_THUMB "Build cross platform sleigh tests thumb" ON "REMILL_ENABLE_TESTING" OFF)
 cmake_dependent_option(REMILL_ENABLE_TESTING_SLEIGH_PPC "Build cross platform sliegh tests for ppc" ON "REMILL_ENABLE_TESTING" OFF)
+cmake_dependent_option(REMILL_ENABLE_TESTING_BC "Build cross platform tests of the bitcode passes" ON "REMILL_ENABLE_TESTING" OFF)
 cmake_dependent_option(REMILL_ENABLE_DIFFERENTIAL_TESTING "Build cross platform differential testing of sleigh x86" ON "REMILL_ENABLE_TESTING" OFF)
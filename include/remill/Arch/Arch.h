@@ -67,7 +67,9 @@ enum OSName : uint32_t;
 enum ArchName : uint32_t;
 
 class Arch;
+class ArchDescription;
 class Instruction;
+class LiftingStatistics;
 
 // An RAII locker for handling issues related to SLEIGH.
 class ArchLocker {
@@ -112,6 +114,9 @@ struct Register {
   Register(const std::string &name_, uint64_t offset_, llvm::Type *type_,
            const Register *parent_, const Arch *arch_);
 
+  Register(const std::string &name_, uint64_t offset_, uint64_t size_,
+           llvm::Type *type_, const Register *parent_, const Arch *arch_);
+
   std::string name;  // Name of the register.
   uint64_t offset;  // Byte offset in `State`.
   uint64_t size;  // Size of this register (in bytes).
@@ -293,6 +298,13 @@ class Arch {
                                  Instruction &inst,
                                  DecodingContext context) const = 0;
 
+  // Attach a lifter to `inst`, which was decoded by this architecture, and
+  // then read back from its binary encoding (see `EncodedInstruction`).
+  // Returns `false` if the lifter depends on the state of the decoder, in
+  // which case `inst` must be decoded again. SLEIGH-backed architectures
+  // always return `false`.
+  virtual bool RestoreInstructionLifter(Instruction &inst) const;
+
   // Decode an instruction that is within a delay slot.
   bool DecodeDelayedInstruction(uint64_t address, std::string_view instr_bytes,
                                 Instruction &inst,
@@ -378,6 +390,21 @@ class Arch {
   //            architectures.
   virtual void PopulateRegisterTable(void) const = 0;
 
+  // Populate the table of register information from `desc`, which describes
+  // this architecture. By default, this adds each register with
+  // `AddRegister`.
+  //
+  // NOTE: Internal API; do not invoke unless you are proxying/composing
+  //       architectures.
+  virtual void BindRegisterTable(const ArchDescription &desc) const;
+
+  // Returns the context-independent description of this architecture's
+  // registers, which is shared by every `Arch` built for the same OS and
+  // architecture name, or `nullptr` if this `Arch` wasn't made by `Build`.
+  inline std::shared_ptr<const ArchDescription> Description(void) const {
+    return description;
+  }
+
   // Populate a just-initialized lifted function function with architecture-
   // specific variables.
   //
@@ -395,6 +422,17 @@ class Arch {
                                       llvm::Type *val_type, size_t offset,
                                       const char *parent_reg_name) const = 0;
 
+  // Collect statistics about the instructions decoded and lifted with this
+  // architecture into `stats`, or stop collecting them if `stats` is null.
+  //
+  // NOTE: This must not race with decoding or lifting on other threads.
+  void SetStatistics(std::shared_ptr<LiftingStatistics> stats) const;
+
+  // Returns the statistics being collected, or `nullptr` if none are.
+  inline LiftingStatistics *Statistics(void) const {
+    return statistics.get();
+  }
+
   // Returns a lock on global state. In general, Remill doesn't use global
   // variables for storing state; however, SLEIGH sometimes does, and so when
   // using SLEIGH-backed architectures, it can be necessary to acquire this
@@ -455,6 +493,10 @@ class Arch {
                                   ArchName arch_name);
 
   Arch(void) = delete;
+
+  mutable std::shared_ptr<LiftingStatistics> statistics;
+
+  mutable std::shared_ptr<const ArchDescription> description;
 };
 
 }  // namespace remill
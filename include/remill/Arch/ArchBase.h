@@ -81,6 +81,10 @@ class ArchBase : public remill::Arch {
                               size_t offset,
                               const char *parent_reg_name) const final;
 
+  // Create the registers described by `desc`, unless this architecture's
+  // register table is already populated.
+  void BindRegisterTable(const ArchDescription &desc) const final;
+
   // State type. Initially this is `nullptr` because we can construct and arch
   // without loading in a semantics module. When we load a semantics module, we
   // learn about the LLVM type of the state structure, and so we need to be
@@ -127,6 +131,9 @@ class DefaultContextAndLifter : virtual public remill::ArchBase {
   OperandLifter::OpLifterPtr
   DefaultLifter(const remill::IntrinsicTable &intrinsics) const override;
 
+  // Instructions are lifted with a stateless `InstructionLifter`.
+  bool RestoreInstructionLifter(Instruction &inst) const override;
+
 
   DefaultContextAndLifter(llvm::LLVMContext *context_, OSName os_name_,
                           ArchName arch_name_);
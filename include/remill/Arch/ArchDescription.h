@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class LLVMContext;
+class Type;
+}  // namespace llvm
+namespace remill {
+
+enum OSName : uint32_t;
+enum ArchName : uint32_t;
+
+class Arch;
+
+// A description of the registers of an architecture that doesn't depend on
+// any `llvm::LLVMContext`. It is computed once per process for each OS and
+// architecture name, and then shared, read-only, by every `Arch` built for
+// them, so that building an `Arch` in a new context only has to bind the
+// description to that context.
+//
+// NOTE: Descriptions are immutable, and so are safe to share between
+//       threads.
+class ArchDescription {
+ public:
+  // A context-independent LLVM type of a register: a scalar, or an array or
+  // vector of scalars.
+  struct RegisterType {
+    enum Kind : uint8_t {
+      kInteger,
+      kHalf,
+      kFloat,
+      kDouble,
+      kX86FP80,
+      kFP128,
+    };
+
+    enum Shape : uint8_t {
+      kScalar,
+      kArray,
+      kVector,
+    };
+
+    Kind kind{kInteger};
+    Shape shape{kScalar};
+
+    // Number of bits in an integer element.
+    unsigned bits{0};
+
+    // Number of elements of an array or vector.
+    uint64_t num_elements{0};
+
+    // Describe `type`. Returns `std::nullopt` if `type` isn't the type of a
+    // register.
+    static std::optional<RegisterType> From(llvm::Type *type);
+
+    // Get this type in `context`.
+    llvm::Type *Get(llvm::LLVMContext &context) const;
+
+    bool operator==(const RegisterType &that) const;
+  };
+
+  // Index of a missing register.
+  static constexpr size_t kNoRegister = ~static_cast<size_t>(0);
+
+  struct RegisterInfo {
+    std::string name;  // Name of the register.
+    uint64_t offset;  // Byte offset in `State`.
+    uint64_t size;  // Size of this register (in bytes).
+    RegisterType type;
+
+    // Index of the enclosing register in `registers`, or `kNoRegister`.
+    size_t parent;
+  };
+
+  // Get the description of the architecture `arch_name` on `os_name`,
+  // building it if this is the first time it's needed in this process.
+  // Returns `nullptr` if there is no such architecture.
+  static std::shared_ptr<const ArchDescription> Get(OSName os_name,
+                                                    ArchName arch_name);
+
+  // Returns the index of the register named `name`, or `kNoRegister`.
+  size_t RegisterIndex(std::string_view name) const;
+
+  const OSName os_name;
+  const ArchName arch_name;
+
+  // Every register, in the order in which the architecture added them.
+  // Enclosing registers come before the registers that they enclose.
+  const std::vector<RegisterInfo> registers;
+
+  // Index of the register that is accessed at each byte offset in `State`,
+  // or `kNoRegister`.
+  const std::vector<size_t> reg_by_offset;
+
+ private:
+  friend class Arch;
+
+  ArchDescription(OSName os_name_, ArchName arch_name_,
+                  std::vector<RegisterInfo> registers_,
+                  std::vector<size_t> reg_by_offset_);
+
+  // Get the description of the architecture of `arch`. If it doesn't exist
+  // yet, then it's built by populating the register table of `arch`, which
+  // must be empty.
+  static std::shared_ptr<const ArchDescription> Describe(const Arch &arch);
+
+  std::unordered_map<std::string_view, size_t> reg_by_name;
+};
+
+}  // namespace remill
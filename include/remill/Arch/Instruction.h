@@ -32,6 +32,7 @@ class Type;
 namespace remill {
 
 class Arch;
+class EncodedInstruction;
 struct Register;
 class OperandExpression;
 
@@ -238,6 +239,18 @@ class Instruction {
   // but it can be used in different applications.
   const Register *segment_override = nullptr;
 
+  // For x86, how this instruction changes `TOP`, the index of the top of the
+  // x87 register stack, modulo 8. Pushes subtract one, and pops add one. This
+  // is `std::nullopt` if the instruction loads `TOP` from elsewhere, as is the
+  // case for `FNINIT`, or stores it, as is the case for `FNSTSW`.
+  std::optional<int8_t> x87_top_adjustment{0};
+
+  // For SPARC, how this instruction changes `CWP`, the index of the current
+  // register window. `SAVE` adds one, and `RESTORE` and `RETURN` subtract one.
+  // Register operands that this instruction writes are in the window that it
+  // moves to.
+  int8_t sparc_window_adjustment{0};
+
   enum Category {
     kCategoryInvalid,
     kCategoryNormal,
@@ -499,6 +512,8 @@ class Instruction {
   void SetLifter(InstructionLifter::LifterPtr lifter);
 
  private:
+  friend class EncodedInstruction;
+
   InstructionLifter::LifterPtr lifter;
   static constexpr auto kMaxNumExpr = 64u;
   OperandExpression exprs[kMaxNumExpr];
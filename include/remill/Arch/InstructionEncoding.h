@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/Arch/Context.h>
+#include <remill/Arch/Instruction.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace remill {
+
+class Arch;
+
+// A decoded `Instruction` in a compact, versioned binary encoding, e.g. to
+// cache decoded instructions on disk, or to send them from a decoding
+// frontend to lifting workers. This is a read-only view of the encoding,
+// which must outlive it. The header fields, function name, and bytes of the
+// instruction are read in place, without copying or decoding the rest.
+//
+// NOTE: This doesn't include `Instruction::arch` or the instruction's lifter.
+//       `Decode` takes those from the `Arch` that it's given.
+//
+// The encoding is the same on every host, and encodings can be concatenated
+// into streams, which are walked with `Size`.
+//
+//      std::string buff;
+//      EncodedInstruction::Encode(inst, context, buff);
+//      ...
+//      for (std::string_view data = buff; !data.empty();) {
+//        auto encoded = EncodedInstruction::Read(data);
+//        encoded->Decode(arch, inst);
+//        data.remove_prefix(encoded->Size());
+//      }
+class EncodedInstruction {
+ public:
+  // Version of the encoding. Encodings of other versions are rejected by
+  // `Read`, so this must change whenever the encoding does.
+  static constexpr uint16_t kVersion = 1;
+
+  // Append the encoding of `inst`, which was decoded in `context`, to `out`.
+  // Returns `false`, and leaves `out` unchanged, if `inst` can't be encoded,
+  // e.g. because one of its operand expressions uses an `llvm::Constant` that
+  // isn't an integer.
+  static bool Encode(const Instruction &inst, const DecodingContext &context,
+                     std::string &out);
+
+  // Read the encoded instruction at the beginning of `data`. Returns
+  // `std::nullopt` if `data` doesn't begin with a valid encoding of the
+  // current version.
+  static std::optional<EncodedInstruction> Read(std::string_view data);
+
+  // Number of bytes of the encoding.
+  inline size_t Size(void) const {
+    return data.size();
+  }
+
+  uint64_t GetPC(void) const;
+  uint64_t GetNextPC(void) const;
+  remill::ArchName GetArchName(void) const;
+  Instruction::Category GetCategory(void) const;
+
+  // Name of the semantics function of the instruction.
+  inline std::string_view GetFunction(void) const {
+    return function;
+  }
+
+  // The decoded bytes of the instruction.
+  inline std::string_view GetBytes(void) const {
+    return bytes;
+  }
+
+  // The context in which the instruction was decoded.
+  DecodingContext GetContext(void) const;
+
+  // Decode the instruction into `inst`, binding its registers and operand
+  // expressions to `arch` and its `llvm::LLVMContext`. This restores the
+  // lifter of `inst` with `Arch::RestoreInstructionLifter`, or by decoding
+  // the bytes of the instruction again if the lifter depends on the state of
+  // the decoder. Returns `false` if `arch` can't represent the instruction,
+  // e.g. because it lacks one of the instruction's registers.
+  //
+  // NOTE: The lifters of SLEIGH-backed architectures, e.g. Thumb2 and PPC,
+  //       always depend on the state of the decoder. Those instructions are
+  //       decoded twice: once when they are encoded, and again here.
+  bool Decode(const Arch *arch, Instruction &inst) const;
+
+ private:
+  EncodedInstruction(void) = default;
+
+  std::string_view data;
+  std::string_view function;
+  std::string_view bytes;
+
+  // Offset in `data` of the sections that follow `bytes`. These are only read
+  // by `GetContext` and `Decode`.
+  size_t body_offset{0};
+};
+
+}  // namespace remill
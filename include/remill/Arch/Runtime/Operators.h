@@ -1175,6 +1175,118 @@ ALWAYS_INLINE static bool BNot(bool a) {
                               make_float_broadcast(F##op, 32, floats) \
                                   make_float_broadcast(F##op, 64, doubles)
 
+#if defined(REMILL_VECTOR_SEMANTICS)
+
+// Element type of a native vector. Signed integer elements are replaced by
+// their unsigned counterparts: signed vector arithmetic is `nsw` in LLVM, so
+// overflow would be poison, whereas the machine wraps around.
+template <typename BT>
+struct NativeElementType {
+  typedef BT NT;
+};
+
+template <>
+struct NativeElementType<int8_t> {
+  typedef uint8_t NT;
+};
+
+template <>
+struct NativeElementType<int16_t> {
+  typedef uint16_t NT;
+};
+
+template <>
+struct NativeElementType<int32_t> {
+  typedef uint32_t NT;
+};
+
+template <>
+struct NativeElementType<int64_t> {
+  typedef uint64_t NT;
+};
+
+// Native vector type with the same number and size of elements as the
+// aggregate vector type `T`, e.g. a `<4 x i32>` in LLVM for a `int32v4_t`.
+template <typename T>
+struct NativeVectorType {
+  typedef typename NativeElementType<typename VectorType<T>::BT>::NT BT;
+  typedef BT NT __attribute__((vector_size(sizeof(T))));
+};
+
+template <typename T>
+ALWAYS_INLINE static typename NativeVectorType<T>::NT
+ToNativeVector(const T &vec) {
+  typename NativeVectorType<T>::NT ret;
+  static_assert(sizeof(ret) == sizeof(vec), "Invalid native vector type");
+  __builtin_memcpy(&ret, &vec, sizeof(ret));
+  return ret;
+}
+
+template <typename T>
+ALWAYS_INLINE static T FromNativeVector(typename NativeVectorType<T>::NT vec) {
+  T ret;
+  static_assert(sizeof(ret) == sizeof(vec), "Invalid native vector type");
+  __builtin_memcpy(&ret, &vec, sizeof(ret));
+  return ret;
+}
+
+// Binary broadcast operator, applied to all elements at once.
+#define MAKE_NATIVE_BIN_BROADCAST(op, size, native_op) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &L, const T &R) { \
+    return FromNativeVector<T>(ToNativeVector(L) native_op ToNativeVector(R)); \
+  }
+
+// Unary broadcast operator, applied to all elements at once.
+#define MAKE_NATIVE_UN_BROADCAST(op, size, native_op) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &R) { \
+    return FromNativeVector<T>(native_op ToNativeVector(R)); \
+  }
+
+#define MAKE_NATIVE_BROADCASTS(op, native_op, make_int_broadcast, \
+                               make_float_broadcast) \
+  make_int_broadcast(U##op, 8, native_op) \
+      make_int_broadcast(U##op, 16, native_op) \
+          make_int_broadcast(U##op, 32, native_op) \
+              make_int_broadcast(U##op, 64, native_op) \
+                  make_int_broadcast(S##op, 8, native_op) \
+                      make_int_broadcast(S##op, 16, native_op) \
+                          make_int_broadcast(S##op, 32, native_op) \
+                              make_int_broadcast(S##op, 64, native_op) \
+                                  make_float_broadcast(F##op, 32, native_op) \
+                                      make_float_broadcast(F##op, 64, \
+                                                           native_op)
+
+// Operators whose element-wise semantics match those of LLVM's vector
+// instructions are lowered to vector instructions, e.g. `add <4 x i32>`. The
+// scalar operators widen their operands first, so integer division (e.g.
+// `INT8_MIN / -1`) and shifts by at least the element size are defined for
+// them but not for LLVM's vector instructions, and so remain element-wise.
+MAKE_NATIVE_BROADCASTS(Add, +, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Sub, -, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Mul, *, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_BROADCASTS(Div, MAKE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Div, /, MAKE_NOP, MAKE_NATIVE_BIN_BROADCAST)
+MAKE_BROADCASTS(Rem, MAKE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(And, &, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(AndN, &~, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Or, |, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Xor, ^, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_BROADCASTS(Shl, MAKE_BIN_BROADCAST, MAKE_NOP)
+MAKE_BROADCASTS(Shr, MAKE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Neg, -, MAKE_NATIVE_UN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Not, ~, MAKE_NATIVE_UN_BROADCAST, MAKE_NOP)
+
+#undef MAKE_NATIVE_BIN_BROADCAST
+#undef MAKE_NATIVE_UN_BROADCAST
+#undef MAKE_NATIVE_BROADCASTS
+
+#else
+
 MAKE_BROADCASTS(Add, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
 MAKE_BROADCASTS(Sub, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
 MAKE_BROADCASTS(Mul, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
@@ -1189,6 +1301,8 @@ MAKE_BROADCASTS(Shr, MAKE_BIN_BROADCAST, MAKE_NOP)
 MAKE_BROADCASTS(Neg, MAKE_UN_BROADCAST, MAKE_NOP)
 MAKE_BROADCASTS(Not, MAKE_UN_BROADCAST, MAKE_NOP)
 
+#endif  // REMILL_VECTOR_SEMANTICS
+
 #undef MAKE_BIN_BROADCAST
 #undef MAKE_UN_BROADCAST
 
@@ -328,6 +328,33 @@ struct RegisterWindow {
   RegisterWindow *prev_window;
 };
 
+// Number of register windows in the register window bank.
+static constexpr unsigned kNumRegisterWindows = 8;
+
+struct WindowReg final {
+  volatile addr_t _0;
+  Reg reg;
+} __attribute__((packed));
+
+static_assert(16 == sizeof(WindowReg), "Invalid packing of `WindowReg`.");
+
+// The in and local registers of every register window, used in place of the
+// windowed registers of `GPR` when the semantics are built with
+// `REMILL_SPARC_WINDOW_BANK`. Counting the registers of a window as `i0-i7`,
+// `l0-l7`, then `o0-o7`, like in `GPR`, register `j` of window `w` is
+// `regs[(w * 16 + j) % 128]`. This makes the out registers of one window the
+// in registers of the next.
+//
+// With the bank, lifted code neither reads nor writes `gpr.i0` through
+// `gpr.o7`, so they go stale. Code that sets up or inspects a `State` has to
+// use the registers of window `psr.cwp` in `window_bank` instead.
+struct WindowBank final {
+  WindowReg regs[kNumRegisterWindows * 16];
+} __attribute__((packed));
+
+static_assert((kNumRegisterWindows * 16 * 16) == sizeof(WindowBank),
+              "Invalid packing of `WindowBank`.");
+
 struct alignas(16) SPARC64State : public ArchState {
   FPURegs fpreg;  // 512 bytes
   volatile uint64_t _0;
@@ -345,6 +372,9 @@ struct alignas(16) SPARC64State : public ArchState {
   volatile uint64_t _6;
   Reg next_pc;  // 8 bytes
   volatile uint64_t _7;
+#if defined(REMILL_SPARC_WINDOW_BANK)
+  WindowBank window_bank;  // 2048 bytes
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
 
   // NOTE(pag): This *must* go at the end, as if we change the target arch/data
   //            layout, then we want to make sure that the offset of this
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/BC/InstructionLifter.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace remill {
+
+// Thread-safe registry of statistics about decoding and lifting, e.g. how
+// often each ISEL fails to lift, and how long decoding and lifting take.
+//
+// Statistics are only collected once a registry is attached to an `Arch` with
+// `Arch::SetStatistics`; until then, decoders and lifters only pay for a null
+// pointer check.
+class LiftingStatistics {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  LiftingStatistics(void);
+  ~LiftingStatistics(void);
+
+  // Record the decoding of one instruction, which started at `start`.
+  void RecordDecode(bool decoded, Clock::time_point start);
+
+  // Record the lifting of one instruction, whose semantics are implemented by
+  // `isel`, which started at `start`.
+  void RecordLift(std::string_view isel, LiftStatus status,
+                  Clock::time_point start);
+
+  // Record the application of a SLEIGH `claim_eq` user operation.
+  void RecordEqualityClaim(void);
+
+  // Forget everything that has been recorded so far.
+  void Reset(void);
+
+  // Export the statistics as a JSON object.
+  std::string ToJSON(void) const;
+
+  // Export the statistics in the Prometheus text exposition format. Every
+  // metric name is prefixed with `prefix`.
+  std::string ToPrometheus(std::string_view prefix = "remill") const;
+
+ private:
+  LiftingStatistics(const LiftingStatistics &) = delete;
+  LiftingStatistics(LiftingStatistics &&) noexcept = delete;
+
+  class Impl;
+
+  const std::unique_ptr<Impl> impl;
+};
+
+// Returns a human-readable name for `status`, e.g. `unsupported`.
+std::string_view LiftStatusName(LiftStatus status);
+
+}  // namespace remill
@@ -42,4 +42,20 @@ extern const std::string_view kInvalidInstructionISelName;
 extern const std::string_view kUnsupportedInstructionISelName;
 extern const std::string_view kIgnoreNextPCVariableName;
 
+// Name of the x86 semantics variable that tells us whether `ST(i)` register
+// operands are indexed relative to `TOP`.
+extern const std::string_view kX87RotatingStackVariableName;
+
+// Name of the metadata on lifted x87 instruction calls that tells us how the
+// instruction changes `TOP`.
+extern const std::string_view kX87TopAdjustmentMetadataName;
+
+// Name of the SPARC semantics variable that tells us whether the windowed
+// registers live in a bank of register windows indexed by `CWP`.
+extern const std::string_view kSPARCWindowBankVariableName;
+
+// Name of the metadata on lifted SPARC instruction calls that tells us how the
+// instruction changes `CWP`.
+extern const std::string_view kSPARCWindowAdjustmentMetadataName;
+
 }  // namespace remill
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <llvm/Support/CodeGen.h>
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+}  // namespace llvm
+namespace remill {
+
+struct CompileOptions {
+  // Number of partitions into which the module is split. Each partition is
+  // compiled on its own thread into its own object file. Zero means one
+  // partition per hardware thread.
+  unsigned num_partitions{0};
+
+  // Target CPU and features. An empty `cpu` means the host CPU when compiling
+  // for the host's architecture, and a generic CPU otherwise.
+  std::string cpu;
+  std::string features;
+
+  llvm::CodeGenOpt::Level opt_level{llvm::CodeGenOpt::Default};
+};
+
+// Wall-clock time, in seconds, spent in each stage of `CompileModule`.
+struct CompileStatistics {
+  double split_seconds{0};
+  double codegen_seconds{0};
+  size_t num_partitions{0};
+  size_t num_functions{0};
+  size_t num_object_bytes{0};
+};
+
+// Compile `module`, e.g. lifted traces that have been optimized with
+// `OptimizeModule` and moved out of the semantics module, into relocatable
+// object files for the module's target triple. The module is split into
+// `options.num_partitions` partitions that are compiled in parallel, each in
+// its own `LLVMContext`, and the contents of one object file per partition
+// are returned. References to Remill's runtime intrinsics are left
+// undefined, to be resolved by linking against a runtime that implements
+// them. The module's data layout is kept if it has one. A module without a
+// triple is compiled for the host.
+//
+// NOTE: Every target that LLVM was built with is initialized, so programs that
+//       call this must link against LLVM's `all-targets` component, as
+//       `remill-compile` does.
+std::optional<std::vector<std::string>>
+CompileModule(const llvm::Module &module, const CompileOptions &options,
+              CompileStatistics *stats = nullptr);
+
+}  // namespace remill
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace remill {
+
+// A memory-mapped ELF file, out of which code is read directly.
+//
+// Only bytes in loadable segments with execute permission are readable as
+// code. Those bytes, and bytes in loadable segments without write permission,
+// e.g. jump tables in `.rodata`, are readable as data. The entry point and the
+// addresses of every defined function symbol (from both the static and
+// dynamic symbol tables) that lies within an executable segment are available
+// as trace heads, so that a whole binary can be lifted by lifting each of
+// `TraceHeads`. For 32-bit ARM, the Thumb bit of the entry point and of
+// function symbols is cleared, and is instead reported by `IsThumb`.
+class ElfImage {
+ public:
+  ~ElfImage(void);
+
+  // Map the ELF file at `path`. If the file can't be read or parsed, then an
+  // error is logged and `IsValid` returns `false`.
+  explicit ElfImage(const std::string &path);
+
+  // Returns `true` if the ELF file was successfully mapped and parsed.
+  bool IsValid(void) const;
+
+  // Returns the `e_machine` field of the ELF header, e.g. `EM_X86_64`.
+  uint16_t Machine(void) const;
+
+  // Returns `true` if the ELF file is little-endian.
+  bool IsLittleEndian(void) const;
+
+  // Returns the entry point of the ELF file.
+  uint64_t EntryPoint(void) const;
+
+  // Returns the sorted, unique addresses of the entry point and all function
+  // symbols that fall within executable segments.
+  const std::vector<uint64_t> &TraceHeads(void) const;
+
+  // Returns `true` if the trace head at `addr` is Thumb code, i.e. if the
+  // Thumb bit of its symbol or of the entry point was set.
+  bool IsThumb(uint64_t addr) const;
+
+  // Read a byte out of an executable segment.
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte);
+
+  // Read a byte out of an executable or non-writable segment.
+  bool TryReadDataByte(uint64_t addr, uint8_t *byte);
+
+ private:
+  ElfImage(void) = delete;
+
+  class Impl;
+
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace remill
@@ -38,6 +38,7 @@ namespace remill {
 class Arch;
 class Instruction;
 class IntrinsicTable;
+class LiftingStatistics;
 class Operand;
 class OperandExpression;
 class TraceLifter;
@@ -125,6 +126,10 @@ class InstructionLifter : public InstructionLifterIntf {
 
   virtual llvm::Type *GetMemoryType() override final;
 
+  // Returns the statistics being collected by the architecture, or `nullptr`
+  // if none are.
+  LiftingStatistics *Statistics(void) const;
+
  protected:
   // Lift an operand to an instruction.
   virtual llvm::Value *LiftOperand(Instruction &inst, llvm::BasicBlock *block,
@@ -185,6 +190,9 @@ class InstructionLifter : public InstructionLifterIntf {
   InstructionLifter(InstructionLifter &&) noexcept = delete;
   InstructionLifter(void) = delete;
 
+  LiftStatus LiftIntoBlockImpl(Instruction &inst, llvm::BasicBlock *block,
+                               llvm::Value *state_ptr, bool is_delayed);
+
   class Impl;
 
   const std::unique_ptr<Impl> impl;
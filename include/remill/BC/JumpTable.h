@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace remill {
+
+class Arch;
+class Instruction;
+class TraceManager;
+
+// A table of code addresses, indexed by a bounded value, that an indirect
+// jump dispatches through, e.g. as emitted by compilers for `switch`
+// statements.
+struct JumpTable {
+
+  // Address and size, in bytes, of the first entry of the table.
+  uint64_t table_addr{0};
+  uint64_t entry_size{0};
+
+  // Target of each entry of the table, in order. Many entries may share the
+  // same target.
+  std::vector<uint64_t> targets;
+};
+
+// Recognize a jump table used by the indirect jump `insts.back()`. `insts`
+// are the instructions that execute, in order, on a straight-line path to
+// the jump, e.g. from the start of its basic block. They must include the
+// comparison and conditional branch that bound the table index.
+//
+// This recognizes bounded, indexed loads from tables of absolute addresses,
+// or of offsets from a base address, as emitted for x86-64 and AArch64:
+//
+//      cmp   edi, 5                      cmp   w0, #5
+//      ja    default                     b.hi  default
+//      lea   rdx, [rip + table]          adrp  x1, table
+//      movsxd rax, [rdx + rdi * 4]       add   x1, x1, :lo12:table
+//      add   rax, rdx                    ldrb  w2, [x1, w0, uxtw]
+//      jmp   rax                         adr   x3, base
+//                                        add   x2, x3, w2, sxtb #2
+//                                        br    x2
+//
+// Entries are read with `TraceManager::TryReadDataByte`, and every target must
+// be executable. Returns `std::nullopt` if no jump table is recognized.
+//
+// NOTE: The targets are only a hint, e.g. for a `switch` on the target of the
+//       jump, whose default case must still handle any other target.
+std::optional<JumpTable>
+RecoverJumpTable(const Arch *arch, TraceManager &manager,
+                 const std::vector<const Instruction *> &insts);
+
+}  // namespace remill
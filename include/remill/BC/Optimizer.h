@@ -46,6 +46,20 @@ struct OptimizationGuide {
   bool loop_vectorize;
   bool verify_input;
   bool verify_output;
+
+  // Remove stores into `State` that are overwritten before being read, both
+  // within and across the lifted traces.
+  bool eliminate_dead_stores;
+
+  // Keep the registers of `State` in SSA values within each lifted trace.
+  bool scalarize_state;
+
+  // Merge adjacent narrow reads and writes of memory into wider ones.
+  bool coalesce_memory_accesses;
+
+  // Keep the stack frame of each lifted trace in a local variable. This
+  // needs `scalarize_state`.
+  bool recover_stack_frames;
 };
 
 template <typename T>
@@ -56,6 +70,13 @@ OptimizeModule(const std::unique_ptr<const remill::Arch> &arch,
   return OptimizeModule(arch.get(), module.get(), generator, guide);
 }
 
+// Optimize the lifted traces produced by `generator`. Calls in the traces are
+// inlined, and then the passes selected by `guide` are run over them. Other
+// functions of `module`, e.g. the semantics, or traces that aren't produced by
+// `generator`, are left alone, so this can be restricted to the hot traces of
+// a profile (see `SelectHotTraces`). The traces that are left alone still
+// call the semantics, so `InlineInternalCalls` must be applied to them before
+// they can be moved out of `module`.
 void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
                     std::function<llvm::Function *(void)> generator,
                     OptimizationGuide guide = {});
@@ -164,6 +185,70 @@ inline static void OptimizeModule(const remill::Arch *arch,
   return OptimizeModule(arch, module, trace_func_gen, guide);
 }
 
+// Keep the registers of `State` that are accessed by each of the lifted
+// `traces` in local variables, which are then promoted to SSA values. Each
+// register is loaded on entry to the trace, and is only written back to
+// `State` around instructions that can observe `State`, e.g. calls to
+// `__remill_function_call` or to hyper calls, and on return. Returns the
+// number of scalarized traces.
+size_t ScalarizeState(const Arch *arch, llvm::Module *module,
+                      const std::vector<llvm::Function *> &traces);
+
+// Remove stores into the `State` structure of the lifted `traces` whose values
+// are always overwritten before being read, whether in the same trace or in a
+// trace that it calls or tail-calls. Liveness is tracked per top-level
+// register, so a write to a sub-register (e.g. `AL`) only kills its enclosing
+// register (`RAX`) if it covers all of it. Calls to anything other than one of
+// `traces`, such as `__remill_jump`, conservatively read every register.
+// Returns the number of removed stores.
+size_t RemoveDeadStateStores(const Arch *arch, llvm::Module *module,
+                             const std::vector<llvm::Function *> &traces);
+
+// Move the stack frame of each of the lifted `traces` out of memory and into
+// an `alloca`, which is then promoted to SSA values. The frame is the memory
+// below the stack pointer on entry to the trace that is accessed by memory
+// intrinsics at constant offsets from that stack pointer. This only handles
+// traces whose stack pointer is kept in an SSA value (see `ScalarizeState`),
+// and that don't let the frame escape, i.e. whose stack pointer is only moved
+// by constants, is only used to address memory, and isn't visible to any call
+// other than the one that leaves the trace. The frame is read from memory on
+// entry, where that's observable, and the part of it that is still live is
+// written back to memory on exit. Returns the number of traces whose frames
+// were recovered.
+size_t RecoverStackFrames(const Arch *arch, llvm::Module *module,
+                          const std::vector<llvm::Function *> &traces);
+
+// Merge runs of calls to the integer memory intrinsics (e.g.
+// `__remill_read_memory_8`) in the lifted `traces` that access contiguous
+// bytes into single calls to wider intrinsics, whose values are split or
+// assembled according to `Arch::MemoryAccessIsLittleEndian`. Reads are merged
+// if they use the same `Memory *`, and writes are merged if they are part of
+// one chain of writes, where each write uses the `Memory *` returned by the
+// previous one, and nothing else does. Addresses must be the same value plus
+// different constants, and accesses must be in the same block. Returns the
+// number of removed calls.
+size_t CoalesceMemoryAccesses(const Arch *arch, llvm::Module *module,
+                              const std::vector<llvm::Function *> &traces);
+
+// Point the `ST(i)` register operands that the x87 instructions of `trace`
+// pass to their semantics at fixed registers. This only does something if the
+// semantics were built with `REMILL_X87_ROTATING_STACK`. Before the first x87
+// instruction, the register file is rotated so that `TOP` is zero, and from
+// then on `TOP` is moved along using how each lifted instruction pushes or
+// pops the stack. The rotation is undone before anything that may observe
+// `TOP`, e.g. `FNSTSW`, calls, and returns, so it isn't visible outside of the
+// trace. Returns the number of resolved operands.
+size_t ResolveX87StackOperands(const Arch *arch, llvm::Function *trace);
+
+// Point the loads, stores, and semantics operands of the SPARC windowed
+// registers (`%i0-%i7`, `%l0-%l7`, and `%o0-%o7`) in `trace` at the registers
+// of the current window in the register window bank. This only does something
+// if the semantics were built with `REMILL_SPARC_WINDOW_BANK`. `CWP` is only
+// read from the `State` structure on entry to the trace, after calls, and at
+// loop heads. Afterwards, the windowed registers of `State::gpr` are neither
+// read nor written by `trace`. Returns the number of resolved operands.
+size_t ResolveSPARCWindowOperands(const Arch *arch, llvm::Function *trace);
+
 // Optimize a normal module. This might not contain special Remill-specific
 // intrinsics functions like `__remill_jump`, etc.
 void OptimizeBareModule(llvm::Module *module, OptimizationGuide guide = {});
@@ -22,6 +22,7 @@
 #include <map>
 #include <mutex>
 #include <sleigh/libsleigh.hh>
+#include <string>
 #include <variant>
 #include <vector>
 
@@ -69,6 +70,13 @@ class PcodeCFG {
 
 PcodeCFG CreateCFG(const std::vector<RemillPcodeOp> &linear_ops);
 
+// Simplifies the p-code of one instruction before it is lifted: propagates
+// constants and copies within each block, folds `claim_eq` claims whose value
+// is a constant, and removes ops writing unique and register varnodes that
+// are never read. Moves `btaken` along with the `CBRANCH` that it belongs to.
+void OptimizeCFG(PcodeCFG &cfg, MaybeBranchTakenVar &btaken,
+                 const std::vector<std::string> &user_op_names);
+
 class PcodeCFGBuilder {
  public:
   explicit PcodeCFGBuilder(const std::vector<RemillPcodeOp> &linear_ops);
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// Instrumentation that `TraceLifter` can add to lifted traces, e.g. to find
+// out which traces are hot when emulating.
+struct TraceInstrumentation {
+  enum CounterKind {
+    kNoCounters,
+
+    // One counter per trace, incremented upon entry to the trace.
+    kTraceCounters,
+
+    // One counter per basic block, incremented upon entry to the block.
+    kBlockCounters
+  };
+
+  // Atomically increment a 64-bit counter in the array named
+  // `kTraceCountersName`. The address associated with each counter index is
+  // available from `TraceLifter::CounterAddresses`.
+  CounterKind counters{kNoCounters};
+
+  // Call `void kTracePCHookName(addr_t pc)` before the semantics of each
+  // lifted instruction, e.g. to record recently executed program counters in
+  // a ring buffer.
+  bool trace_pcs{false};
+
+  inline bool IsEnabled(void) const {
+    return counters != kNoCounters || trace_pcs;
+  }
+};
+
+// Array of `uint64_t` counters incremented by instrumented traces.
+extern const std::string_view kTraceCountersName;
+
+// Array of the `uint64_t` address associated with each counter, and the
+// `uint64_t` number of counters, as defined by `DefineTraceCounters`.
+extern const std::string_view kTraceCounterAddressesName;
+extern const std::string_view kNumTraceCountersName;
+
+// Hook called with the program counter of each instruction.
+extern const std::string_view kTracePCHookName;
+
+// Define the counter arrays referenced by instrumented traces in `module`,
+// given the address associated with each counter. A runtime can then pass
+// these arrays to `WriteProfile`.
+void DefineTraceCounters(llvm::Module *module,
+                         const std::vector<uint64_t> &addresses);
+
+// Maps addresses to execution counts.
+using Profile = std::unordered_map<uint64_t, uint64_t>;
+
+// Write out a profile of `num_counters` counters, one address and count per
+// line. Counters sharing an address are summed.
+bool WriteProfile(const std::filesystem::path &path,
+                  const uint64_t *addresses, const uint64_t *counters,
+                  size_t num_counters);
+
+std::optional<Profile> ReadProfile(const std::filesystem::path &path);
+
+// Returns the hottest of `traces`, i.e. the smallest set of traces that
+// together account for at least `fraction` of the executions in `profile`,
+// in order of decreasing hotness. The result can be passed to
+// `OptimizeModule` to focus optimization on hot code.
+std::vector<llvm::Function *>
+SelectHotTraces(const std::unordered_map<uint64_t, llvm::Function *> &traces,
+                const Profile &profile, double fraction);
+
+}  // namespace remill
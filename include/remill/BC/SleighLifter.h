@@ -20,6 +20,9 @@
 #include <llvm/IR/IRBuilder.h>
 
 #include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
 #include <sleigh/libsleigh.hh>
 
 #include "remill/Arch/Instruction.h"
@@ -40,6 +43,7 @@ using MaybeBranchTakenVar = std::optional<BranchTakenVar>;
 
 class SleighDecoder;
 class SingleInstructionSleighContext;
+struct RemillPcodeOp;
 }  // namespace sleigh
 
 
@@ -75,6 +79,15 @@ class SleighLifter : public InstructionLifter {
   llvm::Function *DefineInstructionFunction(Instruction &inst,
                                             llvm::Module *target_mod);
 
+  // Returns the name under which the instruction function for `inst` can be
+  // shared by every instruction with the same bytes, context, and branch
+  // taken variable. Only meaningful if the p-code of `inst` doesn't depend on
+  // its address.
+  static std::string
+  SharedInstructionFunctionName(const Instruction &inst,
+                                const sleigh::MaybeBranchTakenVar &btaken,
+                                const ContextValues &context_values);
+
   std::pair<LiftStatus, std::optional<llvm::Function *>>
   LiftIntoInternalBlockWithSleighState(
       Instruction &inst, llvm::Module *target_mod, bool is_delayed,
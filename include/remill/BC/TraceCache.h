@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+class DecodingContext;
+class TraceManager;
+
+// Snapshot of the counters maintained by a `TraceCache`.
+struct TraceCacheStatistics {
+  uint64_t num_lookups{0};
+  uint64_t num_hits{0};
+
+  // Lookups for which no entry existed.
+  uint64_t num_misses{0};
+
+  // Lookups for which an entry existed, but where the bytes of the trace
+  // no longer match what the `TraceManager` reports.
+  uint64_t num_stale{0};
+
+  uint64_t num_stores{0};
+  uint64_t num_failed_stores{0};
+  uint64_t num_evictions{0};
+
+  // Approximate number of bytes currently used by the cache on disk.
+  uint64_t num_bytes_on_disk{0};
+
+  inline double HitRate(void) const {
+    return num_lookups ? static_cast<double>(num_hits) / num_lookups : 0.0;
+  }
+};
+
+// Persistent, content-addressed cache of lifted traces.
+//
+// Entries are keyed on the architecture, OS, a hash of the semantics module,
+// the trace head address, and the decoding context. Each entry records the
+// bytes of every instruction that went into the trace, so that a lookup only
+// hits if the `TraceManager` still reports the same bytes.
+//
+// Traces are stored as bitcode with their semantics already inlined, so that
+// they are independent of the (internal) semantics functions of any one
+// module. Entries are written atomically (write to a temporary file, then
+// rename), so multiple threads and processes can share one cache directory.
+class TraceCache {
+ public:
+  ~TraceCache(void);
+
+  // `semantics` is the module returned by `LoadArchSemantics`, which is
+  // hashed to form part of every key. If `max_size_bytes` is non-zero then
+  // least recently used entries are evicted to keep the cache below that
+  // size.
+  TraceCache(const Arch *arch, llvm::Module *semantics,
+             std::filesystem::path cache_dir, uint64_t max_size_bytes = 0);
+
+  // Try to materialize the trace starting at `addr` into `module`. On a hit,
+  // the returned function is named `trace_name`, replaces any declaration of
+  // that name in `module`, and `called_traces` is filled with the addresses
+  // of traces directly called by the cached trace. If `byte_ranges` is
+  // non-null, then it is filled with the `(address, size)` ranges of bytes
+  // that the trace was lifted from. Returns `nullptr` on a miss.
+  llvm::Function *
+  Load(uint64_t addr, const DecodingContext &context, TraceManager &manager,
+       llvm::Module *module, const std::string &trace_name,
+       std::vector<uint64_t> &called_traces,
+       std::vector<std::pair<uint64_t, uint64_t>> *byte_ranges = nullptr);
+
+  // Store the just-lifted trace `func` starting at `addr`. `trace_bytes` maps
+  // the address of every instruction in the trace to the bytes that were
+  // decoded there. Returns `true` if the entry was written.
+  bool Store(uint64_t addr, const DecodingContext &context,
+             const std::map<uint64_t, std::string> &trace_bytes,
+             llvm::Function *func, const std::vector<uint64_t> &called_traces);
+
+  // Return a snapshot of the hit/miss counters.
+  TraceCacheStatistics Statistics(void) const;
+
+ private:
+  TraceCache(void) = delete;
+
+  class Impl;
+
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace remill
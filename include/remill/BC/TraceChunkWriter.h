@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/BC/Optimizer.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// Streams lifted traces out of the module into which they were lifted, so
+// that peak memory usage is bounded by the size of a chunk rather than by
+// the size of the whole program.
+//
+// Each trace passed to `AddTrace` has its semantics inlined and is then moved
+// into the current chunk module, leaving behind a declaration in the lifting
+// module. Once a chunk holds `traces_per_chunk` traces, it is optimized,
+// written to `out_dir` as `chunk_N.bc`, and freed. Chunks keep declarations
+// of the traces and intrinsics that they reference, so that they can be
+// linked together or loaded lazily. An `index.txt` file in `out_dir` maps
+// each trace address and name to the chunk holding its definition.
+//
+// A typical use is to call `AddTrace` from the callback passed to
+// `TraceLifter::Lift`. Chunks are only written when the next trace is added,
+// or upon `Flush`, so the function passed to `AddTrace` remains valid until
+// the `TraceManager` has been told about it.
+class TraceChunkWriter {
+ public:
+  ~TraceChunkWriter(void);
+
+  TraceChunkWriter(const Arch *arch, std::filesystem::path out_dir,
+                   size_t traces_per_chunk, OptimizationGuide guide = {});
+
+  // Move `func`, the lifted trace for `addr`, into the current chunk. Returns
+  // `false` if the trace could not be made independent of the semantics, in
+  // which case it is left where it is.
+  bool AddTrace(uint64_t addr, llvm::Function *func);
+
+  // Optimize and write out the current chunk, if it is non-empty.
+  bool Flush(void);
+
+  // Paths of all chunks written so far.
+  const std::vector<std::filesystem::path> &ChunkPaths(void) const;
+
+ private:
+  TraceChunkWriter(void) = delete;
+
+  class Impl;
+
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace remill
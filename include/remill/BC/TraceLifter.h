@@ -17,12 +17,16 @@
 #pragma once
 
 #include <remill/BC/Lifter.h>
+#include <remill/BC/Profile.h>
 
 #include <functional>
 #include <unordered_map>
+#include <vector>
 
 namespace remill {
 
+class TraceCache;
+
 using TraceMap = std::unordered_map<uint64_t, llvm::Function *>;
 
 enum class DevirtualizedTargetKind { kTraceLocal, kTraceHead };
@@ -79,6 +83,14 @@ class TraceManager {
   // at address `addr` is executable and readable, and updates the byte
   // pointed to by `byte` with the read value.
   virtual bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) = 0;
+
+  // Try to read a byte of read-only data, e.g. an entry of a jump table.
+  // Returns `true` if the byte at address `addr` is readable and not expected
+  // to change, and updates the byte pointed to by `byte` with the read value.
+  // This must succeed for every byte that `TryReadExecutableByte` can read.
+  //
+  // By default, only executable bytes are readable as data.
+  virtual bool TryReadDataByte(uint64_t addr, uint8_t *byte);
 };
 
 // Implements a recursive decoder that lifts a trace of instructions to bitcode.
@@ -86,10 +98,17 @@ class TraceLifter {
  public:
   ~TraceLifter(void);
 
-  inline TraceLifter(const Arch *arch_, TraceManager &manager_)
-      : TraceLifter(arch_, &manager_) {}
+  inline TraceLifter(const Arch *arch_, TraceManager &manager_,
+                     TraceCache *cache_ = nullptr,
+                     TraceInstrumentation instrumentation_ = {})
+      : TraceLifter(arch_, &manager_, cache_, instrumentation_) {}
 
-  TraceLifter(const Arch *arch_, TraceManager *manager_);
+  // If `cache_` is non-null, then it is consulted before decoding each trace,
+  // and every newly lifted trace is stored into it. The cache is bypassed if
+  // `instrumentation_` is enabled, as cached traces are uninstrumented.
+  TraceLifter(const Arch *arch_, TraceManager *manager_,
+              TraceCache *cache_ = nullptr,
+              TraceInstrumentation instrumentation_ = {});
 
   static void NullCallback(uint64_t, llvm::Function *);
 
@@ -99,6 +118,35 @@ class TraceLifter {
   Lift(uint64_t addr,
        std::function<void(uint64_t, llvm::Function *)> callback = NullCallback);
 
+  // Tell the lifter that the bytes in `[begin, end)` have changed, e.g.
+  // because the code is self-modifying or JIT-compiled. Every trace lifted by
+  // this lifter from any of those bytes is lifted again into the same
+  // function, so that calls to it from other traces stay valid. Calls
+  // `callback` with each re-lifted trace, and with any newly lifted traces
+  // that they call. Returns the number of re-lifted traces.
+  //
+  // NOTE: Copies of the old traces that were inlined into other traces, e.g.
+  //       by `OptimizeModule`, are not updated.
+  size_t Relift(
+      uint64_t begin, uint64_t end,
+      std::function<void(uint64_t, llvm::Function *)> callback = NullCallback);
+
+  // Returns the addresses of the traces lifted by this lifter from any of the
+  // bytes in `[begin, end)`.
+  std::vector<uint64_t> TracesUsingBytes(uint64_t begin, uint64_t end) const;
+
+  // Lift indirect jumps into `switch` instructions over the targets from
+  // `TraceManager::ForEachDevirtualizedTarget`, or, if the manager doesn't
+  // devirtualize a jump, over the entries of the jump table recognized by
+  // `RecoverJumpTable`. This is disabled by default, and then every indirect
+  // jump is a tail call to `__remill_jump`.
+  void SetRecoverJumpTables(bool enable);
+
+  // Returns the address of the trace or block associated with each counter
+  // of the instrumented traces lifted so far, indexed by counter. This can be
+  // passed to `DefineTraceCounters` once lifting is done.
+  const std::vector<uint64_t> &CounterAddresses(void) const;
+
  private:
   TraceLifter(void) = delete;
 
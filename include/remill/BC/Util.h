@@ -184,6 +184,16 @@ std::unique_ptr<llvm::Module>
 LoadArchSemantics(const Arch *arch,
                   const std::vector<std::filesystem::path> &sem_dirs);
 
+// Returns `true` if the x86 semantics in `module` were built with
+// `REMILL_X87_ROTATING_STACK`, i.e. if `State::st` holds the physical x87
+// registers and `ST(i)` is the register that is `i` slots past `TOP`.
+bool HasRotatingX87Stack(const llvm::Module *module);
+
+// Returns `true` if the SPARC semantics in `module` were built with
+// `REMILL_SPARC_WINDOW_BANK`, i.e. if the in, local, and out registers of the
+// current window are found in the register window bank using `CWP`.
+bool HasSPARCWindowBank(const llvm::Module *module);
+
 // Store an LLVM module into a file.
 bool StoreModuleToFile(llvm::Module *module, std::string_view file_name,
                        bool allow_failure = false);
@@ -254,8 +264,19 @@ std::string ModuleName(const std::unique_ptr<llvm::Module> &module);
 unsigned ReplaceAllUsesOfConstant(llvm::Constant *old_c, llvm::Constant *new_c,
                                   llvm::Module *module);
 
-// Move a function from one module into another module.
-void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module);
+// Move a function from one module into another module, and return the moved
+// function. If the modules belong to different `llvm::LLVMContext`s, then the
+// returned function is a clone of `func` in the context of `dest_module`, and
+// `func` itself is deleted. Either way, `func` is replaced by a declaration in
+// its original module.
+llvm::Function *MoveFunctionIntoModule(llvm::Function *func,
+                                       llvm::Module *dest_module);
+
+// Inline every call from `func` to a function with internal linkage, e.g. the
+// semantics functions of instructions. This makes `func` movable into a module
+// that doesn't contain the semantics. Returns `false` if some call could not
+// be inlined.
+bool InlineInternalCalls(llvm::Function *func);
 
 // Get an instance of `type` that belongs to `context`.
 llvm::Type *RecontextualizeType(llvm::Type *type, llvm::LLVMContext &context);
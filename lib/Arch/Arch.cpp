@@ -36,7 +36,9 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "remill/Arch/ArchDescription.h"
 #include "remill/Arch/Name.h"
+#include "remill/Arch/Statistics.h"
 #include "remill/BC/ABI.h"
 #include "remill/BC/Util.h"
 #include "remill/BC/Version.h"
@@ -84,11 +86,19 @@ ArchBase::ArchBase(llvm::LLVMContext *context_, OSName os_name_,
 
 Arch::~Arch(void) {}
 
+void Arch::SetStatistics(std::shared_ptr<LiftingStatistics> stats) const {
+  statistics = std::move(stats);
+}
+
 // Returns `true` if memory access are little endian byte ordered.
 bool Arch::MemoryAccessIsLittleEndian(void) const {
   return true;
 }
 
+bool Arch::RestoreInstructionLifter(Instruction &) const {
+  return false;
+}
+
 // Returns `true` if a given instruction might have a delay slot.
 bool Arch::MayHaveDelaySlot(const Instruction &) const {
   return false;
@@ -257,7 +267,11 @@ auto Arch::Build(llvm::LLVMContext *context_, OSName os_name_,
                  ArchName arch_name_) -> ArchPtr {
   ArchPtr ret = Arch::GetArchByName(context_, os_name_, arch_name_);
   if (ret) {
-    ret->PopulateRegisterTable();
+
+    // Only the first `Arch` of each kind populates its register table; the
+    // rest bind the description shared by all contexts.
+    ret->description = ArchDescription::Describe(*ret);
+    ret->BindRegisterTable(*ret->description);
   }
 
   return ret;
@@ -465,9 +479,15 @@ static void AddNoAliasToArgument(llvm::Argument *arg) {
 Register::Register(const std::string &name_, uint64_t offset_,
                    llvm::Type *type_, const Register *parent_,
                    const Arch *arch_)
+    : Register(name_, offset_, arch_->DataLayout().getTypeAllocSize(type_),
+               type_, parent_, arch_) {}
+
+Register::Register(const std::string &name_, uint64_t offset_,
+                   uint64_t size_, llvm::Type *type_, const Register *parent_,
+                   const Arch *arch_)
     : name(name_),
       offset(offset_),
-      size(arch_->DataLayout().getTypeAllocSize(type_)),
+      size(size_),
       type(type_),
       constant_name(
           llvm::ConstantDataArray::getString(type->getContext(), name_)),
@@ -779,6 +799,17 @@ void Arch::PrepareModule(llvm::Module *mod) const {
   PrepareModuleDataLayout(mod);
 }
 
+void Arch::BindRegisterTable(const ArchDescription &desc) const {
+  for (const auto &info : desc.registers) {
+    const char *parent_name = nullptr;
+    if (info.parent != ArchDescription::kNoRegister) {
+      parent_name = desc.registers[info.parent].name.c_str();
+    }
+    AddRegister(info.name.c_str(), info.type.Get(*context), info.offset,
+                parent_name);
+  }
+}
+
 const Register *ArchBase::AddRegister(const char *reg_name_,
                                       llvm::Type *val_type, size_t offset,
                                       const char *parent_reg_name) const {
@@ -790,8 +821,6 @@ const Register *ArchBase::AddRegister(const char *reg_name_,
     return reg->second;
   }
 
-  const auto dl = this->DataLayout();
-
   // If this is a sub-register, then link it in.
   const Register *parent_reg = nullptr;
   if (parent_reg_name) {
@@ -839,6 +868,54 @@ const Register *ArchBase::AddRegister(const char *reg_name_,
   return reg_impl;
 }
 
+// Create the registers described by `desc` in our context. Unlike
+// `AddRegister`, this doesn't need to recompute register sizes or look up
+// enclosing registers by name.
+void ArchBase::BindRegisterTable(const ArchDescription &desc) const {
+
+  // This is the architecture whose register table was used to build `desc`.
+  if (!registers.empty()) {
+    return;
+  }
+
+  // Most registers share a handful of types.
+  std::vector<std::pair<ArchDescription::RegisterType, llvm::Type *>> types;
+  auto get_type = [&](const ArchDescription::RegisterType &desc_type) {
+    for (const auto &[known_desc_type, type] : types) {
+      if (known_desc_type == desc_type) {
+        return type;
+      }
+    }
+    auto type = desc_type.Get(*context);
+    types.emplace_back(desc_type, type);
+    return type;
+  };
+
+  registers.reserve(desc.registers.size());
+  reg_by_name.reserve(desc.registers.size());
+  for (const auto &info : desc.registers) {
+    const Register *parent_reg = nullptr;
+    if (info.parent != ArchDescription::kNoRegister) {
+      parent_reg = registers[info.parent].get();
+    }
+
+    auto reg_impl = new Register(info.name, info.offset, info.size,
+                                 get_type(info.type), parent_reg, this);
+    reg_by_name.emplace(info.name, reg_impl);
+    registers.emplace_back(reg_impl);
+  }
+
+  if (desc.reg_by_offset.size() > reg_by_offset.size()) {
+    reg_by_offset.resize(desc.reg_by_offset.size());
+  }
+  for (size_t i = 0; i < desc.reg_by_offset.size(); ++i) {
+    if (auto index = desc.reg_by_offset[i];
+        index != ArchDescription::kNoRegister) {
+      reg_by_offset[i] = registers[index].get();
+    }
+  }
+}
+
 // Get all of the register information from the prepared module.
 void ArchBase::InitFromSemanticsModule(llvm::Module *module) const {
   if (state_type) {
@@ -957,6 +1034,10 @@ bool DefaultContextAndLifter::DecodeInstruction(uint64_t address,
                                                 std::string_view instr_bytes,
                                                 Instruction &inst,
                                                 DecodingContext context) const {
+  const auto stats = this->Statistics();
+  const auto start = stats ? LiftingStatistics::Clock::now()
+                           : LiftingStatistics::Clock::time_point();
+
   inst.SetLifter(std::make_unique<remill::InstructionLifter>(
       this, this->GetInstrinsicTable()));
 
@@ -965,10 +1046,21 @@ bool DefaultContextAndLifter::DecodeInstruction(uint64_t address,
     inst.flows = this->FillInFlowFromCategoryAndDefaultContext(inst);
   }
 
+  if (stats) {
+    stats->RecordDecode(res, start);
+  }
+
   return res;
 }
 
 
+bool DefaultContextAndLifter::RestoreInstructionLifter(
+    Instruction &inst) const {
+  inst.SetLifter(std::make_unique<remill::InstructionLifter>(
+      this, this->GetInstrinsicTable()));
+  return true;
+}
+
 OperandLifter::OpLifterPtr DefaultContextAndLifter::DefaultLifter(
     const remill::IntrinsicTable &intrinsics) const {
   return std::make_shared<InstructionLifter>(this, intrinsics);
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/Arch/ArchDescription.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Type.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/OS.h"
+
+namespace remill {
+namespace {
+
+using DescriptionKey = std::pair<OSName, ArchName>;
+
+static std::mutex gDescriptionsLock;
+static std::map<DescriptionKey, std::shared_ptr<const ArchDescription>>
+    gDescriptions;
+
+}  // namespace
+
+std::optional<ArchDescription::RegisterType>
+ArchDescription::RegisterType::From(llvm::Type *type) {
+  RegisterType ret;
+  if (auto arr_type = llvm::dyn_cast<llvm::ArrayType>(type)) {
+    ret.shape = kArray;
+    ret.num_elements = arr_type->getNumElements();
+    type = arr_type->getElementType();
+
+  } else if (auto vec_type = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+    ret.shape = kVector;
+    ret.num_elements = vec_type->getNumElements();
+    type = vec_type->getElementType();
+  }
+
+  if (auto int_type = llvm::dyn_cast<llvm::IntegerType>(type)) {
+    ret.kind = kInteger;
+    ret.bits = int_type->getBitWidth();
+  } else if (type->isHalfTy()) {
+    ret.kind = kHalf;
+  } else if (type->isFloatTy()) {
+    ret.kind = kFloat;
+  } else if (type->isDoubleTy()) {
+    ret.kind = kDouble;
+  } else if (type->isX86_FP80Ty()) {
+    ret.kind = kX86FP80;
+  } else if (type->isFP128Ty()) {
+    ret.kind = kFP128;
+  } else {
+    return std::nullopt;
+  }
+
+  return ret;
+}
+
+llvm::Type *
+ArchDescription::RegisterType::Get(llvm::LLVMContext &context) const {
+  llvm::Type *elem_type = nullptr;
+  switch (kind) {
+    case kInteger: elem_type = llvm::IntegerType::get(context, bits); break;
+    case kHalf: elem_type = llvm::Type::getHalfTy(context); break;
+    case kFloat: elem_type = llvm::Type::getFloatTy(context); break;
+    case kDouble: elem_type = llvm::Type::getDoubleTy(context); break;
+    case kX86FP80: elem_type = llvm::Type::getX86_FP80Ty(context); break;
+    case kFP128: elem_type = llvm::Type::getFP128Ty(context); break;
+  }
+
+  switch (shape) {
+    case kScalar: return elem_type;
+    case kArray: return llvm::ArrayType::get(elem_type, num_elements);
+    case kVector:
+      return llvm::FixedVectorType::get(elem_type,
+                                        static_cast<unsigned>(num_elements));
+  }
+  return nullptr;
+}
+
+bool ArchDescription::RegisterType::operator==(
+    const RegisterType &that) const {
+  return kind == that.kind && shape == that.shape && bits == that.bits &&
+         num_elements == that.num_elements;
+}
+
+ArchDescription::ArchDescription(OSName os_name_, ArchName arch_name_,
+                                 std::vector<RegisterInfo> registers_,
+                                 std::vector<size_t> reg_by_offset_)
+    : os_name(os_name_),
+      arch_name(arch_name_),
+      registers(std::move(registers_)),
+      reg_by_offset(std::move(reg_by_offset_)) {
+  reg_by_name.reserve(registers.size());
+  for (size_t i = 0; i < registers.size(); ++i) {
+    reg_by_name.emplace(registers[i].name, i);
+  }
+}
+
+// Returns the index of the register named `name`, or `kNoRegister`.
+size_t ArchDescription::RegisterIndex(std::string_view name) const {
+  if (auto it = reg_by_name.find(name); it != reg_by_name.end()) {
+    return it->second;
+  }
+  return kNoRegister;
+}
+
+std::shared_ptr<const ArchDescription>
+ArchDescription::Get(OSName os_name, ArchName arch_name) {
+  {
+    std::lock_guard<std::mutex> locker(gDescriptionsLock);
+    if (auto it = gDescriptions.find({os_name, arch_name});
+        it != gDescriptions.end()) {
+      return it->second;
+    }
+  }
+
+  // Build a throwaway `Arch` to describe. The description outlives it, as
+  // it doesn't refer to anything in `context`.
+  llvm::LLVMContext context;
+  auto arch = Arch::Build(&context, os_name, arch_name);
+  if (!arch) {
+    return nullptr;
+  }
+  return arch->Description();
+}
+
+std::shared_ptr<const ArchDescription>
+ArchDescription::Describe(const Arch &arch) {
+  std::lock_guard<std::mutex> locker(gDescriptionsLock);
+  auto &desc = gDescriptions[{arch.os_name, arch.arch_name}];
+  if (desc) {
+    return desc;
+  }
+
+  DLOG(INFO) << "Describing registers of " << GetArchName(arch.arch_name)
+             << " on " << GetOSName(arch.os_name);
+
+  arch.PopulateRegisterTable();
+
+  std::vector<RegisterInfo> registers;
+  std::unordered_map<const Register *, size_t> reg_index;
+  arch.ForEachRegister([&](const Register *reg) {
+    auto type = RegisterType::From(reg->type);
+    CHECK(type.has_value())
+        << "Register " << reg->name << " has unsupported type "
+        << LLVMThingToString(reg->type);
+
+    auto parent = kNoRegister;
+    if (reg->parent) {
+      auto parent_it = reg_index.find(reg->parent);
+      CHECK(parent_it != reg_index.end())
+          << "Register " << reg->name << " was added before its parent "
+          << reg->parent->name;
+      parent = parent_it->second;
+    }
+
+    reg_index.emplace(reg, registers.size());
+    registers.push_back({reg->name, reg->offset, reg->size, *type, parent});
+  });
+
+  // Mirror `AddRegister`, where later registers take over the bytes of the
+  // registers that enclose them.
+  std::vector<size_t> reg_by_offset;
+  for (size_t i = 0; i < registers.size(); ++i) {
+    const auto &info = registers[i];
+    const auto end = info.offset + info.size;
+    if (end > reg_by_offset.size()) {
+      reg_by_offset.resize(end, kNoRegister);
+    }
+    std::fill(reg_by_offset.begin() + static_cast<ptrdiff_t>(info.offset),
+              reg_by_offset.begin() + static_cast<ptrdiff_t>(end), i);
+  }
+
+  desc.reset(new ArchDescription(arch.os_name, arch.arch_name,
+                                 std::move(registers),
+                                 std::move(reg_by_offset)));
+  return desc;
+}
+
+}  // namespace remill
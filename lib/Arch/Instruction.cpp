@@ -332,6 +332,8 @@ void Instruction::Reset(void) {
   has_branch_taken_delay_slot = false;
   has_branch_not_taken_delay_slot = false;
   in_delay_slot = false;
+  x87_top_adjustment = 0;
+  sparc_window_adjustment = 0;
   category = Instruction::kCategoryInvalid;
   arch = nullptr;
   operands.clear();
@@ -0,0 +1,750 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/Arch/InstructionEncoding.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/ArchDescription.h"
+#include "remill/Arch/Name.h"
+
+namespace remill {
+namespace {
+
+// "REMI", in little endian.
+static constexpr uint32_t kMagic = 0x494d4552u;
+
+// The encoding begins with a fixed-size header, so that these fields can be
+// read in place. All multi-byte header fields are little endian.
+enum HeaderOffset : size_t {
+  kMagicOffset = 0,  // `uint32_t`.
+  kVersionOffset = 4,  // `uint16_t`.
+  kFlagsOffset = 6,  // `uint16_t`, of `HeaderFlags`.
+  kSizeOffset = 8,  // `uint32_t`, of the whole encoding.
+  kCategoryOffset = 12,  // `uint8_t`.
+  kX87TopAdjustmentOffset = 13,  // `int8_t`.
+  kSPARCWindowAdjustmentOffset = 14,  // `int8_t`.
+  kArchNameOffset = 16,  // `uint32_t`.
+  kSubArchNameOffset = 20,  // `uint32_t`.
+  kBranchTakenArchNameOffset = 24,  // `uint32_t`.
+  kPCOffset = 28,  // `uint64_t`.
+  kNextPCOffset = 36,  // `uint64_t`.
+  kDelayedPCOffset = 44,  // `uint64_t`.
+  kBranchTakenPCOffset = 52,  // `uint64_t`.
+  kBranchNotTakenPCOffset = 60,  // `uint64_t`.
+  kHeaderSize = 68,
+};
+
+enum HeaderFlags : uint16_t {
+  kIsAtomicReadModifyWrite = 1u << 0,
+  kHasBranchTakenDelaySlot = 1u << 1,
+  kHasBranchNotTakenDelaySlot = 1u << 2,
+  kInDelaySlot = 1u << 3,
+  kHasBranchTakenArchName = 1u << 4,
+  kHasX87TopAdjustment = 1u << 5,
+};
+
+// The header is followed by variable-length sections, in order: the function
+// name, the bytes, the decoding context, the name of the segment override
+// register, the operand expressions, the operands, and the flows. Integers
+// in these sections are LEB128-encoded, and signed integers are zigzag-
+// encoded first. Strings are prefixed by their size.
+enum ExpressionKind : uint8_t {
+  kExpressionOp,
+  kExpressionRegister,
+  kExpressionConstant,
+  kExpressionVariable,
+};
+
+template <typename T>
+static void PutFixed(std::string &out, size_t offset, T val) {
+  const auto bits = static_cast<uint64_t>(val);
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out[offset + i] = static_cast<char>((bits >> (i * 8u)) & 0xffu);
+  }
+}
+
+template <typename T>
+static T GetFixed(std::string_view data, size_t offset) {
+  uint64_t bits = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    bits |= static_cast<uint64_t>(static_cast<uint8_t>(data[offset + i]))
+            << (i * 8u);
+  }
+  return static_cast<T>(bits);
+}
+
+class Writer {
+ public:
+  explicit Writer(std::string &out_) : out(out_) {}
+
+  void Byte(uint8_t val) {
+    out.push_back(static_cast<char>(val));
+  }
+
+  void Varint(uint64_t val) {
+    for (; val >= 0x80u; val >>= 7u) {
+      Byte(static_cast<uint8_t>(val | 0x80u));
+    }
+    Byte(static_cast<uint8_t>(val));
+  }
+
+  void SignedVarint(int64_t val) {
+    Varint((static_cast<uint64_t>(val) << 1u) ^
+           static_cast<uint64_t>(val >> 63));
+  }
+
+  void String(std::string_view val) {
+    Varint(val.size());
+    out.append(val.data(), val.size());
+  }
+
+  void Context(const DecodingContext &context) {
+    const auto &values = context.GetContextValues();
+    Varint(values.size());
+    for (const auto &[reg_name, val] : values) {
+      String(reg_name);
+      Varint(val);
+    }
+  }
+
+  void Register(const Operand::Register &reg) {
+    String(reg.name);
+    Varint(reg.size);
+  }
+
+  void Type(const ArchDescription::RegisterType &type) {
+    Byte(type.kind);
+    Byte(type.shape);
+    Varint(type.bits);
+    Varint(type.num_elements);
+  }
+
+  void Flow(const Instruction::DirectFlow &flow) {
+    Varint(flow.known_target);
+    Context(flow.static_context);
+  }
+
+  void Flow(const Instruction::IndirectFlow &flow) {
+    Byte(flow.maybe_context.has_value());
+    if (flow.maybe_context) {
+      Context(*flow.maybe_context);
+    }
+  }
+
+  void AbnormalFlow(const Instruction::AbnormalFlow &flow) {
+    Byte(static_cast<uint8_t>(flow.index()));
+    std::visit(
+        [this](const auto &taken) {
+          using T = std::decay_t<decltype(taken)>;
+          if constexpr (!std::is_same_v<T, Instruction::AsyncHyperCall>) {
+            Flow(taken.taken_flow);
+          }
+        },
+        flow);
+  }
+
+  void Flows(const Instruction::InstructionFlowCategory &flows) {
+    Byte(static_cast<uint8_t>(flows.index()));
+    std::visit(
+        [this](const auto &flow) {
+          using T = std::decay_t<decltype(flow)>;
+          if constexpr (std::is_base_of_v<Instruction::NormalInsn, T>) {
+            Context(flow.fallthrough.fallthrough_context);
+          } else if constexpr (std::is_base_of_v<Instruction::DirectJump, T> ||
+                               std::is_base_of_v<Instruction::IndirectJump,
+                                                 T>) {
+            Flow(flow.taken_flow);
+          } else if constexpr (std::is_same_v<
+                                   T, Instruction::ConditionalInstruction>) {
+            AbnormalFlow(flow.taken_branch);
+            Context(flow.fall_through.fallthrough_context);
+          }
+        },
+        flows);
+  }
+
+ private:
+  std::string &out;
+};
+
+// Reads the sections of an encoding. Reading past the end of the encoding,
+// or reading an invalid value, clears `ok`.
+class Reader {
+ public:
+  Reader(std::string_view data_, size_t pos_) : data(data_), pos(pos_) {}
+
+  uint8_t Byte(void) {
+    if (pos >= data.size()) {
+      ok = false;
+      return 0;
+    }
+    return static_cast<uint8_t>(data[pos++]);
+  }
+
+  uint64_t Varint(void) {
+    uint64_t val = 0;
+    for (unsigned shift = 0; ok && shift < 64u; shift += 7u) {
+      const auto byte = Byte();
+      val |= static_cast<uint64_t>(byte & 0x7fu) << shift;
+      if (!(byte & 0x80u)) {
+        return val;
+      }
+    }
+    ok = false;
+    return 0;
+  }
+
+  int64_t SignedVarint(void) {
+    const auto val = Varint();
+    return static_cast<int64_t>(val >> 1u) ^ -static_cast<int64_t>(val & 1u);
+  }
+
+  // Read a value that must be at most `max`.
+  template <typename T>
+  T Enum(T max) {
+    const auto val = Varint();
+    if (val > static_cast<uint64_t>(max)) {
+      ok = false;
+      return static_cast<T>(0);
+    }
+    return static_cast<T>(val);
+  }
+
+  bool Bool(void) {
+    return Enum<uint8_t>(1u) != 0u;
+  }
+
+  std::string_view String(void) {
+    const auto size = Varint();
+    if (!ok || size > data.size() - pos) {
+      ok = false;
+      return {};
+    }
+    const auto val = data.substr(pos, size);
+    pos += size;
+    return val;
+  }
+
+  DecodingContext Context(void) {
+    ContextValues values;
+    const auto num_values = Varint();
+    for (uint64_t i = 0; ok && i < num_values; ++i) {
+      const auto reg_name = String();
+      const auto val = Varint();
+      values.emplace(std::string(reg_name), val);
+    }
+    return DecodingContext(std::move(values));
+  }
+
+  Operand::Register Register(void) {
+    Operand::Register reg;
+    reg.name = String();
+    reg.size = Varint();
+    return reg;
+  }
+
+  ArchDescription::RegisterType Type(void) {
+    using RegisterType = ArchDescription::RegisterType;
+    RegisterType type;
+    type.kind = static_cast<RegisterType::Kind>(Byte());
+    type.shape = static_cast<RegisterType::Shape>(Byte());
+    const auto bits = Varint();
+    type.num_elements = Varint();
+
+    if (type.kind > RegisterType::kFP128 ||
+        type.shape > RegisterType::kVector ||
+        (type.kind == RegisterType::kInteger &&
+         (!bits || bits > llvm::IntegerType::MAX_INT_BITS)) ||
+        (type.shape != RegisterType::kScalar &&
+         (!type.num_elements || type.num_elements > ~0u))) {
+      ok = false;
+    }
+    type.bits = static_cast<unsigned>(bits);
+    return type;
+  }
+
+  Instruction::DirectFlow DirectFlow(void) {
+    const auto known_target = Varint();
+    return Instruction::DirectFlow(known_target, Context());
+  }
+
+  Instruction::IndirectFlow IndirectFlow(void) {
+    if (Bool()) {
+      return Instruction::IndirectFlow(Context());
+    }
+    return Instruction::IndirectFlow(std::nullopt);
+  }
+
+  Instruction::AbnormalFlow AbnormalFlow(void) {
+    switch (Byte()) {
+      case 0: return Instruction::DirectFunctionCall(DirectFlow());
+      case 1: return Instruction::IndirectFunctionCall(IndirectFlow());
+      case 2: return Instruction::FunctionReturn(IndirectFlow());
+      case 3: return Instruction::AsyncHyperCall();
+      case 4: return Instruction::IndirectJump(IndirectFlow());
+      case 5: return Instruction::DirectJump(DirectFlow());
+      default: ok = false; return Instruction::AsyncHyperCall();
+    }
+  }
+
+  Instruction::InstructionFlowCategory Flows(void) {
+    using Flows = Instruction::InstructionFlowCategory;
+    switch (Byte()) {
+      case 0:
+        return Flows(std::in_place_type<Instruction::NormalInsn>,
+                     Instruction::FallthroughFlow(Context()));
+      case 1:
+        return Flows(std::in_place_type<Instruction::NoOp>,
+                     Instruction::FallthroughFlow(Context()));
+      case 2: return Flows(std::in_place_type<Instruction::InvalidInsn>);
+      case 3: return Flows(std::in_place_type<Instruction::ErrorInsn>);
+      case 4:
+        return Flows(std::in_place_type<Instruction::DirectJump>,
+                     DirectFlow());
+      case 5:
+        return Flows(std::in_place_type<Instruction::IndirectJump>,
+                     IndirectFlow());
+      case 6:
+        return Flows(std::in_place_type<Instruction::IndirectFunctionCall>,
+                     IndirectFlow());
+      case 7:
+        return Flows(std::in_place_type<Instruction::DirectFunctionCall>,
+                     DirectFlow());
+      case 8:
+        return Flows(std::in_place_type<Instruction::FunctionReturn>,
+                     IndirectFlow());
+      case 9: return Flows(std::in_place_type<Instruction::AsyncHyperCall>);
+      case 10: {
+        auto taken_branch = AbnormalFlow();
+        return Flows(std::in_place_type<Instruction::ConditionalInstruction>,
+                     std::move(taken_branch),
+                     Instruction::FallthroughFlow(Context()));
+      }
+      default:
+        ok = false;
+        return Flows(std::in_place_type<Instruction::InvalidInsn>);
+    }
+  }
+
+  const std::string_view data;
+  size_t pos;
+  bool ok{true};
+};
+
+}  // namespace
+
+bool EncodedInstruction::Encode(const Instruction &inst,
+                                const DecodingContext &context,
+                                std::string &out) {
+  const auto begin = out.size();
+  out.resize(begin + kHeaderSize, '\0');
+
+  auto fail = [&](void) {
+    out.resize(begin);
+    return false;
+  };
+
+  uint16_t flags = 0;
+  if (inst.is_atomic_read_modify_write) {
+    flags |= kIsAtomicReadModifyWrite;
+  }
+  if (inst.has_branch_taken_delay_slot) {
+    flags |= kHasBranchTakenDelaySlot;
+  }
+  if (inst.has_branch_not_taken_delay_slot) {
+    flags |= kHasBranchNotTakenDelaySlot;
+  }
+  if (inst.in_delay_slot) {
+    flags |= kInDelaySlot;
+  }
+  if (inst.branch_taken_arch_name) {
+    flags |= kHasBranchTakenArchName;
+  }
+  if (inst.x87_top_adjustment) {
+    flags |= kHasX87TopAdjustment;
+  }
+
+  PutFixed(out, begin + kMagicOffset, kMagic);
+  PutFixed(out, begin + kVersionOffset, kVersion);
+  PutFixed(out, begin + kFlagsOffset, flags);
+  PutFixed(out, begin + kCategoryOffset, static_cast<uint8_t>(inst.category));
+  PutFixed(out, begin + kX87TopAdjustmentOffset,
+           inst.x87_top_adjustment.value_or(0));
+  PutFixed(out, begin + kSPARCWindowAdjustmentOffset,
+           inst.sparc_window_adjustment);
+  PutFixed(out, begin + kArchNameOffset,
+           static_cast<uint32_t>(inst.arch_name));
+  PutFixed(out, begin + kSubArchNameOffset,
+           static_cast<uint32_t>(inst.sub_arch_name));
+  PutFixed(out, begin + kBranchTakenArchNameOffset,
+           static_cast<uint32_t>(inst.branch_taken_arch_name.value_or(
+               static_cast<ArchName>(kArchInvalid))));
+  PutFixed(out, begin + kPCOffset, inst.pc);
+  PutFixed(out, begin + kNextPCOffset, inst.next_pc);
+  PutFixed(out, begin + kDelayedPCOffset, inst.delayed_pc);
+  PutFixed(out, begin + kBranchTakenPCOffset, inst.branch_taken_pc);
+  PutFixed(out, begin + kBranchNotTakenPCOffset, inst.branch_not_taken_pc);
+
+  Writer writer(out);
+  writer.String(inst.function);
+  writer.String(inst.bytes);
+  writer.Context(context);
+  writer.String(inst.segment_override ? std::string_view(
+                                            inst.segment_override->name)
+                                      : std::string_view());
+
+  // Expressions are identified by one plus their index in `inst.exprs`, or
+  // by zero if they're missing. `Instruction::AllocateExpression` hands them
+  // out in order, so an expression only uses the expressions before it.
+  const auto num_exprs = inst.next_expr_index;
+  const auto first_expr = inst.exprs;
+  const auto end_expr = inst.exprs + num_exprs;
+  auto expr_id = [=](const OperandExpression *expr) -> std::optional<size_t> {
+    if (!expr) {
+      return 0u;
+    }
+    std::less<const OperandExpression *> less;
+    if (less(expr, first_expr) || !less(expr, end_expr)) {
+      return std::nullopt;
+    }
+    return static_cast<size_t>(expr - first_expr) + 1u;
+  };
+
+  writer.Varint(num_exprs);
+  for (size_t i = 0; i < num_exprs; ++i) {
+    const auto &expr = inst.exprs[i];
+    if (auto reg = std::get_if<const Register *>(&expr)) {
+      writer.Byte(kExpressionRegister);
+      writer.String((*reg)->name);
+      continue;
+    }
+
+    const auto type = ArchDescription::RegisterType::From(expr.type);
+    if (!type) {
+      return fail();
+    }
+
+    if (auto op = std::get_if<LLVMOpExpr>(&expr)) {
+      const auto op1 = expr_id(op->op1);
+      const auto op2 = expr_id(op->op2);
+      if (!op1 || !op2 || !*op1 || *op1 > i || *op2 > i) {
+        return fail();
+      }
+      writer.Byte(kExpressionOp);
+      writer.Type(*type);
+      writer.Varint(op->llvm_opcode);
+      writer.Varint(*op1);
+      writer.Varint(*op2);
+
+    } else if (auto val = std::get_if<llvm::Constant *>(&expr)) {
+      const auto int_val = llvm::dyn_cast<llvm::ConstantInt>(*val);
+      if (!int_val) {
+        return fail();
+      }
+      writer.Byte(kExpressionConstant);
+      writer.Type(*type);
+      const auto &bits = int_val->getValue();
+      for (auto i = 0u; i < bits.getNumWords(); ++i) {
+        writer.Varint(bits.getRawData()[i]);
+      }
+
+    } else if (auto var_name = std::get_if<std::string>(&expr)) {
+      writer.Byte(kExpressionVariable);
+      writer.Type(*type);
+      writer.String(*var_name);
+    }
+  }
+
+  writer.Varint(inst.operands.size());
+  for (const auto &op : inst.operands) {
+    const auto expr = expr_id(op.expr);
+    if (!expr) {
+      return fail();
+    }
+
+    writer.Varint(op.type);
+    writer.Varint(op.action);
+    writer.Varint(op.size);
+    writer.Register(op.reg);
+
+    writer.Register(op.shift_reg.reg);
+    writer.Varint(op.shift_reg.shift_size);
+    writer.Varint(op.shift_reg.extract_size);
+    writer.Byte(op.shift_reg.shift_first);
+    writer.Byte(op.shift_reg.can_shift_op_size);
+    writer.Varint(op.shift_reg.shift_op);
+    writer.Varint(op.shift_reg.extend_op);
+
+    writer.Varint(op.imm.val);
+    writer.Byte(op.imm.is_signed);
+
+    writer.Register(op.addr.segment_base_reg);
+    writer.Register(op.addr.base_reg);
+    writer.Register(op.addr.index_reg);
+    writer.SignedVarint(op.addr.scale);
+    writer.SignedVarint(op.addr.displacement);
+    writer.Varint(op.addr.address_size);
+    writer.Varint(op.addr.kind);
+
+    writer.Varint(*expr);
+  }
+
+  writer.Flows(inst.flows);
+
+  const auto size = out.size() - begin;
+  if (size > ~0u) {
+    return fail();
+  }
+  PutFixed(out, begin + kSizeOffset, static_cast<uint32_t>(size));
+  return true;
+}
+
+std::optional<EncodedInstruction>
+EncodedInstruction::Read(std::string_view data) {
+  if (data.size() < kHeaderSize ||
+      GetFixed<uint32_t>(data, kMagicOffset) != kMagic ||
+      GetFixed<uint16_t>(data, kVersionOffset) != kVersion) {
+    return std::nullopt;
+  }
+
+  const auto size = GetFixed<uint32_t>(data, kSizeOffset);
+  if (size < kHeaderSize || size > data.size()) {
+    return std::nullopt;
+  }
+
+  EncodedInstruction encoded;
+  encoded.data = data.substr(0, size);
+
+  Reader reader(encoded.data, kHeaderSize);
+  encoded.function = reader.String();
+  encoded.bytes = reader.String();
+  if (!reader.ok) {
+    return std::nullopt;
+  }
+
+  encoded.body_offset = reader.pos;
+  return encoded;
+}
+
+uint64_t EncodedInstruction::GetPC(void) const {
+  return GetFixed<uint64_t>(data, kPCOffset);
+}
+
+uint64_t EncodedInstruction::GetNextPC(void) const {
+  return GetFixed<uint64_t>(data, kNextPCOffset);
+}
+
+ArchName EncodedInstruction::GetArchName(void) const {
+  return static_cast<ArchName>(GetFixed<uint32_t>(data, kArchNameOffset));
+}
+
+Instruction::Category EncodedInstruction::GetCategory(void) const {
+  return static_cast<Instruction::Category>(
+      GetFixed<uint8_t>(data, kCategoryOffset));
+}
+
+DecodingContext EncodedInstruction::GetContext(void) const {
+  Reader reader(data, body_offset);
+  auto context = reader.Context();
+  LOG_IF(ERROR, !reader.ok) << "Invalid decoding context in encoding of "
+                            << "instruction at " << std::hex << GetPC();
+  return context;
+}
+
+bool EncodedInstruction::Decode(const Arch *arch, Instruction &inst) const {
+  const auto flags = GetFixed<uint16_t>(data, kFlagsOffset);
+  const auto category = GetFixed<uint8_t>(data, kCategoryOffset);
+  const auto arch_name = GetFixed<uint32_t>(data, kArchNameOffset);
+  const auto sub_arch_name = GetFixed<uint32_t>(data, kSubArchNameOffset);
+  const auto branch_taken_arch_name =
+      GetFixed<uint32_t>(data, kBranchTakenArchNameOffset);
+
+  if (category > Instruction::kCategoryConditionalAsyncHyperCall ||
+      arch_name > kArchPPC || sub_arch_name > kArchPPC ||
+      branch_taken_arch_name > kArchPPC) {
+    return false;
+  }
+
+  inst.Reset();
+  inst.arch = arch;
+  inst.function.assign(function.data(), function.size());
+  inst.bytes.assign(bytes.data(), bytes.size());
+  inst.pc = GetPC();
+  inst.next_pc = GetNextPC();
+  inst.delayed_pc = GetFixed<uint64_t>(data, kDelayedPCOffset);
+  inst.branch_taken_pc = GetFixed<uint64_t>(data, kBranchTakenPCOffset);
+  inst.branch_not_taken_pc = GetFixed<uint64_t>(data, kBranchNotTakenPCOffset);
+  inst.arch_name = static_cast<ArchName>(arch_name);
+  inst.sub_arch_name = static_cast<ArchName>(sub_arch_name);
+  inst.branch_taken_arch_name = std::nullopt;
+  if (flags & kHasBranchTakenArchName) {
+    inst.branch_taken_arch_name = static_cast<ArchName>(branch_taken_arch_name);
+  }
+  inst.is_atomic_read_modify_write = flags & kIsAtomicReadModifyWrite;
+  inst.has_branch_taken_delay_slot = flags & kHasBranchTakenDelaySlot;
+  inst.has_branch_not_taken_delay_slot = flags & kHasBranchNotTakenDelaySlot;
+  inst.in_delay_slot = flags & kInDelaySlot;
+  inst.x87_top_adjustment = std::nullopt;
+  if (flags & kHasX87TopAdjustment) {
+    inst.x87_top_adjustment = GetFixed<int8_t>(data, kX87TopAdjustmentOffset);
+  }
+  inst.sparc_window_adjustment =
+      GetFixed<int8_t>(data, kSPARCWindowAdjustmentOffset);
+  inst.category = static_cast<Instruction::Category>(category);
+  inst.segment_override = nullptr;
+
+  Reader reader(data, body_offset);
+  const auto context = reader.Context();
+
+  if (auto reg_name = reader.String(); !reg_name.empty()) {
+    inst.segment_override = arch->RegisterByName(reg_name);
+    if (!inst.segment_override) {
+      return false;
+    }
+  }
+
+  auto &llvm_context = *arch->context;
+  const auto num_exprs = reader.Varint();
+  if (num_exprs > Instruction::kMaxNumExpr) {
+    return false;
+  }
+
+  auto get_expr = [&](uint64_t id) { return &(inst.exprs[id - 1u]); };
+
+  for (uint64_t i = 0; reader.ok && i < num_exprs; ++i) {
+    const auto kind = reader.Byte();
+    if (kind == kExpressionRegister) {
+      auto reg = arch->RegisterByName(reader.String());
+      if (!reg) {
+        return false;
+      }
+      inst.EmplaceRegister(reg);
+      continue;
+    }
+
+    const auto type = reader.Type();
+    if (!reader.ok) {
+      return false;
+    }
+
+    switch (kind) {
+      case kExpressionOp: {
+        const auto opcode = reader.Varint();
+        const auto op1 = reader.Varint();
+        const auto op2 = reader.Varint();
+        if (!op1 || op1 > i || op2 > i || opcode > ~0u) {
+          return false;
+        }
+        auto expr = inst.AllocateExpression();
+        expr->emplace<LLVMOpExpr>(
+            LLVMOpExpr{static_cast<unsigned>(opcode), get_expr(op1),
+                       op2 ? get_expr(op2) : nullptr});
+        expr->type = type.Get(llvm_context);
+        break;
+      }
+
+      case kExpressionConstant: {
+        if (type.kind != ArchDescription::RegisterType::kInteger ||
+            type.shape != ArchDescription::RegisterType::kScalar) {
+          return false;
+        }
+        llvm::SmallVector<uint64_t, 2> words((type.bits + 63u) / 64u);
+        for (auto &word : words) {
+          word = reader.Varint();
+        }
+        inst.EmplaceConstant(
+            llvm::ConstantInt::get(llvm_context, llvm::APInt(type.bits, words)));
+        break;
+      }
+
+      case kExpressionVariable:
+        inst.EmplaceVariable(reader.String(), type.Get(llvm_context));
+        break;
+
+      default: return false;
+    }
+  }
+
+  const auto num_operands = reader.Varint();
+  for (uint64_t i = 0; reader.ok && i < num_operands; ++i) {
+    auto &op = inst.operands.emplace_back();
+    op.type = reader.Enum(Operand::kTypeAddressExpression);
+    op.action = reader.Enum(Operand::kActionWrite);
+    op.size = reader.Varint();
+    op.reg = reader.Register();
+
+    op.shift_reg.reg = reader.Register();
+    op.shift_reg.shift_size = reader.Varint();
+    op.shift_reg.extract_size = reader.Varint();
+    op.shift_reg.shift_first = reader.Bool();
+    op.shift_reg.can_shift_op_size = reader.Bool();
+    op.shift_reg.shift_op =
+        reader.Enum(Operand::ShiftRegister::kShiftRightAround);
+    op.shift_reg.extend_op = reader.Enum(Operand::ShiftRegister::kExtendSigned);
+
+    op.imm.val = reader.Varint();
+    op.imm.is_signed = reader.Bool();
+
+    op.addr.segment_base_reg = reader.Register();
+    op.addr.base_reg = reader.Register();
+    op.addr.index_reg = reader.Register();
+    op.addr.scale = reader.SignedVarint();
+    op.addr.displacement = reader.SignedVarint();
+    op.addr.address_size = reader.Varint();
+    op.addr.kind = reader.Enum(Operand::Address::kControlFlowTarget);
+
+    if (const auto expr = reader.Varint(); expr > num_exprs) {
+      return false;
+    } else if (expr) {
+      op.expr = get_expr(expr);
+    }
+  }
+
+  inst.flows = reader.Flows();
+  if (!reader.ok || reader.pos != data.size()) {
+    return false;
+  }
+
+  if (arch->RestoreInstructionLifter(inst)) {
+    return true;
+  }
+
+  // The lifter depends on the state of the decoder, so decode the instruction
+  // again. This is always the case for SLEIGH-backed architectures.
+  const auto pc = inst.pc;
+  const auto in_delay_slot = inst.in_delay_slot;
+  inst.Reset();
+  if (in_delay_slot) {
+    return arch->DecodeDelayedInstruction(pc, bytes, inst, context);
+  } else {
+    return arch->DecodeInstruction(pc, bytes, inst, context);
+  }
+}
+
+}  // namespace remill
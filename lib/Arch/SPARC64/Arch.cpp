@@ -346,6 +346,13 @@ void SPARC64Arch::PopulateRegisterTable(void) const {
   SUB_REG(q60, fpreg.v[15].doubles.elems[0], f64, v15);
 
   REG(PREV_WINDOW_LINK, window, window_ptr_type);
+
+#if defined(REMILL_SPARC_WINDOW_BANK)
+
+  // Used to find the windowed registers in the register window bank.
+  REG(cwp, psr.cwp, u8);
+  REG(WINDOW_BANK, window_bank.regs[0].reg.qword, u64);
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
 }
 
 // Populate a just-initialized lifted function function with architecture-
@@ -372,6 +379,8 @@ void SPARC64Arch::FinishLiftedFunctionInitialization(
   // this is for unknown asr to avoid crash.
   ir.CreateStore(zero_u64, ir.CreateAlloca(u64, nullptr, "asr"), false);
 
+#if !defined(REMILL_SPARC_WINDOW_BANK)
+
   // NOTE(pag): Passing `nullptr` as the type will force `Arch::AddRegister`
   //            to infer the type based on what it finds. It's a pointer to
   //            a structure type, so we can check that.
@@ -389,6 +398,7 @@ void SPARC64Arch::FinishLiftedFunctionInitialization(
       ir.CreateInBoundsGEP(window_type, window, gep_indexes, "WINDOW_LINK");
   auto nullptr_window = llvm::Constant::getNullValue(prev_window_link->type);
   ir.CreateStore(nullptr_window, window_link, false);
+#endif  // !defined(REMILL_SPARC_WINDOW_BANK)
 
   ir.CreateStore(zero_u8, ir.CreateAlloca(u8, nullptr, "IGNORE_BRANCH_TAKEN"),
                  false);
@@ -1018,10 +1018,14 @@ static bool TryDecodeRETURN(Instruction &inst, uint32_t bits) {
   AddPCDest(inst);
   AddNPCDest(inst);
 
+#if !defined(REMILL_SPARC_WINDOW_BANK)
+
   // Smuggle a stack-allocated register window into the semantics.
   AddDestRegop(inst, "PREV_WINDOW", kAddressSize);
+#endif  // !defined(REMILL_SPARC_WINDOW_BANK)
 
   inst.function = "RETURN";
+  inst.sparc_window_adjustment = -1;
   inst.has_branch_taken_delay_slot = true;
   inst.has_branch_not_taken_delay_slot = false;
   inst.delayed_pc = inst.next_pc;
@@ -1122,10 +1126,14 @@ static bool TryDecodeSave(Instruction &inst, uint32_t bits) {
     return false;
   }
 
+#if !defined(REMILL_SPARC_WINDOW_BANK)
+
   // Smuggle a stack-allocated register window into the semantics.
   AddDestRegop(inst, "WINDOW", kAddressSize);
   AddDestRegop(inst, "PREV_WINDOW", kAddressSize);
+#endif  // !defined(REMILL_SPARC_WINDOW_BANK)
 
+  inst.sparc_window_adjustment = 1;
   return true;
 }
 
@@ -1134,9 +1142,13 @@ static bool TryDecodeRestore(Instruction &inst, uint32_t bits) {
     return false;
   }
 
+#if !defined(REMILL_SPARC_WINDOW_BANK)
+
   // Smuggle a stack-allocated register window into the semantics.
   AddDestRegop(inst, "PREV_WINDOW", kAddressSize);
+#endif  // !defined(REMILL_SPARC_WINDOW_BANK)
 
+  inst.sparc_window_adjustment = -1;
   return true;
 }
 
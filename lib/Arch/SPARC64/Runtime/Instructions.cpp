@@ -30,13 +30,55 @@ State __remill_state;
 
 #define REG_PC state.pc.aword
 #define REG_NPC state.next_pc.aword
+#if !defined(REMILL_SPARC_WINDOW_BANK)
 #define REG_SP state.gpr.o6.aword
 #define REG_FP state.gpr.i6.aword
+#endif  // !defined(REMILL_SPARC_WINDOW_BANK)
 
 #define REG_G0 state.gpr.g0.aword
 #define REG_G1 state.gpr.g1.aword
 #define REG_G7 state.gpr.g7.aword  // Thread local pointer
 
+#if defined(REMILL_SPARC_WINDOW_BANK)
+
+// Register `j` of window `w`, counting `i0-i7`, `l0-l7`, then `o0-o7`.
+#  define BANKED_REG(w, j) \
+    state.window_bank \
+        .regs[((w) * 16u + (j)) % (kNumRegisterWindows * 16u)] \
+        .reg.aword
+
+#  define WINDOW_REG(j) BANKED_REG(PSR_CWP, j)
+
+#  define REG_SP WINDOW_REG(22u)
+#  define REG_FP WINDOW_REG(6u)
+
+#  define REG_L0 WINDOW_REG(8u)
+#  define REG_L1 WINDOW_REG(9u)
+#  define REG_L2 WINDOW_REG(10u)
+#  define REG_L3 WINDOW_REG(11u)
+#  define REG_L4 WINDOW_REG(12u)
+#  define REG_L5 WINDOW_REG(13u)
+#  define REG_L6 WINDOW_REG(14u)
+#  define REG_L7 WINDOW_REG(15u)
+
+#  define REG_I0 WINDOW_REG(0u)
+#  define REG_I1 WINDOW_REG(1u)
+#  define REG_I2 WINDOW_REG(2u)
+#  define REG_I3 WINDOW_REG(3u)
+#  define REG_I4 WINDOW_REG(4u)
+#  define REG_I5 WINDOW_REG(5u)
+#  define REG_I6 WINDOW_REG(6u)
+#  define REG_I7 WINDOW_REG(7u)
+
+#  define REG_O0 WINDOW_REG(16u)
+#  define REG_O1 WINDOW_REG(17u)
+#  define REG_O2 WINDOW_REG(18u)
+#  define REG_O3 WINDOW_REG(19u)
+#  define REG_O4 WINDOW_REG(20u)
+#  define REG_O5 WINDOW_REG(21u)
+#  define REG_O6 WINDOW_REG(22u)
+#  define REG_O7 WINDOW_REG(23u)
+#else
 #define REG_L0 state.gpr.l0.aword
 #define REG_L1 state.gpr.l1.aword
 #define REG_L2 state.gpr.l2.aword
@@ -63,6 +105,7 @@ State __remill_state;
 #define REG_O5 state.gpr.o5.aword
 #define REG_O6 state.gpr.o6.aword
 #define REG_O7 state.gpr.o7.aword
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
 
 #define REG_F0 state.fpreg.v[0].floats.elems[0]
 #define REG_F1 state.fpreg.v[0].floats.elems[1]
@@ -151,6 +194,70 @@ DEF_SEM(HandleInvalidInstruction) {
   return memory;
 }
 
+#if defined(REMILL_SPARC_WINDOW_BANK)
+
+// Store the local and in registers of window `w` into the register save area
+// of its stack frame, like a window spill trap handler would.
+DEF_HELPER(SPILL_WINDOW, uint32_t w)->void {
+  const addr_t save_area = BANKED_REG(w, 22u) + SPARC_STACKBIAS;
+  for (uint32_t i = 0; i < 16u; ++i) {
+    Write(WritePtr<addr_t>(save_area + i * sizeof(addr_t)),
+          BANKED_REG(w, (i + 8u) % 16u));
+  }
+}
+
+// Load the local and in registers of window `w` from the register save area
+// of its stack frame, like a window fill trap handler would.
+DEF_HELPER(FILL_WINDOW, uint32_t w)->void {
+  const addr_t save_area = BANKED_REG(w, 22u) + SPARC_STACKBIAS;
+  for (uint32_t i = 0; i < 16u; ++i) {
+    BANKED_REG(w, (i + 8u) % 16u) =
+        Read(ReadPtr<addr_t>(save_area + i * sizeof(addr_t)));
+  }
+}
+
+// Moves to the next register window. The bank only has to spill a window
+// when every other window holds a caller's registers.
+DEF_HELPER(SAVE_WINDOW)->void {
+  uint32_t can_restore = PSR_CANRESTORE;
+  if (can_restore >= (kNumRegisterWindows - 2u)) {
+    SPILL_WINDOW(memory, state, (PSR_CWP + 2u) % kNumRegisterWindows);
+    can_restore -= 1u;
+  }
+  PSR_CWP = static_cast<uint8_t>((PSR_CWP + 1u) % kNumRegisterWindows);
+  PSR_CANRESTORE = static_cast<uint8_t>(can_restore + 1u);
+  PSR_CANSAVE = static_cast<uint8_t>(kNumRegisterWindows - 2u - PSR_CANRESTORE);
+}
+
+// Moves back to the previous register window. If that window was spilled,
+// e.g. because it belongs to a caller that wasn't lifted, then it is filled
+// from its stack frame.
+DEF_HELPER(RESTORE_WINDOW)->void {
+  const uint32_t prev_cwp =
+      (PSR_CWP + kNumRegisterWindows - 1u) % kNumRegisterWindows;
+  uint32_t can_restore = PSR_CANRESTORE;
+  if (can_restore) {
+    can_restore -= 1u;
+  } else {
+    FILL_WINDOW(memory, state, prev_cwp);
+  }
+  PSR_CWP = static_cast<uint8_t>(prev_cwp);
+  PSR_CANRESTORE = static_cast<uint8_t>(can_restore);
+  PSR_CANSAVE = static_cast<uint8_t>(kNumRegisterWindows - 2u - can_restore);
+}
+
+// Spills every window that holds a caller's registers.
+DEF_HELPER(FLUSH_WINDOWS)->void {
+  for (uint32_t i = 1u; i <= PSR_CANRESTORE; ++i) {
+    SPILL_WINDOW(memory, state,
+                 (PSR_CWP + kNumRegisterWindows - i) % kNumRegisterWindows);
+  }
+  PSR_CANRESTORE = 0;
+  PSR_CANSAVE = static_cast<uint8_t>(kNumRegisterWindows - 2u);
+}
+
+#else
+
 DEF_HELPER(SAVE_WINDOW, RegisterWindow *window, RegisterWindow *&prev_window)
     ->void {
 
@@ -232,8 +339,19 @@ DEF_HELPER(RESTORE_WINDOW, RegisterWindow *&prev_window)->void {
   Write(REG_I7, window->i7);
 }
 
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
+
 }  // namespace
 
+// Tells the lifter whether the windowed register operands refer to `GPR`, or
+// to the register window bank using `CWP`.
+extern "C" constexpr bool __remill_sparc_window_bank [[gnu::used]] =
+#if defined(REMILL_SPARC_WINDOW_BANK)
+    true;
+#else
+    false;
+#endif
+
 // Takes the place of an unsupported instruction.
 DEF_ISEL(UNSUPPORTED_INSTRUCTION) = HandleUnsupported;
 DEF_ISEL(INVALID_INSTRUCTION) = HandleInvalidInstruction;
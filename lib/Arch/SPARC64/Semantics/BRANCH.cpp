@@ -67,6 +67,15 @@ DEF_SEM(FBN, PC new_not_taken_pc, PC new_not_taken_npc, T pc_dst, T npc_dst) {
   return memory;
 }
 
+#if defined(REMILL_SPARC_WINDOW_BANK)
+template <typename T>
+DEF_SEM(RETURN, PC new_pc, PC new_npc, T dst_pc, T dst_npc) {
+  RESTORE_WINDOW(memory, state);
+  Write(dst_pc, Read(new_pc));
+  Write(dst_npc, Read(new_npc));
+  return memory;
+}
+#else
 template <typename T>
 DEF_SEM(RETURN, PC new_pc, PC new_npc, T dst_pc, T dst_npc,
         RegisterWindow *&prev_window) {
@@ -75,6 +84,7 @@ DEF_SEM(RETURN, PC new_pc, PC new_npc, T dst_pc, T dst_npc,
   Write(dst_npc, Read(new_npc));
   return memory;
 }
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
 
 
 // Makes an asynchronous and synchronous version of the trap. The asynchronous
@@ -26,6 +26,13 @@ DEF_SEM(FLUSH, M64 src) {
   return memory;
 }
 
+#if defined(REMILL_SPARC_WINDOW_BANK)
+DEF_SEM(FLUSHW) {
+  FLUSH_WINDOWS(memory, state);
+  return memory;
+}
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
+
 
 DEF_SEM(MEMBAR, I32 mask1, I32 mask2) {
 #ifdef DEF_MEMBAR
@@ -63,13 +70,41 @@ DEF_SEM(PREFETCHA, R8 asi, M64 address, I32 fcn) {
 
 DEF_ISEL(NOP) = NOP;
 DEF_ISEL(MEMBAR) = MEMBAR;
+#if defined(REMILL_SPARC_WINDOW_BANK)
+DEF_ISEL(FLUSHW) = FLUSHW;
+#else
 DEF_ISEL(FLUSHW) = NOP;
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
 DEF_ISEL(FLUSH) = FLUSH;
 DEF_ISEL(PREFETCH) = PREFETCH;
 DEF_ISEL(PREFETCHA) = PREFETCHA;
 
 namespace {
 
+#if defined(REMILL_SPARC_WINDOW_BANK)
+
+template <typename S1, typename S2, typename D>
+DEF_SEM(SAVE, S1 src1, S2 src2, D dst) {
+  addr_t sp_base = Read(src1);
+  addr_t sp_offset = Read(src2);
+  addr_t new_sp = UAdd(sp_base, sp_offset);
+  SAVE_WINDOW(memory, state);
+  WriteZExt(dst, new_sp);
+  return memory;
+}
+
+template <typename S1, typename S2, typename D>
+DEF_SEM(RESTORE, S1 src1, S2 src2, D dst) {
+  auto rs1 = Read(src1);
+  auto rs2 = Read(src2);
+  auto sum = UAdd(rs1, rs2);
+  RESTORE_WINDOW(memory, state);
+  WriteZExt(dst, sum);
+  return memory;
+}
+
+#else
+
 template <typename S1, typename S2, typename D>
 DEF_SEM(SAVE, S1 src1, S2 src2, D dst, RegisterWindow *window,
         RegisterWindow *&prev_window) {
@@ -91,6 +126,8 @@ DEF_SEM(RESTORE, S1 src1, S2 src2, D dst, RegisterWindow *&prev_window) {
   return memory;
 }
 
+#endif  // defined(REMILL_SPARC_WINDOW_BANK)
+
 }  // namespace
 
 DEF_ISEL(SAVE) = SAVE<R64, I64, R64W>;
@@ -19,6 +19,7 @@
 
 #include <glog/logging.h>
 #include <remill/Arch/Name.h>
+#include <remill/Arch/Statistics.h>
 #include <remill/BC/SleighLifter.h>
 
 namespace remill::sleigh {
@@ -43,6 +44,110 @@ class AssemblyLogger : public AssemblyEmit {
               << " " << body;
   }
 };
+
+// Constants in p-code templates that are fixed when Sleigh is compiled, or
+// that only depend on the operands. Anything else, e.g. `inst_start`, or
+// `inst_next`, is resolved from the address of the instruction.
+static bool DependsOnAddress(const ConstTpl &val) {
+  switch (val.getType()) {
+    case ConstTpl::real:
+    case ConstTpl::handle:
+    case ConstTpl::j_curspace:
+    case ConstTpl::j_curspace_size:
+    case ConstTpl::spaceid:
+    case ConstTpl::j_relative: return false;
+    default: return true;
+  }
+}
+
+static bool DependsOnAddress(const VarnodeTpl *var) {
+  return var && (DependsOnAddress(var->getSpace()) ||
+                 DependsOnAddress(var->getOffset()) ||
+                 DependsOnAddress(var->getSize()));
+}
+
+static bool DependsOnAddress(const ConstructTpl *tpl) {
+  if (!tpl) {
+    return false;
+  }
+
+  for (auto op : tpl->getOpvec()) {
+
+    // Delay slots and cross-builds pull in the p-code of instructions at
+    // other addresses.
+    if (op->getOpcode() == DELAY_SLOT || op->getOpcode() == CROSSBUILD ||
+        DependsOnAddress(op->getOut())) {
+      return true;
+    }
+    for (int4 i = 0; i < op->numInput(); ++i) {
+      if (DependsOnAddress(op->getIn(i))) {
+        return true;
+      }
+    }
+  }
+
+  if (auto res = tpl->getResult()) {
+    return DependsOnAddress(res->getSpace()) ||
+           DependsOnAddress(res->getSize()) ||
+           DependsOnAddress(res->getPtrSpace()) ||
+           DependsOnAddress(res->getPtrOffset()) ||
+           DependsOnAddress(res->getPtrSize()) ||
+           DependsOnAddress(res->getTempSpace()) ||
+           DependsOnAddress(res->getTempOffset());
+  }
+
+  return false;
+}
+
+// Values computed by the disassembly actions of constructors, e.g.
+// `[ reloc = inst_next + simm32; ]`.
+static bool DependsOnAddress(const PatternExpression *exp) {
+  if (!exp || dynamic_cast<const TokenField *>(exp) ||
+      dynamic_cast<const ContextField *>(exp) ||
+      dynamic_cast<const ConstantValue *>(exp) ||
+      dynamic_cast<const OperandValue *>(exp)) {
+    return false;
+
+  } else if (auto bin = dynamic_cast<const BinaryExpression *>(exp)) {
+    return DependsOnAddress(bin->getLeft()) ||
+           DependsOnAddress(bin->getRight());
+
+  } else if (auto un = dynamic_cast<const UnaryExpression *>(exp)) {
+    return DependsOnAddress(un->getUnary());
+
+  // `inst_start`, `inst_next`, and anything that we don't know about.
+  } else {
+    return true;
+  }
+}
+
+// Visit the constructor at `walker`, and the constructors of its operands.
+static bool DependsOnAddress(ParserWalker &walker) {
+  auto ct = walker.getConstructor();
+  if (!ct) {
+    return false;
+  }
+
+  if (DependsOnAddress(ct->getTempl())) {
+    return true;
+  }
+
+  for (int4 i = 0; i < ct->getNumOperands(); ++i) {
+    if (DependsOnAddress(ct->getOperand(i)->getDefiningExpression())) {
+      return true;
+    }
+
+    walker.pushOperand(i);
+    const auto depends = DependsOnAddress(walker);
+    walker.popOperand();
+    if (depends) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 }  // namespace
 
 PcodeDecoder::PcodeDecoder(::Sleigh &engine_) : engine(engine_) {}
@@ -202,12 +307,18 @@ bool SleighDecoder::DecodeInstruction(uint64_t address,
                                       std::string_view instr_bytes,
                                       Instruction &inst,
                                       DecodingContext context) const {
-
+  const auto stats = arch.Statistics();
+  const auto start = stats ? LiftingStatistics::Clock::now()
+                           : LiftingStatistics::Clock::time_point();
 
   auto context_values = context.GetContextValues();
   auto res_cat = const_cast<SleighDecoder *>(this)->DecodeInstructionImpl(
       address, instr_bytes, inst, std::move(context));
 
+  if (stats) {
+    stats->RecordDecode(res_cat.has_value(), start);
+  }
+
   if (res_cat.has_value()) {
     if (!res_cat->second &&
         std::holds_alternative<remill::Instruction::ConditionalInstruction>(
@@ -333,6 +444,17 @@ ContextDatabase &SingleInstructionSleighContext::GetContext() {
   return this->ctx;
 }
 
+bool SingleInstructionSleighContext::DependsOnAddress(uint64_t address) {
+
+  // The parse of the instruction is cached by `engine`, so this doesn't
+  // decode it again.
+  auto pos = this->engine.obtainContext(this->GetAddressFromOffset(address),
+                                        ParserContext::pcode);
+  ParserWalker walker(pos);
+  walker.baseState();
+  return ::remill::sleigh::DependsOnAddress(walker);
+}
+
 void SingleInstructionSleighContext::resetContext() {
   this->engine.reset(&this->image, &this->ctx);
   this->restoreEngineFromStorage();
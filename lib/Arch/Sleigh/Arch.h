@@ -58,13 +58,21 @@ class CustomLoadImage final : public LoadImage {
   uint64_t current_offset{0};
 };
 
+// Gives access to the parse of a decoded instruction, which Sleigh otherwise
+// keeps to itself.
+class SleighEngine final : public ::Sleigh {
+ public:
+  using ::Sleigh::obtainContext;
+  using ::Sleigh::Sleigh;
+};
+
 // Holds onto contextual sleigh information in order to provide an interface with which you can decode single instructions
 // Give me bytes and i give you pcode (maybe)
 class SingleInstructionSleighContext {
  private:
   CustomLoadImage image;
   ContextInternal ctx;
-  ::Sleigh engine;
+  SleighEngine engine;
   DocumentStorage storage;
 
   std::optional<int32_t>
@@ -86,6 +94,12 @@ class SingleInstructionSleighContext {
 
   ContextDatabase &GetContext(void);
 
+  // Returns `true` if the p-code of the instruction that was last decoded at
+  // `address` depends on that address, i.e. if any of the constructors that
+  // make up the instruction refer to `inst_start` or `inst_next`, or to an
+  // operand computed from them.
+  bool DependsOnAddress(uint64_t address);
+
   void resetContext();
 
   SingleInstructionSleighContext(std::string sla_name, std::string pspec_name);
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/Arch/Statistics.h"
+
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace remill {
+namespace {
+
+static constexpr size_t kNumLiftStatuses = kLiftedInstruction + 1u;
+
+static constexpr double kQuantiles[] = {0.5, 0.9, 0.99};
+
+// Histogram of latencies, bucketed by powers of two of nanoseconds. This keeps
+// recording lock-free, and still gives percentiles to within a factor of two.
+class LatencyHistogram {
+ public:
+  void Record(LiftingStatistics::Clock::time_point start) {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        LiftingStatistics::Clock::now() - start)
+                        .count();
+    const auto ns_u64 = static_cast<uint64_t>(ns > 0 ? ns : 0);
+    buckets[std::bit_width(ns_u64)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns_u64, std::memory_order_relaxed);
+  }
+
+  void Reset(void) {
+    for (auto &bucket : buckets) {
+      bucket = 0;
+    }
+    count = 0;
+    sum_ns = 0;
+  }
+
+  uint64_t Count(void) const {
+    return count.load(std::memory_order_relaxed);
+  }
+
+  double SumSeconds(void) const {
+    return static_cast<double>(sum_ns.load(std::memory_order_relaxed)) / 1e9;
+  }
+
+  // Returns an upper bound on the `quantile`th latency, in seconds.
+  double QuantileSeconds(double quantile) const {
+    const auto total = Count();
+    if (!total) {
+      return 0;
+    }
+
+    const auto rank = static_cast<uint64_t>(
+        std::ceil(quantile * static_cast<double>(total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      seen += buckets[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        return std::ldexp(1.0, static_cast<int>(i)) / 1e9;
+      }
+    }
+    return std::ldexp(1.0, static_cast<int>(buckets.size())) / 1e9;
+  }
+
+ private:
+  // Bucket `i` counts latencies of `[2^(i-1), 2^i)` nanoseconds.
+  std::array<std::atomic<uint64_t>, 65> buckets{};
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> sum_ns{0};
+};
+
+}  // namespace
+
+class LiftingStatistics::Impl {
+ public:
+  std::atomic<uint64_t> num_decoded{0};
+  std::atomic<uint64_t> num_decode_failures{0};
+  std::atomic<uint64_t> num_equality_claims{0};
+  std::array<std::atomic<uint64_t>, kNumLiftStatuses> num_lifted{};
+
+  LatencyHistogram decode_latency;
+  LatencyHistogram lift_latency;
+
+  // Number of lifts of each ISEL, by status. Ordered so that exports are
+  // deterministic.
+  mutable std::mutex isel_lock;
+  std::map<std::string, std::array<uint64_t, kNumLiftStatuses>, std::less<>>
+      isel_lifts;
+};
+
+LiftingStatistics::LiftingStatistics(void) : impl(new Impl) {}
+
+LiftingStatistics::~LiftingStatistics(void) {}
+
+void LiftingStatistics::RecordDecode(bool decoded, Clock::time_point start) {
+  impl->decode_latency.Record(start);
+  if (decoded) {
+    impl->num_decoded.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    impl->num_decode_failures.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void LiftingStatistics::RecordLift(std::string_view isel, LiftStatus status,
+                                   Clock::time_point start) {
+  impl->lift_latency.Record(start);
+  impl->num_lifted[status].fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> locker(impl->isel_lock);
+  auto isel_it = impl->isel_lifts.find(isel);
+  if (isel_it == impl->isel_lifts.end()) {
+    isel_it = impl->isel_lifts.emplace(std::string(isel),
+                                       std::array<uint64_t, kNumLiftStatuses>{})
+                  .first;
+  }
+  isel_it->second[status] += 1;
+}
+
+void LiftingStatistics::RecordEqualityClaim(void) {
+  impl->num_equality_claims.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LiftingStatistics::Reset(void) {
+  impl->num_decoded = 0;
+  impl->num_decode_failures = 0;
+  impl->num_equality_claims = 0;
+  for (auto &num : impl->num_lifted) {
+    num = 0;
+  }
+  impl->decode_latency.Reset();
+  impl->lift_latency.Reset();
+
+  std::lock_guard<std::mutex> locker(impl->isel_lock);
+  impl->isel_lifts.clear();
+}
+
+std::string LiftingStatistics::ToJSON(void) const {
+  std::string json;
+  llvm::raw_string_ostream os(json);
+  llvm::json::OStream out(os);
+
+  auto latency = [&out](const LatencyHistogram &histogram) {
+    out.attribute("count", histogram.Count());
+    out.attribute("sum_seconds", histogram.SumSeconds());
+    for (auto quantile : kQuantiles) {
+      out.attribute("p" + std::to_string(static_cast<int>(quantile * 100)),
+                    histogram.QuantileSeconds(quantile));
+    }
+  };
+
+  out.object([&] {
+    out.attributeObject("decode", [&] {
+      out.attribute("decoded", impl->num_decoded.load());
+      out.attribute("failed", impl->num_decode_failures.load());
+      out.attributeObject("latency", [&] { latency(impl->decode_latency); });
+    });
+
+    out.attributeObject("lift", [&] {
+      for (size_t i = 0; i < kNumLiftStatuses; ++i) {
+        out.attribute(LiftStatusName(static_cast<LiftStatus>(i)),
+                      impl->num_lifted[i].load());
+      }
+      out.attributeObject("latency", [&] { latency(impl->lift_latency); });
+    });
+
+    out.attribute("equality_claims", impl->num_equality_claims.load());
+
+    std::lock_guard<std::mutex> locker(impl->isel_lock);
+    out.attributeObject("isels", [&] {
+      for (const auto &[isel, counts] : impl->isel_lifts) {
+        out.attributeObject(isel, [&] {
+          for (size_t i = 0; i < kNumLiftStatuses; ++i) {
+            if (counts[i]) {
+              out.attribute(LiftStatusName(static_cast<LiftStatus>(i)),
+                            counts[i]);
+            }
+          }
+        });
+      }
+    });
+  });
+
+  os.flush();
+  return json;
+}
+
+std::string LiftingStatistics::ToPrometheus(std::string_view prefix) const {
+  std::stringstream ss;
+  const std::string name(prefix);
+
+  auto latency = [&](std::string_view metric,
+                     const LatencyHistogram &histogram) {
+    ss << "# TYPE " << name << '_' << metric << " summary\n";
+    for (auto quantile : kQuantiles) {
+      ss << name << '_' << metric << "{quantile=\"" << quantile << "\"} "
+         << histogram.QuantileSeconds(quantile) << '\n';
+    }
+    ss << name << '_' << metric << "_sum " << histogram.SumSeconds() << '\n'
+       << name << '_' << metric << "_count " << histogram.Count() << '\n';
+  };
+
+  ss << "# TYPE " << name << "_decoded_instructions_total counter\n"
+     << name << "_decoded_instructions_total{result=\"decoded\"} "
+     << impl->num_decoded.load() << '\n'
+     << name << "_decoded_instructions_total{result=\"failed\"} "
+     << impl->num_decode_failures.load() << '\n';
+  latency("decode_latency_seconds", impl->decode_latency);
+
+  ss << "# TYPE " << name << "_lifted_instructions_total counter\n";
+  for (size_t i = 0; i < kNumLiftStatuses; ++i) {
+    ss << name << "_lifted_instructions_total{status=\""
+       << LiftStatusName(static_cast<LiftStatus>(i)) << "\"} "
+       << impl->num_lifted[i].load() << '\n';
+  }
+  latency("lift_latency_seconds", impl->lift_latency);
+
+  ss << "# TYPE " << name << "_equality_claims_total counter\n"
+     << name << "_equality_claims_total " << impl->num_equality_claims.load()
+     << '\n';
+
+  std::lock_guard<std::mutex> locker(impl->isel_lock);
+  ss << "# TYPE " << name << "_isel_lifts_total counter\n";
+  for (const auto &[isel, counts] : impl->isel_lifts) {
+    for (size_t i = 0; i < kNumLiftStatuses; ++i) {
+      if (counts[i]) {
+        ss << name << "_isel_lifts_total{isel=\"" << isel << "\",status=\""
+           << LiftStatusName(static_cast<LiftStatus>(i)) << "\"} "
+           << counts[i] << '\n';
+      }
+    }
+  }
+
+  return ss.str();
+}
+
+std::string_view LiftStatusName(LiftStatus status) {
+  switch (status) {
+    case kLiftedInvalidInstruction: return "invalid";
+    case kLiftedUnsupportedInstruction: return "unsupported";
+    case kLiftedLifterError: return "lifter_error";
+    case kLiftedUnknownISEL: return "unknown_isel";
+    case kLiftedMismatchedISEL: return "mismatched_isel";
+    case kLiftedInstruction: return "lifted";
+  }
+  return "unknown";
+}
+
+}  // namespace remill
@@ -739,6 +739,46 @@ static void DecodeX87LastIpDp(Instruction &inst) {
   inst.operands.push_back(fop);
 }
 
+// Figure out how an instruction moves the top of the x87 register stack. XED
+// describes pushes and pops as suppressed operands using pseudo-registers.
+static std::optional<int8_t>
+DecodeX87TopAdjustment(const xed_decoded_inst_t *xedd) {
+  switch (xed_decoded_inst_get_iform_enum(xedd)) {
+    case XED_IFORM_FINCSTP: return 1;
+    case XED_IFORM_FDECSTP: return -1;
+    case XED_IFORM_FNINIT:
+    case XED_IFORM_FLDENV_MEMmem14:
+    case XED_IFORM_FLDENV_MEMmem28:
+    case XED_IFORM_FNSTSW_AX:
+    case XED_IFORM_FNSTSW_MEMmem16: return std::nullopt;
+    default: break;
+  }
+
+  // E.g. `FRSTOR`, `FXRSTOR`, and MMX instructions, which write `TOP`, and
+  // `FNSAVE`, `FNSTENV`, and `FXSAVE`, which read it.
+  if (xed_decoded_inst_get_attribute(xedd, XED_ATTRIBUTE_X87_MMX_STATE_W) ||
+      xed_decoded_inst_get_attribute(xedd, XED_ATTRIBUTE_X87_MMX_STATE_R)) {
+    return std::nullopt;
+  }
+
+  const auto xedi = xed_decoded_inst_inst(xedd);
+  const auto num_operands = xed_decoded_inst_noperands(xedd);
+  int8_t adjustment = 0;
+  for (auto i = 0U; i < num_operands; ++i) {
+    const auto op_name = xed_operand_name(xed_inst_operand(xedi, i));
+    if (!xed_operand_is_register(op_name)) {
+      continue;
+    }
+    switch (xed_decoded_inst_get_reg(xedd, op_name)) {
+      case XED_REG_X87PUSH: adjustment -= 1; break;
+      case XED_REG_X87POP: adjustment += 1; break;
+      case XED_REG_X87POP2: adjustment += 2; break;
+      default: break;
+    }
+  }
+  return adjustment;
+}
+
 // Decode an operand.
 static void DecodeOperand(Instruction &inst, const xed_decoded_inst_t *xedd,
                           const xed_operand_t *xedo) {
@@ -801,12 +841,13 @@ X86Arch::X86Arch(llvm::LLVMContext *context_, OSName os_name_,
       X86ArchBase(context_, os_name_, arch_name_),
       DefaultContextAndLifter(context_, os_name_, arch_name_) {
 
-  static bool xed_is_initialized = false;
-  if (!xed_is_initialized) {
+  // XED's tables are global, so initialize them once per process, even if
+  // many threads are building `X86Arch`s for their own contexts.
+  [[maybe_unused]] static const bool xed_is_initialized = [] {
     DLOG(INFO) << "Initializing XED tables";
     xed_tables_init();
-    xed_is_initialized = true;
-  }
+    return true;
+  }();
 }
 
 X86Arch::~X86Arch(void) {}
@@ -1185,6 +1226,8 @@ bool X86Arch::ArchDecodeInstruction(uint64_t address,
     }
   }
 
+  inst.x87_top_adjustment = DecodeX87TopAdjustment(xedd);
+
   if (xed_decoded_inst_is_xacquire(xedd) ||
       xed_decoded_inst_is_xrelease(xedd)) {
     LOG(WARNING) << "Ignoring XACQUIRE/XRELEASE prefix at " << std::hex
@@ -438,6 +438,13 @@ void X86ArchBase::PopulateRegisterTable(void) const {
   REG(ST6, st.elems[6].val, f80);
   REG(ST7, st.elems[7].val, f80);
 
+  // The x87 status word, which holds `TOP`. It is at the same offset in the
+  // 32- and 64-bit `FXSAVE` layouts. Only semantics with a rotating x87 stack
+  // need it.
+#if defined(REMILL_X87_ROTATING_STACK)
+  REG(FSW, x87.fxsave32.swd.flat, u16);
+#endif  // defined(REMILL_X87_ROTATING_STACK)
+
 #if 0  // TODO(pag): Don't emulate directly for now.
   if (32 == address_size) {
     REG(FPU_LASTIP, fpu.u.x86.ip);
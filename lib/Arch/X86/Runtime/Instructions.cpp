@@ -110,14 +110,23 @@ State __remill_state;
 #define FLAG_OF state.aflag.of
 #define FLAG_DF state.aflag.df
 
-#define X87_ST0 state.st.elems[0].val
-#define X87_ST1 state.st.elems[1].val
-#define X87_ST2 state.st.elems[2].val
-#define X87_ST3 state.st.elems[3].val
-#define X87_ST4 state.st.elems[4].val
-#define X87_ST5 state.st.elems[5].val
-#define X87_ST6 state.st.elems[6].val
-#define X87_ST7 state.st.elems[7].val
+#if defined(REMILL_X87_ROTATING_STACK)
+
+// `state.st` is the physical x87 register file, and `ST(i)` is the register
+// that is `i` slots past `TOP`.
+#  define X87_ST(i) state.st.elems[(state.x87.fxsave.swd.top + (i)) % 8].val
+#else
+#  define X87_ST(i) state.st.elems[i].val
+#endif  // defined(REMILL_X87_ROTATING_STACK)
+
+#define X87_ST0 X87_ST(0)
+#define X87_ST1 X87_ST(1)
+#define X87_ST2 X87_ST(2)
+#define X87_ST3 X87_ST(3)
+#define X87_ST4 X87_ST(4)
+#define X87_ST5 X87_ST(5)
+#define X87_ST6 X87_ST(6)
+#define X87_ST7 X87_ST(7)
 
 #define REG_SS state.seg.ss
 #define REG_ES state.seg.es
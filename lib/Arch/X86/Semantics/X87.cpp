@@ -17,6 +17,8 @@
 #pragma once
 
 
+#if !defined(REMILL_X87_ROTATING_STACK)
+
 #define PUSH_X87_STACK(x) \
   do { \
     auto __x = x; \
@@ -51,6 +53,37 @@
     __x; \
   })
 
+#else
+
+// `state.st` is the physical register file, so the registers stay where they
+// are, and only `TOP` moves.
+#define PUSH_X87_STACK(x) \
+  do { \
+    auto __x = x; \
+    state.x87.fxsave.swd.top = \
+        static_cast<uint16_t>((state.x87.fxsave.swd.top + 7) % 8); \
+    X87_ST0 = __x; \
+  } while (false)
+
+#define POP_X87_STACK() \
+  ({ \
+    auto __x = X87_ST0; \
+    state.x87.fxsave.swd.top = \
+        static_cast<uint16_t>((state.x87.fxsave.swd.top + 9) % 8); \
+    __x; \
+  })
+
+#endif  // !defined(REMILL_X87_ROTATING_STACK)
+
+// Tells the lifter whether an `ST(i)` register operand refers to element `i`
+// of `state.st`, or to the element that is `i` slots past `TOP`.
+extern "C" constexpr bool __remill_x87_rotating_stack [[gnu::used]] =
+#if defined(REMILL_X87_ROTATING_STACK)
+    true;
+#else
+    false;
+#endif
+
 namespace {
 
 #define SetFPUIpOp() \
@@ -31,4 +31,14 @@ const std::string_view kUnsupportedInstructionISelName =
 
 const std::string_view kIgnoreNextPCVariableName = "IGNORE_NEXT_PC";
 
+const std::string_view kX87RotatingStackVariableName =
+    "__remill_x87_rotating_stack";
+const std::string_view kX87TopAdjustmentMetadataName =
+    "remill.x87_top_adjustment";
+
+const std::string_view kSPARCWindowBankVariableName =
+    "__remill_sparc_window_bank";
+const std::string_view kSPARCWindowAdjustmentMetadataName =
+    "remill.sparc_window_adjustment";
+
 }  // namespace remill
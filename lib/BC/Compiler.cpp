@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/Compiler.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Triple.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(17, 0)
+#  include <llvm/TargetParser/Host.h>
+#else
+#  include <llvm/Support/Host.h>
+#endif
+
+namespace remill {
+namespace {
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Parse the bitcode of one partition into its own context, and compile it
+// into an object file.
+static bool CompilePartition(const llvm::Target *target,
+                             const std::string &triple,
+                             const CompileOptions &options,
+                             const std::string &cpu, llvm::StringRef bitcode,
+                             std::string &object, std::string &error) {
+  llvm::LLVMContext context;
+  auto maybe_module = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(bitcode, "partition"), context);
+  if (!maybe_module) {
+    error = llvm::toString(maybe_module.takeError());
+    return false;
+  }
+
+  auto &module = *maybe_module;
+  std::unique_ptr<llvm::TargetMachine> tm(target->createTargetMachine(
+      triple, cpu, options.features, llvm::TargetOptions(), llvm::Reloc::PIC_,
+      {}, options.opt_level));
+  if (!tm) {
+    error = "Unable to create target machine for " + triple;
+    return false;
+  }
+
+  // Keep the data layout of the lifted code, which is that of the lifted
+  // architecture, unless it doesn't have one.
+  if (module->getDataLayoutStr().empty()) {
+    module->setDataLayout(tm->createDataLayout());
+  }
+
+  llvm::SmallString<0> buffer;
+  llvm::raw_svector_ostream os(buffer);
+  llvm::legacy::PassManager pm;
+  if (tm->addPassesToEmitFile(pm, os, nullptr, llvm::CGFT_ObjectFile)) {
+    error = "Target " + triple + " cannot emit object files";
+    return false;
+  }
+
+  pm.run(*module);
+  object.assign(buffer.begin(), buffer.end());
+  return true;
+}
+
+}  // namespace
+
+std::optional<std::vector<std::string>>
+CompileModule(const llvm::Module &module, const CompileOptions &options,
+              CompileStatistics *stats) {
+  CompileStatistics local_stats;
+  if (!stats) {
+    stats = &local_stats;
+  }
+
+  static std::once_flag gInitTarget;
+  std::call_once(gInitTarget, [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+  });
+
+  auto triple = module.getTargetTriple();
+  if (triple.empty()) {
+    triple = llvm::sys::getDefaultTargetTriple();
+  }
+
+  std::string error;
+  auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    LOG(ERROR) << "Unable to compile " << module.getName().str() << ": "
+               << error;
+    return std::nullopt;
+  }
+
+  // The host CPU is only meaningful when compiling for the host.
+  auto cpu = options.cpu;
+  if (cpu.empty()) {
+    if (llvm::Triple(triple).getArch() ==
+        llvm::Triple(llvm::sys::getProcessTriple()).getArch()) {
+      cpu = llvm::sys::getHostCPUName().str();
+    } else {
+      cpu = "generic";
+    }
+  }
+
+  auto num_partitions = options.num_partitions;
+  if (!num_partitions) {
+    num_partitions = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (const auto &func : module) {
+    if (!func.isDeclaration()) {
+      ++stats->num_functions;
+    }
+  }
+  num_partitions = static_cast<unsigned>(std::max<size_t>(
+      1u, std::min<size_t>(num_partitions, stats->num_functions)));
+
+  // Split the module, and serialize each partition, so that the partitions
+  // can be compiled in independent contexts.
+  auto start = std::chrono::steady_clock::now();
+  std::vector<llvm::SmallString<0>> bitcodes;
+  auto module_copy = llvm::CloneModule(module);
+  llvm::SplitModule(*module_copy, num_partitions,
+                    [&bitcodes](std::unique_ptr<llvm::Module> part) {
+                      bitcodes.emplace_back();
+                      llvm::raw_svector_ostream os(bitcodes.back());
+                      llvm::WriteBitcodeToFile(*part, os);
+                    });
+  module_copy.reset();
+  stats->split_seconds = SecondsSince(start);
+  stats->num_partitions = bitcodes.size();
+
+  start = std::chrono::steady_clock::now();
+  std::vector<std::string> objects(bitcodes.size());
+  std::vector<std::string> errors(bitcodes.size());
+  std::atomic<bool> ok{true};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < bitcodes.size(); ++i) {
+    threads.emplace_back([&, i] {
+      if (!CompilePartition(target, triple, options, cpu, bitcodes[i],
+                            objects[i], errors[i])) {
+        ok = false;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  stats->codegen_seconds = SecondsSince(start);
+
+  if (!ok) {
+    for (const auto &partition_error : errors) {
+      if (!partition_error.empty()) {
+        LOG(ERROR) << "Unable to compile " << module.getName().str() << ": "
+                   << partition_error;
+      }
+    }
+    return std::nullopt;
+  }
+
+  for (const auto &object : objects) {
+    stats->num_object_bytes += object.size();
+  }
+
+  return objects;
+}
+
+}  // namespace remill
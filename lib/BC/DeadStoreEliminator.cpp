@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+// Liveness is tracked per top-level register (see
+// `Register::EnclosingRegister`) of the `State` structure. A write to a
+// sub-register, e.g. `AL`, uses the slot of `RAX`, but only kills it if the
+// write covers all of `RAX`.
+class StateSlots {
+ public:
+  StateSlots(const Arch *arch, const llvm::DataLayout &dl) {
+    const auto state_size = dl.getTypeAllocSize(arch->StateStructType());
+    byte_to_slot.resize(state_size, kNoSlot);
+
+    std::unordered_map<const Register *, int> slot_of;
+    arch->ForEachRegister([&](const Register *reg) {
+      const auto top = reg->EnclosingRegister();
+      if (slot_of.count(top)) {
+        return;
+      }
+
+      const auto slot = static_cast<int>(slot_begin.size());
+      slot_of.emplace(top, slot);
+      slot_begin.push_back(top->offset);
+      slot_end.push_back(top->offset + top->size);
+
+      for (auto i = top->offset; i < top->offset + top->size; ++i) {
+        if (i >= byte_to_slot.size()) {
+          break;
+        }
+
+        // Overlapping top-level registers are not something we can reason
+        // about, so treat their bytes as unknown.
+        byte_to_slot[i] = byte_to_slot[i] == kNoSlot ? slot : kAmbiguousSlot;
+      }
+    });
+  }
+
+  inline unsigned Size(void) const {
+    return static_cast<unsigned>(slot_begin.size());
+  }
+
+  // Find the slots touched by an access of `size` bytes at `offset`, and the
+  // subset of those slots that are fully covered by the access. Returns
+  // `false` if any of the bytes don't belong to a register.
+  bool Lookup(uint64_t offset, uint64_t size, llvm::BitVector &touched,
+              llvm::BitVector &covered) const {
+    touched.resize(Size());
+    covered.resize(Size());
+    if (!size || (offset + size) > byte_to_slot.size()) {
+      return false;
+    }
+
+    for (auto i = offset; i < offset + size; ++i) {
+      const auto slot = byte_to_slot[i];
+      if (slot < 0) {
+        return false;
+      }
+      touched.set(static_cast<unsigned>(slot));
+    }
+
+    for (auto slot : touched.set_bits()) {
+      if (offset <= slot_begin[slot] && slot_end[slot] <= (offset + size)) {
+        covered.set(slot);
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  static constexpr int kNoSlot = -1;
+  static constexpr int kAmbiguousSlot = -2;
+
+  std::vector<int> byte_to_slot;
+  std::vector<uint64_t> slot_begin;
+  std::vector<uint64_t> slot_end;
+};
+
+// An instruction that interacts with the `State` structure.
+struct StateAccess {
+  enum Kind {
+    kLoad,  // Reads the `gen` slots.
+    kStore,  // Writes the `gen` slots, and fully overwrites the `kill` slots.
+    kCallTrace,  // Transfers control to the lifted trace `callee`.
+    kUnknown  // Might read anything, e.g. `__remill_jump`.
+  };
+
+  Kind kind{kUnknown};
+  llvm::BitVector gen;
+  llvm::BitVector kill;
+  llvm::Function *callee{nullptr};
+};
+
+// Summarizes the effect of executing a trace (until it returns) on the set of
+// live slots: `live_before = gen | (live_after & ~kill)`.
+struct TraceSummary {
+  llvm::BitVector gen;
+  llvm::BitVector kill;
+
+  inline bool operator==(const TraceSummary &that) const {
+    return gen == that.gen && kill == that.kill;
+  }
+};
+
+class DeadStateStoreEliminator {
+ public:
+  DeadStateStoreEliminator(const Arch *arch, llvm::Module *module,
+                           const std::vector<llvm::Function *> &traces_)
+      : slots(arch, module->getDataLayout()),
+        dl(module->getDataLayout()),
+        traces(traces_.begin(), traces_.end()) {}
+
+  size_t Run(void) {
+    for (auto func : traces) {
+      if (!func->isDeclaration()) {
+        FindAccesses(func);
+      }
+    }
+
+    // Optimistically assume that every trace kills everything and reads
+    // nothing, then iterate to a fixpoint. Summaries only ever grow their
+    // `gen` and shrink their `kill` sets, so this terminates.
+    for (auto func : traces) {
+      auto &summary = summaries[func];
+      summary.gen.resize(slots.Size(), false);
+      summary.kill.resize(slots.Size(), true);
+    }
+
+    for (auto changed = true; changed;) {
+      changed = false;
+      for (auto func : traces) {
+        auto summary = Summarize(func);
+        auto &old_summary = summaries[func];
+        if (!(summary == old_summary)) {
+          old_summary = std::move(summary);
+          changed = true;
+        }
+      }
+    }
+
+    std::vector<llvm::StoreInst *> dead_stores;
+    for (auto func : traces) {
+      FindDeadStores(func, dead_stores);
+    }
+
+    // Only delete once the analysis is done, as deleting the stored values
+    // may delete other accesses.
+    accesses.clear();
+    for (auto store : dead_stores) {
+      auto val = store->getValueOperand();
+      auto ptr = store->getPointerOperand();
+      store->eraseFromParent();
+      llvm::RecursivelyDeleteTriviallyDeadInstructions(val);
+      llvm::RecursivelyDeleteTriviallyDeadInstructions(ptr);
+    }
+
+    return dead_stores.size();
+  }
+
+ private:
+  llvm::BitVector AllSlots(void) const {
+    return llvm::BitVector(slots.Size(), true);
+  }
+
+  llvm::BitVector NoSlots(void) const {
+    return llvm::BitVector(slots.Size(), false);
+  }
+
+  // Record `access` as the effect of `inst`. If `inst` was already seen with
+  // another state-derived operand, then it is demoted to an unknown access.
+  void AddAccess(llvm::Instruction *inst, StateAccess access) {
+    auto [it, added] = accesses.emplace(inst, std::move(access));
+    if (!added) {
+      it->second.kind = StateAccess::kUnknown;
+      it->second.gen = AllSlots();
+      it->second.kill = NoSlots();
+      it->second.callee = nullptr;
+    }
+  }
+
+  // Classify all uses of the `State` pointer in `func`. Any use that we
+  // don't understand makes `func` escape, i.e. opaque to this analysis.
+  void FindAccesses(llvm::Function *func) {
+    auto state_ptr = NthArgument(func, kStatePointerArgNum);
+
+    // Pairs of a pointer derived from the `State` pointer, and its offset,
+    // if constant.
+    std::vector<std::pair<llvm::Value *, std::optional<uint64_t>>> work_list;
+    work_list.emplace_back(state_ptr, 0u);
+
+    while (!work_list.empty()) {
+      auto [ptr, offset] = work_list.back();
+      work_list.pop_back();
+
+      for (auto &use : ptr->uses()) {
+        auto user = use.getUser();
+
+        if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+          llvm::APInt delta(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+          if (offset && gep->accumulateConstantOffset(dl, delta) &&
+              !delta.isNegative()) {
+            work_list.emplace_back(gep, *offset + delta.getZExtValue());
+          } else {
+            work_list.emplace_back(gep, std::nullopt);
+          }
+
+        } else if (auto cast = llvm::dyn_cast<llvm::BitCastOperator>(user)) {
+          work_list.emplace_back(cast, offset);
+
+        } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(user)) {
+          StateAccess access;
+          access.kind = StateAccess::kLoad;
+          access.gen = NoSlots();
+          access.kill = NoSlots();
+          llvm::BitVector covered;
+          if (load->isVolatile() || !offset ||
+              !slots.Lookup(*offset, dl.getTypeStoreSize(load->getType()),
+                            access.gen, covered)) {
+            access.gen = AllSlots();
+          }
+          AddAccess(load, std::move(access));
+
+        } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+          if (use.getOperandNo() !=
+              llvm::StoreInst::getPointerOperandIndex()) {
+            escaping.insert(func);
+            return;
+          }
+
+          StateAccess access;
+          access.kind = StateAccess::kStore;
+          access.gen = NoSlots();
+          access.kill = NoSlots();
+
+          // A store whose target isn't known kills nothing, and is never
+          // removed.
+          if (store->isVolatile() || !offset ||
+              !slots.Lookup(
+                  *offset,
+                  dl.getTypeStoreSize(store->getValueOperand()->getType()),
+                  access.gen, access.kill)) {
+            access.kind = StateAccess::kUnknown;
+            access.gen = NoSlots();
+            access.kill = NoSlots();
+          }
+          AddAccess(store, std::move(access));
+
+        } else if (auto call = llvm::dyn_cast<llvm::CallBase>(user)) {
+          StateAccess access;
+          access.gen = AllSlots();
+          access.kill = NoSlots();
+
+          auto callee = call->getCalledFunction();
+          if (callee && offset && !*offset && traces.count(callee) &&
+              call->isArgOperand(&use) &&
+              call->getArgOperandNo(&use) == kStatePointerArgNum) {
+            access.kind = StateAccess::kCallTrace;
+            access.callee = callee;
+          }
+
+          AddAccess(call, std::move(access));
+
+        } else {
+          escaping.insert(func);
+          return;
+        }
+      }
+    }
+  }
+
+  // Compute the effect of `access` on the slots that are `live` after it.
+  void Transfer(const StateAccess &access, llvm::BitVector &live) const {
+    switch (access.kind) {
+      case StateAccess::kLoad: live |= access.gen; break;
+      case StateAccess::kStore: live.reset(access.kill); break;
+      case StateAccess::kCallTrace: {
+        const auto &summary = summaries.at(access.callee);
+        live.reset(summary.kill);
+        live |= summary.gen;
+        break;
+      }
+      case StateAccess::kUnknown: live |= access.gen; break;
+    }
+  }
+
+  // Compute the slots live on exit from `block`, given the slots live on
+  // entry to each block.
+  llvm::BitVector LiveOut(
+      llvm::BasicBlock *block, const llvm::BitVector &on_return,
+      const std::unordered_map<llvm::BasicBlock *, llvm::BitVector> &live_in)
+      const {
+    auto term = block->getTerminator();
+    if (llvm::isa<llvm::ReturnInst>(term)) {
+      return on_return;
+    } else if (llvm::isa<llvm::UnreachableInst>(term)) {
+      return NoSlots();
+    } else if (!term->getNumSuccessors()) {
+      return AllSlots();
+    }
+
+    auto live = NoSlots();
+    for (auto succ : llvm::successors(block)) {
+      if (auto it = live_in.find(succ); it != live_in.end()) {
+        live |= it->second;
+      }
+    }
+    return live;
+  }
+
+  // Compute the slots live on entry to every block of `func`, given the
+  // slots that are live once `func` returns.
+  std::unordered_map<llvm::BasicBlock *, llvm::BitVector>
+  Liveness(llvm::Function *func, const llvm::BitVector &on_return) const {
+    std::unordered_map<llvm::BasicBlock *, llvm::BitVector> live_in;
+    for (auto changed = true; changed;) {
+      changed = false;
+      for (auto block : llvm::post_order(&(func->getEntryBlock()))) {
+        auto live = LiveOut(block, on_return, live_in);
+        for (auto &inst : llvm::reverse(*block)) {
+          if (auto it = accesses.find(&inst); it != accesses.end()) {
+            Transfer(it->second, live);
+          }
+        }
+
+        auto &old_live = live_in[block];
+        if (old_live != live) {
+          old_live = std::move(live);
+          changed = true;
+        }
+      }
+    }
+    return live_in;
+  }
+
+  TraceSummary Summarize(llvm::Function *func) const {
+    TraceSummary summary;
+    if (func->isDeclaration() || escaping.count(func)) {
+      summary.gen = AllSlots();
+      summary.kill = NoSlots();
+      return summary;
+    }
+
+    auto entry = &(func->getEntryBlock());
+    summary.gen = Liveness(func, NoSlots())[entry];
+    summary.kill = Liveness(func, AllSlots())[entry];
+    summary.kill.flip();
+    return summary;
+  }
+
+  // Find the stores in `func` to slots that are dead after the store.
+  // Whatever is observed once `func` returns is unknown, so every slot is
+  // live on return.
+  void FindDeadStores(llvm::Function *func,
+                      std::vector<llvm::StoreInst *> &dead_stores) const {
+    if (func->isDeclaration() || escaping.count(func)) {
+      return;
+    }
+
+    const auto on_return = AllSlots();
+    const auto live_in = Liveness(func, on_return);
+
+    for (auto &block : *func) {
+      if (!live_in.count(&block)) {
+        continue;  // Unreachable.
+      }
+
+      auto live = LiveOut(&block, on_return, live_in);
+      for (auto &inst : llvm::reverse(block)) {
+        auto it = accesses.find(&inst);
+        if (it == accesses.end()) {
+          continue;
+        }
+
+        const auto &access = it->second;
+        if (access.kind == StateAccess::kStore &&
+            !live.anyCommon(access.gen)) {
+          dead_stores.push_back(llvm::cast<llvm::StoreInst>(&inst));
+        }
+        Transfer(access, live);
+      }
+    }
+  }
+
+  const StateSlots slots;
+  const llvm::DataLayout &dl;
+  const std::unordered_set<llvm::Function *> traces;
+
+  std::unordered_map<llvm::Instruction *, StateAccess> accesses;
+  std::unordered_set<llvm::Function *> escaping;
+  std::unordered_map<llvm::Function *, TraceSummary> summaries;
+};
+
+}  // namespace
+
+// Remove stores into the `State` structure whose values are always
+// overwritten before being read.
+size_t RemoveDeadStateStores(const Arch *arch, llvm::Module *module,
+                             const std::vector<llvm::Function *> &traces) {
+  if (traces.empty()) {
+    return 0;
+  }
+
+  DeadStateStoreEliminator dse(arch, module, traces);
+  const auto num_removed = dse.Run();
+  DLOG(INFO) << "Removed " << num_removed << " dead State stores from "
+             << traces.size() << " traces in " << ModuleName(module);
+  return num_removed;
+}
+
+}  // namespace remill
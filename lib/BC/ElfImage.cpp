@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ElfImage.h"
+
+#include <glog/logging.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/Object/ELFObjectFile.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace remill {
+namespace {
+
+// A loadable segment of the ELF file.
+struct Segment {
+  uint64_t vaddr;
+  uint64_t mem_size;
+  const uint8_t *data;
+  uint64_t file_size;
+
+  inline bool Contains(uint64_t addr) const {
+    return vaddr <= addr && (addr - vaddr) < mem_size;
+  }
+
+  // Read a byte of the segment. Bytes of the segment beyond what is backed by
+  // the file are zero.
+  inline uint8_t Read(uint64_t addr) const {
+    const auto offset = addr - vaddr;
+    return offset < file_size ? data[offset] : 0u;
+  }
+};
+
+// Find the segment of `segments` containing `addr`. `last` caches the most
+// recently found segment.
+static const Segment *FindSegment(const std::vector<Segment> &segments,
+                                  const Segment *&last, uint64_t addr) {
+  if (last && last->Contains(addr)) {
+    return last;
+  }
+
+  auto it = std::upper_bound(
+      segments.begin(), segments.end(), addr,
+      [](uint64_t a, const Segment &seg) { return a < seg.vaddr; });
+  if (it == segments.begin()) {
+    return nullptr;
+  }
+
+  --it;
+  if (!it->Contains(addr)) {
+    return nullptr;
+  }
+
+  last = &*it;
+  return last;
+}
+
+}  // namespace
+
+class ElfImage::Impl {
+ public:
+  explicit Impl(const std::string &path);
+
+  template <typename ELFT>
+  bool ReadSegments(const llvm::object::ELFFile<ELFT> &elf);
+
+  void ReadSymbols(const llvm::object::ELFObjectFileBase &obj);
+
+  void AddTraceHead(uint64_t addr);
+
+  inline const Segment *FindSegment(uint64_t addr) {
+    return remill::FindSegment(segments, last_segment, addr);
+  }
+
+  // The mapped file. `MemoryBuffer::getFile` uses `mmap` where possible.
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+
+  // Executable segments, sorted by address.
+  std::vector<Segment> segments;
+  const Segment *last_segment{nullptr};
+
+  // Executable or non-writable segments, sorted by address.
+  std::vector<Segment> data_segments;
+  const Segment *last_data_segment{nullptr};
+
+  std::vector<uint64_t> trace_heads;
+  std::unordered_set<uint64_t> thumb_trace_heads;
+  uint64_t entry_point{0};
+  uint16_t machine{0};
+  bool is_little_endian{true};
+  bool is_valid{false};
+};
+
+ElfImage::Impl::Impl(const std::string &path) {
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      path, false /* IsText */, false /* RequiresNullTerminator */);
+  if (!maybe_buffer) {
+    LOG(ERROR) << "Unable to open ELF file " << path << ": "
+               << maybe_buffer.getError().message();
+    return;
+  }
+  buffer = std::move(*maybe_buffer);
+
+  auto maybe_obj =
+      llvm::object::ObjectFile::createObjectFile(buffer->getMemBufferRef());
+  if (!maybe_obj) {
+    LOG(ERROR) << "Unable to parse " << path << ": "
+               << llvm::toString(maybe_obj.takeError());
+    return;
+  }
+
+  auto obj = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(maybe_obj->get());
+  if (!obj) {
+    LOG(ERROR) << path << " is not an ELF file";
+    return;
+  }
+
+  machine = obj->getEMachine();
+  is_little_endian = obj->isLittleEndian();
+
+  bool ok = false;
+  if (auto elf32le = llvm::dyn_cast<llvm::object::ELF32LEObjectFile>(obj)) {
+    ok = ReadSegments(elf32le->getELFFile());
+  } else if (auto elf32be =
+                 llvm::dyn_cast<llvm::object::ELF32BEObjectFile>(obj)) {
+    ok = ReadSegments(elf32be->getELFFile());
+  } else if (auto elf64le =
+                 llvm::dyn_cast<llvm::object::ELF64LEObjectFile>(obj)) {
+    ok = ReadSegments(elf64le->getELFFile());
+  } else if (auto elf64be =
+                 llvm::dyn_cast<llvm::object::ELF64BEObjectFile>(obj)) {
+    ok = ReadSegments(elf64be->getELFFile());
+  }
+
+  if (!ok) {
+    LOG(ERROR) << "Unable to read the program headers of " << path;
+    return;
+  }
+
+  auto by_address = [](const Segment &a, const Segment &b) {
+    return a.vaddr < b.vaddr;
+  };
+  std::sort(segments.begin(), segments.end(), by_address);
+  std::sort(data_segments.begin(), data_segments.end(), by_address);
+
+  AddTraceHead(entry_point);
+  ReadSymbols(*obj);
+
+  std::sort(trace_heads.begin(), trace_heads.end());
+  trace_heads.erase(std::unique(trace_heads.begin(), trace_heads.end()),
+                    trace_heads.end());
+
+  DLOG(INFO) << "Found " << segments.size() << " executable segments, "
+             << data_segments.size() << " read-only segments, and "
+             << trace_heads.size() << " trace heads in " << path;
+  is_valid = true;
+}
+
+// Collect the executable or read-only, loadable segments of `elf`.
+template <typename ELFT>
+bool ElfImage::Impl::ReadSegments(
+    const llvm::object::ELFFile<ELFT> &elf) {
+  entry_point = elf.getHeader().e_entry;
+
+  auto phdrs = elf.program_headers();
+  if (!phdrs) {
+    LOG(ERROR) << llvm::toString(phdrs.takeError());
+    return false;
+  }
+
+  const auto base = elf.base();
+  const auto size = elf.getBufSize();
+  for (const auto &phdr : *phdrs) {
+    const auto is_exec = (phdr.p_flags & llvm::ELF::PF_X) != 0;
+    const auto is_read_only = !(phdr.p_flags & llvm::ELF::PF_W);
+    if (phdr.p_type != llvm::ELF::PT_LOAD || !(is_exec || is_read_only) ||
+        !phdr.p_memsz) {
+      continue;
+    }
+
+    if (phdr.p_offset > size || phdr.p_filesz > (size - phdr.p_offset) ||
+        phdr.p_filesz > phdr.p_memsz) {
+      LOG(ERROR) << "Segment at " << std::hex << phdr.p_vaddr << std::dec
+                 << " is out of bounds of the file";
+      return false;
+    }
+
+    const Segment seg = {phdr.p_vaddr, phdr.p_memsz, base + phdr.p_offset,
+                         phdr.p_filesz};
+    data_segments.push_back(seg);
+    if (is_exec) {
+      segments.push_back(seg);
+    }
+  }
+
+  return true;
+}
+
+// Add every defined function symbol in an executable segment as a trace head.
+void ElfImage::Impl::ReadSymbols(
+    const llvm::object::ELFObjectFileBase &obj) {
+  auto add_symbols = [this](auto symbols) {
+    for (const llvm::object::ELFSymbolRef sym : symbols) {
+      if (sym.getELFType() != llvm::ELF::STT_FUNC) {
+        continue;
+      }
+
+      auto addr = sym.getAddress();
+      if (!addr) {
+        llvm::consumeError(addr.takeError());
+        continue;
+      }
+
+      AddTraceHead(*addr);
+    }
+  };
+
+  add_symbols(obj.symbols());
+  add_symbols(obj.getDynamicSymbolIterators());
+}
+
+// Add `addr` as a trace head if it's in an executable segment. On 32-bit ARM,
+// bit 0 of a code address selects Thumb mode.
+void ElfImage::Impl::AddTraceHead(uint64_t addr) {
+  const auto is_thumb = machine == llvm::ELF::EM_ARM && (addr & 1u);
+  if (is_thumb) {
+    addr &= ~1ull;
+  }
+
+  if (!addr || !FindSegment(addr)) {
+    return;
+  }
+
+  trace_heads.push_back(addr);
+  if (is_thumb) {
+    thumb_trace_heads.insert(addr);
+  }
+}
+
+ElfImage::~ElfImage(void) {}
+
+ElfImage::ElfImage(const std::string &path)
+    : impl(new Impl(path)) {}
+
+bool ElfImage::IsValid(void) const {
+  return impl->is_valid;
+}
+
+uint16_t ElfImage::Machine(void) const {
+  return impl->machine;
+}
+
+bool ElfImage::IsLittleEndian(void) const {
+  return impl->is_little_endian;
+}
+
+uint64_t ElfImage::EntryPoint(void) const {
+  if (impl->machine == llvm::ELF::EM_ARM) {
+    return impl->entry_point & ~1ull;
+  }
+  return impl->entry_point;
+}
+
+const std::vector<uint64_t> &ElfImage::TraceHeads(void) const {
+  return impl->trace_heads;
+}
+
+bool ElfImage::IsThumb(uint64_t addr) const {
+  return impl->thumb_trace_heads.count(addr) != 0;
+}
+
+// Read a byte out of an executable segment.
+bool ElfImage::TryReadExecutableByte(uint64_t addr, uint8_t *byte) {
+  auto seg = impl->FindSegment(addr);
+  if (!seg) {
+    return false;
+  }
+
+  *byte = seg->Read(addr);
+  return true;
+}
+
+// Read a byte out of an executable or non-writable segment.
+bool ElfImage::TryReadDataByte(uint64_t addr, uint8_t *byte) {
+  auto seg =
+      FindSegment(impl->data_segments, impl->last_data_segment, addr);
+  if (!seg) {
+    return false;
+  }
+
+  *byte = seg->Read(addr);
+  return true;
+}
+
+}  // namespace remill
@@ -41,6 +41,23 @@ llvm::Function *GetInstructionFunction(llvm::Module *module,
   return llvm::dyn_cast_or_null<llvm::Function>(sem);
 }
 
+// Record on a call to the semantics of an instruction how the instruction
+// moves a register file, e.g. the x87 register stack. An empty node means
+// that the adjustment isn't known, and no node means that there is none.
+static void SetAdjustmentMetadata(llvm::CallInst *call, std::string_view kind,
+                                  std::optional<int8_t> adjustment) {
+  auto &context = call->getContext();
+  if (!adjustment) {
+    call->setMetadata(kind, llvm::MDNode::get(context, {}));
+  } else if (*adjustment) {
+    auto adjustment_val = llvm::ConstantInt::getSigned(
+        llvm::Type::getInt8Ty(context), *adjustment);
+    call->setMetadata(
+        kind, llvm::MDNode::get(
+                  context, llvm::ConstantAsMetadata::get(adjustment_val)));
+  }
+}
+
 }  // namespace
 
 InstructionLifter::Impl::Impl(const Arch *arch_,
@@ -57,7 +74,9 @@ InstructionLifter::Impl::Impl(const Arch *arch_,
       invalid_instruction(
           GetInstructionFunction(module, kInvalidInstructionISelName)),
       unsupported_instruction(
-          GetInstructionFunction(module, kUnsupportedInstructionISelName)) {
+          GetInstructionFunction(module, kUnsupportedInstructionISelName)),
+      rotating_x87_stack(HasRotatingX87Stack(module)),
+      sparc_window_bank(HasSPARCWindowBank(module)) {
 
   CHECK(invalid_instruction != nullptr)
       << kInvalidInstructionISelName << " doesn't exist";
@@ -82,11 +101,33 @@ LiftStatus InstructionLifterIntf::LiftIntoBlock(Instruction &inst,
                        is_delayed);
 }
 
+LiftingStatistics *InstructionLifter::Statistics(void) const {
+  return impl->arch->Statistics();
+}
+
 // Lift a single instruction into a basic block.
 LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
                                             llvm::BasicBlock *block,
                                             llvm::Value *state_ptr,
                                             bool is_delayed) {
+  const auto stats = Statistics();
+  if (!stats) {
+    return LiftIntoBlockImpl(arch_inst, block, state_ptr, is_delayed);
+  }
+
+  const auto start = LiftingStatistics::Clock::now();
+  const auto status =
+      LiftIntoBlockImpl(arch_inst, block, state_ptr, is_delayed);
+  stats->RecordLift(arch_inst.IsValid() ? std::string_view(arch_inst.function)
+                                        : kInvalidInstructionISelName,
+                    status, start);
+  return status;
+}
+
+LiftStatus InstructionLifter::LiftIntoBlockImpl(Instruction &arch_inst,
+                                                llvm::BasicBlock *block,
+                                                llvm::Value *state_ptr,
+                                                bool is_delayed) {
   llvm::Function *const func = block->getParent();
   llvm::Module *const module = func->getParent();
   llvm::Function *isel_func = nullptr;
@@ -193,7 +234,25 @@ LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
   args[0] = ir.CreateLoad(impl->memory_ptr_type, mem_ptr_ref);
 
   // Call the function that implements the instruction semantics.
-  ir.CreateStore(ir.CreateCall(isel_func, args), mem_ptr_ref);
+  const auto isel_call = ir.CreateCall(isel_func, args);
+  ir.CreateStore(isel_call, mem_ptr_ref);
+
+  // Tell `ResolveX87StackOperands` how this instruction moves `TOP`.
+  if (impl->rotating_x87_stack) {
+    SetAdjustmentMetadata(isel_call, kX87TopAdjustmentMetadataName,
+                          kLiftedInstruction == status
+                              ? arch_inst.x87_top_adjustment
+                              : std::nullopt);
+  }
+
+  // Tell `ResolveSPARCWindowOperands` how this instruction moves `CWP`.
+  if (impl->sparc_window_bank) {
+    SetAdjustmentMetadata(isel_call, kSPARCWindowAdjustmentMetadataName,
+                          kLiftedInstruction == status
+                              ? std::optional<int8_t>(
+                                    arch_inst.sparc_window_adjustment)
+                              : std::nullopt);
+  }
 
   // End an atomic block.
   if (arch_inst.is_atomic_read_modify_write) {
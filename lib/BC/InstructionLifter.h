@@ -46,6 +46,7 @@
 #include "remill/Arch/Arch.h"
 #include "remill/Arch/Instruction.h"
 #include "remill/Arch/Name.h"
+#include "remill/Arch/Statistics.h"
 #include "remill/BC/ABI.h"
 #include "remill/BC/IntrinsicTable.h"
 #include "remill/BC/Util.h"
@@ -80,6 +81,12 @@ class InstructionLifter::Impl {
   llvm::Module *const module;
   llvm::Function *const invalid_instruction;
   llvm::Function *const unsupported_instruction;
+
+  // Do the semantics index the x87 register stack by `TOP`?
+  const bool rotating_x87_stack;
+
+  // Do the semantics find the SPARC windowed registers using `CWP`?
+  const bool sparc_window_bank;
 };
 
 }  // namespace remill
@@ -0,0 +1,746 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/JumpTable.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/BC/TraceLifter.h"
+
+namespace remill {
+namespace {
+
+// Upper bound on the number of entries of a recovered table. Larger bounds
+// are more likely to come from a misidentified comparison than from a
+// `switch`.
+static constexpr uint64_t kMaxJumpTableEntries = 4096u;
+
+static uint64_t Mask(unsigned bits) {
+  return bits >= 64u ? ~0ull : ((1ull << bits) - 1u);
+}
+
+static uint64_t SignExtend(uint64_t val, unsigned bits) {
+  if (bits >= 64u) {
+    return val;
+  }
+  const auto sign = 1ull << (bits - 1u);
+  return ((val & Mask(bits)) ^ sign) - sign;
+}
+
+// Name of the semantics of `inst`, up to the first underscore, e.g. `MOVSXD`
+// for `MOVSXD_GPRv_MEMd_64`.
+static std::string_view Mnemonic(const Instruction &inst) {
+  std::string_view name = inst.function;
+  return name.substr(0, name.find('_'));
+}
+
+// Suffix of the semantics of `inst`, after the last underscore, e.g. `64` for
+// `MOVSXD_GPRv_MEMd_64`, or `HI` for `B_ONLY_CONDBRANCH_HI`.
+static std::string_view Suffix(const Instruction &inst) {
+  std::string_view name = inst.function;
+  const auto under = name.rfind('_');
+  return under == std::string_view::npos ? std::string_view()
+                                         : name.substr(under + 1u);
+}
+
+// What is known about the value of a register or of an operand. Only the low
+// `bits` bits of a value are meaningful.
+struct Value {
+  enum Kind {
+    kUnknown,
+
+    // `constant`.
+    kConstant,
+
+    // `index * stride`, for some `index` that is at most `bound`.
+    kIndex,
+
+    // `constant + (Extend(entry) << shift)`, where `entry` is the
+    // `entry_size`-byte entry at `table_addr + index * entry_size`, for some
+    // `index` that is at most `bound`.
+    kEntry
+  } kind{kUnknown};
+
+  unsigned bits{64};
+
+  // For `kUnknown`, the bits at and above `zero_above` are known to be zero.
+  unsigned zero_above{64};
+
+  uint64_t constant{0};
+  uint64_t bound{0};
+  uint64_t stride{1};
+  uint64_t table_addr{0};
+  unsigned entry_size{0};
+  bool entry_is_signed{false};
+  unsigned shift{0};
+
+  static Value Constant(uint64_t val) {
+    Value ret;
+    ret.kind = kConstant;
+    ret.constant = val;
+    return ret;
+  }
+
+  inline bool IsFull(void) const {
+    return bits >= 64u;
+  }
+
+  inline bool IsConstant(void) const {
+    return kConstant == kind && IsFull();
+  }
+};
+
+// An address computed as `constant + index * stride`, for some `index` that is
+// at most `bound`.
+struct AddressValue {
+  bool is_known{true};
+  bool has_index{false};
+  uint64_t constant{0};
+  uint64_t bound{0};
+  uint64_t stride{0};
+
+  void Add(const Value &val, uint64_t scale) {
+    if (val.IsConstant()) {
+      constant += val.constant * scale;
+    } else if (Value::kIndex == val.kind && val.IsFull() && !has_index) {
+      has_index = true;
+      bound = val.bound;
+      stride = val.stride * scale;
+    } else {
+      is_known = false;
+    }
+  }
+};
+
+// Conditions of branches that bound an unsigned comparison.
+enum class Bound { kAbove, kAboveOrEqual, kBelowOrEqual, kBelow };
+
+// A comparison of a register with an immediate, whose flags are available to
+// the next instruction.
+struct Comparison {
+  std::string reg_name;
+  unsigned width{0};
+  uint64_t imm{0};
+};
+
+// Symbolically executes a straight-line path of instructions, tracking how
+// registers are derived from a bounded index, up to an indirect jump.
+class JumpTableRecognizer {
+ public:
+  JumpTableRecognizer(const Arch *arch_, TraceManager &manager_)
+      : arch(arch_),
+        manager(manager_),
+        addr_mask(arch->address_size >= 64 ? ~0ull
+                                           : Mask(arch->address_size)) {}
+
+  std::optional<JumpTable> Run(const std::vector<const Instruction *> &insts) {
+    if (insts.empty() || (!arch->IsAMD64() && !arch->IsAArch64())) {
+      return std::nullopt;
+    }
+
+    const auto &jump = *insts.back();
+    if (Instruction::kCategoryIndirectJump != jump.category) {
+      return std::nullopt;
+    }
+
+    for (size_t i = 0; i + 1u < insts.size(); ++i) {
+      Visit(*insts[i], insts[i + 1u]->pc);
+    }
+
+    const auto target = JumpTarget(jump);
+    if (Value::kEntry != target.kind || !target.IsFull()) {
+      return std::nullopt;
+    }
+
+    return ReadTable(target);
+  }
+
+ private:
+  // Name of the register containing `reg`, or an empty string if there is no
+  // such register.
+  std::string RegisterName(const Operand::Register &reg) const {
+    if (auto arch_reg = arch->RegisterByName(reg.name)) {
+      return arch_reg->EnclosingRegister()->name;
+    }
+    return {};
+  }
+
+  // Extend the low `bits` bits of `val`.
+  static Value Extend(const Value &val, unsigned bits, bool is_signed) {
+    if (bits >= 64u) {
+      return val;
+    }
+
+    Value ret;
+    if (val.bits < bits) {
+      return ret;
+    }
+
+    switch (val.kind) {
+      case Value::kUnknown:
+        if (!is_signed) {
+          ret.zero_above = bits;
+        }
+        return ret;
+
+      case Value::kConstant:
+        return Value::Constant(is_signed ? SignExtend(val.constant, bits)
+                                         : (val.constant & Mask(bits)));
+
+      case Value::kIndex:
+        if ((val.bound * val.stride) >= (1ull << (bits - is_signed))) {
+          return ret;
+        }
+        ret = val;
+        ret.bits = 64u;
+        return ret;
+
+      case Value::kEntry: {
+        if (val.constant || val.shift) {
+          return ret;
+        }
+
+        const auto entry_bits = val.entry_size * 8u;
+        ret = val;
+        ret.bits = 64u;
+        if (bits < entry_bits) {
+          if (bits % 8u) {
+            return {};
+          }
+          ret.entry_size = bits / 8u;
+          ret.entry_is_signed = is_signed;
+        } else if (bits == entry_bits) {
+          ret.entry_is_signed = is_signed;
+        } else if (val.entry_is_signed && !is_signed) {
+          return {};
+        }
+        return ret;
+      }
+    }
+    return ret;
+  }
+
+  static Value Add(const Value &a, const Value &b) {
+    if (!a.IsFull() || !b.IsFull()) {
+      return {};
+    } else if (a.IsConstant() && b.IsConstant()) {
+      return Value::Constant(a.constant + b.constant);
+    } else if (Value::kEntry == a.kind && b.IsConstant()) {
+      auto ret = a;
+      ret.constant += b.constant;
+      return ret;
+    } else if (a.IsConstant() && Value::kEntry == b.kind) {
+      return Add(b, a);
+    } else {
+      return {};
+    }
+  }
+
+  Value Read(const Instruction &inst, const Operand::Register &reg) {
+    Value val;
+    if (reg.name == "NEXT_PC") {
+      val = Value::Constant(inst.next_pc);
+    } else if (reg.name == "PC") {
+      val = Value::Constant(inst.pc);
+    } else if (reg.name == "XZR" || reg.name == "WZR") {
+      val = Value::Constant(0);
+    } else if (auto name = RegisterName(reg); !name.empty()) {
+      if (auto reg_it = regs.find(name); reg_it != regs.end()) {
+        val = reg_it->second;
+      }
+    }
+
+    if (reg.size < 64u) {
+      val.constant &= Mask(static_cast<unsigned>(reg.size));
+      val.bits = std::min(val.bits, static_cast<unsigned>(reg.size));
+    }
+    return val;
+  }
+
+  Value Read(const Instruction &inst, const Operand &op) {
+    switch (op.type) {
+      case Operand::kTypeRegister: return Read(inst, op.reg);
+      case Operand::kTypeImmediate: return Value::Constant(op.imm.val);
+      case Operand::kTypeShiftRegister: return ReadShifted(inst, op);
+      case Operand::kTypeAddress:
+        if (op.addr.IsAddressCalculation()) {
+          if (auto addr = Address(inst, op.addr);
+              addr.is_known && !addr.has_index) {
+            return Value::Constant(addr.constant);
+          }
+        }
+        return {};
+      default: return {};
+    }
+  }
+
+  // Read an extended and/or shifted register, e.g. `w2, sxtb #2`.
+  Value ReadShifted(const Instruction &inst, const Operand &op) {
+    const auto &shift_reg = op.shift_reg;
+    auto val = Read(inst, shift_reg.reg);
+
+    const auto has_extend =
+        Operand::ShiftRegister::kExtendInvalid != shift_reg.extend_op &&
+        shift_reg.extract_size;
+    const auto has_shift =
+        Operand::ShiftRegister::kShiftInvalid != shift_reg.shift_op &&
+        shift_reg.shift_size;
+
+    if (has_extend) {
+      if (has_shift && shift_reg.shift_first) {
+        return {};
+      }
+      val = Extend(
+          val, static_cast<unsigned>(shift_reg.extract_size),
+          Operand::ShiftRegister::kExtendSigned == shift_reg.extend_op);
+    }
+
+    if (!has_shift) {
+      return val;
+    } else if (Operand::ShiftRegister::kShiftLeftWithZeroes !=
+                   shift_reg.shift_op ||
+               shift_reg.shift_size >= 64u || !val.IsFull()) {
+      return {};
+    }
+
+    const auto shift = static_cast<unsigned>(shift_reg.shift_size);
+    switch (val.kind) {
+      case Value::kConstant: val.constant <<= shift; return val;
+      case Value::kIndex: val.stride <<= shift; return val;
+      case Value::kEntry:
+        val.constant <<= shift;
+        val.shift += shift;
+        return val;
+      default: return {};
+    }
+  }
+
+  AddressValue Address(const Instruction &inst,
+                       const Operand::Address &addr) {
+    AddressValue ret;
+    ret.constant = static_cast<uint64_t>(addr.displacement);
+    if (!addr.segment_base_reg.name.empty()) {
+      ret.is_known = false;
+    }
+    if (!addr.base_reg.name.empty()) {
+      ret.Add(Read(inst, addr.base_reg), 1u);
+    }
+    if (!addr.index_reg.name.empty()) {
+      ret.Add(Read(inst, addr.index_reg), static_cast<uint64_t>(addr.scale));
+    }
+    return ret;
+  }
+
+  // Load a `size`-byte entry from a table.
+  static Value Load(const AddressValue &addr, unsigned size, bool is_signed) {
+    Value ret;
+    if (!addr.is_known || !addr.has_index || addr.stride != size ||
+        !size || size > 8u) {
+      return ret;
+    }
+
+    ret.kind = Value::kEntry;
+    ret.table_addr = addr.constant;
+    ret.bound = addr.bound;
+    ret.entry_size = size;
+    ret.entry_is_signed = is_signed && size < 8u;
+    return ret;
+  }
+
+  // Write the `width`-bit `val` to the register `op`.
+  void Write(const Operand &op, Value val, unsigned width) {
+    if (Operand::kTypeRegister != op.type) {
+      return;
+    }
+
+    const auto name = RegisterName(op.reg);
+    if (name.empty()) {
+      return;
+    }
+
+    // Writes to 32-bit registers zero the high bits, but narrower writes
+    // merge with the old value of the register on x86.
+    width = std::min(width, static_cast<unsigned>(op.reg.size));
+    if (width < 32u) {
+      regs[name] = {};
+    } else {
+      val.bits = std::min(val.bits, width);
+      regs[name] = Extend(val, width, false);
+    }
+  }
+
+  // Forget the values of the registers written by `inst`.
+  void Clobber(const Instruction &inst) {
+    for (const auto &op : inst.operands) {
+      if (Operand::kActionWrite == op.action &&
+          Operand::kTypeRegister == op.type) {
+        if (auto name = RegisterName(op.reg); !name.empty()) {
+          regs[name] = {};
+        }
+      }
+    }
+  }
+
+  // Apply the bound of the conditional branch `inst` on the path to `next_pc`
+  // to the register of the comparison before it.
+  void ApplyBound(const Instruction &inst, uint64_t next_pc, Bound cond,
+                  const std::optional<Comparison> &cmp) {
+    const auto taken = next_pc == inst.branch_taken_pc;
+    if (!cmp || taken == (next_pc == inst.branch_not_taken_pc)) {
+      return;
+    }
+
+    uint64_t bound = cmp->imm & Mask(cmp->width);
+    switch (cond) {
+      case Bound::kAbove:
+        if (taken) {
+          return;
+        }
+        break;
+      case Bound::kAboveOrEqual:
+        if (taken || !bound--) {
+          return;
+        }
+        break;
+      case Bound::kBelowOrEqual:
+        if (!taken) {
+          return;
+        }
+        break;
+      case Bound::kBelow:
+        if (!taken || !bound--) {
+          return;
+        }
+        break;
+    }
+
+    auto &reg_val = regs[cmp->reg_name];
+    Value index;
+    index.kind = Value::kIndex;
+    index.bound = bound;
+    index.bits = (Value::kUnknown == reg_val.kind &&
+                  reg_val.zero_above <= cmp->width)
+                     ? 64u
+                     : cmp->width;
+    reg_val = index;
+  }
+
+  // Returns the comparison of a register with an immediate, if `inst` is one.
+  std::optional<Comparison> CompareX86(const Instruction &inst) const {
+    const auto &ops = inst.operands;
+    if (Mnemonic(inst) != "CMP" || ops.size() < 2u ||
+        Operand::kTypeRegister != ops[0].type ||
+        Operand::kTypeImmediate != ops[1].type) {
+      return std::nullopt;
+    }
+    return Comparison{RegisterName(ops[0].reg),
+                      static_cast<unsigned>(ops[0].reg.size), ops[1].imm.val};
+  }
+
+  std::optional<Comparison> CompareAArch64(const Instruction &inst) const {
+    const auto &ops = inst.operands;
+    if (Mnemonic(inst) != "SUBS" || ops.size() != 3u ||
+        Operand::kTypeRegister != ops[1].type ||
+        Operand::kTypeImmediate != ops[2].type) {
+      return std::nullopt;
+    }
+
+    // E.g. `subs w0, w0, #5` doesn't leave the compared value in `w0`.
+    auto name = RegisterName(ops[1].reg);
+    if (Operand::kTypeRegister == ops[0].type &&
+        RegisterName(ops[0].reg) == name) {
+      return std::nullopt;
+    }
+    return Comparison{std::move(name), static_cast<unsigned>(ops[1].reg.size),
+                      ops[2].imm.val};
+  }
+
+  static std::optional<Bound> BranchCondition(const Instruction &inst,
+                                              bool is_aarch64) {
+    if (Instruction::kCategoryConditionalBranch != inst.category) {
+      return std::nullopt;
+    }
+
+    const auto cond = is_aarch64 ? Suffix(inst) : Mnemonic(inst);
+    if (cond == "JNBE" || cond == "HI") {
+      return Bound::kAbove;
+    } else if (cond == "JNB" || cond == "CS") {
+      return Bound::kAboveOrEqual;
+    } else if (cond == "JBE" || cond == "LS") {
+      return Bound::kBelowOrEqual;
+    } else if (cond == "JB" || cond == "CC") {
+      return Bound::kBelow;
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  // Width, in bits, of the result of the x86 instruction `inst`. Writes to
+  // 32-bit registers are decoded as writes to the enclosing 64-bit register,
+  // so this comes from the operand size suffix of the semantics instead.
+  static unsigned ResultWidthX86(const Instruction &inst, const Operand &dst) {
+    const auto suffix = Suffix(inst);
+    if (suffix == "16") {
+      return 16u;
+    } else if (suffix == "32") {
+      return 32u;
+    } else {
+      return static_cast<unsigned>(dst.reg.size);
+    }
+  }
+
+  // Size, in bytes, of the x86 memory operand `op` of `inst`. The operand
+  // size of `op` is the effective operand size of `inst`, which isn't the
+  // size of the memory access for e.g. `MOVSXD_GPRv_MEMd_64`.
+  static unsigned MemorySizeX86(const Instruction &inst, const Operand &op) {
+    std::string_view name = inst.function;
+    if (const auto mem = name.find("_MEM");
+        mem != std::string_view::npos && (mem + 4u) < name.size()) {
+      switch (name[mem + 4u]) {
+        case 'b': return 1u;
+        case 'w': return 2u;
+        case 'd': return 4u;
+        case 'q': return 8u;
+        default: break;
+      }
+    }
+    return static_cast<unsigned>(op.size / 8u);
+  }
+
+  // Returns the value written to the first operand of `inst`, or `nullopt` if
+  // `inst` isn't understood.
+  std::optional<Value> EvaluateX86(const Instruction &inst) {
+    const auto &ops = inst.operands;
+    const auto mnemonic = Mnemonic(inst);
+    if (ops.size() < 2u || Operand::kTypeRegister != ops[0].type ||
+        Operand::kActionWrite != ops[0].action) {
+      return std::nullopt;
+    }
+
+    const auto &src = ops[1];
+    if (mnemonic == "MOV" || mnemonic == "MOVSXD" || mnemonic == "MOVSX" ||
+        mnemonic == "MOVZX") {
+      const auto is_signed = mnemonic == "MOVSXD" || mnemonic == "MOVSX";
+      if (Operand::kTypeAddress == src.type &&
+          Operand::Address::kMemoryRead == src.addr.kind) {
+        return Load(Address(inst, src.addr), MemorySizeX86(inst, src),
+                    is_signed);
+      }
+
+      auto val = Read(inst, src);
+      if (mnemonic != "MOV") {
+        val = Extend(val, static_cast<unsigned>(src.size), is_signed);
+      }
+      return val;
+
+    } else if (mnemonic == "LEA") {
+      return Read(inst, src);
+
+    } else if (mnemonic == "ADD" && ops.size() >= 3u) {
+      return Add(Read(inst, ops[1]), Read(inst, ops[2]));
+
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  std::optional<Value> EvaluateAArch64(const Instruction &inst) {
+    const auto &ops = inst.operands;
+    const auto mnemonic = Mnemonic(inst);
+    if (ops.size() < 2u || Operand::kTypeRegister != ops[0].type ||
+        Operand::kActionWrite != ops[0].action) {
+      return std::nullopt;
+    }
+
+    if (mnemonic == "ADR") {
+      return Read(inst, ops[1]);
+
+    } else if (mnemonic == "ADRP") {
+      auto val = Read(inst, ops[1]);
+      val.constant &= ~4095ull;
+      return val;
+
+    } else if (mnemonic == "ADD" && ops.size() == 3u) {
+      return Add(Read(inst, ops[1]), Read(inst, ops[2]));
+
+    // `mov <Wd>, <Wm>` is an alias of `orr <Wd>, wzr, <Wm>`.
+    } else if (mnemonic == "ORR" && ops.size() == 3u &&
+               inst.function.find("_LOG_SHIFT") != std::string::npos) {
+      const auto lhs = Read(inst, ops[1]);
+      const auto rhs = Read(inst, ops[2]);
+      if (lhs.IsConstant() && !lhs.constant) {
+        return rhs;
+      } else if (rhs.IsConstant() && !rhs.constant) {
+        return lhs;
+      }
+      return Value();
+
+    // Register offset loads, e.g. `ldrb <Wt>, [<Xn>, <Wm>, uxtw]`.
+    } else if (mnemonic.substr(0, 3) == "LDR" &&
+               inst.function.find("_LDST_REGOFF") != std::string::npos) {
+      auto size = static_cast<unsigned>(ops[0].reg.size / 8u);
+      if (mnemonic == "LDRB" || mnemonic == "LDRSB") {
+        size = 1u;
+      } else if (mnemonic == "LDRH" || mnemonic == "LDRSH") {
+        size = 2u;
+      } else if (mnemonic == "LDRSW") {
+        size = 4u;
+      } else if (mnemonic != "LDR") {
+        return std::nullopt;
+      }
+      const auto is_signed = mnemonic.substr(0, 4) == "LDRS";
+
+      AddressValue addr;
+      for (size_t i = 1u; i < ops.size(); ++i) {
+        if (Operand::kTypeAddress == ops[i].type) {
+          const auto base = Address(inst, ops[i].addr);
+          if (!base.is_known || base.has_index) {
+            addr.is_known = false;
+          }
+          addr.constant += base.constant;
+        } else {
+          addr.Add(Read(inst, ops[i]), 1u);
+        }
+      }
+
+      return Load(addr, size, is_signed);
+
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  // Symbolically execute `inst`, which is followed by the instruction at
+  // `next_pc`.
+  void Visit(const Instruction &inst, uint64_t next_pc) {
+    const auto is_aarch64 = arch->IsAArch64();
+
+    // Flags are only used by the instruction right after the comparison.
+    const auto cmp = std::move(comparison);
+    comparison.reset();
+
+    if (auto cond = BranchCondition(inst, is_aarch64)) {
+      ApplyBound(inst, next_pc, *cond, cmp);
+      return;
+    }
+
+    comparison = is_aarch64 ? CompareAArch64(inst) : CompareX86(inst);
+    if (comparison && comparison->reg_name.empty()) {
+      comparison.reset();
+    }
+
+    auto val = is_aarch64 ? EvaluateAArch64(inst) : EvaluateX86(inst);
+    Clobber(inst);
+    if (val) {
+      const auto &dst = inst.operands[0];
+      Write(dst, *val,
+            is_aarch64 ? static_cast<unsigned>(dst.reg.size)
+                       : ResultWidthX86(inst, dst));
+    }
+  }
+
+  // Returns the target of the indirect jump `inst`.
+  Value JumpTarget(const Instruction &inst) {
+    if (inst.operands.empty()) {
+      return {};
+    }
+
+    const auto &op = inst.operands[0];
+    const auto mnemonic = Mnemonic(inst);
+    if (mnemonic == "BR" || (mnemonic == "JMP" &&
+                             Operand::kTypeRegister == op.type)) {
+      return Read(inst, op);
+
+    } else if (mnemonic == "JMP" && Operand::kTypeAddress == op.type &&
+               Operand::Address::kMemoryRead == op.addr.kind) {
+      return Load(Address(inst, op.addr), MemorySizeX86(inst, op), false);
+
+    } else {
+      return {};
+    }
+  }
+
+  // Read the entries of the table that `target` loads from.
+  std::optional<JumpTable> ReadTable(const Value &target) {
+    if (target.bound >= kMaxJumpTableEntries) {
+      return std::nullopt;
+    }
+
+    const auto little_endian = arch->MemoryAccessIsLittleEndian();
+    JumpTable table;
+    table.table_addr = target.table_addr & addr_mask;
+    table.entry_size = target.entry_size;
+    table.targets.reserve(target.bound + 1u);
+
+    for (uint64_t i = 0; i <= target.bound; ++i) {
+      const auto entry_addr = table.table_addr + i * target.entry_size;
+      uint64_t entry = 0;
+      for (unsigned b = 0; b < target.entry_size; ++b) {
+        uint8_t byte = 0;
+        if (!manager.TryReadDataByte((entry_addr + b) & addr_mask, &byte)) {
+          return std::nullopt;
+        }
+        const auto byte_index = little_endian ? b : (target.entry_size - b - 1u);
+        entry |= static_cast<uint64_t>(byte) << (byte_index * 8u);
+      }
+
+      if (target.entry_is_signed) {
+        entry = SignExtend(entry, target.entry_size * 8u);
+      }
+
+      const auto target_pc =
+          (target.constant + (entry << target.shift)) & addr_mask;
+      uint8_t byte = 0;
+      if (!manager.TryReadExecutableByte(target_pc, &byte)) {
+        DLOG(WARNING) << "Entry " << i << " of jump table at " << std::hex
+                      << table.table_addr << " targets non-executable address "
+                      << target_pc << std::dec;
+        return std::nullopt;
+      }
+      table.targets.push_back(target_pc);
+    }
+
+    return table;
+  }
+
+  const Arch *const arch;
+  TraceManager &manager;
+  const uint64_t addr_mask;
+
+  // Known values of registers, by the name of their enclosing register.
+  std::unordered_map<std::string, Value> regs;
+
+  // Comparison made by the last visited instruction.
+  std::optional<Comparison> comparison;
+};
+
+}  // namespace
+
+// Recognize a jump table used by the indirect jump `insts.back()`.
+std::optional<JumpTable>
+RecoverJumpTable(const Arch *arch, TraceManager &manager,
+                 const std::vector<const Instruction *> &insts) {
+  return JumpTableRecognizer(arch, manager).Run(insts);
+}
+
+}  // namespace remill
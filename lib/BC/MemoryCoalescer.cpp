@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// The widest integer memory intrinsic, in bytes.
+static constexpr int64_t kMaxAccessSize = 8;
+
+// A call to one of the integer memory intrinsics, whose address is `base`
+// plus a constant `offset`.
+struct MemoryAccess {
+  llvm::CallInst *call;
+
+  // `nullptr` if the address is a constant.
+  llvm::Value *base;
+  int64_t offset;
+  int64_t size;
+
+  // Position of `call` in its block, or in its chain of writes.
+  size_t order;
+};
+
+// Split `addr` into a base and a constant offset.
+static std::pair<llvm::Value *, int64_t> SplitAddress(llvm::Value *addr) {
+  uint64_t offset = 0;
+  for (;;) {
+    if (auto ci = llvm::dyn_cast<llvm::ConstantInt>(addr)) {
+      offset += static_cast<uint64_t>(ci->getSExtValue());
+      return {nullptr, static_cast<int64_t>(offset)};
+    }
+
+    auto bin = llvm::dyn_cast<llvm::BinaryOperator>(addr);
+    if (!bin) {
+      break;
+    }
+
+    auto ci = llvm::dyn_cast<llvm::ConstantInt>(bin->getOperand(1));
+    if (!ci) {
+      break;
+    }
+
+    if (bin->getOpcode() == llvm::Instruction::Add) {
+      offset += static_cast<uint64_t>(ci->getSExtValue());
+    } else if (bin->getOpcode() == llvm::Instruction::Sub) {
+      offset -= static_cast<uint64_t>(ci->getSExtValue());
+    } else {
+      break;
+    }
+    addr = bin->getOperand(0);
+  }
+  return {addr, static_cast<int64_t>(offset)};
+}
+
+// Returns `true` if `val` can be used at `pos`, given that it's used
+// somewhere in the block of `pos`.
+static bool IsAvailableAt(llvm::Value *val, llvm::Instruction *pos) {
+  auto inst = llvm::dyn_cast<llvm::Instruction>(val);
+  return !inst || inst->getParent() != pos->getParent() ||
+         inst->comesBefore(pos);
+}
+
+// Index of the intrinsic for accesses of `size` bytes.
+static unsigned SizeIndex(int64_t size) {
+  switch (size) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    case 8: return 3;
+    default: return ~0u;
+  }
+}
+
+// Find the runs of `accesses`, which are sorted by offset and access disjoint
+// or identical bytes, that cover 2, 4, or 8 contiguous bytes with at least two
+// different accesses. Returns the `[begin, end)` index ranges of the runs.
+static std::vector<std::pair<size_t, size_t>>
+FindRuns(const std::vector<MemoryAccess> &accesses) {
+  std::vector<std::pair<size_t, size_t>> runs;
+  for (size_t i = 0; i < accesses.size();) {
+    const auto start = accesses[i].offset;
+    auto end = start + accesses[i].size;
+    auto num_slots = 1u;
+    auto last = i + 1u;
+
+    for (auto j = i + 1u; j < accesses.size(); ++j) {
+      const auto &prev = accesses[j - 1u];
+      const auto &acc = accesses[j];
+      if (acc.offset == prev.offset && acc.size == prev.size) {
+        // Same bytes as the previous access.
+      } else if (acc.offset == end &&
+                 (end - start + acc.size) <= kMaxAccessSize) {
+        end += acc.size;
+        num_slots += 1u;
+      } else {
+        break;
+      }
+
+      if (1u < num_slots && SizeIndex(end - start) != ~0u) {
+        last = j + 1u;
+      }
+    }
+
+    if (last > i + 1u) {
+      runs.emplace_back(i, last);
+    }
+    i = last;
+  }
+  return runs;
+}
+
+class MemoryCoalescer {
+ public:
+  MemoryCoalescer(const Arch *arch, llvm::Module *module)
+      : little_endian(arch->MemoryAccessIsLittleEndian()) {
+    static const char *const kReads[] = {
+        "__remill_read_memory_8", "__remill_read_memory_16",
+        "__remill_read_memory_32", "__remill_read_memory_64"};
+    static const char *const kWrites[] = {
+        "__remill_write_memory_8", "__remill_write_memory_16",
+        "__remill_write_memory_32", "__remill_write_memory_64"};
+
+    for (auto i = 0u; i < 4u; ++i) {
+      reads[i] = FindFunction(module, kReads[i]);
+      writes[i] = FindFunction(module, kWrites[i]);
+      if (reads[i]) {
+        read_size[reads[i]] = static_cast<int64_t>(1) << i;
+      }
+      if (writes[i]) {
+        write_size[writes[i]] = static_cast<int64_t>(1) << i;
+      }
+    }
+  }
+
+  // Returns the number of removed calls to memory intrinsics.
+  size_t Run(llvm::Function *func) {
+    size_t num_removed = 0;
+    for (auto &block : *func) {
+      num_removed += CoalesceReads(block);
+      num_removed += CoalesceWrites(block);
+    }
+    return num_removed;
+  }
+
+ private:
+  std::optional<MemoryAccess> GetAccess(
+      llvm::Instruction &inst,
+      const std::unordered_map<llvm::Function *, int64_t> &sizes) const {
+    auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+    if (!call) {
+      return std::nullopt;
+    }
+    auto it = sizes.find(call->getCalledFunction());
+    if (it == sizes.end()) {
+      return std::nullopt;
+    }
+    auto [base, offset] = SplitAddress(call->getArgOperand(1));
+    return MemoryAccess{call, base, offset, it->second, 0};
+  }
+
+  // Shift, in bits, of the `size` bytes at `offset` within a `width`-byte
+  // value.
+  uint64_t BitShift(int64_t offset, int64_t size, int64_t width) const {
+    return static_cast<uint64_t>(little_endian ? offset
+                                               : (width - offset - size)) *
+           8u;
+  }
+
+  // Reads with the same `Memory *` see the same memory, no matter where they
+  // are, so every read in the block with the same `Memory *` and base can be
+  // merged with the others.
+  size_t CoalesceReads(llvm::BasicBlock &block) {
+    // Groups are kept in the order of their first reads, so that the output
+    // doesn't depend on where things are allocated.
+    std::map<std::pair<llvm::Value *, llvm::Value *>, size_t> group_index;
+    std::vector<std::vector<MemoryAccess>> groups;
+    size_t order = 0;
+    for (auto &inst : block) {
+      if (auto access = GetAccess(inst, read_size)) {
+        access->order = order;
+        auto [it, added] = group_index.emplace(
+            std::make_pair(access->call->getArgOperand(0), access->base),
+            groups.size());
+        if (added) {
+          groups.emplace_back();
+        }
+        groups[it->second].push_back(*access);
+      }
+      ++order;
+    }
+
+    size_t num_removed = 0;
+    for (auto &accesses : groups) {
+      if (accesses.size() < 2u) {
+        continue;
+      }
+
+      std::stable_sort(accesses.begin(), accesses.end(),
+                       [](const MemoryAccess &a, const MemoryAccess &b) {
+                         return std::make_pair(a.offset, a.size) <
+                                std::make_pair(b.offset, b.size);
+                       });
+
+      for (auto [begin, end] : FindRuns(accesses)) {
+        num_removed += MergeReads(&accesses[begin], &accesses[end]);
+      }
+    }
+    return num_removed;
+  }
+
+  // NOTE: The base and `Memory *` of the reads are taken from their operands,
+  //       as merging other reads may have replaced them.
+  size_t MergeReads(MemoryAccess *begin, MemoryAccess *end) {
+    const auto start = begin->offset;
+    const auto width = (end - 1)->offset + (end - 1)->size - start;
+    auto wide_read = reads[SizeIndex(width)];
+    if (!wide_read) {
+      return 0;
+    }
+
+    auto first = std::min_element(
+        begin, end, [](const MemoryAccess &a, const MemoryAccess &b) {
+          return a.order < b.order;
+        });
+    auto pos = first->call;
+    auto memory = pos->getArgOperand(0);
+
+    // Find an address for the wide read that is available before all of the
+    // reads that it replaces.
+    llvm::Value *addr = nullptr;
+    for (auto acc = begin; acc != end && acc->offset == start; ++acc) {
+      if (IsAvailableAt(acc->call->getArgOperand(1), pos)) {
+        addr = acc->call->getArgOperand(1);
+        break;
+      }
+    }
+
+    llvm::IRBuilder<> ir(pos);
+    if (!addr) {
+      auto base = SplitAddress(begin->call->getArgOperand(1)).first;
+      if (base && !IsAvailableAt(base, pos)) {
+        return 0;
+      }
+      auto addr_type = begin->call->getArgOperand(1)->getType();
+      auto disp = llvm::ConstantInt::get(addr_type,
+                                         static_cast<uint64_t>(start), true);
+      addr = base ? ir.CreateAdd(base, disp) : disp;
+    }
+
+    auto wide = ir.CreateCall(wide_read, {memory, addr});
+    for (auto acc = begin; acc != end; ++acc) {
+      llvm::Value *val = wide;
+      auto shift = BitShift(acc->offset - start, acc->size, width);
+      if (shift) {
+        val = ir.CreateLShr(val, shift);
+      }
+      val = ir.CreateTrunc(val, acc->call->getType());
+      acc->call->replaceAllUsesWith(val);
+      acc->call->eraseFromParent();
+    }
+    return static_cast<size_t>(end - begin) - 1u;
+  }
+
+  // Writes are merged within a chain of writes that each use the `Memory *`
+  // returned by the previous one, and nothing else does. Nothing else can
+  // access memory between two writes in a chain, but a write to one base
+  // might alias a write to another, so a chain is split into segments of
+  // consecutive writes to the same base that access disjoint bytes, which can
+  // then be reordered.
+  size_t CoalesceWrites(llvm::BasicBlock &block) {
+    std::vector<std::vector<MemoryAccess>> segments;
+    for (auto &inst : block) {
+      auto access = GetAccess(inst, write_size);
+      if (!access) {
+        continue;
+      }
+
+      // Only start from the head of a chain.
+      if (auto prev = llvm::dyn_cast<llvm::CallInst>(
+              access->call->getArgOperand(0));
+          prev && prev->getParent() == &block && prev->hasOneUse() &&
+          write_size.count(prev->getCalledFunction())) {
+        continue;
+      }
+
+      std::vector<MemoryAccess> segment;
+      for (size_t order = 0;; ++order) {
+        access->order = order;
+        auto overlaps = [&access](const MemoryAccess &acc) {
+          return acc.offset < access->offset + access->size &&
+                 access->offset < acc.offset + acc.size;
+        };
+        if (!segment.empty() &&
+            (segment.back().base != access->base ||
+             std::any_of(segment.begin(), segment.end(), overlaps))) {
+          segments.push_back(std::move(segment));
+          segment.clear();
+        }
+        segment.push_back(*access);
+
+        auto call = access->call;
+        if (!call->hasOneUse()) {
+          break;
+        }
+        auto next = llvm::dyn_cast<llvm::Instruction>(*call->user_begin());
+        if (!next || next->getParent() != &block) {
+          break;
+        }
+        access = GetAccess(*next, write_size);
+        if (!access || access->call->getArgOperand(0) != call) {
+          break;
+        }
+      }
+      segments.push_back(std::move(segment));
+    }
+
+    size_t num_removed = 0;
+    for (auto &accesses : segments) {
+      if (accesses.size() < 2u) {
+        continue;
+      }
+
+      std::sort(accesses.begin(), accesses.end(),
+                [](const MemoryAccess &a, const MemoryAccess &b) {
+                  return a.offset < b.offset;
+                });
+
+      for (auto [begin, end] : FindRuns(accesses)) {
+        num_removed += MergeWrites(&accesses[begin], &accesses[end]);
+      }
+    }
+    return num_removed;
+  }
+
+  size_t MergeWrites(MemoryAccess *begin, MemoryAccess *end) {
+    const auto start = begin->offset;
+    const auto width = (end - 1)->offset + (end - 1)->size - start;
+    auto wide_write = writes[SizeIndex(width)];
+    if (!wide_write) {
+      return 0;
+    }
+
+    std::vector<MemoryAccess> in_order(begin, end);
+    std::sort(in_order.begin(), in_order.end(),
+              [](const MemoryAccess &a, const MemoryAccess &b) {
+                return a.order < b.order;
+              });
+
+    // The wide write goes where the last of the writes that it replaces is,
+    // which all of their addresses and values are available to.
+    auto last = in_order.back().call;
+    llvm::IRBuilder<> ir(last);
+    auto wide_type = wide_write->getFunctionType()->getParamType(2);
+    llvm::Value *wide = nullptr;
+    for (auto acc = begin; acc != end; ++acc) {
+      llvm::Value *val = ir.CreateZExt(acc->call->getArgOperand(2), wide_type);
+      auto shift = BitShift(acc->offset - start, acc->size, width);
+      if (shift) {
+        val = ir.CreateShl(val, shift);
+      }
+      wide = wide ? ir.CreateOr(wide, val) : val;
+    }
+
+    auto addr = begin->call->getArgOperand(1);
+
+    // Unlink the other writes from the chain.
+    in_order.pop_back();
+    for (auto &acc : in_order) {
+      acc.call->replaceAllUsesWith(acc.call->getArgOperand(0));
+      acc.call->eraseFromParent();
+    }
+
+    auto merged = ir.CreateCall(wide_write,
+                                {last->getArgOperand(0), addr, wide});
+    last->replaceAllUsesWith(merged);
+    last->eraseFromParent();
+    return in_order.size();
+  }
+
+  const bool little_endian;
+  llvm::Function *reads[4];
+  llvm::Function *writes[4];
+  std::unordered_map<llvm::Function *, int64_t> read_size;
+  std::unordered_map<llvm::Function *, int64_t> write_size;
+};
+
+}  // namespace
+
+// Merge adjacent narrow memory intrinsic calls into wider ones.
+size_t CoalesceMemoryAccesses(const Arch *arch, llvm::Module *module,
+                              const std::vector<llvm::Function *> &traces) {
+  std::vector<llvm::Function *> funcs;
+  for (auto func : traces) {
+    if (!func->isDeclaration()) {
+      funcs.push_back(func);
+    }
+  }
+
+  if (funcs.empty()) {
+    return 0;
+  }
+
+  // Promote the `MEMORY` variable so that the `Memory *` chain is threaded
+  // through SSA values across instructions, and give equal addresses the same
+  // base.
+  llvm::ModuleAnalysisManager mam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::LoopAnalysisManager lam;
+  llvm::CGSCCAnalysisManager cam;
+
+  llvm::PassBuilder pb;
+  pb.registerModuleAnalyses(mam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.registerCGSCCAnalyses(cam);
+  pb.crossRegisterProxies(lam, fam, cam, mam);
+
+  llvm::FunctionPassManager fpm;
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(16, 0)
+  fpm.addPass(llvm::SROAPass());
+#else
+  fpm.addPass(llvm::SROAPass(llvm::SROAOptions::ModifyCFG));
+#endif
+  fpm.addPass(llvm::EarlyCSEPass(false /* UseMemorySSA */));
+
+  MemoryCoalescer coalescer(arch, module);
+  size_t num_removed = 0;
+  for (auto func : funcs) {
+    fpm.run(*func, fam);
+    num_removed += coalescer.Run(func);
+  }
+
+  fam.clear();
+  mam.clear();
+  lam.clear();
+  cam.clear();
+
+  DLOG(INFO) << "Removed " << num_removed << " memory accesses from "
+             << funcs.size() << " traces in " << ModuleName(module);
+  return num_removed;
+}
+
+}  // namespace remill
@@ -17,9 +17,11 @@
 #include "remill/BC/Optimizer.h"
 
 #include <glog/logging.h>
+#include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/CGSCCPassManager.h>
 #include <llvm/Analysis/InlineCost.h>
 #include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DebugInfo.h>
@@ -44,16 +46,120 @@
 #include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 
+#include <utility>
+
 #include "remill/Arch/Arch.h"
 #include "remill/BC/Util.h"
 #include "remill/BC/Version.h"
 
 namespace remill {
+namespace {
+
+// Inline calls into each of `traces`, including the calls exposed by
+// inlining, for as long as the inliner's cost model allows it. Unlike
+// `OptimizeBareModule`, this leaves the other functions of the module, e.g.
+// the semantics and any cold traces, alone.
+static void InlineIntoTraces(const std::vector<llvm::Function *> &traces) {
+  llvm::FunctionAnalysisManager fam;
+  llvm::PassBuilder pb;
+  pb.registerFunctionAnalyses(fam);
+
+  auto get_ac = [&fam](llvm::Function &func) -> llvm::AssumptionCache & {
+    return fam.getResult<llvm::AssumptionAnalysis>(func);
+  };
+  auto get_tli =
+      [&fam](llvm::Function &func) -> const llvm::TargetLibraryInfo & {
+    return fam.getResult<llvm::TargetLibraryAnalysis>(func);
+  };
+
+  const auto params = llvm::getInlineParams(250);
+
+  for (auto trace : traces) {
+    if (trace->isDeclaration()) {
+      continue;
+    }
+
+    // The functions that were inlined to expose each call site, so that
+    // recursive functions aren't inlined forever. Each entry is a function
+    // and the index of the entry for the call site that it was inlined at.
+    std::vector<std::pair<llvm::Function *, int>> history;
+    auto in_history = [&history](llvm::Function *func, int index) {
+      for (; index != -1; index = history[index].second) {
+        if (history[index].first == func) {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    std::vector<std::pair<llvm::CallBase *, int>> calls;
+    for (auto &inst : llvm::instructions(trace)) {
+      if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+        calls.emplace_back(call, -1);
+      }
+    }
+
+    while (!calls.empty()) {
+      auto [call, index] = calls.back();
+      calls.pop_back();
+
+      auto callee = call->getCalledFunction();
+      if (!callee || callee->isDeclaration() || callee == trace ||
+          in_history(callee, index)) {
+        continue;
+      }
+
+      auto cost = llvm::getInlineCost(
+          *call, params, fam.getResult<llvm::TargetIRAnalysis>(*callee),
+          get_ac, get_tli);
+      if (!cost) {
+        continue;
+      }
+
+      llvm::InlineFunctionInfo info;
+      if (!llvm::InlineFunction(*call, info).isSuccess()) {
+        continue;
+      }
+      fam.invalidate(*trace, llvm::PreservedAnalyses::none());
+
+      const auto callee_index = static_cast<int>(history.size());
+      history.emplace_back(callee, index);
+      for (auto inlined_call : info.InlinedCallSites) {
+        calls.emplace_back(inlined_call, callee_index);
+      }
+    }
+  }
+
+  fam.clear();
+}
+
+}  // namespace
 
 void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
                     std::function<llvm::Function *(void)> generator,
                     OptimizationGuide guide) {
-  OptimizeBareModule(module, guide);
+  std::vector<llvm::Function *> traces;
+  while (auto trace = generator()) {
+    traces.push_back(trace);
+  }
+
+  InlineIntoTraces(traces);
+
+  if (guide.scalarize_state) {
+    ScalarizeState(arch, module, traces);
+  }
+
+  if (guide.recover_stack_frames) {
+    RecoverStackFrames(arch, module, traces);
+  }
+
+  if (guide.eliminate_dead_stores) {
+    RemoveDeadStateStores(arch, module, traces);
+  }
+
+  if (guide.coalesce_memory_accesses) {
+    CoalesceMemoryAccesses(arch, module, traces);
+  }
 }
 
 // Optimize a normal module. This might not contain special Remill-specific
@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <remill/BC/PCodeCFG.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <sleigh/opcodes.hh>
+#include <sleigh/pcoderaw.hh>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "lib/Arch/Sleigh/ControlFlowStructuring.h"
+
+namespace remill {
+namespace sleigh {
+namespace {
+
+static constexpr std::string_view kEqualityClaimName = "claim_eq";
+static constexpr size_t kEqualityClaimArity = 3;
+
+// The lifter treats varnodes in the `unique` and `register` spaces as
+// variables; everything else is either a constant or memory.
+static bool IsUnique(const VarnodeData &vnode) {
+  return vnode.space->getName() == "unique";
+}
+
+static bool IsRegister(const VarnodeData &vnode) {
+  return vnode.space->getName() == "register";
+}
+
+static bool IsVariable(const VarnodeData &vnode) {
+  return IsUnique(vnode) || IsRegister(vnode);
+}
+
+static bool IsRam(const VarnodeData &vnode) {
+  return vnode.space->getName() == "ram";
+}
+
+static bool SameVarnode(const VarnodeData &a, const VarnodeData &b) {
+  return a.space == b.space && a.offset == b.offset && a.size == b.size;
+}
+
+static bool Overlaps(const VarnodeData &a, const VarnodeData &b) {
+  return a.space == b.space && a.offset < (b.offset + b.size) &&
+         b.offset < (a.offset + a.size);
+}
+
+// Does `outer` contain every byte of `inner`?
+static bool Covers(const VarnodeData &outer, const VarnodeData &inner) {
+  return outer.space == inner.space && outer.offset <= inner.offset &&
+         (inner.offset + inner.size) <= (outer.offset + outer.size);
+}
+
+static bool AnyOverlaps(const std::vector<VarnodeData> &vnodes,
+                        const VarnodeData &vnode) {
+  return std::any_of(vnodes.begin(), vnodes.end(),
+                     [&](const VarnodeData &v) { return Overlaps(v, vnode); });
+}
+
+static uint64_t Truncate(uint64_t val, uint32_t size) {
+  if (size >= sizeof(uint64_t)) {
+    return val;
+  }
+  return val & ((uint64_t(1) << (size * 8u)) - 1u);
+}
+
+static int64_t SignExtend(uint64_t val, uint32_t size) {
+  if (size >= sizeof(uint64_t)) {
+    return static_cast<int64_t>(val);
+  }
+  const auto shift = 64u - size * 8u;
+  return static_cast<int64_t>(val << shift) >> shift;
+}
+
+// Ops whose only effect is to write their output varnode, and which can
+// therefore be removed if nothing reads that output.
+static bool IsPure(OpCode opc) {
+  switch (opc) {
+    case CPUI_COPY:
+    case CPUI_INT_EQUAL:
+    case CPUI_INT_NOTEQUAL:
+    case CPUI_INT_SLESS:
+    case CPUI_INT_SLESSEQUAL:
+    case CPUI_INT_LESS:
+    case CPUI_INT_LESSEQUAL:
+    case CPUI_INT_ZEXT:
+    case CPUI_INT_SEXT:
+    case CPUI_INT_ADD:
+    case CPUI_INT_SUB:
+    case CPUI_INT_CARRY:
+    case CPUI_INT_SCARRY:
+    case CPUI_INT_SBORROW:
+    case CPUI_INT_2COMP:
+    case CPUI_INT_NEGATE:
+    case CPUI_INT_XOR:
+    case CPUI_INT_AND:
+    case CPUI_INT_OR:
+    case CPUI_INT_LEFT:
+    case CPUI_INT_RIGHT:
+    case CPUI_INT_SRIGHT:
+    case CPUI_INT_MULT:
+    case CPUI_INT_DIV:
+    case CPUI_INT_SDIV:
+    case CPUI_INT_REM:
+    case CPUI_INT_SREM:
+    case CPUI_BOOL_NEGATE:
+    case CPUI_BOOL_XOR:
+    case CPUI_BOOL_AND:
+    case CPUI_BOOL_OR:
+    case CPUI_FLOAT_EQUAL:
+    case CPUI_FLOAT_NOTEQUAL:
+    case CPUI_FLOAT_LESS:
+    case CPUI_FLOAT_LESSEQUAL:
+    case CPUI_FLOAT_NAN:
+    case CPUI_FLOAT_ADD:
+    case CPUI_FLOAT_DIV:
+    case CPUI_FLOAT_MULT:
+    case CPUI_FLOAT_SUB:
+    case CPUI_FLOAT_NEG:
+    case CPUI_FLOAT_ABS:
+    case CPUI_FLOAT_SQRT:
+    case CPUI_FLOAT_INT2FLOAT:
+    case CPUI_FLOAT_FLOAT2FLOAT:
+    case CPUI_FLOAT_TRUNC:
+    case CPUI_FLOAT_CEIL:
+    case CPUI_FLOAT_FLOOR:
+    case CPUI_FLOAT_ROUND:
+    case CPUI_PIECE:
+    case CPUI_SUBPIECE:
+    case CPUI_POPCOUNT: return true;
+    default: return false;
+  }
+}
+
+// Is the `index`th input of `op` the destination of a direct branch? Those
+// are addresses, or offsets to other p-code ops, rather than values.
+static bool IsBranchTarget(const RemillPcodeOp &op, size_t index) {
+  switch (op.op) {
+    case CPUI_BRANCH:
+    case CPUI_CBRANCH:
+    case CPUI_CALL: return index == 0;
+    default: return false;
+  }
+}
+
+// Computes the result of `op` on constant inputs, as the lifter would.
+// Returns `std::nullopt` if `op` isn't foldable.
+static std::optional<uint64_t> Evaluate(const RemillPcodeOp &op) {
+  const auto &out = *op.outvar;
+  const auto a = op.vars[0].offset;
+  const auto a_size = op.vars[0].size;
+  const auto b = op.vars.size() > 1 ? op.vars[1].offset : 0u;
+  switch (op.op) {
+    case CPUI_INT_ZEXT: return a;
+    case CPUI_INT_SEXT: return static_cast<uint64_t>(SignExtend(a, a_size));
+    case CPUI_INT_ADD: return a + b;
+    case CPUI_INT_SUB: return a - b;
+    case CPUI_INT_MULT: return a * b;
+    case CPUI_INT_AND: return a & b;
+    case CPUI_INT_OR: return a | b;
+    case CPUI_INT_XOR: return a ^ b;
+    case CPUI_INT_NEGATE: return ~a;
+    case CPUI_INT_2COMP: return -a;
+    case CPUI_INT_LEFT: return b >= out.size * 8u ? 0u : a << b;
+    case CPUI_INT_RIGHT: return b >= a_size * 8u ? 0u : a >> b;
+    case CPUI_INT_EQUAL: return a == b;
+    case CPUI_INT_NOTEQUAL: return a != b;
+    case CPUI_INT_LESS: return a < b;
+    case CPUI_INT_LESSEQUAL: return a <= b;
+    case CPUI_INT_SLESS: return SignExtend(a, a_size) < SignExtend(b, a_size);
+    case CPUI_INT_SLESSEQUAL:
+      return SignExtend(a, a_size) <= SignExtend(b, a_size);
+    case CPUI_BOOL_NEGATE: return a == 0u;
+    case CPUI_BOOL_AND: return a & b;
+    case CPUI_BOOL_OR: return a | b;
+    case CPUI_BOOL_XOR: return a ^ b;
+    case CPUI_SUBPIECE: return b >= a_size ? 0u : a >> (b * 8u);
+    default: return std::nullopt;
+  }
+}
+
+class PcodeOptimizer {
+ public:
+  PcodeOptimizer(PcodeCFG &cfg_, MaybeBranchTakenVar &btaken_,
+                 const std::vector<std::string> &user_op_names_)
+      : cfg(cfg_),
+        btaken(btaken_),
+        user_op_names(user_op_names_) {}
+
+  void Run(void) {
+    FindBranchTaken();
+
+    for (auto &[base_index, blk] : cfg.blocks) {
+      for (const auto &op : blk.ops) {
+        if (IsEqualityClaim(op)) {
+          claimed_constants[op.vars[1].offset] += 1u;
+        }
+      }
+    }
+
+    for (auto changed = true; changed;) {
+      changed = false;
+      for (auto &[base_index, blk] : cfg.blocks) {
+        changed = PropagateInBlock(blk) || changed;
+      }
+      changed = FoldEqualityClaims() || changed;
+      changed = EliminateDeadOps() || changed;
+    }
+
+    // The branch taken variable is lifted just before its `CBRANCH`, so it
+    // has to follow the `CBRANCH` around.
+    if (btaken_block) {
+      const auto &cbranch = btaken_block->ops[btaken_pos];
+      btaken->index = btaken_block->base_index + btaken_pos;
+      btaken->target_vnode = cbranch.vars[1];
+    }
+  }
+
+ private:
+  void FindBranchTaken(void) {
+    if (!btaken) {
+      return;
+    }
+    for (auto &[base_index, blk] : cfg.blocks) {
+      if (base_index <= btaken->index &&
+          btaken->index < (base_index + blk.ops.size())) {
+        btaken_block = &blk;
+        btaken_pos = btaken->index - base_index;
+        CHECK(blk.ops[btaken_pos].op == CPUI_CBRANCH);
+        return;
+      }
+    }
+  }
+
+  bool IsCallOther(const RemillPcodeOp &op, std::string_view name) const {
+    return op.op == CPUI_CALLOTHER && !op.vars.empty() &&
+           op.vars[0].offset < user_op_names.size() &&
+           user_op_names[op.vars[0].offset] == name;
+  }
+
+  bool IsEqualityClaim(const RemillPcodeOp &op) const {
+    return IsCallOther(op, kEqualityClaimName) &&
+           op.vars.size() == kEqualityClaimArity;
+  }
+
+  // A `CALLOTHER` that the lifter may turn into a hyper call, which can read
+  // and write any register.
+  bool IsOpaqueCallOther(const RemillPcodeOp &op) const {
+    return op.op == CPUI_CALLOTHER && !IsEqualityClaim(op);
+  }
+
+  // Can `vnode` be substituted for a variable holding its value? Constants
+  // named by a `claim_eq` are off limits, as the lifter replaces them.
+  bool IsPropagatableConstant(const VarnodeData &vnode) const {
+    return isVarnodeInConstantSpace(vnode) &&
+           vnode.size <= sizeof(uint64_t) &&
+           !claimed_constants.count(vnode.offset);
+  }
+
+  // Replace each input of the ops in `blk` that is a copy of a constant or of
+  // another variable with that constant or variable, and fold ops whose
+  // inputs are all constants.
+  bool PropagateInBlock(PcodeBlock &blk) {
+    std::vector<std::pair<VarnodeData, VarnodeData>> copies;
+    auto forget = [&copies](auto pred) {
+      copies.erase(std::remove_if(copies.begin(), copies.end(), pred),
+                   copies.end());
+    };
+
+    auto changed = false;
+    for (auto &op : blk.ops) {
+      const auto is_claim = IsEqualityClaim(op);
+      for (size_t i = 0; i < op.vars.size(); ++i) {
+        auto &var = op.vars[i];
+        if (!IsVariable(var) || IsBranchTarget(op, i)) {
+          continue;
+        }
+        for (const auto &[dest, src] : copies) {
+          if (!SameVarnode(dest, var)) {
+            continue;
+          }
+
+          // The lifter reads the claimed value where the claimed constant is
+          // used, not at the claim, so only constants can stand in for it.
+          if (!is_claim || !IsVariable(src)) {
+            var = src;
+            changed = true;
+          }
+          break;
+        }
+      }
+
+      if (FoldConstant(op)) {
+        changed = true;
+      }
+
+      if (IsOpaqueCallOther(op)) {
+        forget([](const auto &copy) {
+          return IsRegister(copy.first) || IsRegister(copy.second);
+        });
+      }
+
+      if (!op.outvar || !IsVariable(*op.outvar)) {
+        continue;
+      }
+
+      const auto &out = *op.outvar;
+      forget([&out](const auto &copy) {
+        return Overlaps(copy.first, out) || Overlaps(copy.second, out);
+      });
+
+      if (op.op == CPUI_COPY && !Overlaps(op.vars[0], out) &&
+          (IsVariable(op.vars[0]) || IsPropagatableConstant(op.vars[0]))) {
+        copies.emplace_back(out, op.vars[0]);
+      }
+    }
+
+    return changed;
+  }
+
+  // Turn `op` into a `COPY` of its result if all of its inputs are constants.
+  bool FoldConstant(RemillPcodeOp &op) {
+    if (op.op == CPUI_COPY || !op.outvar || !IsVariable(*op.outvar) ||
+        op.outvar->size > sizeof(uint64_t) || op.vars.empty()) {
+      return false;
+    }
+
+    for (const auto &var : op.vars) {
+      if (!IsPropagatableConstant(var)) {
+        return false;
+      }
+    }
+
+    auto result = Evaluate(op);
+    if (!result) {
+      return false;
+    }
+
+    VarnodeData cst = op.vars[0];
+    cst.offset = Truncate(*result, op.outvar->size);
+    cst.size = op.outvar->size;
+    if (!IsPropagatableConstant(cst)) {
+      return false;
+    }
+
+    op.op = CPUI_COPY;
+    op.vars = {cst};
+    return true;
+  }
+
+  // Collect the inputs and outputs of `op` that the lifter replaces with the
+  // claimed value when they are `constant`.
+  void CollectClaimedUses(RemillPcodeOp &op, uint64_t constant,
+                          std::vector<VarnodeData *> &uses) const {
+    if (op.outvar && IsRam(*op.outvar) && op.outvar->offset == constant) {
+      uses.push_back(&*op.outvar);
+    }
+
+    for (size_t i = 0; i < op.vars.size(); ++i) {
+      auto &var = op.vars[i];
+      if (var.offset != constant) {
+        continue;
+      } else if (IsRam(var)) {
+        uses.push_back(&var);
+      } else if (!isVarnodeInConstantSpace(var) || IsBranchTarget(op, i)) {
+        continue;
+      } else if (i == 0 && (op.op == CPUI_LOAD || op.op == CPUI_STORE ||
+                            op.op == CPUI_CALLOTHER)) {
+        continue;  // Space or user op IDs.
+      } else if (i == 1 &&
+                 (op.op == CPUI_SUBPIECE || op.op == CPUI_CALLOTHER)) {
+        continue;  // Byte offsets, or the claimed constant itself.
+      } else {
+        uses.push_back(&var);
+      }
+    }
+  }
+
+  // A `claim_eq` whose value has become a constant is folded into the
+  // constants it applies to.
+  bool FoldEqualityClaims(void) {
+    auto changed = false;
+    for (auto blk_it = cfg.blocks.begin(); blk_it != cfg.blocks.end();
+         ++blk_it) {
+      auto &blk = blk_it->second;
+      for (size_t i = 0; i < blk.ops.size();) {
+        const auto &claim = blk.ops[i];
+        if (!IsEqualityClaim(claim) ||
+            !isVarnodeInConstantSpace(claim.vars[2]) ||
+            claimed_constants[claim.vars[1].offset] != 1u) {
+          ++i;
+          continue;
+        }
+
+        const auto constant = claim.vars[1].offset;
+        const auto value = claim.vars[2];
+        if (value.offset != constant && claimed_constants.count(value.offset)) {
+          ++i;
+          continue;
+        }
+
+        // The claim applies to every op lifted after it.
+        std::vector<VarnodeData *> uses;
+        for (auto j = i + 1u; j < blk.ops.size(); ++j) {
+          CollectClaimedUses(blk.ops[j], constant, uses);
+        }
+        for (auto next_it = std::next(blk_it); next_it != cfg.blocks.end();
+             ++next_it) {
+          for (auto &op : next_it->second.ops) {
+            CollectClaimedUses(op, constant, uses);
+          }
+        }
+
+        // Leave unused claims, and claims that the lifter would fail to apply,
+        // alone so that they are reported as they were.
+        const auto applies = std::all_of(
+            uses.begin(), uses.end(), [&value](const VarnodeData *use) {
+              return IsRam(*use) || use->size == value.size;
+            });
+        if (uses.empty() || !applies) {
+          ++i;
+          continue;
+        }
+
+        for (auto use : uses) {
+          use->offset = value.offset;
+        }
+        claimed_constants.erase(constant);
+        RemoveOp(blk, i);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  // Remove pure ops whose outputs are unique varnodes that are never read, or
+  // varnodes that are overwritten later in the same block before being read.
+  bool EliminateDeadOps(void) {
+    std::vector<VarnodeData> unique_reads;
+    std::vector<VarnodeData> claimed_values;
+    for (const auto &[base_index, blk] : cfg.blocks) {
+      for (const auto &op : blk.ops) {
+        for (const auto &var : op.vars) {
+          if (IsUnique(var)) {
+            unique_reads.push_back(var);
+          }
+        }
+        if (IsEqualityClaim(op) && IsVariable(op.vars[2])) {
+          claimed_values.push_back(op.vars[2]);
+        }
+      }
+    }
+
+    auto changed = false;
+    for (auto &[base_index, blk] : cfg.blocks) {
+
+      // Variables that are written before they are read by the rest of the
+      // block.
+      std::vector<VarnodeData> overwritten;
+      auto forget = [&overwritten](auto pred) {
+        overwritten.erase(
+            std::remove_if(overwritten.begin(), overwritten.end(), pred),
+            overwritten.end());
+      };
+
+      for (auto i = blk.ops.size(); i--;) {
+        const auto &op = blk.ops[i];
+        if (IsOpaqueCallOther(op)) {
+          forget([](const VarnodeData &var) { return IsRegister(var); });
+        }
+
+        if (op.outvar && IsVariable(*op.outvar)) {
+          const auto &out = *op.outvar;
+          const auto is_dead =
+              std::any_of(overwritten.begin(), overwritten.end(),
+                          [&out](const VarnodeData &var) {
+                            return Covers(var, out);
+                          }) ||
+              (IsUnique(out) && !AnyOverlaps(unique_reads, out)) ||
+              (op.op == CPUI_COPY && SameVarnode(op.vars[0], out));
+
+          if (is_dead && IsPure(op.op) && !AnyOverlaps(claimed_values, out)) {
+            RemoveOp(blk, i);
+            changed = true;
+            continue;
+          }
+
+          overwritten.push_back(out);
+        }
+
+        for (const auto &var : op.vars) {
+          if (IsVariable(var)) {
+            forget([&var](const VarnodeData &v) { return Overlaps(v, var); });
+          }
+        }
+      }
+    }
+
+    return changed;
+  }
+
+  void RemoveOp(PcodeBlock &blk, size_t i) {
+    if (btaken_block == &blk) {
+      CHECK(i != btaken_pos);
+      if (i < btaken_pos) {
+        btaken_pos -= 1u;
+      }
+    }
+    blk.ops.erase(blk.ops.begin() + static_cast<ptrdiff_t>(i));
+  }
+
+  PcodeCFG &cfg;
+  MaybeBranchTakenVar &btaken;
+  const std::vector<std::string> &user_op_names;
+
+  // Number of `claim_eq` claims about each constant.
+  std::map<uint64_t, unsigned> claimed_constants;
+
+  // The block containing the `CBRANCH` of the branch taken variable, and the
+  // position of the `CBRANCH` in that block.
+  PcodeBlock *btaken_block{nullptr};
+  size_t btaken_pos{0};
+};
+
+}  // namespace
+
+void OptimizeCFG(PcodeCFG &cfg, MaybeBranchTakenVar &btaken,
+                 const std::vector<std::string> &user_op_names) {
+  PcodeOptimizer(cfg, btaken, user_op_names).Run();
+}
+
+}  // namespace sleigh
+}  // namespace remill
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/Profile.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+namespace remill {
+
+const std::string_view kTraceCountersName = "__remill_trace_counters";
+const std::string_view kTraceCounterAddressesName =
+    "__remill_trace_counter_addresses";
+const std::string_view kNumTraceCountersName = "__remill_num_trace_counters";
+const std::string_view kTracePCHookName = "__remill_trace_pc";
+
+namespace {
+
+// Define the global named `name` in `module` with `init`, replacing any
+// existing declaration of it.
+static void DefineGlobal(llvm::Module *module, std::string_view name,
+                         llvm::Constant *init, bool is_constant) {
+  auto old_global = module->getNamedGlobal(name);
+  if (old_global) {
+    old_global->setName("");
+  }
+
+  auto global = new llvm::GlobalVariable(
+      *module, init->getType(), is_constant,
+      llvm::GlobalValue::ExternalLinkage, init, name);
+  global->setAlignment(llvm::MaybeAlign(8));
+
+  if (old_global) {
+    old_global->replaceAllUsesWith(
+        llvm::ConstantExpr::getBitCast(global, old_global->getType()));
+    old_global->eraseFromParent();
+  }
+}
+
+}  // namespace
+
+void DefineTraceCounters(llvm::Module *module,
+                         const std::vector<uint64_t> &addresses) {
+  auto &context = module->getContext();
+  auto i64_type = llvm::Type::getInt64Ty(context);
+  auto array_type = llvm::ArrayType::get(i64_type, addresses.size());
+
+  DefineGlobal(module, kTraceCountersName,
+               llvm::ConstantAggregateZero::get(array_type), false);
+  DefineGlobal(module, kTraceCounterAddressesName,
+               llvm::ConstantDataArray::get(context, addresses), true);
+  DefineGlobal(module, kNumTraceCountersName,
+               llvm::ConstantInt::get(i64_type, addresses.size()), true);
+}
+
+bool WriteProfile(const std::filesystem::path &path,
+                  const uint64_t *addresses, const uint64_t *counters,
+                  size_t num_counters) {
+  std::map<uint64_t, uint64_t> profile;
+  for (size_t i = 0; i < num_counters; ++i) {
+    profile[addresses[i]] += counters[i];
+  }
+
+  std::ofstream os(path);
+  if (!os) {
+    LOG(ERROR) << "Unable to open profile " << path << " for writing";
+    return false;
+  }
+
+  os << std::hex;
+  for (auto [addr, count] : profile) {
+    os << addr << ' ' << std::dec << count << std::hex << '\n';
+  }
+  return static_cast<bool>(os);
+}
+
+std::optional<Profile> ReadProfile(const std::filesystem::path &path) {
+  std::ifstream is(path);
+  if (!is) {
+    LOG(ERROR) << "Unable to open profile " << path;
+    return std::nullopt;
+  }
+
+  Profile profile;
+  uint64_t addr = 0;
+  uint64_t count = 0;
+  while (is >> std::hex >> addr >> std::dec >> count) {
+    profile[addr] += count;
+  }
+
+  if (!is.eof()) {
+    LOG(ERROR) << "Malformed profile " << path;
+    return std::nullopt;
+  }
+  return profile;
+}
+
+std::vector<llvm::Function *>
+SelectHotTraces(const std::unordered_map<uint64_t, llvm::Function *> &traces,
+                const Profile &profile, double fraction) {
+  std::vector<std::pair<uint64_t, llvm::Function *>> counted;
+  uint64_t total = 0;
+  for (auto [addr, func] : traces) {
+    auto it = profile.find(addr);
+    if (it != profile.end() && it->second) {
+      counted.emplace_back(it->second, func);
+      total += it->second;
+    }
+  }
+
+  std::sort(counted.begin(), counted.end(), [](const auto &a, const auto &b) {
+    return a.first > b.first;
+  });
+
+  std::vector<llvm::Function *> hot;
+  uint64_t covered = 0;
+  for (auto [count, func] : counted) {
+    if (static_cast<double>(covered) >= fraction * static_cast<double>(total)) {
+      break;
+    }
+    hot.push_back(func);
+    covered += count;
+  }
+  return hot;
+}
+
+}  // namespace remill
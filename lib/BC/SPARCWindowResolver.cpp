@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Annotate.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+// Number of register windows in the bank, and number of registers in each
+// window that aren't shared with the next window.
+static constexpr unsigned kNumWindows = 8;
+static constexpr unsigned kNumWindowRegs = 16;
+
+// Number of windowed registers visible at a time, i.e. the ins, locals, and
+// outs of the current window.
+static constexpr unsigned kNumVisibleRegs = 24;
+
+// Names of the windowed registers, in the order in which they are laid out.
+static const char *const kWindowedRegNames[kNumVisibleRegs] = {
+    "i0", "i1", "i2", "i3", "i4", "i5", "i6", "i7",
+    "l0", "l1", "l2", "l3", "l4", "l5", "l6", "l7",
+    "o0", "o1", "o2", "o3", "o4", "o5", "o6", "o7"};
+
+class SPARCWindowResolver {
+ public:
+  SPARCWindowResolver(const Register *i0_, uint64_t reg_stride_,
+                      const Register *cwp_reg_, const Register *bank_,
+                      llvm::Function *func_)
+      : i0(i0_),
+        reg_stride(reg_stride_),
+        cwp_reg(cwp_reg_),
+        bank(bank_),
+        func(func_),
+        dl(func->getParent()->getDataLayout()),
+        state_ptr(NthArgument(func, kStatePointerArgNum)) {}
+
+  // Returns the number of resolved operands.
+  size_t Run(void) {
+    if (!FindAccesses()) {
+      return 0;
+    }
+
+    size_t num_resolved = 0;
+    llvm::ReversePostOrderTraversal<llvm::Function *> rpot(func);
+    for (auto block : rpot) {
+      cwp = CWPOnEntry(block);
+      ptrs.clear();
+
+      std::vector<llvm::Instruction *> insts;
+      for (auto &inst : *block) {
+        insts.push_back(&inst);
+      }
+
+      for (auto inst : insts) {
+        auto call = llvm::dyn_cast<llvm::CallInst>(inst);
+        auto adjustment = call ? Adjustment(call) : std::optional<int8_t>(0);
+
+        // The registers that an instruction writes are in the window that it
+        // moves to, e.g. the `%sp` written by `save %sp, -176, %sp`.
+        if (adjustment && *adjustment) {
+          if (auto it = accesses.find(inst); it != accesses.end()) {
+            llvm::IRBuilder<> ir(inst);
+            LoadCWP(ir);
+            MoveCWP(ir, *adjustment);
+            num_resolved += Resolve(ir, inst, it->second);
+          } else if (cwp) {
+            llvm::IRBuilder<> ir(inst->getNextNode());
+            MoveCWP(ir, *adjustment);
+          }
+          continue;
+        }
+
+        if (auto it = accesses.find(inst); it != accesses.end()) {
+          llvm::IRBuilder<> ir(inst);
+          num_resolved += Resolve(ir, inst, it->second);
+        }
+
+        // Anything else that is given `State` might change `CWP`, e.g. a
+        // call to another lifted function.
+        if (call && (!adjustment || !IsSemanticsCall(call)) &&
+            !call->onlyReadsMemory() &&
+            llvm::is_contained(call->args(), state_ptr)) {
+          cwp = nullptr;
+        }
+      }
+
+      cwp_on_exit[block] = cwp;
+    }
+
+    return num_resolved;
+  }
+
+ private:
+  // Find the loads and stores of windowed registers, as well as the windowed
+  // register operands of calls to semantics functions. Returns `false` if
+  // there are none.
+  bool FindAccesses(void) {
+    std::vector<std::pair<llvm::Value *, uint64_t>> work_list;
+    work_list.emplace_back(state_ptr, 0u);
+
+    while (!work_list.empty()) {
+      auto [ptr, offset] = work_list.back();
+      work_list.pop_back();
+
+      for (auto &use : ptr->uses()) {
+        auto user = use.getUser();
+        if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+          llvm::APInt delta(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+          if (gep->accumulateConstantOffset(dl, delta) &&
+              !delta.isNegative()) {
+            work_list.emplace_back(gep, offset + delta.getZExtValue());
+          }
+          continue;
+
+        } else if (auto cast = llvm::dyn_cast<llvm::BitCastOperator>(user)) {
+          work_list.emplace_back(cast, offset);
+          continue;
+        }
+
+        const auto reg_num = WindowedRegNum(offset);
+        if (!reg_num) {
+          continue;
+        }
+
+        auto inst = llvm::dyn_cast<llvm::Instruction>(user);
+        if (llvm::isa_and_nonnull<llvm::LoadInst>(inst) ||
+            (llvm::isa_and_nonnull<llvm::StoreInst>(inst) &&
+             use.getOperandNo() == 1)) {
+          accesses[inst].emplace_back(use.getOperandNo(), *reg_num);
+
+        } else if (auto call = llvm::dyn_cast_or_null<llvm::CallInst>(inst);
+                   call && call->isArgOperand(&use) && IsSemanticsCall(call)) {
+          accesses[inst].emplace_back(use.getOperandNo(), *reg_num);
+        }
+      }
+    }
+
+    return !accesses.empty();
+  }
+
+  // Returns which of the windowed registers, if any, is at `offset` in
+  // `State`.
+  std::optional<unsigned> WindowedRegNum(uint64_t offset) const {
+    if (offset < i0->offset) {
+      return std::nullopt;
+    }
+    const auto reg_num = (offset - i0->offset) / reg_stride;
+    if (reg_num >= kNumVisibleRegs ||
+        (i0->offset + reg_num * reg_stride) != offset) {
+      return std::nullopt;
+    }
+    return static_cast<unsigned>(reg_num);
+  }
+
+  // Is `call` a call to the semantics of a lifted instruction?
+  static bool IsSemanticsCall(llvm::CallInst *call) {
+    auto callee = call->getCalledFunction();
+    return callee && !callee->isDeclaration() &&
+           HasOriginType<Semantics>(callee);
+  }
+
+  // How the instruction whose semantics are called by `call` moves `CWP`.
+  // Returns `std::nullopt` if it isn't known.
+  static std::optional<int8_t> Adjustment(llvm::CallInst *call) {
+    auto md = call->getMetadata(kSPARCWindowAdjustmentMetadataName);
+    if (!md) {
+      return 0;
+    } else if (!md->getNumOperands()) {
+      return std::nullopt;
+    }
+    return static_cast<int8_t>(
+        llvm::mdconst::extract<llvm::ConstantInt>(md->getOperand(0))
+            ->getSExtValue());
+  }
+
+  // Figure out `CWP` on entry to `block` from `CWP` on exit from all of its
+  // predecessors. Returns `nullptr` if it isn't known, e.g. at loop heads.
+  llvm::Value *CWPOnEntry(llvm::BasicBlock *block) {
+    if (block == &(func->getEntryBlock())) {
+      return nullptr;
+    }
+
+    std::vector<std::pair<llvm::BasicBlock *, llvm::Value *>> incoming;
+    for (auto pred : llvm::predecessors(block)) {
+      auto cwp_it = cwp_on_exit.find(pred);
+      if (cwp_it == cwp_on_exit.end() || !cwp_it->second) {
+        return nullptr;
+      }
+      incoming.emplace_back(pred, cwp_it->second);
+    }
+
+    if (incoming.empty()) {
+      return nullptr;
+    }
+
+    auto same = true;
+    for (auto [pred, val] : incoming) {
+      same = same && val == incoming.front().second;
+    }
+    if (same) {
+      return incoming.front().second;
+    }
+
+    auto phi = llvm::PHINode::Create(incoming.front().second->getType(),
+                                     static_cast<unsigned>(incoming.size()),
+                                     "", &(block->front()));
+    for (auto [pred, val] : incoming) {
+      phi->addIncoming(val, pred);
+    }
+    return phi;
+  }
+
+  // Make sure that `CWP` is known before the insertion point of `ir`.
+  void LoadCWP(llvm::IRBuilder<> &ir) {
+    if (!cwp) {
+      auto cwp_val =
+          ir.CreateLoad(cwp_reg->type, cwp_reg->AddressOf(state_ptr, ir));
+      cwp = ir.CreateAnd(ir.CreateZExt(cwp_val, ir.getInt32Ty()),
+                         kNumWindows - 1u);
+      ptrs.clear();
+    }
+  }
+
+  // Move `CWP` by `adjustment` windows.
+  void MoveCWP(llvm::IRBuilder<> &ir, int8_t adjustment) {
+    const auto delta = static_cast<uint32_t>(adjustment) % kNumWindows;
+    if (delta) {
+      cwp = ir.CreateAnd(ir.CreateAdd(cwp, ir.getInt32(delta)),
+                         kNumWindows - 1u);
+      ptrs.clear();
+    }
+  }
+
+  // Point the operands of `inst` that access windowed registers at the
+  // registers of the current window.
+  size_t Resolve(llvm::IRBuilder<> &ir, llvm::Instruction *inst,
+                 const std::vector<std::pair<unsigned, unsigned>> &ops) {
+    LoadCWP(ir);
+    for (auto [op_num, reg_num] : ops) {
+      auto &ptr = ptrs[reg_num];
+      if (!ptr) {
+        auto index = ir.CreateAnd(
+            ir.CreateAdd(ir.CreateMul(cwp, ir.getInt32(kNumWindowRegs)),
+                         ir.getInt32(reg_num)),
+            kNumWindows * kNumWindowRegs - 1u);
+        auto offset = ir.CreateMul(ir.CreateZExt(index, ir.getInt64Ty()),
+                                   ir.getInt64(reg_stride));
+        ptr = ir.CreateInBoundsGEP(ir.getInt8Ty(),
+                                   bank->AddressOf(state_ptr, ir), offset);
+      }
+      auto op = inst->getOperand(op_num);
+      inst->setOperand(op_num, ir.CreatePointerCast(ptr, op->getType()));
+    }
+    return ops.size();
+  }
+
+  const Register *const i0;
+  const uint64_t reg_stride;
+  const Register *const cwp_reg;
+  const Register *const bank;
+  llvm::Function *const func;
+  const llvm::DataLayout &dl;
+  llvm::Value *const state_ptr;
+
+  // Operands to resolve, as pairs of operand number and windowed register
+  // number, by instruction.
+  std::unordered_map<llvm::Instruction *,
+                     std::vector<std::pair<unsigned, unsigned>>>
+      accesses;
+
+  // Value of `CWP` at the end of each visited block, or `nullptr` if it isn't
+  // known.
+  std::unordered_map<llvm::BasicBlock *, llvm::Value *> cwp_on_exit;
+
+  // Value of `CWP` at the current position in the current block, and the
+  // pointers to the windowed registers computed from it.
+  llvm::Value *cwp{nullptr};
+  std::map<unsigned, llvm::Value *> ptrs;
+};
+
+}  // namespace
+
+// Point the windowed register operands of the SPARC instructions in `trace`
+// at the registers of the current window in the register window bank.
+size_t ResolveSPARCWindowOperands(const Arch *arch, llvm::Function *trace) {
+  if (trace->isDeclaration() || !HasSPARCWindowBank(trace->getParent())) {
+    return 0;
+  }
+
+  const Register *regs[kNumVisibleRegs] = {};
+  for (auto i = 0u; i < kNumVisibleRegs; ++i) {
+    regs[i] = arch->RegisterByName(kWindowedRegNames[i]);
+  }
+  const auto cwp = arch->RegisterByName("cwp");
+  const auto bank = arch->RegisterByName("WINDOW_BANK");
+  CHECK(regs[0] && regs[1] && cwp && bank)
+      << "Semantics with a register window bank require the windowed, "
+      << "cwp, and WINDOW_BANK registers; was remill built with "
+      << "REMILL_SPARC_WINDOW_BANK?";
+
+  // The windowed registers of `GPR` have to be laid out like the registers of
+  // the bank, so that they can be mapped into the bank by their index.
+  const auto reg_stride = regs[1]->offset - regs[0]->offset;
+  for (auto i = 1u; i < kNumVisibleRegs; ++i) {
+    CHECK(regs[i] && regs[i]->offset == (regs[0]->offset + i * reg_stride))
+        << "Register " << kWindowedRegNames[i]
+        << " isn't where a register window bank expects";
+  }
+
+  return SPARCWindowResolver(regs[0], reg_stride, cwp, bank, trace).Run();
+}
+
+}  // namespace remill
@@ -26,9 +26,11 @@
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/MD5.h>
 #include <remill/Arch/Context.h>
 #include <remill/Arch/Name.h>
 #include <remill/Arch/Runtime/HyperCall.h>
+#include <remill/Arch/Statistics.h>
 #include <remill/BC/ABI.h>
 #include <remill/BC/InstructionLifter.h>
 #include <remill/BC/IntrinsicTable.h>
@@ -1376,6 +1378,9 @@ class SleighLifter::PcodeToLLVMEmitIntoBlock {
       if (other_func_name == kEqualityClaimName &&
           isize == kEqualityClaimArity) {
         DLOG(INFO) << "Applying eq claim";
+        if (auto stats = this->insn_lifter_parent.Statistics()) {
+          stats->RecordEqualityClaim();
+        }
         this->replacement_cont.ApplyEqualityClaim(bldr, *this, vars[1],
                                                   vars[2]);
         return kLiftedInstruction;
@@ -1491,7 +1496,7 @@ class SleighLifter::PcodeToLLVMEmitIntoBlock {
     // we have a problem with block terminators where a cbranch <relative> -> fallthrough, need to either exit to the exit block
     // or transfer to a block. So really our cfg needs to tell us how to terminate a block
     // either exit (means real control flow), to block (fake control flow)
-    size_t index = 0;
+    size_t index = blk.base_index;
     for (auto pc : blk.ops) {
       this->LiftBtakenIfReached(bldr, pc.op, index);
       this->LiftPcodeOp(bldr, pc.op, pc.outvar, pc.vars.data(), pc.vars.size());
@@ -1696,6 +1701,35 @@ SleighLifter::DefineInstructionFunction(Instruction &inst,
   return func;
 }
 
+// Returns the name under which the instruction function for `inst` can be
+// shared by every instruction with the same bytes, context, and branch taken
+// variable.
+std::string SleighLifter::SharedInstructionFunctionName(
+    const Instruction &inst, const sleigh::MaybeBranchTakenVar &btaken,
+    const ContextValues &context_values) {
+  std::stringstream key;
+  for (const auto &[name, val] : context_values) {
+    key << name << '=' << val << ';';
+  }
+  if (btaken) {
+    key << "btaken=" << btaken->invert << ','
+        << btaken->target_vnode.space->getName() << ','
+        << btaken->target_vnode.offset << ',' << btaken->target_vnode.size
+        << ',' << btaken->index;
+  }
+
+  llvm::MD5 hasher;
+  hasher.update(key.str());
+  llvm::MD5::MD5Result digest;
+  hasher.final(digest);
+
+  std::stringstream nm;
+  nm << SleighLifter::kInstructionFunctionPrefix << "_"
+     << llvm::toHex(inst.bytes, true /* LowerCase */) << "_" << std::hex
+     << digest.low();
+  return nm.str();
+}
+
 std::pair<LiftStatus, std::optional<llvm::Function *>>
 SleighLifter::LiftIntoInternalBlockWithSleighState(
     Instruction &inst, llvm::Module *target_mod, bool is_delayed,
@@ -1707,7 +1741,22 @@ SleighLifter::LiftIntoInternalBlockWithSleighState(
                                         context_values);
 
   sleigh::PcodeDecoder pcode_record(this->GetEngine());
-  sleigh_context->oneInstruction(inst.pc, pcode_record, inst.bytes);
+  const auto decoded =
+      sleigh_context->oneInstruction(inst.pc, pcode_record, inst.bytes);
+
+  // Instructions whose p-code doesn't depend on their address, e.g. the many
+  // copies of `push {r4, lr}` in a binary, share one instruction function.
+  std::optional<std::string> shared_name;
+  if (decoded && !sleigh_context->DependsOnAddress(inst.pc)) {
+    shared_name = SharedInstructionFunctionName(inst, btaken, context_values);
+    auto shared_func = target_mod->getFunction(*shared_name);
+    if (shared_func && !shared_func->isDeclaration()) {
+      DLOG(INFO) << "Reusing " << *shared_name << " for instruction at "
+                 << std::hex << inst.pc << std::dec;
+      return {LiftStatus::kLiftedInstruction, shared_func};
+    }
+  }
+
   for (const auto &op : pcode_record.ops) {
     DLOG(INFO) << "Pcodeop: " << DumpPcode(this->GetEngine(), op);
   }
@@ -1735,6 +1784,13 @@ SleighLifter::LiftIntoInternalBlockWithSleighState(
 
 
   auto cfg = sleigh::CreateCFG(pcode_record.ops);
+  auto user_op_names = this->sleigh_context->getUserOpNames();
+
+  // Optimizing the p-code can move the `CBRANCH` that `btaken` refers to.
+  auto cfg_btaken = btaken;
+#ifdef REMILL_OPTIMIZE_PCODE
+  sleigh::OptimizeCFG(cfg, cfg_btaken, user_op_names);
+#endif
 
 
   SleighLifter::PcodeToLLVMEmitIntoBlock::DecodingContextConstants
@@ -1744,7 +1800,7 @@ SleighLifter::LiftIntoInternalBlockWithSleighState(
 
   SleighLifter::PcodeToLLVMEmitIntoBlock lifter(
       target_block, internal_state_pointer, inst, *this,
-      this->sleigh_context->getUserOpNames(), exit_block, btaken,
+      std::move(user_op_names), exit_block, cfg_btaken,
       std::move(decoding_context_lifter));
 
 
@@ -1765,6 +1821,13 @@ SleighLifter::LiftIntoInternalBlockWithSleighState(
   remill::InitFunctionAttributes(target_func);
 
   CHECK(remill::VerifyFunction(target_func));
+
+  // Only successfully lifted functions are shared, so that a reused function
+  // always implies `kLiftedInstruction`.
+  if (shared_name && lifter.GetStatus() == LiftStatus::kLiftedInstruction) {
+    target_func->setName(*shared_name);
+  }
+
   return {lifter.GetStatus(), target_func};
 }
 
@@ -1850,8 +1913,19 @@ SleighLifterWithState::SleighLifterWithState(
 LiftStatus
 SleighLifterWithState::LiftIntoBlock(Instruction &inst, llvm::BasicBlock *block,
                                      llvm::Value *state_ptr, bool is_delayed) {
-  return this->lifter->LiftIntoBlockWithSleighState(
+  const auto stats = this->lifter->Statistics();
+  if (!stats) {
+    return this->lifter->LiftIntoBlockWithSleighState(
+        inst, block, state_ptr, is_delayed, this->btaken, this->context_values);
+  }
+
+  const auto start = LiftingStatistics::Clock::now();
+  const auto status = this->lifter->LiftIntoBlockWithSleighState(
       inst, block, state_ptr, is_delayed, this->btaken, this->context_values);
+  stats->RecordLift(inst.IsValid() ? std::string_view(inst.function)
+                                   : kInvalidInstructionISelName,
+                    status, start);
+  return status;
 }
 
 
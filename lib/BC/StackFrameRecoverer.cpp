@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// Frames bigger than this are left in memory, e.g. because they are probably
+// the result of `alloca`-like stack allocation.
+static constexpr int64_t kMaxFrameSize = 4096;
+
+// A call to a memory intrinsic at a constant offset from the stack pointer
+// on entry to the trace.
+struct FrameAccess {
+  llvm::CallInst *call;
+  int64_t offset;
+  bool is_write;
+};
+
+// A place where control leaves the trace, and where the frame has to be in
+// memory for whatever comes next.
+struct FrameExit {
+
+  // The call that leaves the trace, or the `ret` if there is no such call.
+  llvm::Instruction *inst;
+
+  // Offset of the stack pointer from its value on entry.
+  int64_t sp_offset;
+
+  // Whether or not this returns from the function of the trace, which means
+  // that everything below the stack pointer is dead.
+  bool is_return;
+};
+
+class StackFrameRecoverer {
+ public:
+  StackFrameRecoverer(llvm::Function *func_, const Register *sp_reg_)
+      : func(func_),
+        module(func->getParent()),
+        dl(module->getDataLayout()),
+        sp_reg(sp_reg_),
+        state_ptr(NthArgument(func, kStatePointerArgNum)),
+        entry_memory(NthArgument(func, kMemoryPointerArgNum)) {
+    static const char *const kReads[] = {
+        "__remill_read_memory_8", "__remill_read_memory_16",
+        "__remill_read_memory_32", "__remill_read_memory_64",
+        "__remill_read_memory_f32", "__remill_read_memory_f64"};
+    static const char *const kWrites[] = {
+        "__remill_write_memory_8", "__remill_write_memory_16",
+        "__remill_write_memory_32", "__remill_write_memory_64",
+        "__remill_write_memory_f32", "__remill_write_memory_f64"};
+
+    for (auto name : kReads) {
+      if (auto read = FindFunction(module, name)) {
+        memory_intrinsics.emplace(read, false);
+      }
+    }
+    for (auto name : kWrites) {
+      if (auto write = FindFunction(module, name)) {
+        memory_intrinsics.emplace(write, true);
+      }
+    }
+  }
+
+  // Returns `true` if the frame of `func` was moved into an `alloca`.
+  bool Run(void) {
+    if (!FindEntryStackPointer() || !FindFrameAccesses() || accesses.empty() ||
+        !FindExits()) {
+      return false;
+    }
+
+    const auto frame_size = -frame_begin;
+    auto &entry = func->getEntryBlock();
+    llvm::IRBuilder<> ir(&*entry.getFirstInsertionPt());
+    auto frame_type = llvm::ArrayType::get(ir.getInt8Ty(),
+                                           static_cast<uint64_t>(frame_size));
+    frame = ir.CreateAlloca(frame_type, nullptr, "STACK_FRAME");
+
+    // Initialize the frame from memory. These reads are removed afterward if
+    // nothing observes them, i.e. if everything in the frame is written before
+    // it's read.
+    ir.SetInsertPoint(entry_sp->getNextNode());
+    CopyFrame(frame_begin, 0, [&](int64_t offset, unsigned size) {
+      auto read = Intrinsic("__remill_read_memory_", size);
+      auto val = ir.CreateCall(read, {entry_memory, Address(ir, offset)});
+      ir.CreateStore(val, FrameAddress(ir, offset));
+      init_reads.emplace_back(val);
+    });
+
+    // Redirect the in-frame accesses to the frame.
+    for (const auto &access : accesses) {
+      ir.SetInsertPoint(access.call);
+      auto ptr = FrameAddress(ir, access.offset);
+      if (access.is_write) {
+        ir.CreateStore(access.call->getArgOperand(2), ptr);
+        access.call->replaceAllUsesWith(access.call->getArgOperand(0));
+      } else {
+        auto val = ir.CreateLoad(access.call->getType(), ptr);
+        access.call->replaceAllUsesWith(val);
+      }
+      access.call->eraseFromParent();
+    }
+
+    // Write the part of the frame that is still live back into memory before
+    // leaving the trace.
+    for (const auto &exit : exits) {
+      auto begin = exit.is_return ? std::max(frame_begin, exit.sp_offset)
+                                  : frame_begin;
+      if (begin >= 0) {
+        continue;
+      }
+
+      auto memory_use = ExitMemory(exit.inst);
+      llvm::Value *memory = memory_use->get();
+      ir.SetInsertPoint(exit.inst);
+      CopyFrame(begin, 0, [&](int64_t offset, unsigned size) {
+        auto write = Intrinsic("__remill_write_memory_", size);
+        auto val = ir.CreateLoad(write->getFunctionType()->getParamType(2),
+                                 FrameAddress(ir, offset));
+        memory = ir.CreateCall(write, {memory, Address(ir, offset), val});
+      });
+      memory_use->set(memory);
+    }
+
+    return true;
+  }
+
+  // Reads that initialize the frame, and that may be dead.
+  std::vector<llvm::WeakTrackingVH> init_reads;
+
+ private:
+  // Returns the offset in `State` that `ptr` points to, if any.
+  std::optional<uint64_t> StateOffset(llvm::Value *ptr) const {
+    llvm::APInt offset(dl.getIndexTypeSizeInBits(ptr->getType()), 0);
+    auto base = ptr->stripAndAccumulateConstantOffsets(dl, offset, true);
+    if (base != state_ptr || offset.isNegative()) {
+      return std::nullopt;
+    }
+    return offset.getZExtValue();
+  }
+
+  // Returns `true` if `ptr` points into the stack pointer register.
+  bool IsStackPointerAccess(llvm::Value *ptr, llvm::Type *type) const {
+    auto offset = StateOffset(ptr);
+    if (!offset) {
+      return false;
+    }
+    const auto size = dl.getTypeStoreSize(type).getFixedValue();
+    return *offset < (sp_reg->offset + sp_reg->size) &&
+           sp_reg->offset < (*offset + size);
+  }
+
+  // Find the load of the stack pointer on entry to the trace. It has to be
+  // the only load of the stack pointer that is used, which is what happens
+  // when the trace has been scalarized.
+  bool FindEntryStackPointer(void) {
+    for (auto &inst : llvm::instructions(*func)) {
+      auto load = llvm::dyn_cast<llvm::LoadInst>(&inst);
+      if (!load || load->use_empty() ||
+          !IsStackPointerAccess(load->getPointerOperand(), load->getType())) {
+        continue;
+      }
+
+      if (entry_sp || load->getParent() != &func->getEntryBlock() ||
+          load->getType() != sp_reg->type || !load->isSimple() ||
+          StateOffset(load->getPointerOperand()) != sp_reg->offset) {
+        return false;
+      }
+      entry_sp = load;
+    }
+    return entry_sp != nullptr;
+  }
+
+  // Follow the values derived from the stack pointer on entry by adding or
+  // subtracting constants. Returns `false` if one of them is used in any way
+  // other than as the address of a memory intrinsic, or as the new value of
+  // the stack pointer, i.e. if the frame escapes.
+  bool FindFrameAccesses(void) {
+    std::vector<std::pair<llvm::Value *, int64_t>> work_list;
+    work_list.emplace_back(entry_sp, 0);
+
+    while (!work_list.empty()) {
+      auto [val, offset] = work_list.back();
+      work_list.pop_back();
+      if (!sp_offsets.emplace(val, offset).second) {
+        continue;
+      }
+
+      for (auto &use : val->uses()) {
+        auto user = use.getUser();
+        if (auto bin = llvm::dyn_cast<llvm::BinaryOperator>(user)) {
+          auto other = bin->getOperand(1u - use.getOperandNo());
+          auto ci = llvm::dyn_cast<llvm::ConstantInt>(other);
+          if (!ci) {
+            return false;
+          }
+
+          auto delta = ci->getSExtValue();
+          if (bin->getOpcode() == llvm::Instruction::Add) {
+            work_list.emplace_back(bin, offset + delta);
+          } else if (bin->getOpcode() == llvm::Instruction::Sub &&
+                     !use.getOperandNo()) {
+            work_list.emplace_back(bin, offset - delta);
+          } else {
+            return false;
+          }
+
+        } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+          if (use.getOperandNo() != 0u ||
+              StateOffset(store->getPointerOperand()) != sp_reg->offset) {
+            return false;
+          }
+
+        } else if (auto call = llvm::dyn_cast<llvm::CallInst>(user)) {
+          auto it = memory_intrinsics.find(call->getCalledFunction());
+          if (it == memory_intrinsics.end() || use.getOperandNo() != 1u) {
+            return false;
+          }
+
+          const auto size = static_cast<int64_t>(dl.getTypeStoreSize(
+              it->second ? call->getArgOperand(2)->getType()
+                         : call->getType()));
+          if ((offset + size) <= 0) {
+            accesses.push_back({call, offset, it->second});
+            frame_begin = std::min(frame_begin, offset);
+          } else if (offset < 0) {
+            return false;  // Straddles the stack pointer on entry.
+          }
+
+        } else {
+          return false;
+        }
+      }
+    }
+
+    return frame_begin >= -kMaxFrameSize;
+  }
+
+  // Find every place where control leaves the trace, and where the stack
+  // pointer is at that point. Returns `false` if the trace calls anything
+  // that can observe the frame before then.
+  bool FindExits(void) {
+    bool writes_sp = false;
+    for (auto &inst : llvm::instructions(*func)) {
+      if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        if (IsStackPointerAccess(store->getPointerOperand(),
+                                 store->getValueOperand()->getType())) {
+          if (!sp_offsets.count(store->getValueOperand())) {
+            return false;
+          }
+          writes_sp = true;
+        }
+
+      } else if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(&inst)) {
+        auto ret_val = ret->getReturnValue();
+        if (!ret_val) {
+          return false;
+        }
+        auto prev = ret->getPrevNode();
+        auto call = llvm::dyn_cast_or_null<llvm::CallInst>(prev);
+        if (call && call == ret_val && IsExitCall(call)) {
+          exits.push_back({call, 0, IsReturn(call)});
+        } else {
+          exits.push_back({ret, 0, false});
+        }
+
+      } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        if (memory_intrinsics.count(call->getCalledFunction())) {
+          continue;
+        }
+
+        // E.g. a `memcpy` out of `State` could read the stack pointer.
+        if (auto mem = llvm::dyn_cast<llvm::MemIntrinsic>(call)) {
+          if (llvm::getUnderlyingObject(mem->getDest()) == state_ptr) {
+            return false;
+          }
+          auto transfer = llvm::dyn_cast<llvm::MemTransferInst>(mem);
+          if (transfer && llvm::getUnderlyingObject(transfer->getSource()) ==
+                              state_ptr) {
+            return false;
+          }
+          continue;
+        } else if (llvm::isa<llvm::IntrinsicInst>(call)) {
+          continue;
+        }
+
+        // Anything that gets `State` or `Memory *` can see the frame.
+        auto takes_ptr = std::any_of(
+            call->arg_begin(), call->arg_end(),
+            [](const llvm::Use &arg) {
+              return arg->getType()->isPointerTy();
+            });
+        auto next = llvm::dyn_cast_or_null<llvm::ReturnInst>(
+            call->getNextNode());
+        if (takes_ptr && (!next || next->getReturnValue() != call ||
+                          !IsExitCall(call))) {
+          return false;
+        }
+      }
+    }
+
+    // The stack pointer on exit is the last value stored into it in the block
+    // of the exit.
+    for (auto &exit : exits) {
+      llvm::StoreInst *sp_store = nullptr;
+      for (auto inst = exit.inst->getPrevNode(); inst && !sp_store;
+           inst = inst->getPrevNode()) {
+        auto store = llvm::dyn_cast<llvm::StoreInst>(inst);
+        if (store && IsStackPointerAccess(store->getPointerOperand(),
+                                          store->getValueOperand()->getType())) {
+          sp_store = store;
+        }
+      }
+
+      if (sp_store) {
+        exit.sp_offset = sp_offsets[sp_store->getValueOperand()];
+      } else if (writes_sp) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns `true` if `call` leaves the trace with the usual lifted function
+  // arguments.
+  bool IsExitCall(llvm::CallInst *call) const {
+    return call->arg_size() == kNumBlockArgs &&
+           call->getArgOperand(kStatePointerArgNum) == state_ptr &&
+           call->getArgOperand(kMemoryPointerArgNum)->getType() ==
+               entry_memory->getType();
+  }
+
+  static bool IsReturn(llvm::CallInst *call) {
+    auto callee = call->getCalledFunction();
+    return callee && callee->getName() == "__remill_function_return";
+  }
+
+  // The use of the `Memory *` that leaves the trace at `exit`.
+  static llvm::Use *ExitMemory(llvm::Instruction *exit) {
+    if (auto call = llvm::dyn_cast<llvm::CallInst>(exit)) {
+      return &call->getArgOperandUse(kMemoryPointerArgNum);
+    }
+    return &llvm::cast<llvm::ReturnInst>(exit)->getOperandUse(0);
+  }
+
+  // Call `copy` for each of the pieces of the frame between `begin` and `end`
+  // that can be read or written in one access.
+  template <typename T>
+  static void CopyFrame(int64_t begin, int64_t end, T copy) {
+    for (auto offset = begin; offset < end;) {
+      int64_t size = 8;
+      while ((offset + size) > end || (offset % size)) {
+        size /= 2;
+      }
+      copy(offset, static_cast<unsigned>(size));
+      offset += size;
+    }
+  }
+
+  llvm::Function *Intrinsic(const char *prefix, unsigned size) const {
+    auto func = FindFunction(module, prefix + std::to_string(size * 8u));
+    CHECK(func != nullptr) << "Missing " << prefix << size * 8u;
+    return func;
+  }
+
+  llvm::Value *Address(llvm::IRBuilder<> &ir, int64_t offset) const {
+    return ir.CreateAdd(entry_sp, llvm::ConstantInt::get(
+                                      sp_reg->type,
+                                      static_cast<uint64_t>(offset), true));
+  }
+
+  llvm::Value *FrameAddress(llvm::IRBuilder<> &ir, int64_t offset) const {
+    return ir.CreateConstInBoundsGEP1_64(
+        ir.getInt8Ty(), frame, static_cast<uint64_t>(offset - frame_begin));
+  }
+
+  llvm::Function *const func;
+  llvm::Module *const module;
+  const llvm::DataLayout &dl;
+  const Register *const sp_reg;
+  llvm::Value *const state_ptr;
+  llvm::Value *const entry_memory;
+
+  // Memory intrinsics, and whether or not they write.
+  std::unordered_map<llvm::Function *, bool> memory_intrinsics;
+
+  llvm::LoadInst *entry_sp{nullptr};
+
+  // Values derived from `entry_sp`, and their offsets from it.
+  std::unordered_map<llvm::Value *, int64_t> sp_offsets;
+
+  std::vector<FrameAccess> accesses;
+  std::vector<FrameExit> exits;
+
+  // The frame covers `[frame_begin, 0)` relative to `entry_sp`.
+  int64_t frame_begin{0};
+
+  llvm::AllocaInst *frame{nullptr};
+};
+
+}  // namespace
+
+// Move the stack frames of the lifted traces into `alloca`s.
+size_t RecoverStackFrames(const Arch *arch, llvm::Module *module,
+                          const std::vector<llvm::Function *> &traces) {
+  const auto sp_reg = arch->RegisterByName(arch->StackPointerRegisterName());
+  const auto &dl = module->getDataLayout();
+  if (!sp_reg || sp_reg->EnclosingRegister() != sp_reg ||
+      !sp_reg->type->isIntegerTy() ||
+      dl.getTypeStoreSize(sp_reg->type) != sp_reg->size ||
+      arch->MemoryAccessIsLittleEndian() != dl.isLittleEndian()) {
+    return 0;
+  }
+
+  llvm::ModuleAnalysisManager mam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::LoopAnalysisManager lam;
+  llvm::CGSCCAnalysisManager cam;
+
+  llvm::PassBuilder pb;
+  pb.registerModuleAnalyses(mam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.registerCGSCCAnalyses(cam);
+  pb.crossRegisterProxies(lam, fam, cam, mam);
+
+  llvm::FunctionPassManager fpm;
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(16, 0)
+  fpm.addPass(llvm::SROAPass());
+#else
+  fpm.addPass(llvm::SROAPass(llvm::SROAOptions::ModifyCFG));
+#endif
+  fpm.addPass(llvm::EarlyCSEPass(false /* UseMemorySSA */));
+
+  size_t num_recovered = 0;
+  for (auto func : traces) {
+    if (func->isDeclaration()) {
+      continue;
+    }
+
+    // Get rid of the dead reloads of `State` that scalarization leaves after
+    // calls, so that only the stack pointer on entry is left.
+    fpm.run(*func, fam);
+
+    StackFrameRecoverer recoverer(func, sp_reg);
+    if (!recoverer.Run()) {
+      continue;
+    }
+
+    // Promote the frame into SSA values, then remove the initial reads of
+    // the parts of the frame that are always written before being read.
+    fpm.run(*func, fam);
+    for (auto &read : recoverer.init_reads) {
+      llvm::Value *val = read;
+      if (auto inst = llvm::dyn_cast_or_null<llvm::Instruction>(val);
+          inst && inst->use_empty()) {
+        inst->eraseFromParent();
+      }
+    }
+
+    ++num_recovered;
+  }
+
+  fam.clear();
+  mam.clear();
+  lam.clear();
+  cam.clear();
+
+  DLOG(INFO) << "Recovered the stack frames of " << num_recovered << " of "
+             << traces.size() << " traces in " << ModuleName(module);
+  return num_recovered;
+}
+
+}  // namespace remill
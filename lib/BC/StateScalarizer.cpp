@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// A load or store that falls entirely within one top-level register.
+struct RegisterAccess {
+  llvm::Instruction *inst;
+  const Register *reg;
+  uint64_t offset_in_reg;
+};
+
+class StateScalarizer {
+ public:
+  StateScalarizer(const Arch *arch_, llvm::Function *func_)
+      : arch(arch_),
+        func(func_),
+        dl(func->getParent()->getDataLayout()),
+        state_ptr(NthArgument(func, kStatePointerArgNum)) {}
+
+  // Returns `true` if `func` was changed.
+  bool Run(void) {
+    if (!FindAccesses() || accesses.empty()) {
+      return false;
+    }
+
+    llvm::IRBuilder<> ir(&*func->getEntryBlock().getFirstInsertionPt());
+
+    // One local copy of every register used by the function, initialized on
+    // entry.
+    for (const auto &access : accesses) {
+      auto &local = locals[access.reg];
+      if (!local) {
+        local = ir.CreateAlloca(access.reg->type, nullptr, access.reg->name);
+      }
+    }
+    Reload(ir);
+
+    // Redirect every access into the local copy of its register.
+    std::vector<llvm::WeakTrackingVH> old_ptrs;
+    for (const auto &access : accesses) {
+      ir.SetInsertPoint(access.inst);
+      llvm::Value *ptr = locals[access.reg];
+      if (access.offset_in_reg) {
+        ptr = ir.CreateConstInBoundsGEP1_64(ir.getInt8Ty(), ptr,
+                                            access.offset_in_reg);
+      }
+
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(access.inst)) {
+        old_ptrs.push_back(load->getPointerOperand());
+        load->setOperand(llvm::LoadInst::getPointerOperandIndex(), ptr);
+      } else {
+        auto store = llvm::cast<llvm::StoreInst>(access.inst);
+        old_ptrs.push_back(store->getPointerOperand());
+        store->setOperand(llvm::StoreInst::getPointerOperandIndex(), ptr);
+        written.insert(access.reg);
+      }
+    }
+
+    // Make sure that anything that can observe `State` sees the current
+    // values of the registers, and that we see anything that it changed.
+    for (auto [inst, may_write] : observers) {
+      ir.SetInsertPoint(inst);
+      Spill(ir);
+      if (may_write) {
+        ir.SetInsertPoint(inst->getNextNode());
+        Reload(ir);
+      }
+    }
+
+    for (auto &block : *func) {
+      if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator())) {
+        ir.SetInsertPoint(ret);
+        Spill(ir);
+      }
+    }
+
+    for (auto &ptr : old_ptrs) {
+      if (ptr) {
+        llvm::RecursivelyDeleteTriviallyDeadInstructions(ptr);
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  // Classify all uses of the `State` pointer. Returns `false` if the pointer
+  // escapes in a way that we can't account for.
+  bool FindAccesses(void) {
+    std::vector<std::pair<llvm::Value *, std::optional<uint64_t>>> work_list;
+    work_list.emplace_back(state_ptr, 0u);
+
+    while (!work_list.empty()) {
+      auto [ptr, offset] = work_list.back();
+      work_list.pop_back();
+
+      for (auto &use : ptr->uses()) {
+        auto user = use.getUser();
+
+        if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+          llvm::APInt delta(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+          if (offset && gep->accumulateConstantOffset(dl, delta) &&
+              !delta.isNegative()) {
+            work_list.emplace_back(gep, *offset + delta.getZExtValue());
+          } else {
+            work_list.emplace_back(gep, std::nullopt);
+          }
+
+        } else if (auto cast = llvm::dyn_cast<llvm::BitCastOperator>(user)) {
+          work_list.emplace_back(cast, offset);
+
+        } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(user)) {
+          if (!AddAccess(load, offset, load->getType())) {
+            observers.emplace(load, false);
+          }
+
+        } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+          if (use.getOperandNo() !=
+              llvm::StoreInst::getPointerOperandIndex()) {
+            return false;
+          }
+          if (!AddAccess(store, offset,
+                         store->getValueOperand()->getType())) {
+            observers[store] = true;
+          }
+
+        } else if (auto call = llvm::dyn_cast<llvm::CallInst>(user)) {
+          observers[call] = true;
+
+        } else {
+          return false;
+        }
+      }
+    }
+
+    // An instruction with more than one use of the `State` pointer might
+    // have been classified as both an access and an observer.
+    std::vector<RegisterAccess> unobserved_accesses;
+    for (const auto &access : accesses) {
+      if (!observers.count(access.inst)) {
+        unobserved_accesses.push_back(access);
+      }
+    }
+    accesses.swap(unobserved_accesses);
+    return true;
+  }
+
+  // Try to map an access of type `type` at `offset` in `State` to the
+  // top-level register that fully contains it.
+  bool AddAccess(llvm::Instruction *inst, std::optional<uint64_t> offset,
+                 llvm::Type *type) {
+    if (!offset || !type->isSized()) {
+      return false;
+    }
+
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(inst);
+        load && !load->isSimple()) {
+      return false;
+    } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(inst);
+               store && !store->isSimple()) {
+      return false;
+    }
+
+    const auto reg = arch->RegisterAtStateOffset(*offset);
+    if (!reg) {
+      return false;
+    }
+
+    const auto top = reg->EnclosingRegister();
+    const auto size = dl.getTypeStoreSize(type);
+    if (*offset < top->offset ||
+        (*offset + size) > (top->offset + top->size) ||
+        dl.getTypeStoreSize(top->type) != top->size) {
+      return false;
+    }
+
+    accesses.push_back({inst, top, *offset - top->offset});
+    return true;
+  }
+
+  // Write back the modified registers into `State`.
+  void Spill(llvm::IRBuilder<> &ir) {
+    for (auto reg : written) {
+      auto val = ir.CreateLoad(reg->type, locals[reg]);
+      ir.CreateStore(val, reg->AddressOf(state_ptr, ir));
+    }
+  }
+
+  // Read all registers used by the function from `State`.
+  void Reload(llvm::IRBuilder<> &ir) {
+    for (auto [reg, local] : locals) {
+      auto val = ir.CreateLoad(reg->type, reg->AddressOf(state_ptr, ir));
+      ir.CreateStore(val, local);
+    }
+  }
+
+  const Arch *const arch;
+  llvm::Function *const func;
+  const llvm::DataLayout &dl;
+  llvm::Value *const state_ptr;
+
+  std::vector<RegisterAccess> accesses;
+
+  // Instructions that can observe `State`, and whether or not they may also
+  // modify it.
+  std::map<llvm::Instruction *, bool> observers;
+
+  std::map<const Register *, llvm::AllocaInst *> locals;
+  std::set<const Register *> written;
+};
+
+}  // namespace
+
+// Keep the registers of `State` in local variables across each lifted trace.
+size_t ScalarizeState(const Arch *arch, llvm::Module *module,
+                      const std::vector<llvm::Function *> &traces) {
+  std::vector<llvm::Function *> changed;
+  for (auto func : traces) {
+    if (!func->isDeclaration() && StateScalarizer(arch, func).Run()) {
+      changed.push_back(func);
+    }
+  }
+
+  if (changed.empty()) {
+    return 0;
+  }
+
+  // Promote the local copies of the registers into SSA values, and clean up
+  // redundant spills and reloads.
+  llvm::ModuleAnalysisManager mam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::LoopAnalysisManager lam;
+  llvm::CGSCCAnalysisManager cam;
+
+  llvm::PassBuilder pb;
+  pb.registerModuleAnalyses(mam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.registerCGSCCAnalyses(cam);
+  pb.crossRegisterProxies(lam, fam, cam, mam);
+
+  llvm::FunctionPassManager fpm;
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(16, 0)
+  fpm.addPass(llvm::SROAPass());
+#else
+  fpm.addPass(llvm::SROAPass(llvm::SROAOptions::ModifyCFG));
+#endif
+  fpm.addPass(llvm::EarlyCSEPass(true /* UseMemorySSA */));
+
+  for (auto func : changed) {
+    fpm.run(*func, fam);
+  }
+
+  fam.clear();
+  mam.clear();
+  lam.clear();
+  cam.clear();
+
+  DLOG(INFO) << "Scalarized State in " << changed.size() << " of "
+             << traces.size() << " traces in " << ModuleName(module);
+  return changed.size();
+}
+
+}  // namespace remill
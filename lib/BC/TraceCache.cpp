@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/TraceCache.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Context.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/TraceLifter.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/OS.h"
+
+namespace remill {
+namespace {
+
+static constexpr llvm::StringLiteral kEntryMagic("remill-trace-cache-v1");
+static constexpr llvm::StringLiteral kEntryExtension(".trace");
+
+// Decoded form of an on-disk cache entry.
+struct TraceCacheEntry {
+  llvm::StringRef func_name;
+  llvm::StringRef bytes_digest;
+  std::vector<std::pair<uint64_t, uint64_t>> byte_ranges;
+  std::vector<uint64_t> called_traces;
+  llvm::StringRef bitcode;
+};
+
+template <typename T>
+static void HashInt(llvm::MD5 &hasher, T val) {
+  hasher.update(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&val),
+                                        sizeof(val)));
+}
+
+static std::string HexDigest(llvm::MD5 &hasher) {
+  llvm::MD5::MD5Result result;
+  hasher.final(result);
+  return result.digest().str().str();
+}
+
+// Hash the bitcode of the semantics module. Any change to the semantics, or
+// to the version of LLVM producing the bitcode, invalidates all entries.
+static std::string HashModule(llvm::Module *module) {
+  llvm::SmallVector<char, 0> buffer;
+  llvm::raw_svector_ostream os(buffer);
+  llvm::WriteBitcodeToFile(*module, os);
+
+  llvm::MD5 hasher;
+  hasher.update(llvm::StringRef(buffer.data(), buffer.size()));
+  return HexDigest(hasher);
+}
+
+// Merge the per-instruction byte windows of a trace into disjoint ranges.
+static std::vector<std::pair<uint64_t, std::string>>
+MergeByteRanges(const std::map<uint64_t, std::string> &trace_bytes) {
+  std::vector<std::pair<uint64_t, std::string>> ranges;
+  for (const auto &[addr, bytes] : trace_bytes) {
+    if (bytes.empty()) {
+      continue;
+    }
+
+    if (!ranges.empty()) {
+      auto &[prev_addr, prev_bytes] = ranges.back();
+      const auto prev_end = prev_addr + prev_bytes.size();
+      if (addr <= prev_end) {
+        const auto overlap = prev_end - addr;
+        if (overlap < bytes.size()) {
+          prev_bytes.append(bytes, overlap, std::string::npos);
+        }
+        continue;
+      }
+    }
+
+    ranges.emplace_back(addr, bytes);
+  }
+  return ranges;
+}
+
+// Re-read the bytes covered by an entry and hash them. Returns an empty
+// string if any of the bytes is no longer readable. These include the entries
+// of any recovered jump tables, which are read as data.
+static std::string
+HashCurrentBytes(TraceManager &manager,
+                 const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+  llvm::MD5 hasher;
+  for (auto [addr, size] : ranges) {
+    HashInt(hasher, addr);
+    HashInt(hasher, size);
+    for (uint64_t i = 0; i < size; ++i) {
+      uint8_t byte = 0;
+      if (!manager.TryReadDataByte(addr + i, &byte)) {
+        return {};
+      }
+      hasher.update(byte);
+    }
+  }
+  return HexDigest(hasher);
+}
+
+static bool ParseEntry(llvm::StringRef data, TraceCacheEntry &entry) {
+  auto next_line = [&data](void) -> llvm::StringRef {
+    auto [line, rest] = data.split('\n');
+    data = rest;
+    return line;
+  };
+
+  auto next_int = [&next_line](unsigned radix, uint64_t &val) -> bool {
+    return !next_line().getAsInteger(radix, val);
+  };
+
+  if (next_line() != kEntryMagic) {
+    return false;
+  }
+
+  entry.func_name = next_line();
+  entry.bytes_digest = next_line();
+
+  uint64_t num_ranges = 0;
+  if (entry.func_name.empty() || entry.bytes_digest.empty() ||
+      !next_int(10, num_ranges)) {
+    return false;
+  }
+
+  for (uint64_t i = 0; i < num_ranges; ++i) {
+    auto [addr_str, size_str] = next_line().split(' ');
+    uint64_t addr = 0;
+    uint64_t size = 0;
+    if (addr_str.getAsInteger(16, addr) || size_str.getAsInteger(10, size)) {
+      return false;
+    }
+    entry.byte_ranges.emplace_back(addr, size);
+  }
+
+  uint64_t num_called = 0;
+  if (!next_int(10, num_called)) {
+    return false;
+  }
+
+  for (uint64_t i = 0; i < num_called; ++i) {
+    uint64_t addr = 0;
+    if (!next_int(16, addr)) {
+      return false;
+    }
+    entry.called_traces.push_back(addr);
+  }
+
+  entry.bitcode = data;
+  return !entry.bitcode.empty();
+}
+
+}  // namespace
+
+class TraceCache::Impl {
+ public:
+  Impl(const Arch *arch_, llvm::Module *semantics,
+       std::filesystem::path cache_dir_, uint64_t max_size_bytes_);
+
+  // Compute the key of the trace starting at `addr`.
+  std::string Key(uint64_t addr, const DecodingContext &context) const;
+
+  std::filesystem::path EntryPath(const std::string &key) const;
+
+  // Return all entries in the cache, sorted from least to most recently used.
+  std::vector<std::pair<std::filesystem::path, uint64_t>>
+  ListEntries(uint64_t &total_size) const;
+
+  // Evict least recently used entries until we're under the size limit.
+  void Evict(void);
+
+  const Arch *const arch;
+  const std::filesystem::path cache_dir;
+  const uint64_t max_size_bytes;
+
+  // Hash of the architecture, OS, and semantics module.
+  std::string key_prefix;
+
+  // Suffix used for temporary files, unique to this cache instance.
+  std::string temp_suffix;
+  std::atomic<uint64_t> num_temp_files{0};
+
+  std::mutex eviction_lock;
+
+  std::atomic<uint64_t> num_lookups{0};
+  std::atomic<uint64_t> num_hits{0};
+  std::atomic<uint64_t> num_misses{0};
+  std::atomic<uint64_t> num_stale{0};
+  std::atomic<uint64_t> num_stores{0};
+  std::atomic<uint64_t> num_failed_stores{0};
+  std::atomic<uint64_t> num_evictions{0};
+  std::atomic<uint64_t> num_bytes_on_disk{0};
+};
+
+TraceCache::Impl::Impl(const Arch *arch_, llvm::Module *semantics,
+                       std::filesystem::path cache_dir_,
+                       uint64_t max_size_bytes_)
+    : arch(arch_),
+      cache_dir(std::move(cache_dir_)),
+      max_size_bytes(max_size_bytes_) {
+
+  std::error_code ec;
+  std::filesystem::create_directories(cache_dir, ec);
+  LOG_IF(ERROR, ec) << "Unable to create trace cache directory " << cache_dir
+                    << ": " << ec.message();
+
+  llvm::MD5 hasher;
+  hasher.update(GetArchName(arch->arch_name));
+  hasher.update(GetOSName(arch->os_name));
+  hasher.update(HashModule(semantics));
+  key_prefix = HexDigest(hasher);
+
+  std::random_device rd;
+  std::stringstream ss;
+  ss << ".tmp." << std::hex << rd() << rd();
+  temp_suffix = ss.str();
+
+  uint64_t total_size = 0;
+  (void) ListEntries(total_size);
+  num_bytes_on_disk = total_size;
+}
+
+std::string TraceCache::Impl::Key(uint64_t addr,
+                                  const DecodingContext &context) const {
+  llvm::MD5 hasher;
+  hasher.update(key_prefix);
+  HashInt(hasher, addr);
+  for (const auto &[reg_name, val] : context.GetContextValues()) {
+    hasher.update(reg_name);
+    HashInt(hasher, val);
+  }
+  return HexDigest(hasher);
+}
+
+// Entries are fanned out into sub-directories using the first two characters
+// of the key, so that no one directory gets too big.
+std::filesystem::path
+TraceCache::Impl::EntryPath(const std::string &key) const {
+  return cache_dir / key.substr(0, 2) / (key + kEntryExtension.str());
+}
+
+std::vector<std::pair<std::filesystem::path, uint64_t>>
+TraceCache::Impl::ListEntries(uint64_t &total_size) const {
+  std::vector<
+      std::tuple<std::filesystem::file_time_type, std::filesystem::path, uint64_t>>
+      entries;
+
+  total_size = 0;
+  std::error_code ec;
+  for (std::filesystem::recursive_directory_iterator it(cache_dir, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    if (it->path().extension() != kEntryExtension.str() ||
+        !it->is_regular_file(ec)) {
+      continue;
+    }
+
+    std::error_code entry_ec;
+    const auto size = it->file_size(entry_ec);
+    const auto time = it->last_write_time(entry_ec);
+    if (!entry_ec) {
+      entries.emplace_back(time, it->path(), size);
+      total_size += size;
+    }
+  }
+
+  std::sort(entries.begin(), entries.end());
+
+  std::vector<std::pair<std::filesystem::path, uint64_t>> ret;
+  ret.reserve(entries.size());
+  for (auto &[time, path, size] : entries) {
+    ret.emplace_back(std::move(path), size);
+  }
+  return ret;
+}
+
+void TraceCache::Impl::Evict(void) {
+  std::lock_guard<std::mutex> locker(eviction_lock);
+
+  // Another thread might have already evicted on our behalf.
+  if (num_bytes_on_disk <= max_size_bytes) {
+    return;
+  }
+
+  // Evict down to a bit less than the limit so that we don't re-scan the
+  // cache directory on every store.
+  const auto goal_size = max_size_bytes - (max_size_bytes / 8u);
+
+  uint64_t total_size = 0;
+  for (const auto &[path, size] : ListEntries(total_size)) {
+    if (total_size <= goal_size) {
+      break;
+    }
+
+    std::error_code ec;
+    if (std::filesystem::remove(path, ec)) {
+      total_size -= size;
+      num_evictions++;
+    }
+  }
+
+  num_bytes_on_disk = total_size;
+}
+
+TraceCache::~TraceCache(void) {}
+
+TraceCache::TraceCache(const Arch *arch, llvm::Module *semantics,
+                       std::filesystem::path cache_dir,
+                       uint64_t max_size_bytes)
+    : impl(new Impl(arch, semantics, std::move(cache_dir), max_size_bytes)) {}
+
+// Try to materialize the trace starting at `addr` into `module`.
+llvm::Function *
+TraceCache::Load(uint64_t addr, const DecodingContext &context,
+                 TraceManager &manager, llvm::Module *module,
+                 const std::string &trace_name,
+                 std::vector<uint64_t> &called_traces,
+                 std::vector<std::pair<uint64_t, uint64_t>> *byte_ranges) {
+  impl->num_lookups++;
+
+  const auto path = impl->EntryPath(impl->Key(addr, context));
+  auto maybe_buff = llvm::MemoryBuffer::getFile(
+      path.string(), false /* IsText */, false /* RequiresNullTerminator */);
+  if (!maybe_buff) {
+    impl->num_misses++;
+    return nullptr;
+  }
+
+  TraceCacheEntry entry;
+  if (!ParseEntry((*maybe_buff)->getBuffer(), entry)) {
+    LOG(WARNING) << "Ignoring malformed trace cache entry " << path;
+    impl->num_misses++;
+    return nullptr;
+  }
+
+  // The code at `addr` has changed since this entry was made.
+  if (HashCurrentBytes(manager, entry.byte_ranges) != entry.bytes_digest) {
+    impl->num_stale++;
+    return nullptr;
+  }
+
+  // NOTE: The copy guarantees the bitcode is suitably aligned.
+  auto bitcode_buff =
+      llvm::MemoryBuffer::getMemBufferCopy(entry.bitcode, path.string());
+  auto maybe_module =
+      llvm::parseBitcodeFile(bitcode_buff->getMemBufferRef(),
+                             module->getContext());
+  if (!maybe_module) {
+    LOG(WARNING) << "Unable to parse bitcode of trace cache entry " << path
+                 << ": " << llvm::toString(maybe_module.takeError());
+    impl->num_misses++;
+    return nullptr;
+  }
+
+  auto entry_module = std::move(*maybe_module);
+  auto func = entry_module->getFunction(entry.func_name);
+  if (func && func->getName() != trace_name) {
+    func->setName(trace_name);
+  }
+
+  if (!func || func->isDeclaration() || func->getName() != trace_name) {
+    LOG(WARNING) << "Trace cache entry " << path
+                 << " does not contain a definition of "
+                 << entry.func_name.str();
+    impl->num_misses++;
+    return nullptr;
+  }
+
+  func = MoveFunctionIntoModule(func, module);
+
+  // Bump the modification time so that eviction is least-recently-used.
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), ec);
+
+  called_traces = std::move(entry.called_traces);
+  if (byte_ranges) {
+    *byte_ranges = std::move(entry.byte_ranges);
+  }
+  impl->num_hits++;
+  return func;
+}
+
+// Store the just-lifted trace `func` starting at `addr`.
+bool TraceCache::Store(uint64_t addr, const DecodingContext &context,
+                       const std::map<uint64_t, std::string> &trace_bytes,
+                       llvm::Function *func,
+                       const std::vector<uint64_t> &called_traces) {
+
+  // Make a self-contained copy of the trace, then clone it into a fresh
+  // module that doesn't contain any of the semantics.
+  llvm::ValueToValueMapTy value_map;
+  auto inlined_func = llvm::CloneFunction(func, value_map);
+  const auto inlined_ok = InlineInternalCalls(inlined_func);
+
+  llvm::Module entry_module(func->getName(), func->getContext());
+  impl->arch->PrepareModuleDataLayout(&entry_module);
+
+  if (inlined_ok) {
+    auto entry_func = llvm::Function::Create(
+        func->getFunctionType(), llvm::GlobalValue::ExternalLinkage,
+        func->getName(), &entry_module);
+    CloneFunctionInto(inlined_func, entry_func);
+  }
+
+  inlined_func->eraseFromParent();
+
+  if (!inlined_ok || !VerifyModule(&entry_module)) {
+    LOG(WARNING) << "Unable to make a self-contained copy of trace "
+                 << func->getName().str() << " for the trace cache";
+    impl->num_failed_stores++;
+    return false;
+  }
+
+  const auto ranges = MergeByteRanges(trace_bytes);
+
+  llvm::MD5 hasher;
+  for (const auto &[range_addr, bytes] : ranges) {
+    HashInt(hasher, range_addr);
+    HashInt(hasher, static_cast<uint64_t>(bytes.size()));
+    hasher.update(bytes);
+  }
+
+  std::string data;
+  llvm::raw_string_ostream os(data);
+  os << kEntryMagic << '\n'
+     << func->getName() << '\n'
+     << HexDigest(hasher) << '\n'
+     << ranges.size() << '\n';
+  for (const auto &[range_addr, bytes] : ranges) {
+    os.write_hex(range_addr);
+    os << ' ' << bytes.size() << '\n';
+  }
+  os << called_traces.size() << '\n';
+  for (auto called_addr : called_traces) {
+    os.write_hex(called_addr);
+    os << '\n';
+  }
+  llvm::WriteBitcodeToFile(entry_module, os);
+  os.flush();
+
+  // Write to a temporary file and then rename it into place, so that
+  // concurrent readers only ever observe complete entries.
+  const auto path = impl->EntryPath(impl->Key(addr, context));
+  std::stringstream ss;
+  ss << path.string() << impl->temp_suffix << "." << impl->num_temp_files++;
+  const auto temp_path = ss.str();
+
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+
+  std::ofstream temp_file(temp_path, std::ios::binary | std::ios::trunc);
+  temp_file.write(data.data(), static_cast<std::streamsize>(data.size()));
+  temp_file.close();
+
+  if (!temp_file) {
+    LOG(ERROR) << "Unable to write trace cache entry " << temp_path;
+    std::filesystem::remove(temp_path, ec);
+    impl->num_failed_stores++;
+    return false;
+  }
+
+  // The rename replaces any existing entry for this key, whose bytes are
+  // already counted.
+  std::error_code size_ec;
+  uint64_t old_size = std::filesystem::file_size(path, size_ec);
+  if (size_ec) {
+    old_size = 0;
+  }
+
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    LOG(ERROR) << "Unable to rename " << temp_path << " to " << path << ": "
+               << ec.message();
+    std::filesystem::remove(temp_path, ec);
+    impl->num_failed_stores++;
+    return false;
+  }
+
+  impl->num_stores++;
+  if (data.size() >= old_size) {
+    impl->num_bytes_on_disk += data.size() - old_size;
+  } else {
+    impl->num_bytes_on_disk -= old_size - data.size();
+  }
+
+  if (impl->max_size_bytes && impl->num_bytes_on_disk > impl->max_size_bytes) {
+    impl->Evict();
+  }
+
+  return true;
+}
+
+// Return a snapshot of the hit/miss counters.
+TraceCacheStatistics TraceCache::Statistics(void) const {
+  TraceCacheStatistics stats;
+  stats.num_lookups = impl->num_lookups;
+  stats.num_hits = impl->num_hits;
+  stats.num_misses = impl->num_misses;
+  stats.num_stale = impl->num_stale;
+  stats.num_stores = impl->num_stores;
+  stats.num_failed_stores = impl->num_failed_stores;
+  stats.num_evictions = impl->num_evictions;
+  stats.num_bytes_on_disk = impl->num_bytes_on_disk;
+  return stats;
+}
+
+}  // namespace remill
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/TraceChunkWriter.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+
+class TraceChunkWriter::Impl {
+ public:
+  Impl(const Arch *arch_, std::filesystem::path out_dir_,
+       size_t traces_per_chunk_, OptimizationGuide guide_);
+
+  const Arch *const arch;
+  const std::filesystem::path out_dir;
+  const size_t traces_per_chunk;
+  const OptimizationGuide guide;
+
+  // The chunk currently being filled, and the traces within it.
+  std::unique_ptr<llvm::Module> chunk;
+  std::vector<std::pair<uint64_t, std::string>> chunk_traces;
+
+  std::vector<std::filesystem::path> chunk_paths;
+  std::ofstream index;
+};
+
+TraceChunkWriter::Impl::Impl(const Arch *arch_, std::filesystem::path out_dir_,
+                             size_t traces_per_chunk_,
+                             OptimizationGuide guide_)
+    : arch(arch_),
+      out_dir(std::move(out_dir_)),
+      traces_per_chunk(std::max<size_t>(1u, traces_per_chunk_)),
+      guide(guide_) {
+
+  std::error_code ec;
+  std::filesystem::create_directories(out_dir, ec);
+  CHECK(!ec) << "Unable to create chunk directory " << out_dir << ": "
+             << ec.message();
+
+  index.open(out_dir / "index.txt", std::ios::trunc);
+  CHECK(index.good()) << "Unable to open chunk index in " << out_dir;
+}
+
+TraceChunkWriter::~TraceChunkWriter(void) {
+  Flush();
+}
+
+TraceChunkWriter::TraceChunkWriter(const Arch *arch,
+                                   std::filesystem::path out_dir,
+                                   size_t traces_per_chunk,
+                                   OptimizationGuide guide)
+    : impl(new Impl(arch, std::move(out_dir), traces_per_chunk, guide)) {}
+
+// Move `func`, the lifted trace for `addr`, into the current chunk.
+bool TraceChunkWriter::AddTrace(uint64_t addr, llvm::Function *func) {
+  if (!InlineInternalCalls(func)) {
+    LOG(ERROR) << "Unable to inline the semantics of trace "
+               << func->getName().str() << "; leaving it in module "
+               << ModuleName(func->getParent());
+    return false;
+  }
+
+  if (impl->chunk_traces.size() >= impl->traces_per_chunk) {
+    Flush();
+  }
+
+  if (!impl->chunk) {
+    std::stringstream ss;
+    ss << "chunk_" << impl->chunk_paths.size();
+    impl->chunk =
+        std::make_unique<llvm::Module>(ss.str(), func->getContext());
+    impl->arch->PrepareModuleDataLayout(impl->chunk.get());
+  }
+
+  impl->chunk_traces.emplace_back(addr, func->getName().str());
+  MoveFunctionIntoModule(func, impl->chunk.get());
+  return true;
+}
+
+// Optimize and write out the current chunk, if it is non-empty.
+bool TraceChunkWriter::Flush(void) {
+  if (!impl->chunk) {
+    return true;
+  }
+
+  auto chunk = std::move(impl->chunk);
+  OptimizeBareModule(chunk.get(), impl->guide);
+
+  const auto path =
+      impl->out_dir / (ModuleName(chunk.get()) + ".bc");
+  const auto ok = StoreModuleToFile(chunk.get(), path.string(), true);
+  if (ok) {
+    for (const auto &[addr, name] : impl->chunk_traces) {
+      impl->index << std::hex << addr << std::dec << ' ' << name << ' '
+                  << path.filename().string() << '\n';
+    }
+    impl->index.flush();
+    impl->chunk_paths.push_back(path);
+  } else {
+    LOG(ERROR) << "Unable to write chunk " << path;
+  }
+
+  impl->chunk_traces.clear();
+  return ok;
+}
+
+// Paths of all chunks written so far.
+const std::vector<std::filesystem::path> &
+TraceChunkWriter::ChunkPaths(void) const {
+  return impl->chunk_paths;
+}
+
+}  // namespace remill
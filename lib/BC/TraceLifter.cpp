@@ -15,15 +15,25 @@
  */
 
 #include <glog/logging.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <remill/Arch/Instruction.h>
 #include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/JumpTable.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/TraceCache.h>
 #include <remill/BC/TraceLifter.h>
 #include <remill/BC/Util.h>
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "InstructionLifter.h"
 
@@ -52,6 +62,12 @@ void TraceManager::ForEachDevirtualizedTarget(
   // Must be extended.
 }
 
+// Try to read a byte of read-only data. By default, only executable bytes
+// are readable as data.
+bool TraceManager::TryReadDataByte(uint64_t addr, uint8_t *byte) {
+  return TryReadExecutableByte(addr, byte);
+}
+
 // Figure out the name for the trace starting at address `addr`.
 std::string TraceManager::TraceName(uint64_t addr) {
   std::stringstream ss;
@@ -63,17 +79,54 @@ namespace {
 
 using DecoderWorkList = std::set<uint64_t>;  // For ordering.
 
+// Maximum number of instructions leading up to an indirect jump that are
+// searched for the loads and comparisons of a jump table.
+static constexpr size_t kMaxJumpTableHistory = 16u;
+
+// Marks an instruction with more than one known predecessor.
+static constexpr uint64_t kManyPredecessors = ~0ull;
+
+// Returns the number of bytes of `bytes` that were decoded into `inst`, or
+// all of them if that isn't known.
+static uint64_t DecodedSize(const Instruction &inst, const std::string &bytes) {
+  if (inst.bytes.empty() || inst.bytes.size() > bytes.size()) {
+    return bytes.size();
+  }
+  return inst.bytes.size();
+}
+
 }  // namespace
 
 class TraceLifter::Impl {
  public:
-  Impl(const Arch *arch_, TraceManager *manager_);
+  Impl(const Arch *arch_, TraceManager *manager_, TraceCache *cache_,
+       TraceInstrumentation instrumentation_);
 
   // Lift one or more traces starting from `addr`. Calls `callback` with each
   // lifted trace.
   bool Lift(uint64_t addr,
             std::function<void(uint64_t, llvm::Function *)> callback);
 
+  // Lift the traces that were lifted from any of the bytes in `[begin, end)`
+  // again. Returns the number of re-lifted traces.
+  size_t Relift(uint64_t begin, uint64_t end,
+                std::function<void(uint64_t, llvm::Function *)> callback);
+
+  // Returns the addresses of the traces lifted from any of the bytes in
+  // `[begin, end)`.
+  std::vector<uint64_t> TracesUsingBytes(uint64_t begin, uint64_t end) const;
+
+  // Remember that the current trace depends on the `size` bytes starting at
+  // `addr`.
+  void AddTraceRange(uint64_t addr, uint64_t size) {
+    auto &range_end = trace_ranges[addr];
+    range_end = std::max(range_end, addr + std::max<uint64_t>(size, 1u));
+  }
+
+  // Replace the byte ranges that the trace at `trace_addr` depends on with
+  // `trace_ranges`.
+  void SetTraceRanges(uint64_t trace_addr);
+
   // Reads the bytes of an instruction at `addr` into `state.inst_bytes`.
   bool ReadInstructionBytes(uint64_t addr);
 
@@ -115,6 +168,39 @@ class TraceLifter::Impl {
     return GetOrCreateBlock(inst.next_pc);
   }
 
+  // Add the target of a direct function call to the trace work list, and
+  // remember that the current trace calls it.
+  void AddCalledTrace(uint64_t target_pc) {
+    trace_work_list.insert(target_pc);
+    called_traces.push_back(target_pc);
+  }
+
+  // Atomically increment a new counter, associated with `addr`, at
+  // `insert_pt`.
+  void AddCounter(uint64_t addr, llvm::Instruction *insert_pt);
+
+  // Add counters to the current trace, as requested by `instrumentation`.
+  void InstrumentCounters(uint64_t trace_addr);
+
+  // Call `kTracePCHookName` with the address of `inst` at the end of `block`.
+  void AddTracePCHook(void);
+
+  // Remember `inst`, and the instructions that it falls through or branches
+  // to, for `JumpHistory`.
+  void AddToHistory(void);
+
+  // Returns the instructions on the straight-line path within the current
+  // trace that ends with `inst`.
+  std::vector<const Instruction *> JumpHistory(void) const;
+
+  // End `block` with the indirect jump `inst`. If jump table recovery is
+  // enabled, then the jump is lifted into a `switch` on the targets that the
+  // manager or `RecoverJumpTable` know about, whose default case calls
+  // `intrinsics->jump`. Otherwise, the jump calls `intrinsics->jump`.
+  void AddIndirectJump(
+      llvm::BasicBlock *jump_block,
+      const std::function<llvm::Function *(uint64_t)> &get_trace_decl);
+
   uint64_t PopTraceAddress(void) {
     auto trace_it = trace_work_list.begin();
     const auto trace_addr = *trace_it;
@@ -136,6 +222,8 @@ class TraceLifter::Impl {
   llvm::Module *const module;
   const uint64_t addr_mask;
   TraceManager &manager;
+  TraceCache *const cache;
+  const TraceInstrumentation instrumentation;
 
   llvm::Function *func;
   llvm::BasicBlock *block;
@@ -147,9 +235,41 @@ class TraceLifter::Impl {
   DecoderWorkList trace_work_list;
   DecoderWorkList inst_work_list;
   std::map<uint64_t, llvm::BasicBlock *> blocks;
+
+  // Bytes decoded, and traces called, by the current trace. Used to key
+  // entries in `cache`.
+  std::map<uint64_t, std::string> trace_bytes;
+  std::vector<uint64_t> called_traces;
+
+  // Byte ranges that the current trace depends on, as a map from the start
+  // of each range to its end. Unlike `trace_bytes`, this covers only decoded
+  // bytes, plus the first byte of any instruction that couldn't be read.
+  std::map<uint64_t, uint64_t> trace_ranges;
+
+  // Byte ranges that each lifted trace depends on, and the reverse index from
+  // the start of each range to its end and trace. Used to find the traces to
+  // re-lift when code changes.
+  std::unordered_map<uint64_t, std::map<uint64_t, uint64_t>> ranges_by_trace;
+  std::multimap<uint64_t, std::pair<uint64_t, uint64_t>> traces_by_range;
+  uint64_t max_range_size{0};
+
+  // Traces to lift again, even though they have already been lifted.
+  std::set<uint64_t> stale_traces;
+
+  // Address associated with each counter of `kTraceCountersName`.
+  std::vector<uint64_t> counter_addresses;
+
+  // Instructions decoded in the current trace, and the instruction that falls
+  // through or branches to each of them, or `kManyPredecessors`. Only kept
+  // when recovering jump tables.
+  bool recover_jump_tables{false};
+  std::unordered_map<uint64_t, Instruction> history;
+  std::unordered_map<uint64_t, uint64_t> predecessors;
 };
 
-TraceLifter::Impl::Impl(const Arch *arch_, TraceManager *manager_)
+TraceLifter::Impl::Impl(const Arch *arch_, TraceManager *manager_,
+                        TraceCache *cache_,
+                        TraceInstrumentation instrumentation_)
     : arch(arch_),
       intrinsics(arch->GetInstrinsicTable()),
       word_type(arch->AddressType()),
@@ -158,6 +278,10 @@ TraceLifter::Impl::Impl(const Arch *arch_, TraceManager *manager_)
       addr_mask(arch->address_size >= 64 ? ~0ULL
                                          : (~0ULL >> arch->address_size)),
       manager(*manager_),
+      // Cached traces aren't instrumented, and we don't want to cache
+      // instrumented traces either.
+      cache(instrumentation_.IsEnabled() ? nullptr : cache_),
+      instrumentation(instrumentation_),
       func(nullptr),
       block(nullptr),
       switch_inst(nullptr),
@@ -208,11 +332,282 @@ llvm::Function *TraceLifter::Impl::GetLiftedTraceDefinition(uint64_t addr) {
 
 TraceLifter::~TraceLifter(void) {}
 
-TraceLifter::TraceLifter(const Arch *arch_, TraceManager *manager_)
-    : impl(new Impl(arch_, manager_)) {}
+TraceLifter::TraceLifter(const Arch *arch_, TraceManager *manager_,
+                         TraceCache *cache_,
+                         TraceInstrumentation instrumentation_)
+    : impl(new Impl(arch_, manager_, cache_, instrumentation_)) {}
 
 void TraceLifter::NullCallback(uint64_t, llvm::Function *) {}
 
+const std::vector<uint64_t> &TraceLifter::CounterAddresses(void) const {
+  return impl->counter_addresses;
+}
+
+void TraceLifter::SetRecoverJumpTables(bool enable) {
+  impl->recover_jump_tables = enable;
+}
+
+// Lift the traces that were lifted from any of the bytes in `[begin, end)`
+// again.
+size_t TraceLifter::Relift(
+    uint64_t begin, uint64_t end,
+    std::function<void(uint64_t, llvm::Function *)> callback) {
+  return impl->Relift(begin, end, callback);
+}
+
+// Returns the addresses of the traces lifted from any of the bytes in
+// `[begin, end)`.
+std::vector<uint64_t> TraceLifter::TracesUsingBytes(uint64_t begin,
+                                                    uint64_t end) const {
+  return impl->TracesUsingBytes(begin, end);
+}
+
+// Returns the addresses of the traces lifted from any of the bytes in
+// `[begin, end)`.
+std::vector<uint64_t> TraceLifter::Impl::TracesUsingBytes(uint64_t begin,
+                                                          uint64_t end) const {
+  std::set<uint64_t> traces;
+
+  // No range is longer than `max_range_size`, so only ranges that start
+  // within that many bytes of `begin` can reach it.
+  const auto first = begin > max_range_size ? begin - max_range_size : 0u;
+  for (auto it = traces_by_range.lower_bound(first);
+       it != traces_by_range.end() && it->first < end; ++it) {
+    const auto [range_end, trace_addr] = it->second;
+    if (range_end > begin) {
+      traces.insert(trace_addr);
+    }
+  }
+
+  return {traces.begin(), traces.end()};
+}
+
+// Replace the byte ranges that the trace at `trace_addr` depends on with
+// `trace_ranges`.
+void TraceLifter::Impl::SetTraceRanges(uint64_t trace_addr) {
+  auto &old_ranges = ranges_by_trace[trace_addr];
+  for (auto [range_addr, range_end] : old_ranges) {
+    auto [it, it_end] = traces_by_range.equal_range(range_addr);
+    for (; it != it_end; ++it) {
+      if (it->second == std::make_pair(range_end, trace_addr)) {
+        traces_by_range.erase(it);
+        break;
+      }
+    }
+  }
+
+  for (auto [range_addr, range_end] : trace_ranges) {
+    traces_by_range.emplace(range_addr, std::make_pair(range_end, trace_addr));
+    max_range_size = std::max(max_range_size, range_end - range_addr);
+  }
+  old_ranges = trace_ranges;
+}
+
+// Lift the traces that were lifted from any of the bytes in `[begin, end)`
+// again.
+size_t TraceLifter::Impl::Relift(
+    uint64_t begin, uint64_t end,
+    std::function<void(uint64_t, llvm::Function *)> callback) {
+  const auto traces = TracesUsingBytes(begin, end);
+  if (traces.empty()) {
+    return 0;
+  }
+
+  // Re-lift into the existing functions, so that calls to them from other
+  // traces, which were made through `GetLiftedTraceDeclaration`, stay valid.
+  for (auto trace_addr : traces) {
+    if (auto func = GetLiftedTraceDefinition(trace_addr);
+        func && !func->isDeclaration()) {
+      func->deleteBody();
+    }
+    stale_traces.insert(trace_addr);
+  }
+
+  // `Lift` lifts every stale trace along with the one it is asked to lift.
+  Lift(traces.front(), std::move(callback));
+  return traces.size();
+}
+
+// Atomically increment a new counter, associated with `addr`, at `insert_pt`.
+void TraceLifter::Impl::AddCounter(uint64_t addr,
+                                   llvm::Instruction *insert_pt) {
+  auto i64_type = llvm::Type::getInt64Ty(context);
+  auto counters = module->getOrInsertGlobal(kTraceCountersName, i64_type);
+  const auto index = counter_addresses.size();
+  counter_addresses.push_back(addr);
+
+  llvm::IRBuilder<> ir(insert_pt);
+  auto counter_ptr = ir.CreateConstGEP1_64(i64_type, counters, index);
+  ir.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter_ptr,
+                     llvm::ConstantInt::get(i64_type, 1), llvm::MaybeAlign(8),
+                     llvm::AtomicOrdering::Monotonic);
+}
+
+// Add counters to the current trace. A block counter is added to the start of
+// every lifted block that can be reached other than by falling through from
+// the previous instruction, i.e. to the head of every basic block.
+void TraceLifter::Impl::InstrumentCounters(uint64_t trace_addr) {
+  switch (instrumentation.counters) {
+    case TraceInstrumentation::kNoCounters: break;
+    case TraceInstrumentation::kTraceCounters:
+      AddCounter(trace_addr, func->front().getTerminator());
+      break;
+    case TraceInstrumentation::kBlockCounters:
+      for (auto [block_pc, block] : blocks) {
+
+        // Only count blocks whose instructions were lifted into this trace,
+        // and not tail-calls to other traces.
+        if (!trace_bytes.count(block_pc)) {
+          continue;
+        }
+
+        auto pred = block->getUniquePredecessor();
+        if (block_pc == trace_addr || !pred ||
+            pred->getTerminator()->getNumSuccessors() != 1) {
+          AddCounter(block_pc, &*block->getFirstInsertionPt());
+        }
+      }
+      break;
+  }
+}
+
+// Call `kTracePCHookName` with the address of `inst` at the end of `block`.
+void TraceLifter::Impl::AddTracePCHook(void) {
+  auto hook_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context),
+                                           {word_type}, false);
+  auto hook = module->getOrInsertFunction(kTracePCHookName, hook_type);
+  llvm::IRBuilder<> ir(block);
+  ir.CreateCall(hook, {llvm::ConstantInt::get(word_type, inst.pc)});
+}
+
+// Remember `inst`, and the instructions that it falls through or branches to.
+void TraceLifter::Impl::AddToHistory(void) {
+  history[inst.pc] = inst;
+
+  auto add_successor = [this](uint64_t succ_pc) {
+    auto [pred_it, added] = predecessors.emplace(succ_pc, inst.pc);
+    if (!added && pred_it->second != inst.pc) {
+      pred_it->second = kManyPredecessors;
+    }
+  };
+
+  switch (inst.category) {
+    case Instruction::kCategoryNormal:
+    case Instruction::kCategoryNoOp: add_successor(inst.next_pc); break;
+    case Instruction::kCategoryDirectJump:
+      add_successor(inst.branch_taken_pc);
+      break;
+    case Instruction::kCategoryConditionalBranch:
+      add_successor(inst.branch_taken_pc);
+      add_successor(inst.branch_not_taken_pc);
+      break;
+    default: break;
+  }
+}
+
+// Returns the instructions on the straight-line path within the current trace
+// that ends with `inst`. Predecessors that are only decoded later on aren't
+// known, so this may include instructions that don't dominate `inst`. That is
+// fine, as recovered jump table targets are only used as `switch` cases.
+std::vector<const Instruction *> TraceLifter::Impl::JumpHistory(void) const {
+  std::vector<const Instruction *> insts;
+  insts.push_back(&inst);
+
+  auto pc = inst.pc;
+  while (insts.size() < kMaxJumpTableHistory) {
+    auto pred_it = predecessors.find(pc);
+    if (pred_it == predecessors.end() ||
+        pred_it->second == kManyPredecessors) {
+      break;
+    }
+
+    auto inst_it = history.find(pred_it->second);
+    if (inst_it == history.end()) {
+      break;
+    }
+
+    pc = pred_it->second;
+    insts.push_back(&(inst_it->second));
+  }
+
+  std::reverse(insts.begin(), insts.end());
+  return insts;
+}
+
+// End `jump_block` with the indirect jump `inst`.
+void TraceLifter::Impl::AddIndirectJump(
+    llvm::BasicBlock *jump_block,
+    const std::function<llvm::Function *(uint64_t)> &get_trace_decl) {
+  if (!recover_jump_tables) {
+    AddTerminatingTailCall(jump_block, intrinsics->jump, *intrinsics);
+    return;
+  }
+
+  // Ordered, so that the `switch` cases are deterministic.
+  std::map<uint64_t, DevirtualizedTargetKind> targets;
+  manager.ForEachDevirtualizedTarget(
+      inst, [&targets, this](uint64_t target_pc, DevirtualizedTargetKind kind) {
+        auto [it, added] = targets.emplace(target_pc & addr_mask, kind);
+        if (!added && kind == DevirtualizedTargetKind::kTraceHead) {
+          it->second = kind;
+        }
+      });
+
+  if (targets.empty()) {
+    if (auto table = RecoverJumpTable(arch, manager, JumpHistory())) {
+      DLOG(INFO) << "Recovered jump table at " << std::hex << table->table_addr
+                 << " with " << std::dec << table->targets.size()
+                 << " entries for the jump at " << std::hex << inst.pc
+                 << std::dec;
+
+      for (auto target_pc : table->targets) {
+        targets.emplace(target_pc, DevirtualizedTargetKind::kTraceLocal);
+      }
+
+      // Lift this trace again if the table changes, and only reuse a cached
+      // copy of it if the table is unchanged.
+      const auto table_size = table->entry_size * table->targets.size();
+      AddTraceRange(table->table_addr, table_size);
+      auto &table_bytes = trace_bytes[table->table_addr];
+      table_bytes.clear();
+      for (uint64_t i = 0; i < table_size; ++i) {
+        uint8_t byte = 0;
+        if (!manager.TryReadDataByte(table->table_addr + i, &byte)) {
+          break;
+        }
+        table_bytes.push_back(static_cast<char>(byte));
+      }
+    }
+  }
+
+  if (targets.empty()) {
+    AddTerminatingTailCall(jump_block, intrinsics->jump, *intrinsics);
+    return;
+  }
+
+  auto default_block = llvm::BasicBlock::Create(context, "", func);
+  AddTerminatingTailCall(default_block, intrinsics->jump, *intrinsics);
+
+  switch_inst = llvm::SwitchInst::Create(
+      LoadNextProgramCounter(jump_block, *intrinsics), default_block,
+      static_cast<unsigned>(targets.size()), jump_block);
+
+  for (auto [target_pc, kind] : targets) {
+    llvm::BasicBlock *target_block = nullptr;
+    if (kind == DevirtualizedTargetKind::kTraceLocal) {
+      inst_work_list.insert(target_pc);
+      target_block = GetOrCreateBlock(target_pc);
+    } else {
+      AddCalledTrace(target_pc);
+      target_block = llvm::BasicBlock::Create(context, "", func);
+      AddTerminatingTailCall(target_block, get_trace_decl(target_pc),
+                             *intrinsics);
+    }
+    switch_inst->addCase(llvm::ConstantInt::get(intrinsics->pc_type, target_pc),
+                         target_block);
+  }
+}
+
 // Reads the bytes of an instruction at `addr` into `inst_bytes`.
 bool TraceLifter::Impl::ReadInstructionBytes(uint64_t addr) {
   inst_bytes.clear();
@@ -265,12 +660,14 @@ bool TraceLifter::Impl::Lift(
   };
 
   trace_work_list.insert(addr);
+  trace_work_list.insert(stale_traces.begin(), stale_traces.end());
   while (!trace_work_list.empty()) {
     const auto trace_addr = PopTraceAddress();
 
-    // Already lifted.
+    // Already lifted, and its bytes haven't changed since.
     func = GetLiftedTraceDefinition(trace_addr);
-    if (func) {
+    const auto is_stale = stale_traces.erase(trace_addr) != 0u;
+    if (func && !is_stale) {
       continue;
     }
 
@@ -279,6 +676,11 @@ bool TraceLifter::Impl::Lift(
 
     func = get_trace_decl(trace_addr);
     blocks.clear();
+    trace_bytes.clear();
+    trace_ranges.clear();
+    called_traces.clear();
+    history.clear();
+    predecessors.clear();
 
     if (!func || !func->isDeclaration()) {
       func = arch->DeclareLiftedFunction(manager.TraceName(trace_addr), module);
@@ -286,6 +688,26 @@ bool TraceLifter::Impl::Lift(
 
     CHECK(func->isDeclaration());
 
+    // Try to materialize a previously lifted copy of this trace, in which
+    // case we only need to schedule the traces that it calls.
+    if (cache) {
+      std::vector<std::pair<uint64_t, uint64_t>> cached_ranges;
+      auto cached_func = cache->Load(
+          trace_addr, arch->CreateInitialContext(), manager, module,
+          func->getName().str(), called_traces, &cached_ranges);
+      if (cached_func) {
+        func = cached_func;
+        for (auto [range_addr, range_size] : cached_ranges) {
+          AddTraceRange(range_addr, range_size);
+        }
+        SetTraceRanges(trace_addr);
+        trace_work_list.insert(called_traces.begin(), called_traces.end());
+        callback(trace_addr, func);
+        manager.SetLiftedTraceDefinition(trace_addr, func);
+        continue;
+      }
+    }
+
     // Fill in the function, and make sure the block with all register
     // variables jumps to the block that will contain the first instruction
     // of the trace.
@@ -331,17 +753,25 @@ bool TraceLifter::Impl::Lift(
         }
       }
 
-      // No executable bytes here.
+      // No executable bytes here. If some appear, e.g. because code is
+      // JIT-compiled here, then this trace needs to be lifted again.
       if (!ReadInstructionBytes(inst_addr)) {
+        AddTraceRange(inst_addr, 1u);
         AddTerminatingTailCall(block, intrinsics->missing_block, *intrinsics);
         continue;
       }
 
       inst.Reset();
+      trace_bytes[inst_addr] = inst_bytes;
 
       // TODO(Ian): not passing context around in trace lifter
       std::ignore = arch->DecodeInstruction(inst_addr, inst_bytes, inst,
                                             this->arch->CreateInitialContext());
+      AddTraceRange(inst_addr, DecodedSize(inst, inst_bytes));
+
+      if (instrumentation.trace_pcs) {
+        AddTracePCHook();
+      }
 
       auto lift_status =
           inst.GetLifter()->LiftIntoBlock(inst, block, state_ptr);
@@ -350,6 +780,10 @@ bool TraceLifter::Impl::Lift(
         continue;
       }
 
+      if (recover_jump_tables) {
+        AddToHistory();
+      }
+
       // Handle lifting a delayed instruction.
       auto try_delay = arch->MayHaveDelaySlot(inst);
       if (try_delay) {
@@ -358,11 +792,14 @@ bool TraceLifter::Impl::Lift(
             !arch->DecodeDelayedInstruction(
                 inst.delayed_pc, inst_bytes, delayed_inst,
                 this->arch->CreateInitialContext())) {
+          AddTraceRange(inst.delayed_pc, inst_bytes.size());
           LOG(ERROR) << "Couldn't read delayed inst "
                      << delayed_inst.Serialize();
           AddTerminatingTailCall(block, intrinsics->error, *intrinsics);
           continue;
         }
+        trace_bytes[inst.delayed_pc] = inst_bytes;
+        AddTraceRange(inst.delayed_pc, DecodedSize(delayed_inst, inst_bytes));
       }
 
       // Functor used to add in a delayed instruction.
@@ -407,7 +844,7 @@ bool TraceLifter::Impl::Lift(
 
         case Instruction::kCategoryIndirectJump: {
           try_add_delay_slot(true, block);
-          AddTerminatingTailCall(block, intrinsics->jump, *intrinsics);
+          AddIndirectJump(block, get_trace_decl);
           break;
         }
 
@@ -478,7 +915,7 @@ bool TraceLifter::Impl::Lift(
         direct_func_call:
           try_add_delay_slot(true, block);
           if (inst.branch_not_taken_pc != inst.branch_taken_pc) {
-            trace_work_list.insert(inst.branch_taken_pc);
+            AddCalledTrace(inst.branch_taken_pc);
             auto target_trace = get_trace_decl(inst.branch_taken_pc);
             AddCall(block, target_trace, *intrinsics);
           }
@@ -517,7 +954,7 @@ bool TraceLifter::Impl::Lift(
           llvm::BranchInst::Create(taken_block, not_taken_block,
                                    LoadBranchTaken(block), block);
 
-          trace_work_list.insert(inst.branch_taken_pc);
+          AddCalledTrace(inst.branch_taken_pc);
           auto target_trace = get_trace_decl(inst.branch_taken_pc);
 
           AddCall(taken_block, intrinsics->function_call, *intrinsics);
@@ -646,7 +1083,7 @@ bool TraceLifter::Impl::Lift(
           llvm::BranchInst::Create(taken_block, not_taken_block,
                                    LoadBranchTaken(block), block);
 
-          AddTerminatingTailCall(taken_block, intrinsics->jump, *intrinsics);
+          AddIndirectJump(taken_block, get_trace_decl);
           block = orig_not_taken_block;
           continue;
         }
@@ -659,6 +1096,16 @@ bool TraceLifter::Impl::Lift(
       }
     }
 
+    ResolveX87StackOperands(arch, func);
+    ResolveSPARCWindowOperands(arch, func);
+    InstrumentCounters(trace_addr);
+    SetTraceRanges(trace_addr);
+
+    if (cache) {
+      cache->Store(trace_addr, arch->CreateInitialContext(), trace_bytes, func,
+                   called_traces);
+    }
+
     callback(trace_addr, func);
     manager.SetLiftedTraceDefinition(trace_addr, func);
   }
@@ -36,6 +36,8 @@
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LLVMContext.h>
@@ -47,6 +49,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 #include "remill/Arch/Arch.h"
 #include "remill/Arch/Name.h"
@@ -422,6 +425,29 @@ LoadArchSemantics(const Arch *arch,
   return module;
 }
 
+namespace {
+
+// Returns the value of a `bool` variable that the semantics define to tell the
+// lifter how they were built, or `false` if it isn't defined.
+static bool SemanticsFlag(const llvm::Module *module, std::string_view name) {
+  const auto var = module->getGlobalVariable(name);
+  if (!var || !var->hasInitializer()) {
+    return false;
+  }
+  const auto val = llvm::dyn_cast<llvm::ConstantInt>(var->getInitializer());
+  return val && !val->isZero();
+}
+
+}  // namespace
+
+bool HasRotatingX87Stack(const llvm::Module *module) {
+  return SemanticsFlag(module, kX87RotatingStackVariableName);
+}
+
+bool HasSPARCWindowBank(const llvm::Module *module) {
+  return SemanticsFlag(module, kSPARCWindowBankVariableName);
+}
+
 std::optional<std::string> VerifyModuleMsg(llvm::Module *module) {
   std::string error;
   llvm::raw_string_ostream error_stream(error);
@@ -881,6 +907,7 @@ static llvm::Type *RecontextualizeType(llvm::Type *type,
   switch (type->getTypeID()) {
     case llvm::Type::VoidTyID: return llvm::Type::getVoidTy(context);
     case llvm::Type::HalfTyID: return llvm::Type::getHalfTy(context);
+    case llvm::Type::BFloatTyID: return llvm::Type::getBFloatTy(context);
     case llvm::Type::FloatTyID: return llvm::Type::getFloatTy(context);
     case llvm::Type::DoubleTyID: return llvm::Type::getDoubleTy(context);
     case llvm::Type::X86_FP80TyID: return llvm::Type::getX86_FP80Ty(context);
@@ -911,12 +938,49 @@ static llvm::Type *RecontextualizeType(llvm::Type *type,
 
     case llvm::Type::StructTyID: {
       auto struct_type = llvm::dyn_cast<llvm::StructType>(type);
-      llvm::StructType *new_struct_type = nullptr;
+
+      // Literal structures are uniqued by their elements, and can't be
+      // recursive.
       if (struct_type->isLiteral()) {
-        new_struct_type = llvm::StructType::create(context);
-      } else {
+        llvm::SmallVector<llvm::Type *, 4> elem_types;
+        for (auto elem_type : struct_type->elements()) {
+          elem_types.push_back(RecontextualizeType(elem_type, context, cache));
+        }
+        cached = llvm::StructType::get(context, elem_types,
+                                       struct_type->isPacked());
+        break;
+      }
+
+      // Reuse an identically named and laid out structure if `context` has
+      // one, so that moving many functions into the same module doesn't
+      // produce a `%struct.State.N` for each of them.
+      if (struct_type->hasName()) {
+        if (auto existing_type = llvm::StructType::getTypeByName(
+                context, struct_type->getName())) {
+          cached = existing_type;
+          auto same_layout =
+              existing_type->isOpaque() == struct_type->isOpaque() &&
+              existing_type->isPacked() == struct_type->isPacked() &&
+              existing_type->getNumElements() ==
+                  struct_type->getNumElements();
+          for (auto i = 0u; same_layout && i < struct_type->getNumElements();
+               ++i) {
+            same_layout = existing_type->getElementType(i) ==
+                          RecontextualizeType(struct_type->getElementType(i),
+                                              context, cache);
+          }
+          if (same_layout) {
+            return existing_type;
+          }
+        }
+      }
+
+      llvm::StructType *new_struct_type = nullptr;
+      if (struct_type->hasName()) {
         new_struct_type =
             llvm::StructType::create(context, struct_type->getName());
+      } else {
+        new_struct_type = llvm::StructType::create(context);
       }
       cached = new_struct_type;
 
@@ -925,7 +989,7 @@ static llvm::Type *RecontextualizeType(llvm::Type *type,
         elem_types.push_back(RecontextualizeType(elem_type, context, cache));
       }
 
-      if (elem_types.size()) {
+      if (!struct_type->isOpaque()) {
         new_struct_type->setBody(elem_types, struct_type->isPacked());
       }
 
@@ -1009,6 +1073,15 @@ MoveConstantIntoModule(llvm::Constant *c, llvm::Module *dest_module,
         moved_c = ret;
         return ret;
       }
+    } else if (auto p = llvm::dyn_cast<llvm::PoisonValue>(d); p) {
+      if (in_same_context) {
+        moved_c = p;
+        return p;
+      } else {
+        auto ret = llvm::PoisonValue::get(type);
+        moved_c = ret;
+        return ret;
+      }
     } else if (auto u = llvm::dyn_cast<llvm::UndefValue>(d); u) {
       if (in_same_context) {
         moved_c = u;
@@ -1095,18 +1168,22 @@ MoveConstantIntoModule(llvm::Constant *c, llvm::Module *dest_module,
           return ret;
         }
 
-        LOG(FATAL) << "Unsupported element type in constant data array: "
-                   << remill::LLVMThingToString(el_type);
-        return nullptr;
+        auto ret = llvm::ConstantDataArray::getRaw(
+            raw_data, a->getNumElements(),
+            RecontextualizeType(el_type, dest_context, type_map));
+        moved_c = ret;
+        return ret;
       }
     } else if (auto v = llvm::dyn_cast<llvm::ConstantDataVector>(d); v) {
       if (in_same_context) {
         moved_c = v;
         return v;
       } else {
-        LOG(FATAL)
-            << "Moving constant data vectors across contexts is not yet supported";
-        return nullptr;
+        auto ret = llvm::ConstantDataVector::getRaw(
+            v->getRawDataValues(), v->getNumElements(),
+            RecontextualizeType(v->getElementType(), dest_context, type_map));
+        moved_c = ret;
+        return ret;
       }
 
     } else if (in_same_context) {
@@ -1515,13 +1592,29 @@ static void MoveInstructionIntoModule(llvm::Instruction *inst,
     }
 
     // Substitute the called function.
-  } else if (auto call = llvm::dyn_cast<llvm::CallInst>(inst)) {
+  } else if (auto call = llvm::dyn_cast<llvm::CallBase>(inst)) {
+    auto &dest_context = dest_module->getContext();
+    auto dest_func_type = llvm::dyn_cast<llvm::FunctionType>(
+        RecontextualizeType(call->getFunctionType(), dest_context, type_map));
+
     if (auto callee_func = call->getCalledFunction()) {
       if (callee_func->getParent() != dest_module) {
         call->setCalledFunction(
             DeclareFunctionInModule(callee_func, dest_module, value_map));
       }
 
+    } else if (auto callee_asm =
+                   llvm::dyn_cast<llvm::InlineAsm>(call->getCalledOperand())) {
+      if (&(callee_asm->getContext()) != &dest_context) {
+        call->setCalledFunction(
+            dest_func_type,
+            llvm::InlineAsm::get(
+                dest_func_type, callee_asm->getAsmString(),
+                callee_asm->getConstraintString(),
+                callee_asm->hasSideEffects(), callee_asm->isAlignStack(),
+                callee_asm->getDialect(), callee_asm->canThrow()));
+      }
+
     } else if (auto callee_val = call->getCalledOperand()) {
       auto &new_callee_val = value_map[callee_val];
       if (!new_callee_val) {
@@ -1534,15 +1627,56 @@ static void MoveInstructionIntoModule(llvm::Instruction *inst,
         }
       }
 
-      auto dest_func_type =
-          llvm::dyn_cast<llvm::FunctionType>(RecontextualizeType(
-              call->getFunctionType(), dest_module->getContext(), type_map));
       llvm::FunctionCallee callee(dest_func_type, new_callee_val);
       call->setCalledFunction(callee);
     }
   }
 }
 
+// Get an instance of `attrs` that belongs to `context`.
+static llvm::AttributeSet RecontextualizeAttributes(llvm::AttributeSet attrs,
+                                                    llvm::LLVMContext &context,
+                                                    TypeMap &type_map) {
+  llvm::SmallVector<llvm::Attribute, 8> new_attrs;
+  for (auto attr : attrs) {
+    if (attr.isStringAttribute()) {
+      new_attrs.push_back(llvm::Attribute::get(
+          context, attr.getKindAsString(), attr.getValueAsString()));
+    } else if (attr.isTypeAttribute()) {
+      new_attrs.push_back(llvm::Attribute::get(
+          context, attr.getKindAsEnum(),
+          RecontextualizeType(attr.getValueAsType(), context, type_map)));
+    } else if (attr.isIntAttribute()) {
+      new_attrs.push_back(llvm::Attribute::get(context, attr.getKindAsEnum(),
+                                               attr.getValueAsInt()));
+    } else {
+      new_attrs.push_back(llvm::Attribute::get(context, attr.getKindAsEnum()));
+    }
+  }
+  return llvm::AttributeSet::get(context, new_attrs);
+}
+
+// Get an instance of `attrs`, describing a function or call with `num_params`
+// parameters, that belongs to `context`.
+static llvm::AttributeList
+RecontextualizeAttributes(llvm::AttributeList attrs, unsigned num_params,
+                          llvm::LLVMContext &context, TypeMap &type_map) {
+  if (attrs.isEmpty()) {
+    return {};
+  }
+
+  llvm::SmallVector<llvm::AttributeSet, 8> param_attrs;
+  for (auto i = 0u; i < num_params; ++i) {
+    param_attrs.push_back(
+        RecontextualizeAttributes(attrs.getParamAttrs(i), context, type_map));
+  }
+
+  return llvm::AttributeList::get(
+      context, RecontextualizeAttributes(attrs.getFnAttrs(), context, type_map),
+      RecontextualizeAttributes(attrs.getRetAttrs(), context, type_map),
+      param_attrs);
+}
+
 llvm::Metadata *CloneMetadataInto(llvm::Module *source_mod,
                                   llvm::Module *dest_mod, llvm::Metadata *md,
                                   ValueMap &value_map, TypeMap &type_map,
@@ -1605,6 +1739,57 @@ llvm::Metadata *CloneMetadataInto(llvm::Module *source_mod,
   return mapped_md;
 }
 
+// Finish moving `inst`, whose operands have already been moved by
+// `MoveInstructionIntoModule`, into the context of `dest_mod`, by replacing
+// the types and metadata operands that it holds onto.
+static void RecontextualizeInstruction(llvm::Instruction *inst,
+                                       llvm::Module *source_mod,
+                                       llvm::Module *dest_mod,
+                                       ValueMap &value_map, TypeMap &type_map,
+                                       MDMap &md_map) {
+  auto &dest_context = dest_mod->getContext();
+
+  for (auto &op : inst->operands()) {
+    if (auto md_val = llvm::dyn_cast<llvm::MetadataAsValue>(op.get());
+        md_val && &(md_val->getContext()) != &dest_context) {
+      auto md = CloneMetadataInto(source_mod, dest_mod, md_val->getMetadata(),
+                                  value_map, type_map, md_map);
+      CHECK(md != nullptr)
+          << "Unable to move metadata operand of " << LLVMThingToString(inst)
+          << " across context boundaries";
+      op.set(llvm::MetadataAsValue::get(dest_context, md));
+    }
+  }
+
+  inst->mutateType(
+      RecontextualizeType(inst->getType(), dest_context, type_map));
+
+  if (auto alloca = llvm::dyn_cast<llvm::AllocaInst>(inst)) {
+    alloca->setAllocatedType(RecontextualizeType(alloca->getAllocatedType(),
+                                                 dest_context, type_map));
+
+  } else if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(inst)) {
+    gep->setSourceElementType(RecontextualizeType(gep->getSourceElementType(),
+                                                  dest_context, type_map));
+    gep->setResultElementType(RecontextualizeType(gep->getResultElementType(),
+                                                  dest_context, type_map));
+
+  } else if (auto shuffle = llvm::dyn_cast<llvm::ShuffleVectorInst>(inst)) {
+
+    // The mask is also held as a constant, for the bitcode writer.
+    llvm::SmallVector<int, 16> mask(shuffle->getShuffleMask().begin(),
+                                    shuffle->getShuffleMask().end());
+    shuffle->setShuffleMask(mask);
+
+  } else if (auto call = llvm::dyn_cast<llvm::CallBase>(inst)) {
+    CHECK(!call->hasOperandBundles())
+        << "Cannot move operand bundles across context boundaries: "
+        << LLVMThingToString(inst);
+    call->setAttributes(RecontextualizeAttributes(
+        call->getAttributes(), call->arg_size(), dest_context, type_map));
+  }
+}
+
 }  // namespace
 
 // Clone function `source_func` into `dest_func`, using `value_map` to map over
@@ -1626,7 +1811,14 @@ void CloneFunctionInto(llvm::Function *source_func, llvm::Function *dest_func,
   // throw away register names and such.
   dest_func->getContext().setDiscardValueNames(false);
 
-  dest_func->setAttributes(source_func->getAttributes());
+  if (&source_context == &dest_context) {
+    dest_func->setAttributes(source_func->getAttributes());
+  } else {
+    dest_func->setAttributes(
+        RecontextualizeAttributes(source_func->getAttributes(),
+                                  source_func->arg_size(), dest_context,
+                                  type_map));
+  }
   dest_func->setLinkage(source_func->getLinkage());
   dest_func->setVisibility(source_func->getVisibility());
   dest_func->setCallingConv(source_func->getCallingConv());
@@ -1687,6 +1879,10 @@ void CloneFunctionInto(llvm::Function *source_func, llvm::Function *dest_func,
       new_inst->setName(old_inst.getName());
 
       MoveInstructionIntoModule(new_inst, dest_mod, value_map, type_map);
+      if (&source_context != &dest_context) {
+        RecontextualizeInstruction(new_inst, source_mod, dest_mod, value_map,
+                                   type_map, md_map);
+      }
     }
   }
 
@@ -1779,25 +1975,29 @@ unsigned ReplaceAllUsesOfConstant(llvm::Constant *old_c, llvm::Constant *new_c,
   return num_const_uses;
 }
 
-// Move a function from one module into another module.
-//
-// TODO(pag): Make this work across distinct `llvm::LLVMContext`s.
-void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
+// Move a function from one module into another module. If the modules belong
+// to different contexts, then `func` is cloned into `dest_module` and deleted,
+// and the returned function is the clone.
+llvm::Function *MoveFunctionIntoModule(llvm::Function *func,
+                                       llvm::Module *dest_module) {
   const auto source_context = &(func->getContext());
   const auto dest_context = &(dest_module->getContext());
-  CHECK_EQ(source_context, dest_context)
-      << "Cannot move function across two independent LLVM contexts.";
 
   auto source_module = func->getParent();
   CHECK_NE(source_module, dest_module)
       << "Cannot move function to the same module.";
 
+  ValueMap value_map;
+  TypeMap type_map;
+
+  const auto dest_func_type = llvm::dyn_cast<llvm::FunctionType>(
+      RecontextualizeType(func->getFunctionType(), *dest_context, type_map));
+
   const auto func_name = func->getName().str();
   auto existing_decl_in_dest_module = dest_module->getFunction(func_name);
   if (existing_decl_in_dest_module) {
     CHECK_NE(existing_decl_in_dest_module, func);
-    CHECK_EQ(existing_decl_in_dest_module->getFunctionType(),
-             func->getFunctionType());
+    CHECK_EQ(existing_decl_in_dest_module->getFunctionType(), dest_func_type);
 
     existing_decl_in_dest_module->setName(llvm::Twine::createNull());
     existing_decl_in_dest_module->setLinkage(llvm::GlobalValue::PrivateLinkage);
@@ -1819,25 +2019,48 @@ void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
     replacement_decl_in_source_module->setSection(func->getSection());
   }
 
-  ValueMap value_map;
-  TypeMap type_map;
-
   // When mapping in the destination module, we'll reference `func` any time
   // we see the `replacement_decl_in_source_module` or `func`.
   (void) ReplaceAllUsesOfConstant(func, replacement_decl_in_source_module,
                                   source_module);
-  value_map.emplace(replacement_decl_in_source_module, func);
-  value_map.emplace(func, func);
 
   // Move `func` into the destination module.
+  llvm::Function *moved_func = func;
   if (in_same_context) {
+    value_map.emplace(replacement_decl_in_source_module, func);
+    value_map.emplace(func, func);
+
     func->removeFromParent();
     func->setName(func_name);
     dest_module->getFunctionList().push_back(func);
 
-    // TODO(pag): Probably clone it into the destination module.
+  // Types, constants, and metadata are all owned by the context, so `func`
+  // must be rebuilt in the destination context. The clone refers to its
+  // globals by name, and the original is left behind as a declaration.
   } else {
-    LOG(FATAL) << "TODO: Not yet supported.";
+    moved_func = llvm::Function::Create(dest_func_type, func->getLinkage(),
+                                        func_name, dest_module);
+    moved_func->setVisibility(func->getVisibility());
+    moved_func->setCallingConv(func->getCallingConv());
+    if (func->hasSection()) {
+      moved_func->setSection(func->getSection());
+    }
+    value_map.emplace(replacement_decl_in_source_module, moved_func);
+    value_map.emplace(func, moved_func);
+
+    auto moved_arg = moved_func->arg_begin();
+    for (auto &arg : func->args()) {
+      moved_arg->setName(arg.getName());
+      value_map.emplace(&arg, &*moved_arg);
+      ++moved_arg;
+    }
+
+    MDMap md_map;
+    CloneFunctionInto(func, moved_func, value_map, type_map, md_map);
+
+    func->replaceAllUsesWith(replacement_decl_in_source_module);
+    func->eraseFromParent();
+    func = nullptr;
   }
 
   // There was a prior existing_decl_in_dest_module declaration in out target
@@ -1845,14 +2068,19 @@ void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
   // to rewrite all constants that might use `existing_decl_in_dest_module` into
   // constants that instead use `func`.
   if (existing_decl_in_dest_module) {
-    value_map.emplace(existing_decl_in_dest_module, func);
-    if (!ReplaceAllUsesOfConstant(existing_decl_in_dest_module, func,
+    value_map.emplace(existing_decl_in_dest_module, moved_func);
+    if (!ReplaceAllUsesOfConstant(existing_decl_in_dest_module, moved_func,
                                   dest_module)) {
       existing_decl_in_dest_module->eraseFromParent();
     }
     existing_decl_in_dest_module = nullptr;
   }
 
+  // The clone's references were already mapped into `dest_module`.
+  if (!in_same_context) {
+    return moved_func;
+  }
+
   ClearMetaData(func);
 
   // Fill up the locals so that they map to themselves.
@@ -1873,6 +2101,35 @@ void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
       MoveInstructionIntoModule(&inst, dest_module, value_map, type_map);
     }
   }
+
+  return func;
+}
+
+// Inline every call from `func` to a function with internal linkage.
+bool InlineInternalCalls(llvm::Function *func) {
+  for (auto changed = true; changed;) {
+    changed = false;
+
+    std::vector<llvm::CallBase *> calls;
+    for (auto &inst : llvm::instructions(func)) {
+      if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+        auto callee = call->getCalledFunction();
+        if (callee && callee != func && !callee->isDeclaration() &&
+            callee->hasLocalLinkage()) {
+          calls.push_back(call);
+        }
+      }
+    }
+
+    for (auto call : calls) {
+      llvm::InlineFunctionInfo info;
+      if (!llvm::InlineFunction(*call, info).isSuccess()) {
+        return false;
+      }
+      changed = true;
+    }
+  }
+  return true;
 }
 
 // Get an instance of `type` that belongs to `context`.
@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Annotate.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+static constexpr unsigned kNumX87Registers = 8;
+
+// Mask of `TOP` within the x87 status word, and its position.
+static constexpr unsigned kTopShift = 11;
+static constexpr uint16_t kTopMask = 7u << kTopShift;
+
+// An argument of a call to a semantics function that points to `ST(i)`.
+struct StackOperand {
+  unsigned arg_num;
+  unsigned index;
+};
+
+// How an instruction of a trace interacts with the x87 register stack.
+enum class StackEffect {
+  kNone,
+
+  // The instruction accesses `ST(i)` registers, or moves `TOP`, by a known
+  // amount.
+  kRelative,
+
+  // The instruction, or whatever runs after it, may observe or change `TOP`
+  // and the registers in ways that we don't track, e.g. `FNSTSW`, `FNINIT`,
+  // calls, and returns.
+  kBarrier
+};
+
+// Within a trace, the register file is rebased: on entry to x87 code, it is
+// rotated so that `ST(i)` is element `i` of `State::st`, and `TOP` is zero.
+// `TOP` then only moves by the known amounts of the instructions that push and
+// pop the stack, so it is a constant, and so every `ST(i)` access is to a
+// fixed element of `State::st`. Before anything that may observe the stack,
+// the rotation is undone, so `State::st` and `TOP` are as the semantics expect
+// at the boundaries of the x87 code.
+//
+// Physical register `p` of the rebased register file is physical register
+// `(p + base) % 8` of the actual one, where `base` is the value of `TOP` when
+// the register file was rebased.
+struct RebasedLayout {
+  bool rebased{false};
+
+  // Value of `TOP`, if the register file is rebased, and `TOP` is known.
+  std::optional<unsigned> top;
+
+  bool operator==(const RebasedLayout &that) const {
+    return rebased == that.rebased && top == that.top;
+  }
+
+  bool operator!=(const RebasedLayout &that) const {
+    return !(*this == that);
+  }
+};
+
+class X87StackResolver {
+ public:
+  X87StackResolver(const Register *st0_, uint64_t st_stride_,
+                   const Register *fsw_, llvm::Function *func_)
+      : st0(st0_),
+        st_stride(st_stride_),
+        fsw(fsw_),
+        func(func_),
+        dl(func->getParent()->getDataLayout()),
+        state_ptr(NthArgument(func, kStatePointerArgNum)),
+        reg_type(llvm::IntegerType::get(
+            func->getContext(),
+            static_cast<unsigned>(dl.getTypeStoreSizeInBits(st0->type)))) {}
+
+  // Returns the number of resolved operands.
+  size_t Run(void) {
+    auto has_x87_code = FindOperands();
+    for (auto &inst : llvm::instructions(func)) {
+      int8_t adjustment = 0;
+      has_x87_code = has_x87_code ||
+                     StackEffect::kRelative == Classify(&inst, adjustment);
+    }
+    if (!has_x87_code) {
+      return 0;
+    }
+
+    llvm::ReversePostOrderTraversal<llvm::Function *> rpot(func);
+    std::vector<llvm::BasicBlock *> blocks(rpot.begin(), rpot.end());
+
+    // Figure out where the register file is rebased, and where `TOP` is
+    // known, before changing anything.
+    for (auto changed = true; changed;) {
+      changed = false;
+      for (auto block : blocks) {
+        auto layout = MergeLayouts(block);
+        for (auto &inst : *block) {
+          int8_t adjustment = 0;
+          switch (Classify(&inst, adjustment)) {
+            case StackEffect::kNone: break;
+            case StackEffect::kBarrier: layout = {}; break;
+            case StackEffect::kRelative:
+              if (!layout.rebased) {
+                layout = {true, 0u};
+              }
+              if (layout.top) {
+                layout.top = (*layout.top + static_cast<unsigned>(adjustment) %
+                                                 kNumX87Registers) %
+                             kNumX87Registers;
+              }
+              break;
+          }
+        }
+        if (auto [it, added] = layout_on_exit.emplace(block, layout);
+            added || it->second != layout) {
+          it->second = layout;
+          changed = true;
+        }
+      }
+    }
+
+    size_t num_resolved = 0;
+    for (auto block : blocks) {
+      num_resolved += RewriteBlock(block);
+    }
+
+    for (auto block : blocks) {
+      ConnectBlock(block);
+    }
+
+    return num_resolved;
+  }
+
+ private:
+  // Values of `TOP` and `base` at some point in a rebased register file.
+  struct RebasedValues {
+    llvm::Value *base{nullptr};
+    llvm::Value *top{nullptr};
+  };
+
+  // Find the arguments of calls to semantics functions that point to the
+  // `ST(i)` registers. Returns `false` if there are none.
+  bool FindOperands(void) {
+    std::vector<std::pair<llvm::Value *, uint64_t>> work_list;
+    work_list.emplace_back(state_ptr, 0u);
+
+    while (!work_list.empty()) {
+      auto [ptr, offset] = work_list.back();
+      work_list.pop_back();
+
+      for (auto &use : ptr->uses()) {
+        auto user = use.getUser();
+        if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+          llvm::APInt delta(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+          if (gep->accumulateConstantOffset(dl, delta) &&
+              !delta.isNegative()) {
+            work_list.emplace_back(gep, offset + delta.getZExtValue());
+          }
+
+        } else if (auto cast = llvm::dyn_cast<llvm::BitCastOperator>(user)) {
+          work_list.emplace_back(cast, offset);
+
+        } else if (auto call = llvm::dyn_cast<llvm::CallInst>(user)) {
+          if (offset < st0->offset || !call->isArgOperand(&use) ||
+              !IsSemanticsCall(call)) {
+            continue;
+          }
+          const auto index = (offset - st0->offset) / st_stride;
+          if (index < kNumX87Registers &&
+              (st0->offset + index * st_stride) == offset) {
+            operands[call].push_back(
+                {call->getArgOperandNo(&use), static_cast<unsigned>(index)});
+          }
+        }
+      }
+    }
+
+    return !operands.empty();
+  }
+
+  // Is `call` a call to the semantics of a lifted instruction?
+  static bool IsSemanticsCall(llvm::CallInst *call) {
+    auto callee = call->getCalledFunction();
+    return callee && !callee->isDeclaration() &&
+           HasOriginType<Semantics>(callee);
+  }
+
+  // Figure out how `inst` interacts with the x87 register stack. If it moves
+  // `TOP`, then `adjustment` is set to how.
+  StackEffect Classify(llvm::Instruction *inst, int8_t &adjustment) const {
+    if (llvm::isa<llvm::ReturnInst>(inst)) {
+      return StackEffect::kBarrier;
+    }
+
+    auto call = llvm::dyn_cast<llvm::CallInst>(inst);
+    if (!call) {
+      return StackEffect::kNone;
+
+    } else if (!IsSemanticsCall(call)) {
+      if (call->onlyReadsMemory() || llvm::isa<llvm::IntrinsicInst>(call)) {
+        return StackEffect::kNone;
+      }
+      return StackEffect::kBarrier;
+    }
+
+    auto md = call->getMetadata(kX87TopAdjustmentMetadataName);
+    if (!md) {
+      return StackEffect::kNone;
+    } else if (!md->getNumOperands()) {
+      return StackEffect::kBarrier;
+    }
+
+    adjustment = static_cast<int8_t>(
+        llvm::mdconst::extract<llvm::ConstantInt>(md->getOperand(0))
+            ->getSExtValue());
+    if (operands.count(call) || (adjustment % kNumX87Registers)) {
+      return StackEffect::kRelative;
+    }
+    return StackEffect::kNone;
+  }
+
+  // Figure out the layout of the register file on entry to `block` from its
+  // layout on exit from the predecessors of `block` that have been visited.
+  // The register file is rebased if it is rebased in any of them, in which
+  // case it is rebased on the edges from the others.
+  RebasedLayout MergeLayouts(llvm::BasicBlock *block) const {
+    RebasedLayout layout;
+    if (block == &(func->getEntryBlock())) {
+      return layout;
+    }
+
+    std::vector<std::optional<unsigned>> incoming_tops;
+    for (auto pred : llvm::predecessors(block)) {
+      if (auto it = layout_on_exit.find(pred); it != layout_on_exit.end()) {
+        const auto &pred_layout = it->second;
+        layout.rebased = layout.rebased || pred_layout.rebased;
+        incoming_tops.push_back(pred_layout.rebased ? pred_layout.top : 0u);
+      }
+    }
+
+    if (layout.rebased) {
+      layout.top = incoming_tops.front();
+      for (auto top : incoming_tops) {
+        if (top != layout.top) {
+          layout.top.reset();
+        }
+      }
+    }
+    return layout;
+  }
+
+  // Rotate the register file before `inst` so that it's rebased. Returns the
+  // value of `base`, i.e. the original value of `TOP`.
+  llvm::Value *Rebase(llvm::Instruction *inst) {
+    llvm::IRBuilder<> ir(inst);
+    const auto fsw_ptr = fsw->AddressOf(state_ptr, ir);
+    const auto fsw_val = ir.CreateLoad(fsw->type, fsw_ptr);
+    const auto base = ir.CreateZExt(
+        ir.CreateAnd(ir.CreateLShr(fsw_val, kTopShift), 7u), ir.getInt32Ty());
+
+    std::vector<llvm::Value *> regs;
+    for (auto i = 0u; i < kNumX87Registers; ++i) {
+      regs.push_back(ir.CreateLoad(reg_type, RegisterPointer(ir, base, i)));
+    }
+    for (auto i = 0u; i < kNumX87Registers; ++i) {
+      ir.CreateStore(regs[i], RegisterPointer(ir, ir.getInt32(0), i));
+    }
+    ir.CreateStore(ir.CreateAnd(fsw_val, static_cast<uint16_t>(~kTopMask)),
+                   fsw_ptr);
+    return base;
+  }
+
+  // Undo the rotation of the register file by `base` before `inst`.
+  void Restore(llvm::Instruction *inst, llvm::Value *base) {
+    llvm::IRBuilder<> ir(inst);
+    const auto fsw_ptr = fsw->AddressOf(state_ptr, ir);
+    const auto fsw_val = ir.CreateLoad(fsw->type, fsw_ptr);
+    const auto top = ir.CreateAnd(
+        ir.CreateAdd(ir.CreateLShr(fsw_val, kTopShift),
+                     ir.CreateTrunc(base, fsw->type)),
+        7u);
+
+    std::vector<llvm::Value *> regs;
+    for (auto i = 0u; i < kNumX87Registers; ++i) {
+      regs.push_back(
+          ir.CreateLoad(reg_type, RegisterPointer(ir, ir.getInt32(0), i)));
+    }
+    for (auto i = 0u; i < kNumX87Registers; ++i) {
+      ir.CreateStore(regs[i], RegisterPointer(ir, base, i));
+    }
+    ir.CreateStore(
+        ir.CreateOr(ir.CreateAnd(fsw_val, static_cast<uint16_t>(~kTopMask)),
+                    ir.CreateShl(top, kTopShift)),
+        fsw_ptr);
+  }
+
+  // Returns a pointer to element `(top + index) % 8` of `State::st`. If `top`
+  // is a constant, then so is the pointer.
+  llvm::Value *RegisterPointer(llvm::IRBuilder<> &ir, llvm::Value *top,
+                               unsigned index) {
+    llvm::Value *reg_num = top;
+    if (index) {
+      reg_num = ir.CreateAnd(ir.CreateAdd(top, ir.getInt32(index)), 7u);
+    }
+    auto offset = ir.CreateMul(ir.CreateZExt(reg_num, ir.getInt64Ty()),
+                               ir.getInt64(st_stride));
+    return ir.CreateInBoundsGEP(ir.getInt8Ty(), st0->AddressOf(state_ptr, ir),
+                                offset);
+  }
+
+  // Rebase the register file in `block` where needed, undo it before barriers,
+  // and point the `ST(i)` operands at the right elements of `State::st`.
+  // Returns the number of resolved operands.
+  size_t RewriteBlock(llvm::BasicBlock *block) {
+    const auto layout = MergeLayouts(block);
+    RebasedValues values;
+    if (layout.rebased) {
+      llvm::IRBuilder<> ir(&(block->front()));
+      const auto i32 = ir.getInt32Ty();
+      const auto num_preds = static_cast<unsigned>(llvm::pred_size(block));
+      auto base = ir.CreatePHI(i32, num_preds);
+      base_on_entry[block] = base;
+      values.base = base;
+      if (layout.top) {
+        values.top = ir.getInt32(*layout.top);
+      } else {
+        auto top = ir.CreatePHI(i32, num_preds);
+        top_on_entry[block] = top;
+        values.top = top;
+      }
+    }
+
+    std::vector<llvm::Instruction *> insts;
+    for (auto &inst : *block) {
+      insts.push_back(&inst);
+    }
+
+    size_t num_resolved = 0;
+    for (auto inst : insts) {
+      int8_t adjustment = 0;
+      switch (Classify(inst, adjustment)) {
+        case StackEffect::kNone: break;
+
+        case StackEffect::kBarrier:
+          if (values.base) {
+            Restore(inst, values.base);
+            values = {};
+          }
+          break;
+
+        case StackEffect::kRelative: {
+          if (!values.base) {
+            values.base = Rebase(inst);
+            values.top = llvm::ConstantInt::get(values.base->getType(), 0);
+          }
+
+          auto call = llvm::cast<llvm::CallInst>(inst);
+          llvm::IRBuilder<> ir(call);
+          if (auto ops_it = operands.find(call); ops_it != operands.end()) {
+            for (auto [arg_num, index] : ops_it->second) {
+              auto arg = call->getArgOperand(arg_num);
+              call->setArgOperand(
+                  arg_num,
+                  ir.CreatePointerCast(RegisterPointer(ir, values.top, index),
+                                       arg->getType()));
+              ++num_resolved;
+            }
+          }
+
+          if (const auto delta =
+                  static_cast<uint32_t>(adjustment) % kNumX87Registers) {
+            ir.SetInsertPoint(call->getNextNode());
+            values.top = ir.CreateAnd(
+                ir.CreateAdd(values.top, ir.getInt32(delta)), 7u);
+          }
+          break;
+        }
+      }
+    }
+
+    values_on_exit[block] = values;
+    return num_resolved;
+  }
+
+  // Returns the block in which to put code that runs on the edge from `pred`
+  // to `block`, splitting the edge if `pred` has other successors.
+  llvm::BasicBlock *EdgeBlock(llvm::BasicBlock *pred,
+                              llvm::BasicBlock *block) {
+    if (pred->getSingleSuccessor() == block) {
+      return pred;
+    }
+    auto edge = llvm::BasicBlock::Create(func->getContext(), "", func, block);
+    llvm::BranchInst::Create(block, edge);
+    pred->getTerminator()->replaceSuccessorWith(block, edge);
+    block->replacePhiUsesWith(pred, edge);
+    return edge;
+  }
+
+  // Make the layout of the register file on exit from each predecessor of
+  // `block` match the one on entry to `block`.
+  void ConnectBlock(llvm::BasicBlock *block) {
+    auto base = base_on_entry[block];
+    auto top = top_on_entry[block];
+
+    std::unordered_map<llvm::BasicBlock *, RebasedValues> incoming;
+    std::unordered_set<llvm::BasicBlock *> seen;
+    std::vector<llvm::BasicBlock *> preds(llvm::pred_begin(block),
+                                          llvm::pred_end(block));
+    for (auto pred : preds) {
+      if (!seen.insert(pred).second) {
+        continue;
+      }
+
+      // Unreachable predecessor.
+      auto values_it = values_on_exit.find(pred);
+      if (values_it == values_on_exit.end()) {
+        incoming[pred] = {};
+        continue;
+      }
+
+      const auto values = values_it->second;
+      if (base && !values.base) {
+        auto edge = EdgeBlock(pred, block);
+        auto edge_base = Rebase(edge->getTerminator());
+        incoming[edge] = {edge_base, llvm::ConstantInt::get(
+                                         edge_base->getType(), 0)};
+
+      } else if (!base && values.base) {
+        Restore(EdgeBlock(pred, block)->getTerminator(), values.base);
+
+      } else {
+        incoming[pred] = values;
+      }
+    }
+
+    if (!base) {
+      return;
+    }
+
+    for (auto pred : llvm::predecessors(block)) {
+      const auto &values = incoming[pred];
+      base->addIncoming(
+          values.base ? values.base : llvm::PoisonValue::get(base->getType()),
+          pred);
+      if (top) {
+        top->addIncoming(
+            values.top ? values.top : llvm::PoisonValue::get(top->getType()),
+            pred);
+      }
+    }
+
+    for (auto phi : {base, top}) {
+      if (phi) {
+        if (auto val = phi->hasConstantValue()) {
+          phi->replaceAllUsesWith(val);
+          phi->eraseFromParent();
+        }
+      }
+    }
+  }
+
+  const Register *const st0;
+  const uint64_t st_stride;
+  const Register *const fsw;
+  llvm::Function *const func;
+  const llvm::DataLayout &dl;
+  llvm::Value *const state_ptr;
+
+  // Type used to move a whole register when rotating the register file.
+  llvm::IntegerType *const reg_type;
+
+  // Arguments to resolve, by call.
+  std::unordered_map<llvm::CallInst *, std::vector<StackOperand>> operands;
+
+  // Layout of the register file on exit from each block.
+  std::unordered_map<llvm::BasicBlock *, RebasedLayout> layout_on_exit;
+
+  // Values of `base` and `TOP` on entry to and exit from each block in which
+  // the register file is rebased.
+  std::unordered_map<llvm::BasicBlock *, llvm::PHINode *> base_on_entry;
+  std::unordered_map<llvm::BasicBlock *, llvm::PHINode *> top_on_entry;
+  std::unordered_map<llvm::BasicBlock *, RebasedValues> values_on_exit;
+};
+
+}  // namespace
+
+// Point the `ST(i)` operands of the x87 instructions in `trace` at fixed
+// registers of a rebased register file.
+size_t ResolveX87StackOperands(const Arch *arch, llvm::Function *trace) {
+  if (trace->isDeclaration() || !HasRotatingX87Stack(trace->getParent())) {
+    return 0;
+  }
+
+  const Register *regs[kNumX87Registers] = {};
+  for (auto i = 0u; i < kNumX87Registers; ++i) {
+    regs[i] = arch->RegisterByName("ST" + std::to_string(i));
+  }
+  const auto fsw = arch->RegisterByName("FSW");
+  CHECK(regs[0] && regs[1] && fsw)
+      << "Semantics with a rotating x87 stack require the ST0-ST7 and FSW "
+      << "registers; was remill built with REMILL_X87_ROTATING_STACK?";
+
+  // The semantics index `State::st` with `TOP`, so the registers have to be
+  // evenly spaced.
+  const auto st_stride = regs[1]->offset - regs[0]->offset;
+  for (auto i = 1u; i < kNumX87Registers; ++i) {
+    CHECK(regs[i] && regs[i]->offset == (regs[0]->offset + i * st_stride))
+        << "Register ST" << i << " isn't where a rotating x87 stack expects";
+  }
+
+  return X87StackResolver(regs[0], st_stride, fsw, trace).Run();
+}
+
+}  // namespace remill
@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Copyright (c) 2022 Trail of Bits, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares code lifted from unoptimized p-code against code lifted from
+# optimized p-code, i.e. with `remill-lift` built with
+# `-DREMILL_OPTIMIZE_PCODE=OFF` and `-DREMILL_OPTIMIZE_PCODE=ON`. Each ELF
+# binary is lifted in full with `remill-lift --binary`, e.g. a Thumb2 or PPC
+# build of a large shared library. For each binary, this reports the number of
+# LLVM IR instructions in the lifted module, and the time spent lifting
+# instructions.
+#
+# Usage: benchmark-pcode-optimizer.sh <unoptimized remill-lift>
+#                                     <optimized remill-lift> <arch> <binary>...
+
+set -euo pipefail
+
+USAGE="Usage: $0 <unoptimized remill-lift> <optimized remill-lift> <arch> <binary>..."
+LIFT=${1:?"${USAGE}"}
+OPT_LIFT=${2:?"${USAGE}"}
+ARCH=${3:?"${USAGE}"}
+shift 3
+OUT_DIR=$(mktemp -d)
+trap 'rm -rf "${OUT_DIR}"' EXIT
+
+function count_insts {
+  grep -cE '^\s+(%[^ ]+ = )?[a-z]' "$1" || true
+}
+
+printf "%-32s %-12s %12s %10s\n" "binary" "pcode" "insts" "lift s"
+for binary in "$@"; do
+  for mode in unoptimized optimized; do
+    lift="${LIFT}"
+    if [[ "${mode}" == "optimized" ]]; then
+      lift="${OPT_LIFT}"
+    fi
+
+    name="$(basename "${binary}")_${mode}"
+    "${lift}" --arch "${ARCH}" --binary "${binary}" \
+      --ir_out "${OUT_DIR}/${name}.ll" --stats_out "${OUT_DIR}/${name}.json" \
+      2>/dev/null
+
+    # E.g. `"lift":{...,"latency":{"count":123,"sum_seconds":0.456,...}}`.
+    lift_s=$(python3 -c \
+      'import json, sys; print(json.load(sys.stdin)["lift"]["latency"]["sum_seconds"])' \
+      < "${OUT_DIR}/${name}.json")
+
+    printf "%-32s %-12s %12s %10.3f\n" "$(basename "${binary}")" "${mode}" \
+      "$(count_insts "${OUT_DIR}/${name}.ll")" "${lift_s}"
+  done
+done
@@ -0,0 +1,68 @@
+#!/usr/bin/env bash
+# Copyright (c) 2022 Trail of Bits, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares the lifted code produced by `remill-lift` with and without
+# `--scalarize_state`. For each input, this reports the number of LLVM IR
+# instructions, the time taken to lift, and the time taken by `llc` to
+# compile the lifted code to native code, which is representative of the
+# cost of JIT compiling it.
+#
+# Usage: benchmark-scalarize-state.sh <remill-lift> [llc]
+
+set -euo pipefail
+
+LIFT=${1:?"Usage: $0 <remill-lift> [llc]"}
+LLC=${2:-$(command -v llc || true)}
+OUT_DIR=$(mktemp -d)
+trap 'rm -rf "${OUT_DIR}"' EXIT
+
+# Architecture, address, and hex-encoded bytes of each input.
+INPUTS=(
+  "amd64 0 c704ba01000000"
+  "amd64 0 554889e54883ec10897dfc8b45fc83c0014883c4105dc3"
+  "aarch64 0x400544 FD7BBFA90000009000601891FD030091B7FFFF97E0031F2AFD7BC1A8C0035FD6"
+  "aarch32 0 0cd04de208008de504108de500208de508309de504009de500109de5903122e0c20fa0e110109fe5001091e5002081e5040081e50cd08de21eff2fe14000000000000000"
+)
+
+function count_insts {
+  grep -cE '^\s+(%[^ ]+ = )?[a-z]' "$1" || true
+}
+
+function now_ms {
+  date +%s%3N
+}
+
+printf "%-8s %-10s %10s %10s %10s\n" "arch" "scalarize" "insts" "lift ms" "llc ms"
+for input in "${INPUTS[@]}"; do
+  read -r arch address bytes <<< "${input}"
+  for scalarize in false true; do
+    ll="${OUT_DIR}/${arch}_${scalarize}.ll"
+
+    start=$(now_ms)
+    "${LIFT}" --arch "${arch}" --address "${address}" --bytes "${bytes}" \
+      --scalarize_state="${scalarize}" --ir_out "${ll}" 2>/dev/null
+    lift_ms=$(( $(now_ms) - start ))
+
+    llc_ms="n/a"
+    if [[ -n "${LLC}" ]]; then
+      start=$(now_ms)
+      "${LLC}" -O2 -filetype=obj -o /dev/null "${ll}"
+      llc_ms=$(( $(now_ms) - start ))
+    fi
+
+    printf "%-8s %-10s %10s %10s %10s\n" "${arch}" "${scalarize}" \
+      "$(count_insts "${ll}")" "${lift_ms}" "${llc_ms}"
+  done
+done
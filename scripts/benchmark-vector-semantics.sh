@@ -0,0 +1,145 @@
+#!/usr/bin/env bash
+# Copyright (c) 2022 Trail of Bits, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares SIMD kernels lifted with element-wise semantics against the same
+# kernels lifted with vector semantics, i.e. semantics built with
+# `-DREMILL_VECTOR_SEMANTICS=ON`. Two builds of `remill-lift` are needed, one
+# of each. For each kernel, this reports the number of LLVM IR instructions,
+# how many of those operate on LLVM vectors, and the time per run of the
+# kernel when JIT-executed by `lli`.
+#
+# Usage: benchmark-vector-semantics.sh <remill-lift> <vector remill-lift>
+#                                      [lli] [clang] [runs]
+
+set -euo pipefail
+
+LIFT=${1:?"Usage: $0 <remill-lift> <vector remill-lift> [lli] [clang] [runs]"}
+VECTOR_LIFT=${2:?"Usage: $0 <remill-lift> <vector remill-lift> [lli] [clang] [runs]"}
+LLI=${3:-$(command -v lli || true)}
+CLANG=${4:-$(command -v clang || true)}
+RUNS=${5:-1000}
+OUT_DIR=$(mktemp -d)
+trap 'rm -rf "${OUT_DIR}"' EXIT
+
+ADDRESS=0x1000
+
+# Name, architecture, and hex-encoded bytes of each kernel. Each kernel loops
+# 1000 times over its SIMD instructions, then returns.
+KERNELS=(
+  # paddd, psubw, pmullw, pxor, addps, mulpd on XMM registers.
+  "sse amd64 b9e8030000660ffec1660ff9d3660fd5e5660feff7450f58c166450f59d3ffc975e3c3"
+  # vpaddd, vpsubq, vpand, vaddps, vmulpd on YMM registers.
+  "avx amd64_avx b9e8030000c5fdfec1c5edfbd3c5dddbe5c5cc58f7c4413d59c1ffc975e7c3"
+)
+
+# The lifted code only reads the return address from memory, so the memory
+# and other intrinsics are stubbed out.
+cat > "${OUT_DIR}/harness.c" <<EOF
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct Memory Memory;
+
+extern Memory *sub_${ADDRESS#0x}(void *state, uint64_t pc, Memory *memory);
+
+#define READ(n, type) \\
+  type __remill_read_memory_##n(Memory *m, uint64_t a) { return 0; }
+#define WRITE(n, type) \\
+  Memory *__remill_write_memory_##n(Memory *m, uint64_t a, type v) { \\
+    return m; \\
+  }
+#define UNDEF(n, type) \\
+  type __remill_undefined_##n(void) { return 0; }
+
+READ(8, uint8_t) READ(16, uint16_t) READ(32, uint32_t) READ(64, uint64_t)
+READ(f32, float) READ(f64, double)
+WRITE(8, uint8_t) WRITE(16, uint16_t) WRITE(32, uint32_t) WRITE(64, uint64_t)
+WRITE(f32, float) WRITE(f64, double)
+UNDEF(8, uint8_t) UNDEF(16, uint16_t) UNDEF(32, uint32_t) UNDEF(64, uint64_t)
+UNDEF(f32, float) UNDEF(f64, double)
+
+_Bool __remill_flag_computation_zero(_Bool r, ...) { return r; }
+_Bool __remill_flag_computation_sign(_Bool r, ...) { return r; }
+_Bool __remill_flag_computation_overflow(_Bool r, ...) { return r; }
+_Bool __remill_flag_computation_carry(_Bool r, ...) { return r; }
+_Bool __remill_compare_eq(_Bool r) { return r; }
+_Bool __remill_compare_neq(_Bool r) { return r; }
+int __remill_fpu_exception_test_and_clear(int r, int c) { return 0; }
+
+Memory *__remill_function_return(void *s, uint64_t pc, Memory *m) {
+  return m;
+}
+Memory *__remill_missing_block(void *s, uint64_t pc, Memory *m) {
+  return m;
+}
+Memory *__remill_error(void *s, uint64_t pc, Memory *m) {
+  abort();
+}
+
+int main(int argc, char *argv[]) {
+  static _Alignas(64) uint8_t state[1 << 16];
+  const long runs = atol(argv[1]);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < runs; ++i) {
+    sub_${ADDRESS#0x}(state, ${ADDRESS}, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double ns = (double) (end.tv_sec - start.tv_sec) * 1e9 +
+                    (double) (end.tv_nsec - start.tv_nsec);
+  printf("%.0f\n", ns / (double) runs);
+  return 0;
+}
+EOF
+
+if [[ -n "${CLANG}" ]]; then
+  "${CLANG}" -O2 -c -emit-llvm -o "${OUT_DIR}/harness.bc" "${OUT_DIR}/harness.c"
+fi
+
+function count_insts {
+  grep -cE '^\s+(%[^ ]+ = )?[a-z]' "$1" || true
+}
+
+function count_vector_insts {
+  grep -cE '^\s+%[^ ]+ = [a-z ]+<[0-9]+ x ' "$1" || true
+}
+
+printf "%-6s %-8s %10s %10s %10s\n" "kernel" "vector" "insts" "vec insts" "ns/run"
+for kernel in "${KERNELS[@]}"; do
+  read -r name arch bytes <<< "${kernel}"
+  for vector in false true; do
+    lift="${LIFT}"
+    if [[ "${vector}" == "true" ]]; then
+      lift="${VECTOR_LIFT}"
+    fi
+
+    ll="${OUT_DIR}/${name}_${vector}.ll"
+    "${lift}" --arch "${arch}" --address "${ADDRESS}" --bytes "${bytes}" \
+      --ir_out "${ll}" 2>/dev/null
+
+    run_ns="n/a"
+    if [[ -n "${LLI}" && -f "${OUT_DIR}/harness.bc" ]]; then
+      run_ns=$("${LLI}" -O2 --extra-module "${ll}" "${OUT_DIR}/harness.bc" \
+        "${RUNS}")
+    fi
+
+    printf "%-6s %-8s %10s %10s %10s\n" "${name}" "${vector}" \
+      "$(count_insts "${ll}")" "$(count_vector_insts "${ll}")" "${run_ns}"
+  done
+done
@@ -20,6 +20,7 @@
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/Interpreter.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Passes/PassBuilder.h>
@@ -31,9 +32,11 @@
 #include <llvm/Transforms/Utils/Cloning.h>
 #include <remill/Arch/Arch.h>
 #include <remill/Arch/Runtime/HyperCall.h>
+#include <remill/BC/ABI.h>
 #include <remill/BC/InstructionLifter.h>
 #include <remill/BC/IntrinsicTable.h>
 #include <remill/BC/Lifter.h>
+#include <remill/BC/Optimizer.h>
 #include <remill/BC/SleighLifter.h>
 #include <remill/BC/Util.h>
 #include <test_runner/TestRunner.h>
@@ -268,6 +271,10 @@ LiftingTester::LiftInstructionFunction(std::string_view fname,
 
   bldr.CreateRet(bldr.CreateLoad(this->lifter->GetMemoryType(), mem_ptr_ref));
 
+  // Like the trace lifter, point the `ST(i)` operands of x87 instructions at
+  // the right registers when the semantics have a rotating x87 stack.
+  remill::ResolveX87StackOperands(this->arch.get(), target_func);
+
   return std::make_pair(target_func, insn);
 }
 
@@ -309,6 +316,110 @@ CopyFunctionIntoNewModule(llvm::Module *target, const llvm::Function *old_func,
   return new_f;
 }
 
+std::unique_ptr<llvm::ExecutionEngine>
+CreateExecutionEngine(std::unique_ptr<llvm::Module> module) {
+  std::string load_error = "";
+  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr, &load_error);
+  if (!load_error.empty()) {
+    LOG(FATAL) << "Failed to load: " << load_error;
+  }
+
+  module->setTargetTriple("");
+  module->setDataLayout(llvm::DataLayout(""));
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmParser();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  auto res = remill::VerifyModuleMsg(module.get());
+  if (res.has_value()) {
+    LOG(FATAL) << *res;
+  }
+
+  auto mod = module.get();
+  llvm::EngineBuilder builder(std::move(module));
+
+  std::string estr;
+  auto eptr =
+      builder.setEngineKind(llvm::EngineKind::JIT).setErrorStr(&estr).create();
+
+  if (eptr == nullptr) {
+    LOG(FATAL) << estr;
+  }
+
+  std::unique_ptr<llvm::ExecutionEngine> engine(eptr);
+  StubOutFlagComputationInstrinsics(mod, *engine);
+
+  engine->InstallLazyFunctionCreator(&MissingFunctionStub);
+  engine->DisableSymbolSearching(false);
+  return engine;
+}
+
+llvm::Function *CreateBatchFunction(llvm::Function *func,
+                                    const remill::Register *pc_reg,
+                                    uint64_t state_size) {
+  auto &context = func->getContext();
+  auto module = func->getParent();
+  auto ptr_type = llvm::PointerType::get(context, 0);
+  auto i64_type = llvm::Type::getInt64Ty(context);
+  auto batch_type = llvm::FunctionType::get(
+      llvm::Type::getVoidTy(context), {ptr_type, ptr_type, i64_type}, false);
+  auto batch_func =
+      llvm::Function::Create(batch_type, llvm::GlobalValue::ExternalLinkage,
+                             func->getName() + "_batch", module);
+
+  auto states = batch_func->getArg(0);
+  auto handlers = batch_func->getArg(1);
+  auto num_states = batch_func->getArg(2);
+
+  auto entry = llvm::BasicBlock::Create(context, "", batch_func);
+  auto loop_head = llvm::BasicBlock::Create(context, "", batch_func);
+  auto loop_body = llvm::BasicBlock::Create(context, "", batch_func);
+  auto run = llvm::BasicBlock::Create(context, "", batch_func);
+  auto loop_next = llvm::BasicBlock::Create(context, "", batch_func);
+  auto exit = llvm::BasicBlock::Create(context, "", batch_func);
+
+  llvm::IRBuilder<> ir(entry);
+  ir.CreateBr(loop_head);
+
+  ir.SetInsertPoint(loop_head);
+  auto index = ir.CreatePHI(i64_type, 2);
+  index->addIncoming(llvm::ConstantInt::get(i64_type, 0), entry);
+  ir.CreateCondBr(ir.CreateICmpULT(index, num_states), loop_body, exit);
+
+  // Find this iteration's state and memory, and remember the starting
+  // program counter.
+  ir.SetInsertPoint(loop_body);
+  auto state = ir.CreateGEP(ir.getInt8Ty(), states,
+                            ir.CreateMul(index, ir.getInt64(state_size)));
+  auto memory =
+      ir.CreateLoad(ptr_type, ir.CreateGEP(ptr_type, handlers, index));
+  auto pc_ptr = pc_reg->AddressOf(state, ir);
+  auto orig_pc = ir.CreateLoad(pc_reg->type, pc_ptr);
+  ir.CreateBr(run);
+
+  // Run the instruction until it moves on to the next program counter.
+  ir.SetInsertPoint(run);
+  auto pc_arg_type = func->getArg(remill::kPCArgNum)->getType();
+  llvm::Value *args[remill::kNumBlockArgs] = {};
+  args[remill::kStatePointerArgNum] = state;
+  args[remill::kMemoryPointerArgNum] = memory;
+  args[remill::kPCArgNum] = ir.CreateZExtOrTrunc(
+      ir.CreateLoad(pc_reg->type, pc_ptr), pc_arg_type);
+  ir.CreateCall(func, args);
+  ir.CreateCondBr(
+      ir.CreateICmpEQ(ir.CreateLoad(pc_reg->type, pc_ptr), orig_pc), run,
+      loop_next);
+
+  ir.SetInsertPoint(loop_next);
+  auto next_index = ir.CreateAdd(index, ir.getInt64(1));
+  index->addIncoming(next_index, loop_next);
+  ir.CreateBr(loop_head);
+
+  ir.SetInsertPoint(exit);
+  ir.CreateRetVoid();
+  return batch_func;
+}
+
 void StubOutFlagComputationInstrinsics(llvm::Module *mod,
                                        llvm::ExecutionEngine &exec_engine) {
   for (auto &func : mod->getFunctionList()) {
@@ -100,56 +100,24 @@ CopyFunctionIntoNewModule(llvm::Module *target, const llvm::Function *old_func,
 
 void *MissingFunctionStub(const std::string &name);
 
+// JIT compile `module`, resolving Remill's runtime intrinsics to the stubs
+// and memory handlers of the test runner.
+std::unique_ptr<llvm::ExecutionEngine>
+CreateExecutionEngine(std::unique_ptr<llvm::Module> module);
+
 template <typename T, typename P>
 void ExecuteLiftedFunction(
     llvm::Function *func, size_t insn_length, T *state,
     test_runner::MemoryHandler *handler,
     const std::function<uint64_t(T *)> &program_counter_fetch) {
-  std::string load_error = "";
-  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr, &load_error);
-  if (!load_error.empty()) {
-    LOG(FATAL) << "Failed to load: " << load_error;
-  }
-
-  auto tgt_mod = llvm::CloneModule(*func->getParent());
-  tgt_mod->setTargetTriple("");
-  tgt_mod->setDataLayout(llvm::DataLayout(""));
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmParser();
-  llvm::InitializeNativeTargetAsmPrinter();
-
-
-  auto res = remill::VerifyModuleMsg(tgt_mod.get());
-  if (res.has_value()) {
-
-    LOG(FATAL) << *res;
-  }
-
-  llvm::EngineBuilder builder(std::move(tgt_mod));
-
+  auto engine = CreateExecutionEngine(llvm::CloneModule(*func->getParent()));
 
-  std::string estr;
-  auto eptr =
-      builder.setEngineKind(llvm::EngineKind::JIT).setErrorStr(&estr).create();
-
-  if (eptr == nullptr) {
-    LOG(FATAL) << estr;
-  }
-
-  std::unique_ptr<llvm::ExecutionEngine> engine(eptr);
-
-
-  auto target = engine->FindFunctionNamed(func->getName());
-  StubOutFlagComputationInstrinsics(target->getParent(), *engine);
-
-  engine->InstallLazyFunctionCreator(&MissingFunctionStub);
-  engine->DisableSymbolSearching(false);
   // expect traditional remill lifted insn
   assert(func->arg_size() == 3);
 
   auto returned =
       (void *(*) (T *, uint32_t, void *) ) engine->getFunctionAddress(
-          target->getName().str());
+          func->getName().str());
 
   assert(returned != nullptr);
   auto orig_pc = program_counter_fetch(state);
@@ -159,6 +127,34 @@ void ExecuteLiftedFunction(
   }
 }
 
+// Define a function in the module of `func` that takes an array of states,
+// each `state_size` bytes, an array of memory handlers, and a count, and runs
+// `func` on each state with its memory handler until the program counter
+// `pc_reg` changes. Returns the new function.
+llvm::Function *CreateBatchFunction(llvm::Function *func,
+                                    const remill::Register *pc_reg,
+                                    uint64_t state_size);
+
+// Like `ExecuteLiftedFunction`, but runs `func` over all of `states`, each
+// with the corresponding one of `handlers`, within a single JIT compiled
+// call.
+template <typename T>
+void ExecuteLiftedFunctionBatch(llvm::Function *func,
+                                const remill::Register *pc_reg, T *states,
+                                test_runner::MemoryHandler **handlers,
+                                size_t num_states) {
+  auto module = llvm::CloneModule(*func->getParent());
+  auto batch_func = CreateBatchFunction(module->getFunction(func->getName()),
+                                        pc_reg, sizeof(T));
+  const auto batch_name = batch_func->getName().str();
+  auto engine = CreateExecutionEngine(std::move(module));
+
+  auto batch = (void (*)(T *, test_runner::MemoryHandler **,
+                         uint64_t)) engine->getFunctionAddress(batch_name);
+  CHECK(batch != nullptr);
+  batch(states, handlers, num_states);
+}
+
 template <typename T>
 void RandomizeState(T &state, random_bytes_engine &rbe) {
   std::vector<uint8_t> data(sizeof(T));
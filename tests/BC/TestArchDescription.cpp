@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Type.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/ArchDescription.h>
+#include <remill/Arch/Name.h>
+#include <remill/OS/OS.h>
+
+#include <cstddef>
+
+namespace {
+
+// Check that architectures built in different contexts share one register
+// description, and that they agree on every register.
+static void CheckSharedAcrossContexts(remill::ArchName arch_name) {
+  llvm::LLVMContext context_a;
+  llvm::LLVMContext context_b;
+  auto arch_a =
+      remill::Arch::Build(&context_a, remill::OSName::kOSLinux, arch_name);
+  auto arch_b =
+      remill::Arch::Build(&context_b, remill::OSName::kOSLinux, arch_name);
+  ASSERT_NE(arch_a, nullptr);
+  ASSERT_NE(arch_b, nullptr);
+
+  auto desc = remill::ArchDescription::Get(remill::OSName::kOSLinux, arch_name);
+  ASSERT_NE(desc, nullptr);
+  EXPECT_EQ(arch_a->Description(), desc);
+  EXPECT_EQ(arch_b->Description(), desc);
+
+  size_t num_regs = 0;
+  arch_a->ForEachRegister([&](const remill::Register *reg_a) {
+    ++num_regs;
+    auto reg_b = arch_b->RegisterByName(reg_a->name);
+    ASSERT_NE(reg_b, nullptr) << reg_a->name;
+    EXPECT_EQ(reg_a->offset, reg_b->offset) << reg_a->name;
+    EXPECT_EQ(reg_a->size, reg_b->size) << reg_a->name;
+    EXPECT_EQ(&reg_a->type->getContext(), &context_a);
+    EXPECT_EQ(&reg_b->type->getContext(), &context_b);
+    EXPECT_EQ(reg_a->parent ? reg_a->parent->name : "",
+              reg_b->parent ? reg_b->parent->name : "")
+        << reg_a->name;
+    EXPECT_EQ(arch_b->RegisterAtStateOffset(reg_a->offset)->name,
+              arch_a->RegisterAtStateOffset(reg_a->offset)->name);
+  });
+  EXPECT_EQ(num_regs, desc->registers.size());
+}
+
+TEST(ArchDescriptionTest, AMD64SharedAcrossContexts) {
+  CheckSharedAcrossContexts(remill::kArchAMD64);
+}
+
+TEST(ArchDescriptionTest, AArch64SharedAcrossContexts) {
+  CheckSharedAcrossContexts(remill::kArchAArch64LittleEndian);
+}
+
+TEST(ArchDescriptionTest, PPCSharedAcrossContexts) {
+  CheckSharedAcrossContexts(remill::kArchPPC);
+}
+
+}  // namespace
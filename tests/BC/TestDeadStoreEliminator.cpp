@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+static constexpr auto kDeclarations = R"(
+declare ptr @__remill_function_return(ptr, i64, ptr)
+declare ptr @__remill_jump(ptr, i64, ptr)
+)";
+
+class DeadStoreEliminatorTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+  }
+
+  // Returns the constants stored into the register `name` by `func`, in
+  // program order.
+  std::vector<uint64_t> StoredValues(llvm::Function *func,
+                                     std::string_view name) {
+    std::vector<uint64_t> values;
+    for (auto store :
+         test::StateStores(func, arch->RegisterByName(name)->offset)) {
+      auto val = llvm::dyn_cast<llvm::ConstantInt>(store->getValueOperand());
+      values.push_back(val ? val->getZExtValue() : ~0ull);
+    }
+    return values;
+  }
+};
+
+TEST_F(DeadStoreEliminatorTest, OverwrittenStoreIsRemoved) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  store i64 2, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            1u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({2}));
+  EXPECT_TRUE(remill::VerifyFunction(trace));
+}
+
+TEST_F(DeadStoreEliminatorTest, StoreReadBeforeOverwriteIsKept) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  store i64 1, ptr %rax
+  %val = load i64, ptr %rax
+  store i64 %val, ptr %rbx
+  store i64 2, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({1, 2}));
+}
+
+// Writing `EAX` doesn't overwrite the high half of `RAX`, so the earlier
+// store into `RAX` is still observable.
+TEST_F(DeadStoreEliminatorTest, PartialOverwriteKeepsStore) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  store i32 2, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({1, 2}));
+}
+
+TEST_F(DeadStoreEliminatorTest, StoreBeforeReturnIsKept) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  ret ptr %memory
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({1}));
+}
+
+// `__remill_jump` isn't one of the traces, so it might read anything.
+TEST_F(DeadStoreEliminatorTest, StoreBeforeUnknownCallIsKept) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  %mem = call ptr @__remill_jump(ptr %state, i64 %pc, ptr %memory)
+  store i64 2, ptr %rax
+  ret ptr %mem
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({1, 2}));
+}
+
+TEST_F(DeadStoreEliminatorTest, StoreOverwrittenOnAllPathsIsRemoved) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+entry:
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  %cond = icmp eq i64 %pc, 0
+  br i1 %cond, label %left, label %right
+
+left:
+  store i64 2, ptr %rax
+  br label %exit
+
+right:
+  store i64 3, ptr %rax
+  br label %exit
+
+exit:
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            1u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({2, 3}));
+}
+
+TEST_F(DeadStoreEliminatorTest, StoreOverwrittenOnSomePathsIsKept) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+entry:
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  %cond = icmp eq i64 %pc, 0
+  br i1 %cond, label %left, label %exit
+
+left:
+  store i64 2, ptr %rax
+  br label %exit
+
+exit:
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({1, 2}));
+}
+
+// The store into `RBX` by `@caller` is dead because `@callee` overwrites
+// `RBX` before reading it. The store into `RCX` is live because `@callee`
+// reads `RCX`.
+TEST_F(DeadStoreEliminatorTest, StoresAcrossTracesUseCalleeSummary) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @caller(ptr %state, i64 %pc, ptr %memory) {
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  %rcx = getelementptr inbounds i8, ptr %state, i64 {RCX}
+  store i64 1, ptr %rbx
+  store i64 2, ptr %rcx
+  %ret = tail call ptr @callee(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+
+define ptr @callee(ptr %state, i64 %pc, ptr %memory) {
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  %rcx = getelementptr inbounds i8, ptr %state, i64 {RCX}
+  %rdx = getelementptr inbounds i8, ptr %state, i64 {RDX}
+  store i64 3, ptr %rbx
+  %val = load i64, ptr %rcx
+  store i64 %val, ptr %rdx
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto caller = module->getFunction("caller");
+  auto callee = module->getFunction("callee");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(),
+                                          {caller, callee}),
+            1u);
+  EXPECT_EQ(StoredValues(caller, "RBX"), std::vector<uint64_t>());
+  EXPECT_EQ(StoredValues(caller, "RCX"), std::vector<uint64_t>({2}));
+  EXPECT_EQ(StoredValues(callee, "RBX"), std::vector<uint64_t>({3}));
+}
+
+// Calls to a trace that isn't one of the analyzed traces might read anything.
+TEST_F(DeadStoreEliminatorTest, StoreBeforeCallToOtherTraceIsKept) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+declare ptr @other(ptr, i64, ptr)
+
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  store i64 1, ptr %rbx
+  %ret = tail call ptr @other(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RBX"), std::vector<uint64_t>({1}));
+}
+
+// Once the `State` pointer escapes, nothing can be said about its stores.
+TEST_F(DeadStoreEliminatorTest, EscapingStateKeepsStores) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %slot = alloca ptr
+  store ptr %state, ptr %slot
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  store i64 2, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::RemoveDeadStateStores(arch.get(), module.get(), {trace}),
+            0u);
+  EXPECT_EQ(StoredValues(trace, "RAX"), std::vector<uint64_t>({1, 2}));
+}
+
+}  // namespace
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/Object/ELFTypes.h>
+#include <remill/BC/ElfImage.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A loadable segment of a test ELF file. Bytes past `data` up to `mem_size`
+// are zero-filled.
+struct TestSegment {
+  uint64_t vaddr;
+  uint32_t flags;
+  std::string data;
+  uint64_t mem_size;
+};
+
+// Returns an ELF executable with no sections, made of `segments`.
+template <typename ELFT>
+static std::string MakeElf(uint16_t machine, uint64_t entry,
+                           const std::vector<TestSegment> &segments) {
+  typename ELFT::Ehdr ehdr;
+  std::memset(&ehdr, 0, sizeof(ehdr));
+  ehdr.e_ident[llvm::ELF::EI_MAG0] = llvm::ELF::ElfMagic[0];
+  ehdr.e_ident[llvm::ELF::EI_MAG1] = llvm::ELF::ElfMagic[1];
+  ehdr.e_ident[llvm::ELF::EI_MAG2] = llvm::ELF::ElfMagic[2];
+  ehdr.e_ident[llvm::ELF::EI_MAG3] = llvm::ELF::ElfMagic[3];
+  ehdr.e_ident[llvm::ELF::EI_CLASS] =
+      ELFT::Is64Bits ? llvm::ELF::ELFCLASS64 : llvm::ELF::ELFCLASS32;
+  ehdr.e_ident[llvm::ELF::EI_DATA] =
+      ELFT::TargetEndianness == llvm::support::little
+          ? llvm::ELF::ELFDATA2LSB
+          : llvm::ELF::ELFDATA2MSB;
+  ehdr.e_ident[llvm::ELF::EI_VERSION] = llvm::ELF::EV_CURRENT;
+  ehdr.e_type = llvm::ELF::ET_EXEC;
+  ehdr.e_machine = machine;
+  ehdr.e_version = llvm::ELF::EV_CURRENT;
+  ehdr.e_entry = entry;
+  ehdr.e_phoff = sizeof(ehdr);
+  ehdr.e_ehsize = sizeof(ehdr);
+  ehdr.e_phentsize = sizeof(typename ELFT::Phdr);
+  ehdr.e_phnum = static_cast<uint16_t>(segments.size());
+  ehdr.e_shentsize = sizeof(typename ELFT::Shdr);
+
+  std::string elf(reinterpret_cast<const char *>(&ehdr), sizeof(ehdr));
+  uint64_t offset =
+      sizeof(ehdr) + segments.size() * sizeof(typename ELFT::Phdr);
+  for (const auto &seg : segments) {
+    typename ELFT::Phdr phdr;
+    std::memset(&phdr, 0, sizeof(phdr));
+    phdr.p_type = llvm::ELF::PT_LOAD;
+    phdr.p_flags = seg.flags;
+    phdr.p_offset = offset;
+    phdr.p_vaddr = seg.vaddr;
+    phdr.p_paddr = seg.vaddr;
+    phdr.p_filesz = seg.data.size();
+    phdr.p_memsz = seg.mem_size;
+    phdr.p_align = 1;
+    elf.append(reinterpret_cast<const char *>(&phdr), sizeof(phdr));
+    offset += seg.data.size();
+  }
+
+  for (const auto &seg : segments) {
+    elf += seg.data;
+  }
+  return elf;
+}
+
+class ElfImageTest : public ::testing::Test {
+ protected:
+  void SetUp(void) override {
+    std::random_device rd;
+    std::stringstream ss;
+    ss << "remill-elf-image-test." << std::hex << rd() << rd();
+    path = std::filesystem::temp_directory_path() / ss.str();
+  }
+
+  void TearDown(void) override {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+
+  void Write(const std::string &elf) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << elf;
+  }
+
+  std::filesystem::path path;
+};
+
+// Code is only read out of executable segments, and data out of executable
+// or read-only segments. Bytes past the end of the file-backed part of a
+// segment read as zero.
+TEST_F(ElfImageTest, SegmentReads) {
+  Write(MakeElf<llvm::object::ELF64LE>(
+      llvm::ELF::EM_X86_64, 0x1000,
+      {{0x3000, llvm::ELF::PF_R | llvm::ELF::PF_W, "rw", 2},
+       {0x1000, llvm::ELF::PF_R | llvm::ELF::PF_X, "\x90\xc3", 4},
+       {0x2000, llvm::ELF::PF_R, "ro", 2}}));
+
+  remill::ElfImage elf(path.string());
+  ASSERT_TRUE(elf.IsValid());
+  EXPECT_EQ(elf.Machine(), llvm::ELF::EM_X86_64);
+  EXPECT_TRUE(elf.IsLittleEndian());
+  EXPECT_EQ(elf.EntryPoint(), 0x1000u);
+  EXPECT_EQ(elf.TraceHeads(), std::vector<uint64_t>({0x1000u}));
+  EXPECT_FALSE(elf.IsThumb(0x1000));
+
+  uint8_t byte = 0xffu;
+  EXPECT_TRUE(elf.TryReadExecutableByte(0x1000, &byte));
+  EXPECT_EQ(byte, 0x90u);
+  EXPECT_TRUE(elf.TryReadExecutableByte(0x1001, &byte));
+  EXPECT_EQ(byte, 0xc3u);
+  EXPECT_TRUE(elf.TryReadExecutableByte(0x1003, &byte));
+  EXPECT_EQ(byte, 0u);
+  EXPECT_FALSE(elf.TryReadExecutableByte(0x1004, &byte));
+  EXPECT_FALSE(elf.TryReadExecutableByte(0x0fff, &byte));
+  EXPECT_FALSE(elf.TryReadExecutableByte(0x2000, &byte));
+  EXPECT_FALSE(elf.TryReadExecutableByte(0x3000, &byte));
+
+  EXPECT_TRUE(elf.TryReadDataByte(0x1001, &byte));
+  EXPECT_EQ(byte, 0xc3u);
+  EXPECT_TRUE(elf.TryReadDataByte(0x2001, &byte));
+  EXPECT_EQ(byte, static_cast<uint8_t>('o'));
+  EXPECT_FALSE(elf.TryReadDataByte(0x3000, &byte));
+}
+
+// The machine and byte order come from the ELF header.
+TEST_F(ElfImageTest, BigEndianMachine) {
+  Write(MakeElf<llvm::object::ELF32BE>(
+      llvm::ELF::EM_PPC, 0x10000,
+      {{0x10000, llvm::ELF::PF_R | llvm::ELF::PF_X, "\x4e\x80\x00\x20", 4}}));
+
+  remill::ElfImage elf(path.string());
+  ASSERT_TRUE(elf.IsValid());
+  EXPECT_EQ(elf.Machine(), llvm::ELF::EM_PPC);
+  EXPECT_FALSE(elf.IsLittleEndian());
+  EXPECT_EQ(elf.TraceHeads(), std::vector<uint64_t>({0x10000u}));
+
+  uint8_t byte = 0;
+  EXPECT_TRUE(elf.TryReadExecutableByte(0x10000, &byte));
+  EXPECT_EQ(byte, 0x4eu);
+}
+
+// On 32-bit ARM, the Thumb bit of the entry point is cleared, and reported
+// by `IsThumb` instead.
+TEST_F(ElfImageTest, ThumbEntryPoint) {
+  Write(MakeElf<llvm::object::ELF32LE>(
+      llvm::ELF::EM_ARM, 0x8001,
+      {{0x8000, llvm::ELF::PF_R | llvm::ELF::PF_X, "\x70\x47", 2}}));
+
+  remill::ElfImage elf(path.string());
+  ASSERT_TRUE(elf.IsValid());
+  EXPECT_EQ(elf.Machine(), llvm::ELF::EM_ARM);
+  EXPECT_EQ(elf.EntryPoint(), 0x8000u);
+  EXPECT_EQ(elf.TraceHeads(), std::vector<uint64_t>({0x8000u}));
+  EXPECT_TRUE(elf.IsThumb(0x8000));
+}
+
+// An entry point outside of every executable segment isn't a trace head.
+TEST_F(ElfImageTest, EntryPointOutsideCode) {
+  Write(MakeElf<llvm::object::ELF64LE>(
+      llvm::ELF::EM_X86_64, 0x2000,
+      {{0x1000, llvm::ELF::PF_R | llvm::ELF::PF_X, "\xc3", 1},
+       {0x2000, llvm::ELF::PF_R, "ro", 2}}));
+
+  remill::ElfImage elf(path.string());
+  ASSERT_TRUE(elf.IsValid());
+  EXPECT_TRUE(elf.TraceHeads().empty());
+}
+
+// Segments that extend past the end of the file, and files that aren't ELF
+// files, are rejected.
+TEST_F(ElfImageTest, InvalidFiles) {
+  auto elf = MakeElf<llvm::object::ELF64LE>(
+      llvm::ELF::EM_X86_64, 0x1000,
+      {{0x1000, llvm::ELF::PF_R | llvm::ELF::PF_X, "\x90\x90\x90\xc3", 4}});
+  elf.resize(elf.size() - 2u);
+  Write(elf);
+  EXPECT_FALSE(remill::ElfImage(path.string()).IsValid());
+
+  Write("not an ELF file");
+  EXPECT_FALSE(remill::ElfImage(path.string()).IsValid());
+
+  std::filesystem::remove(path);
+  EXPECT_FALSE(remill::ElfImage(path.string()).IsValid());
+}
+
+}  // namespace
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/JSON.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/InstructionEncoding.h>
+#include <remill/Arch/Name.h>
+#include <remill/Arch/Statistics.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/Util.h>
+#include <remill/OS/OS.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "TestUtil.h"
+
+namespace {
+
+class InstructionEncodingTest : public test::LiftedCodeTest {
+ protected:
+  // Build `arch_name` twice, in different contexts: instructions are decoded
+  // by `arch`, and read back from their encodings by `other_arch`.
+  void BuildArchs(remill::ArchName arch_name) {
+    BuildArch(arch_name);
+    other_arch =
+        remill::Arch::Build(&other_context, remill::kOSLinux, arch_name);
+    ASSERT_TRUE(other_arch != nullptr);
+    other_semantics = remill::LoadArchSemantics(other_arch.get());
+    ASSERT_TRUE(other_semantics != nullptr);
+  }
+
+  // Returns the number of instructions that `other_arch` decoded from their
+  // bytes since the last call.
+  int64_t NumDecoded(void) {
+    auto json = llvm::json::parse(stats->ToJSON());
+    EXPECT_TRUE(!!json) << llvm::toString(json.takeError());
+    if (!json) {
+      return -1;
+    }
+    stats->Reset();
+    const auto num_decoded =
+        json->getAsObject()->getObject("decode")->getInteger("decoded");
+    return num_decoded ? *num_decoded : -1;
+  }
+
+  // Decode the instruction `bytes` at `pc`, and check that it survives a trip
+  // through its binary encoding into another context, and that the result
+  // can be lifted.
+  void CheckRoundTrip(uint64_t pc, std::string_view bytes) {
+    const auto context = arch->CreateInitialContext();
+    remill::Instruction inst;
+    ASSERT_TRUE(arch->DecodeInstruction(pc, bytes, inst, context));
+
+    std::string buff;
+    ASSERT_TRUE(remill::EncodedInstruction::Encode(inst, context, buff));
+    EXPECT_FALSE(remill::EncodedInstruction::Read(buff.substr(0, 16)));
+    EXPECT_FALSE(
+        remill::EncodedInstruction::Read(buff.substr(0, buff.size() - 1)));
+
+    auto encoded = remill::EncodedInstruction::Read(buff);
+    ASSERT_TRUE(encoded.has_value());
+    EXPECT_EQ(encoded->Size(), buff.size());
+    EXPECT_EQ(encoded->GetPC(), pc);
+    EXPECT_EQ(encoded->GetNextPC(), inst.next_pc);
+    EXPECT_EQ(encoded->GetArchName(), arch->arch_name);
+    EXPECT_EQ(encoded->GetCategory(), inst.category);
+    EXPECT_EQ(encoded->GetBytes(), bytes);
+    EXPECT_EQ(encoded->GetFunction(), inst.function);
+    EXPECT_TRUE(encoded->GetContext() == context);
+
+    // Native architectures restore the lifter without decoding the bytes of
+    // the instruction again.
+    remill::Instruction decoded;
+    ASSERT_TRUE(encoded->Decode(other_arch.get(), decoded));
+    EXPECT_EQ(NumDecoded(), 0);
+    EXPECT_EQ(decoded.Serialize(), inst.Serialize());
+    EXPECT_TRUE(decoded.flows == inst.flows);
+    EXPECT_EQ(decoded.arch, other_arch.get());
+    ASSERT_NE(decoded.GetLifter(), nullptr);
+
+    remill::IntrinsicTable intrinsics(other_semantics.get());
+    auto func = other_arch->DefineLiftedFunction(
+        "lifted_" + std::to_string(pc), other_semantics.get());
+    auto block = &(func->getEntryBlock());
+    EXPECT_EQ(decoded.GetLifter()->LiftIntoBlock(decoded, block),
+              remill::kLiftedInstruction);
+    remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                   intrinsics);
+    EXPECT_TRUE(remill::VerifyFunction(func));
+  }
+
+  llvm::LLVMContext other_context;
+  remill::Arch::ArchPtr other_arch;
+  std::unique_ptr<llvm::Module> other_semantics;
+  std::shared_ptr<remill::LiftingStatistics> stats{
+      std::make_shared<remill::LiftingStatistics>()};
+};
+
+TEST_F(InstructionEncodingTest, AMD64RoundTrip) {
+  BuildArchs(remill::kArchAMD64);
+  other_arch->SetStatistics(stats);
+
+  // mov rax, qword ptr [rbx + rcx * 8 + 0x10]
+  CheckRoundTrip(0x1000, std::string_view("\x48\x8b\x44\xcb\x10", 5));
+
+  // jne 0x2012
+  CheckRoundTrip(0x2000, std::string_view("\x75\x10", 2));
+
+  // call qword ptr [rip + 0x100]
+  CheckRoundTrip(0x3000, std::string_view("\xff\x15\x00\x01\x00\x00", 6));
+}
+
+TEST_F(InstructionEncodingTest, AArch64RoundTrip) {
+  BuildArchs(remill::kArchAArch64LittleEndian);
+  other_arch->SetStatistics(stats);
+
+  // ldr x0, [x1, #8]
+  CheckRoundTrip(0x1000, std::string_view("\x20\x04\x40\xf9", 4));
+
+  // b.ne 0x2010
+  CheckRoundTrip(0x2000, std::string_view("\x81\x00\x00\x54", 4));
+
+  // add x0, x1, w2, sxtw #2
+  CheckRoundTrip(0x3000, std::string_view("\x20\xc8\x22\x8b", 4));
+}
+
+}  // namespace
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/TraceLifter.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+// Address at which the code of each test is placed.
+static constexpr uint64_t kCodeAddr = 0x1000;
+
+//      cmp     edi, 3
+//      ja      default
+//      mov     eax, edi
+//      lea     rdx, [rip + table]
+//      movsxd  rax, dword ptr [rdx + rax * 4]
+//      add     rax, rdx
+//      jmp     rax
+//  case0:  mov eax, 10; ret        (0x1017)
+//  case1:  mov eax, 11; ret        (0x101d)
+//  case2:  mov eax, 12; ret        (0x1023)
+//  default: xor eax, eax; ret
+//  table:  .long case0 - table, case1 - table, case2 - table, case1 - table
+static constexpr std::string_view kAMD64Switch(
+    "\x83\xff\x03\x77\x24\x89\xf8\x48\x8d\x15\x1e\x00\x00\x00\x48\x63\x04\x82"
+    "\x48\x01\xd0\xff\xe0\xb8\x0a\x00\x00\x00\xc3\xb8\x0b\x00\x00\x00\xc3\xb8"
+    "\x0c\x00\x00\x00\xc3\x31\xc0\xc3\xeb\xff\xff\xff\xf1\xff\xff\xff\xf7\xff"
+    "\xff\xff\xf1\xff\xff\xff",
+    60);
+
+//      cmp     w0, #3
+//      b.hi    default
+//      adrp    x1, table
+//      add     x1, x1, :lo12:table
+//      ldrb    w2, [x1, w0, uxtw]
+//      adr     x3, case0
+//      add     x2, x3, w2, sxtb #2
+//      br      x2
+//  case0:  mov w0, #10; ret        (0x1020)
+//  case1:  mov w0, #11; ret        (0x1028)
+//  case2:  mov w0, #12; ret        (0x1030)
+//  default: mov w0, #0; ret
+//  table:  .byte 0, 2, 4, 2
+static constexpr std::string_view kAArch64Switch(
+    "\x1f\x0c\x00\x71\xa8\x01\x00\x54\x01\x00\x00\x90\x21\x00\x01\x91\x22\x48"
+    "\x60\x38\x63\x00\x00\x10\x62\x88\x22\x8b\x40\x00\x1f\xd6\x40\x01\x80\x52"
+    "\xc0\x03\x5f\xd6\x60\x01\x80\x52\xc0\x03\x5f\xd6\x80\x01\x80\x52\xc0\x03"
+    "\x5f\xd6\x00\x00\x80\x52\xc0\x03\x5f\xd6\x00\x02\x04\x02",
+    68);
+
+class TestTraceManager : public remill::TraceManager {
+ public:
+  virtual ~TestTraceManager(void) = default;
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    traces[addr] = lifted_func;
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto trace_it = traces.find(addr);
+    if (trace_it != traces.end()) {
+      return trace_it->second;
+    } else {
+      return nullptr;
+    }
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    return GetLiftedTraceDeclaration(addr);
+  }
+
+  void ForEachDevirtualizedTarget(
+      const remill::Instruction &,
+      std::function<void(uint64_t, remill::DevirtualizedTargetKind)>)
+      override {
+    num_devirtualized += 1u;
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto byte_it = memory.find(addr);
+    if (byte_it != memory.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ public:
+  std::unordered_map<uint64_t, uint8_t> memory;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+  unsigned num_devirtualized{0};
+};
+
+class JumpTableTest : public test::LiftedCodeTest {
+ protected:
+  // Lift the trace of `code`, placed at `kCodeAddr`, into fresh semantics.
+  llvm::Function *LiftTrace(remill::ArchName arch_name, std::string_view code,
+                            bool recover_jump_tables) {
+    BuildArch(arch_name);
+    manager.traces.clear();
+    for (uint64_t i = 0; i < code.size(); ++i) {
+      manager.memory[kCodeAddr + i] = static_cast<uint8_t>(code[i]);
+    }
+
+    remill::TraceLifter trace_lifter(arch.get(), manager);
+    trace_lifter.SetRecoverJumpTables(recover_jump_tables);
+    EXPECT_TRUE(trace_lifter.Lift(kCodeAddr));
+
+    auto trace = manager.GetLiftedTraceDefinition(kCodeAddr);
+    EXPECT_NE(trace, nullptr);
+    if (trace) {
+      EXPECT_TRUE(remill::VerifyFunction(trace));
+    }
+    return trace;
+  }
+
+  // Returns the cases of each `switch` in `func`.
+  static std::vector<std::set<uint64_t>> Switches(llvm::Function *func) {
+    std::vector<std::set<uint64_t>> switches;
+    for (auto &inst : llvm::instructions(func)) {
+      if (auto switch_inst = llvm::dyn_cast<llvm::SwitchInst>(&inst)) {
+        auto &cases = switches.emplace_back();
+        for (auto &case_ : switch_inst->cases()) {
+          cases.insert(case_.getCaseValue()->getZExtValue());
+        }
+      }
+    }
+    return switches;
+  }
+
+  // Check that the switch of `code` is lifted into a `switch` over `targets`,
+  // whose default case still jumps to any other target, and that it is a
+  // plain indirect jump without jump table recovery.
+  void CheckSwitch(remill::ArchName arch_name, std::string_view code,
+                   std::set<uint64_t> targets) {
+    auto plain = LiftTrace(arch_name, code, false);
+    ASSERT_NE(plain, nullptr);
+    EXPECT_TRUE(Switches(plain).empty());
+    EXPECT_EQ(test::CallsTo(plain, "__remill_jump").size(), 1u);
+    EXPECT_EQ(manager.num_devirtualized, 0u);
+
+    auto recovered = LiftTrace(arch_name, code, true);
+    ASSERT_NE(recovered, nullptr);
+    EXPECT_EQ(Switches(recovered), std::vector<std::set<uint64_t>>{targets});
+    EXPECT_EQ(test::CallsTo(recovered, "__remill_jump").size(), 1u);
+    EXPECT_EQ(manager.num_devirtualized, 1u);
+  }
+
+  TestTraceManager manager;
+};
+
+TEST_F(JumpTableTest, AMD64RelativeTable) {
+  CheckSwitch(remill::kArchAMD64, kAMD64Switch, {0x1017, 0x101d, 0x1023});
+}
+
+TEST_F(JumpTableTest, AArch64ByteTable) {
+  CheckSwitch(remill::kArchAArch64LittleEndian, kAArch64Switch, {0x1020, 0x1028, 0x1030});
+}
+
+}  // namespace
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Drives `remill-lift --daemon` with newline-delimited JSON requests, and
+// checks its responses.
+
+#include <gtest/gtest.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#ifndef _WIN32
+#  include <poll.h>
+#  include <signal.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class LiftDaemonTest : public ::testing::Test {
+ protected:
+  void SetUp(void) override {
+    std::random_device rd;
+    std::stringstream ss;
+    ss << "remill-lift-daemon-test." << std::hex << rd() << rd();
+    work_dir = std::filesystem::temp_directory_path() / ss.str();
+    std::filesystem::create_directories(work_dir);
+  }
+
+  void TearDown(void) override {
+    std::error_code ec;
+    std::filesystem::remove_all(work_dir, ec);
+  }
+
+  // Parse one response line, split out by its `id`. Responses without an
+  // `id` are collected into `anonymous`.
+  void AddResponse(const std::string &line) {
+    auto parsed = llvm::json::parse(line);
+    if (!parsed) {
+      FAIL() << "Invalid response " << line << ": "
+             << llvm::toString(parsed.takeError());
+    }
+    auto obj = parsed->getAsObject();
+    ASSERT_NE(obj, nullptr) << line;
+
+    std::string id;
+    if (auto str_id = obj->getString("id")) {
+      id = str_id->str();
+    } else if (auto num_id = obj->getInteger("id")) {
+      id = std::to_string(*num_id);
+    } else {
+      anonymous.push_back(std::move(*obj));
+      return;
+    }
+    EXPECT_FALSE(responses.count(id)) << "Duplicate response for " << id;
+    responses.emplace(id, std::move(*obj));
+  }
+
+  // Returns the `error` of the response to `id`, or an empty string.
+  std::string Error(const std::string &id) {
+    auto it = responses.find(id);
+    if (it == responses.end()) {
+      return "";
+    }
+    if (auto err = it->second.getString("error")) {
+      return err->str();
+    }
+    return "";
+  }
+
+  std::filesystem::path work_dir;
+  std::map<std::string, llvm::json::Object> responses;
+  std::vector<llvm::json::Object> anonymous;
+};
+
+// Bad requests get error responses, and don't stop the daemon from serving
+// the requests after them, even as workers start over with fresh contexts.
+TEST_F(LiftDaemonTest, RequestsOverStdin) {
+  const auto in_path = work_dir / "requests.jsonl";
+  const auto out_path = work_dir / "responses.jsonl";
+  {
+    std::ofstream in(in_path, std::ios::trunc);
+    in << R"({"id": 1, "arch": "amd64", "bytes": "c704ba01000000", )"
+          R"("address": 4096})" "\n"
+       << "not json\n"
+       << "[1, 2]\n"
+       << R"({"id": "four", "arch": "bogus", "bytes": "90"})" "\n"
+       << R"({"id": 5, "arch": "amd64", "bytes": "90", "address": "zzz"})"
+          "\n"
+       << R"({"id": 6, "arch": "amd64", "bytes": "909", "address": 4096})"
+          "\n"
+       << "\n"
+       << R"({"id": 7, "arch": "amd64", "bytes": "c3", "address": "0x2000", )"
+          R"("format": "bc"})" "\n"
+       << R"({"id": 8, "arch": "amd64", "bytes": "90", "format": "xml"})" "\n"
+       << R"({"id": 9, "arch": "x86", "bytes": "c3", "address": 4096})" "\n"
+
+       // The last request isn't followed by a newline.
+       << R"({"id": 10, "arch": "amd64", "bytes": "c3", "address": 12288})";
+  }
+
+  std::stringstream cmd;
+  cmd << REMILL_LIFT_PATH << " --daemon --daemon_workers 2"
+      << " --daemon_requests_per_context 2 < " << in_path << " > "
+      << out_path;
+  ASSERT_EQ(std::system(cmd.str().c_str()), 0) << cmd.str();
+
+  std::ifstream out(out_path);
+  for (std::string line; std::getline(out, line);) {
+    AddResponse(line);
+  }
+
+  EXPECT_EQ(responses.size(), 8u);
+  ASSERT_EQ(anonymous.size(), 2u);
+  for (const auto &response : anonymous) {
+    EXPECT_TRUE(static_cast<bool>(response.getString("error")));
+  }
+
+  for (auto id : {"1", "9", "10"}) {
+    ASSERT_TRUE(responses.count(id)) << id;
+    EXPECT_EQ(Error(id), "") << id;
+    auto ir = responses[id].getString("ir");
+    ASSERT_TRUE(static_cast<bool>(ir)) << id;
+    EXPECT_NE(ir->find("define "), llvm::StringRef::npos) << id;
+  }
+  EXPECT_NE(responses["1"].getString("ir")->find("@sub_1000"),
+            llvm::StringRef::npos);
+  EXPECT_NE(responses["10"].getString("ir")->find("@sub_3000"),
+            llvm::StringRef::npos);
+
+  EXPECT_NE(Error("four").find("Invalid architecture name"), std::string::npos);
+  EXPECT_NE(Error("5").find("Invalid address"), std::string::npos);
+  EXPECT_NE(Error("6").find("even number of nibbles"), std::string::npos);
+  EXPECT_NE(Error("8").find("Invalid format"), std::string::npos);
+
+  // Bitcode responses are hex-encoded modules.
+  ASSERT_EQ(Error("7"), "");
+  auto bc_hex = responses["7"].getString("bc");
+  ASSERT_TRUE(static_cast<bool>(bc_hex));
+  const auto bc = llvm::fromHex(*bc_hex);
+  llvm::LLVMContext context;
+  auto module = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(bc, "response_7"), context);
+  if (!module) {
+    FAIL() << llvm::toString(module.takeError());
+  }
+  auto func = (*module)->getFunction("sub_2000");
+  ASSERT_NE(func, nullptr);
+  EXPECT_FALSE(func->isDeclaration());
+}
+
+#ifndef _WIN32
+
+// Read one line from `fd`, waiting at most a minute for it.
+static bool ReadLine(int fd, std::string &line) {
+  line.clear();
+  for (char ch = 0; ch != '\n';) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 60000) != 1 || read(fd, &ch, 1) != 1) {
+      return false;
+    }
+    if (ch != '\n') {
+      line.push_back(ch);
+    }
+  }
+  return true;
+}
+
+static bool WriteString(int fd, const std::string &data) {
+  for (size_t i = 0; i < data.size();) {
+    auto ret = write(fd, &(data[i]), data.size() - i);
+    if (ret <= 0) {
+      return false;
+    }
+    i += static_cast<size_t>(ret);
+  }
+  return true;
+}
+
+// Clients that go away without reading their responses, or that send bad
+// requests, don't take down a daemon that listens on a socket.
+TEST_F(LiftDaemonTest, ClientFailuresOverSocket) {
+  signal(SIGPIPE, SIG_IGN);
+
+  const auto socket_path = (work_dir / "daemon.sock").string();
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  ASSERT_LT(socket_path.size(), sizeof(addr.sun_path));
+  socket_path.copy(addr.sun_path, socket_path.size());
+
+  const auto pid = fork();
+  ASSERT_GE(pid, 0);
+  if (!pid) {
+    execl(REMILL_LIFT_PATH, REMILL_LIFT_PATH, "--daemon", "--daemon_socket",
+          socket_path.c_str(), "--daemon_workers", "1", nullptr);
+    _exit(127);
+  }
+
+  // Connect to the daemon, waiting for it to start listening.
+  auto connect_to_daemon = [&addr](void) {
+    for (auto i = 0; i < 6000; ++i) {
+      const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0) {
+        return -1;
+      }
+      if (!connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        return fd;
+      }
+      close(fd);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+  };
+
+  const std::string request =
+      R"({"id": 1, "arch": "amd64", "bytes": "c3", "address": 4096})" "\n";
+
+  // Hang up before the response is written.
+  auto fd = connect_to_daemon();
+  ASSERT_GE(fd, 0);
+  EXPECT_TRUE(WriteString(fd, request));
+  close(fd);
+
+  // Send a bad request, then a good one, over the same connection.
+  fd = connect_to_daemon();
+  ASSERT_GE(fd, 0);
+  EXPECT_TRUE(WriteString(fd, "{\"id\": 2, \"bytes\": \"c3\", \"arch\"\n"));
+  EXPECT_TRUE(WriteString(fd, request));
+
+  std::string line;
+  for (auto i = 0; i < 2 && ReadLine(fd, line); ++i) {
+    AddResponse(line);
+  }
+  shutdown(fd, SHUT_WR);
+  EXPECT_FALSE(ReadLine(fd, line));
+  close(fd);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+
+  ASSERT_EQ(responses.size(), 1u);
+  ASSERT_EQ(anonymous.size(), 1u);
+  EXPECT_TRUE(static_cast<bool>(anonymous[0].getString("error")));
+  EXPECT_EQ(Error("1"), "");
+  auto ir = responses["1"].getString("ir");
+  ASSERT_TRUE(static_cast<bool>(ir));
+  EXPECT_NE(ir->find("@sub_1000"), llvm::StringRef::npos);
+}
+
+#endif  // _WIN32
+
+}  // namespace
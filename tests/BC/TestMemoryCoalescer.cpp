@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "TestUtil.h"
+
+namespace {
+
+static constexpr auto kDeclarations = R"(
+declare i8 @__remill_read_memory_8(ptr, i64)
+declare i16 @__remill_read_memory_16(ptr, i64)
+declare i32 @__remill_read_memory_32(ptr, i64)
+declare i64 @__remill_read_memory_64(ptr, i64)
+declare ptr @__remill_write_memory_8(ptr, i64, i8)
+declare ptr @__remill_write_memory_16(ptr, i64, i16)
+declare ptr @__remill_write_memory_32(ptr, i64, i32)
+declare ptr @__remill_write_memory_64(ptr, i64, i64)
+declare ptr @__remill_function_return(ptr, i64, ptr)
+declare i8 @byte(i64)
+declare void @use(i8, i8)
+)";
+
+// Reads the bytes at `pc` and `pc + {OFFSET}`.
+static constexpr auto kTwoReads = R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %addr = add i64 %pc, {OFFSET}
+  %a = call i8 @__remill_read_memory_8(ptr %memory, i64 %pc)
+  %b = call i8 @__remill_read_memory_8(ptr %memory, i64 %addr)
+  call void @use(i8 %a, i8 %b)
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)";
+
+// Writes the bytes at `pc` and `pc + {OFFSET}`.
+static constexpr auto kTwoWrites = R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %addr = add i64 %pc, {OFFSET}
+  %a = call i8 @byte(i64 0)
+  %b = call i8 @byte(i64 1)
+  %m1 = call ptr @__remill_write_memory_8(ptr %memory, i64 %pc, i8 %a)
+  %m2 = call ptr @__remill_write_memory_8(ptr %m1, i64 %addr, i8 %b)
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %m2)
+  ret ptr %ret
+}
+)";
+
+class MemoryCoalescerTest : public test::LiftedCodeTest {
+ protected:
+  // Parse `ir`, with `{OFFSET}` replaced by `offset`, and coalesce the memory
+  // accesses of its trace. Returns the trace.
+  llvm::Function *Coalesce(std::string ir, int offset,
+                           size_t expected_num_removed) {
+    ir.replace(ir.find("{OFFSET}"), 8, std::to_string(offset));
+    module = Parse(std::string(kDeclarations) + ir);
+    auto trace = module->getFunction("trace");
+    EXPECT_EQ(
+        remill::CoalesceMemoryAccesses(arch.get(), module.get(), {trace}),
+        expected_num_removed);
+    EXPECT_TRUE(remill::VerifyFunction(trace));
+    return trace;
+  }
+
+  // Returns the number of bits by which `val` is shifted out of `wide`, if
+  // `val` is `wide`, shifted right and truncated.
+  static int ShiftOutOf(llvm::Value *val, llvm::Value *wide) {
+    auto trunc = llvm::dyn_cast<llvm::TruncInst>(val);
+    if (!trunc) {
+      return -1;
+    } else if (trunc->getOperand(0) == wide) {
+      return 0;
+    }
+    auto shr = llvm::dyn_cast<llvm::BinaryOperator>(trunc->getOperand(0));
+    if (!shr || shr->getOpcode() != llvm::Instruction::LShr ||
+        shr->getOperand(0) != wide) {
+      return -1;
+    }
+    auto shift = llvm::dyn_cast<llvm::ConstantInt>(shr->getOperand(1));
+    return shift ? static_cast<int>(shift->getZExtValue()) : -1;
+  }
+
+  // Returns the narrow values that `wide` is assembled from, by the number of
+  // bits by which they are shifted into it.
+  static std::map<int, llvm::Value *> ShiftsInto(llvm::Value *wide) {
+    std::map<int, llvm::Value *> parts;
+    auto add = [&parts](llvm::Value *val) {
+      auto shift = 0;
+      auto shl = llvm::dyn_cast<llvm::BinaryOperator>(val);
+      if (shl && shl->getOpcode() == llvm::Instruction::Shl) {
+        auto amount = llvm::dyn_cast<llvm::ConstantInt>(shl->getOperand(1));
+        shift = amount ? static_cast<int>(amount->getZExtValue()) : -1;
+        val = shl->getOperand(0);
+      }
+      if (auto zext = llvm::dyn_cast<llvm::ZExtInst>(val)) {
+        parts[shift] = zext->getOperand(0);
+      } else {
+        parts[-1] = val;
+      }
+    };
+
+    auto bin = llvm::dyn_cast<llvm::BinaryOperator>(wide);
+    if (bin && bin->getOpcode() == llvm::Instruction::Or) {
+      add(bin->getOperand(0));
+      add(bin->getOperand(1));
+    } else {
+      add(wide);
+    }
+    return parts;
+  }
+
+  // Check that the reads of `kTwoReads` at offset 1 are merged into one
+  // 16-bit read, in which the first byte is shifted by `first_shift` bits.
+  void CheckMergedReads(int first_shift) {
+    auto trace = Coalesce(kTwoReads, 1, 1u);
+    EXPECT_TRUE(test::CallsTo(trace, "__remill_read_memory_8").empty());
+
+    auto wides = test::CallsTo(trace, "__remill_read_memory_16");
+    ASSERT_EQ(wides.size(), 1u);
+    EXPECT_EQ(wides[0]->getArgOperand(0), trace->getArg(2));
+    EXPECT_EQ(wides[0]->getArgOperand(1), trace->getArg(1));
+
+    auto uses = test::CallsTo(trace, "use");
+    ASSERT_EQ(uses.size(), 1u);
+    EXPECT_EQ(ShiftOutOf(uses[0]->getArgOperand(0), wides[0]), first_shift);
+    EXPECT_EQ(ShiftOutOf(uses[0]->getArgOperand(1), wides[0]),
+              8 - first_shift);
+  }
+
+  // Check that the writes of `kTwoWrites` at offset 1 are merged into one
+  // 16-bit write, in which the first byte is shifted by `first_shift` bits.
+  void CheckMergedWrites(int first_shift) {
+    auto trace = Coalesce(kTwoWrites, 1, 1u);
+    EXPECT_TRUE(test::CallsTo(trace, "__remill_write_memory_8").empty());
+
+    auto wides = test::CallsTo(trace, "__remill_write_memory_16");
+    ASSERT_EQ(wides.size(), 1u);
+    EXPECT_EQ(wides[0]->getArgOperand(0), trace->getArg(2));
+    EXPECT_EQ(wides[0]->getArgOperand(1), trace->getArg(1));
+
+    auto bytes = test::CallsTo(trace, "byte");
+    ASSERT_EQ(bytes.size(), 2u);
+    EXPECT_EQ(ShiftsInto(wides[0]->getArgOperand(2)),
+              (std::map<int, llvm::Value *>{{first_shift, bytes[0]},
+                                            {8 - first_shift, bytes[1]}}));
+
+    auto rets = test::CallsTo(trace, "__remill_function_return");
+    ASSERT_EQ(rets.size(), 1u);
+    EXPECT_EQ(rets[0]->getArgOperand(2), wides[0]);
+  }
+
+  std::unique_ptr<llvm::Module> module;
+};
+
+TEST_F(MemoryCoalescerTest, AdjacentReadsAreMerged) {
+  BuildArch(remill::kArchAMD64);
+  CheckMergedReads(0);
+}
+
+TEST_F(MemoryCoalescerTest, AdjacentReadsAreMergedBigEndian) {
+  BuildArch(remill::kArchSparc64);
+  CheckMergedReads(8);
+}
+
+TEST_F(MemoryCoalescerTest, NonAdjacentReadsAreKept) {
+  BuildArch(remill::kArchAMD64);
+  auto trace = Coalesce(kTwoReads, 2, 0u);
+  EXPECT_EQ(test::CallsTo(trace, "__remill_read_memory_8").size(), 2u);
+  EXPECT_TRUE(test::CallsTo(trace, "__remill_read_memory_16").empty());
+}
+
+TEST_F(MemoryCoalescerTest, AdjacentWritesAreMerged) {
+  BuildArch(remill::kArchAMD64);
+  CheckMergedWrites(0);
+}
+
+TEST_F(MemoryCoalescerTest, AdjacentWritesAreMergedBigEndian) {
+  BuildArch(remill::kArchSparc64);
+  CheckMergedWrites(8);
+}
+
+TEST_F(MemoryCoalescerTest, NonAdjacentWritesAreKept) {
+  BuildArch(remill::kArchAMD64);
+  auto trace = Coalesce(kTwoWrites, 2, 0u);
+  EXPECT_EQ(test::CallsTo(trace, "__remill_write_memory_8").size(), 2u);
+  EXPECT_TRUE(test::CallsTo(trace, "__remill_write_memory_16").empty());
+}
+
+// The second write replaces the byte written by the first one, so they can't
+// be reordered into one write.
+TEST_F(MemoryCoalescerTest, OverlappingWritesAreKept) {
+  BuildArch(remill::kArchAMD64);
+  auto trace = Coalesce(kTwoWrites, 0, 0u);
+  EXPECT_EQ(test::CallsTo(trace, "__remill_write_memory_8").size(), 2u);
+}
+
+}  // namespace
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Attributes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/Util.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+class MoveFunctionTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+  }
+
+  // Returns a new, empty module in `dest_context`, with the same target as
+  // the semantics.
+  std::unique_ptr<llvm::Module> DestModule(void) {
+    auto module = std::make_unique<llvm::Module>("dest", dest_context);
+    arch->PrepareModuleDataLayout(module.get());
+    return module;
+  }
+
+  // Returns the opcode and the type of every instruction in `func`, in
+  // program order, printed with the names of the types.
+  static std::vector<std::string> Shape(llvm::Function *func) {
+    std::vector<std::string> shape;
+    for (auto &inst : llvm::instructions(func)) {
+      shape.push_back(std::string(inst.getOpcodeName()) + " " +
+                      remill::LLVMThingToString(inst.getType()));
+    }
+    return shape;
+  }
+
+  // Checks that every type used by `func` belongs to the context of `func`.
+  static void ExpectInOwnContext(llvm::Function *func) {
+    auto &func_context = func->getContext();
+    EXPECT_EQ(&(func->getFunctionType()->getContext()), &func_context);
+    for (auto &inst : llvm::instructions(func)) {
+      EXPECT_EQ(&(inst.getType()->getContext()), &func_context);
+      for (auto &op : inst.operands()) {
+        EXPECT_EQ(&(op->getType()->getContext()), &func_context);
+      }
+    }
+  }
+
+  llvm::LLVMContext dest_context;
+};
+
+TEST_F(MoveFunctionTest, LiftedFunctionAcrossContexts) {
+  remill::IntrinsicTable intrinsics(semantics.get());
+  auto func = arch->DefineLiftedFunction("lifted", semantics.get());
+  auto block = &(func->getEntryBlock());
+
+  // add eax, ebx; paddb mm0, mm1
+  std::string_view bytes("\x01\xd8\x0f\xfc\xc1", 5);
+  uint64_t pc = 0x1000;
+  while (!bytes.empty()) {
+    remill::Instruction inst;
+    ASSERT_TRUE(arch->DecodeInstruction(pc, bytes, inst,
+                                        arch->CreateInitialContext()));
+    ASSERT_EQ(inst.GetLifter()->LiftIntoBlock(inst, block),
+              remill::kLiftedInstruction);
+    bytes = bytes.substr(inst.bytes.size());
+    pc += inst.bytes.size();
+  }
+  remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                 intrinsics);
+  ASSERT_TRUE(remill::VerifyFunction(func));
+
+  std::vector<std::string> callees;
+  for (auto &inst : llvm::instructions(func)) {
+    if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+      callees.push_back(call->getCalledFunction()->getName().str());
+    }
+  }
+  ASSERT_FALSE(callees.empty());
+
+  const auto shape = Shape(func);
+  auto dest = DestModule();
+  auto moved = remill::MoveFunctionIntoModule(func, dest.get());
+
+  ASSERT_NE(moved, nullptr);
+  EXPECT_EQ(moved->getParent(), dest.get());
+  EXPECT_EQ(&(moved->getContext()), &dest_context);
+  EXPECT_EQ(moved->getName(), "lifted");
+  EXPECT_FALSE(moved->isDeclaration());
+  EXPECT_EQ(Shape(moved), shape);
+  ExpectInOwnContext(moved);
+
+  // The callees are declared in the destination module under their original
+  // names, and the source module keeps a declaration of the moved function.
+  for (const auto &callee : callees) {
+    auto decl = dest->getFunction(callee);
+    ASSERT_NE(decl, nullptr) << callee;
+    EXPECT_TRUE(decl->isDeclaration()) << callee;
+  }
+  EXPECT_EQ(test::CallsTo(moved, callees.front()).size(), 1u);
+
+  auto source_decl = semantics->getFunction("lifted");
+  ASSERT_NE(source_decl, nullptr);
+  EXPECT_TRUE(source_decl->isDeclaration());
+
+  EXPECT_TRUE(remill::VerifyModule(dest.get()));
+}
+
+TEST_F(MoveFunctionTest, AttributesAndOperandsAcrossContexts) {
+  auto module = Parse(R"(
+@table = global [2 x i64] [i64 1, i64 2]
+
+declare ptr @__remill_function_return(ptr, i64, ptr)
+
+define ptr @trace(ptr noalias %state, i64 %pc, ptr %memory) #0 {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  %slot = getelementptr inbounds [2 x i64], ptr @table, i64 0, i64 1
+  %val = load i64, ptr %slot, align 8, !range !0
+  %vec = insertelement <4 x i32> poison, i32 7, i32 0
+  %shuf = shufflevector <4 x i32> %vec, <4 x i32> poison, <4 x i32> <i32 3, i32 2, i32 1, i32 0>
+  %lane = extractelement <4 x i32> %shuf, i32 3
+  %wide = zext i32 %lane to i64
+  %asm = call i64 asm sideeffect "bswap $0", "=r,0"(i64 %wide)
+  %sum = add i64 %val, %asm
+  store i64 %sum, ptr %rax, align 8
+  %ret = tail call ptr @__remill_function_return(ptr nonnull %state, i64 %pc, ptr %memory) #1
+  ret ptr %ret
+}
+
+attributes #0 = { noinline nounwind }
+attributes #1 = { nounwind }
+
+!0 = !{i64 0, i64 3}
+)");
+  auto trace = module->getFunction("trace");
+  const auto shape = Shape(trace);
+
+  auto dest = DestModule();
+  auto moved = remill::MoveFunctionIntoModule(trace, dest.get());
+  ASSERT_NE(moved, nullptr);
+  EXPECT_EQ(&(moved->getContext()), &dest_context);
+  EXPECT_EQ(Shape(moved), shape);
+  ExpectInOwnContext(moved);
+
+  // Function, parameter, and call site attributes are rebuilt in the
+  // destination context.
+  EXPECT_TRUE(moved->hasFnAttribute(llvm::Attribute::NoInline));
+  EXPECT_TRUE(moved->hasFnAttribute(llvm::Attribute::NoUnwind));
+  EXPECT_TRUE(moved->hasParamAttribute(0, llvm::Attribute::NoAlias));
+
+  auto rets = test::CallsTo(moved, "__remill_function_return");
+  ASSERT_EQ(rets.size(), 1u);
+  EXPECT_TRUE(rets[0]->hasFnAttr(llvm::Attribute::NoUnwind));
+  EXPECT_TRUE(rets[0]->paramHasAttr(0, llvm::Attribute::NonNull));
+
+  // Shuffle masks, inline assembly, metadata, and global variables.
+  for (auto &inst : llvm::instructions(moved)) {
+    if (auto shuf = llvm::dyn_cast<llvm::ShuffleVectorInst>(&inst)) {
+      EXPECT_EQ(shuf->getShuffleMask(), llvm::ArrayRef<int>({3, 2, 1, 0}));
+
+    } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+               call && call->isInlineAsm()) {
+      auto asm_ = llvm::cast<llvm::InlineAsm>(call->getCalledOperand());
+      EXPECT_EQ(asm_->getAsmString(), "bswap $0");
+      EXPECT_EQ(asm_->getConstraintString(), "=r,0");
+      EXPECT_TRUE(asm_->hasSideEffects());
+
+    } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+      EXPECT_NE(load->getMetadata(llvm::LLVMContext::MD_range), nullptr);
+    }
+  }
+  EXPECT_NE(dest->getGlobalVariable("table"), nullptr);
+
+  EXPECT_TRUE(remill::VerifyModule(dest.get()));
+}
+
+}  // namespace
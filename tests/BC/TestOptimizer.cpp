@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+// add eax, ebx; xor rcx, rcx
+static constexpr std::string_view kCode("\x01\xd8\x48\x31\xc9", 5);
+
+class OptimizerTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+  }
+
+  // Lift `kCode` into a single block of a new lifted function named `name`.
+  llvm::Function *Lift(const std::string &name) {
+    remill::IntrinsicTable intrinsics(semantics.get());
+    auto func = arch->DefineLiftedFunction(name, semantics.get());
+    auto block = &(func->getEntryBlock());
+    std::string_view bytes = kCode;
+    for (uint64_t pc = 0x1000; !bytes.empty();) {
+      remill::Instruction inst;
+      EXPECT_TRUE(arch->DecodeInstruction(pc, bytes, inst,
+                                          arch->CreateInitialContext()));
+      EXPECT_EQ(inst.GetLifter()->LiftIntoBlock(inst, block),
+                remill::kLiftedInstruction);
+      bytes = bytes.substr(inst.bytes.size());
+      pc += inst.bytes.size();
+    }
+    remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                   intrinsics);
+    return func;
+  }
+
+  // Returns the number of calls in `func` to functions with internal linkage,
+  // which can't be declared in another module.
+  static size_t NumInternalCalls(llvm::Function *func) {
+    size_t num_calls = 0;
+    for (auto &inst : llvm::instructions(func)) {
+      if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+        auto callee = call->getCalledFunction();
+        num_calls += callee && callee->hasLocalLinkage();
+      }
+    }
+    return num_calls;
+  }
+};
+
+// Only the traces given to `OptimizeModule` have the semantics inlined into
+// them. The others still call the semantics, and have to have them inlined
+// before everything can be moved out of the semantics module.
+TEST_F(OptimizerTest, SubsetOfTracesThenMoveAll) {
+  auto hot = Lift("hot");
+  auto cold = Lift("cold");
+  ASSERT_GT(NumInternalCalls(hot), 0u);
+  ASSERT_GT(NumInternalCalls(cold), 0u);
+
+  remill::OptimizeModule(arch.get(), semantics.get(),
+                         std::vector<llvm::Function *>{hot});
+  EXPECT_EQ(NumInternalCalls(hot), 0u);
+  EXPECT_GT(NumInternalCalls(cold), 0u);
+
+  ASSERT_TRUE(remill::InlineInternalCalls(cold));
+  EXPECT_EQ(NumInternalCalls(cold), 0u);
+
+  llvm::Module dest("dest", context);
+  arch->PrepareModuleDataLayout(&dest);
+  for (auto func : {hot, cold}) {
+    auto moved = remill::MoveFunctionIntoModule(func, &dest);
+    ASSERT_NE(moved, nullptr);
+    EXPECT_FALSE(moved->isDeclaration());
+  }
+
+  for (auto &func : dest) {
+    EXPECT_FALSE(func.isDeclaration() && func.hasLocalLinkage())
+        << func.getName().str();
+  }
+  EXPECT_NE(dest.getFunction("hot"), nullptr);
+  EXPECT_NE(dest.getFunction("cold"), nullptr);
+  EXPECT_TRUE(remill::VerifyModule(&dest));
+}
+
+}  // namespace
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <remill/BC/PCodeCFG.h>
+#include <remill/BC/SleighLifter.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sleigh/opcodes.hh>
+#include <sleigh/pcoderaw.hh>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lib/Arch/Sleigh/Arch.h"
+
+namespace {
+
+using remill::sleigh::RemillPcodeOp;
+
+// User-defined p-code ops of the tests, in the order of their IDs.
+static const std::vector<std::string> kUserOpNames = {"claim_eq", "hyper"};
+
+static std::string Print(const VarnodeData &vnode) {
+  std::stringstream ss;
+  ss << vnode.space->getName() << ":0x" << std::hex << vnode.offset << ":"
+     << std::dec << vnode.size;
+  return ss.str();
+}
+
+static std::string Print(const std::vector<RemillPcodeOp> &ops) {
+  std::stringstream ss;
+  for (const auto &op : ops) {
+    if (op.outvar) {
+      ss << Print(*op.outvar) << " = ";
+    }
+    ss << get_opname(op.op);
+    for (const auto &var : op.vars) {
+      ss << " " << Print(var);
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+// Runs the p-code optimizer over hand-written p-code, and compares it with
+// the expected p-code. The varnodes are in the address spaces of a real
+// SLEIGH specification, so that they are classified as the lifter sees them.
+class PcodeOptimizerTest : public ::testing::Test {
+ protected:
+  void SetUp(void) override {
+    sleigh_context =
+        std::make_unique<remill::sleigh::SingleInstructionSleighContext>(
+            "ppc_32_e200_be.sla", "ppc_32.pspec");
+  }
+
+  VarnodeData Const(uint64_t val, uint32_t size = 4) {
+    return {sleigh_context->GetEngine().getConstantSpace(), val, size};
+  }
+
+  VarnodeData Unique(uint64_t offset, uint32_t size = 4) {
+    return {sleigh_context->GetEngine().getUniqueSpace(), offset, size};
+  }
+
+  VarnodeData Ram(uint64_t addr, uint32_t size = 4) {
+    return {sleigh_context->GetEngine().getDefaultCodeSpace(), addr, size};
+  }
+
+  VarnodeData Reg(const std::string &name) {
+    return sleigh_context->GetEngine().getRegister(name);
+  }
+
+  static RemillPcodeOp Op(OpCode opc, std::optional<VarnodeData> out,
+                          std::vector<VarnodeData> in) {
+    return {opc, out, std::move(in)};
+  }
+
+  // Optimizes `ops` as the single block of an instruction.
+  static std::vector<RemillPcodeOp>
+  Optimize(std::vector<RemillPcodeOp> ops,
+           remill::sleigh::MaybeBranchTakenVar &btaken) {
+    std::map<size_t, remill::sleigh::PcodeBlock> blocks;
+    blocks.emplace(0, remill::sleigh::PcodeBlock(
+                          0, std::move(ops),
+                          remill::sleigh::Exit(remill::sleigh::InstrExit{})));
+    remill::sleigh::PcodeCFG cfg(std::move(blocks));
+    remill::sleigh::OptimizeCFG(cfg, btaken, kUserOpNames);
+    return cfg.blocks.at(0).ops;
+  }
+
+  static std::vector<RemillPcodeOp> Optimize(std::vector<RemillPcodeOp> ops) {
+    remill::sleigh::MaybeBranchTakenVar btaken;
+    return Optimize(std::move(ops), btaken);
+  }
+
+  std::unique_ptr<remill::sleigh::SingleInstructionSleighContext>
+      sleigh_context;
+};
+
+TEST_F(PcodeOptimizerTest, ConstantsAreFolded) {
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_COPY, Unique(0x100), {Const(5)}),
+      Op(CPUI_INT_ADD, Unique(0x200), {Unique(0x100), Const(3)}),
+      Op(CPUI_COPY, Reg("r3"), {Unique(0x200)}),
+  };
+  const std::vector<RemillPcodeOp> after = {
+      Op(CPUI_COPY, Reg("r3"), {Const(8)}),
+  };
+  EXPECT_EQ(Print(Optimize(before)), Print(after));
+}
+
+TEST_F(PcodeOptimizerTest, CopiesArePropagated) {
+  // The copy into `r4` stays, as the register is live out of the instruction.
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_COPY, Reg("r4"), {Reg("r3")}),
+      Op(CPUI_INT_ADD, Reg("r5"), {Reg("r4"), Const(1)}),
+  };
+  const std::vector<RemillPcodeOp> after = {
+      Op(CPUI_COPY, Reg("r4"), {Reg("r3")}),
+      Op(CPUI_INT_ADD, Reg("r5"), {Reg("r3"), Const(1)}),
+  };
+  EXPECT_EQ(Print(Optimize(before)), Print(after));
+}
+
+TEST_F(PcodeOptimizerTest, OverwrittenRegistersAreDead) {
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_COPY, Reg("r3"), {Const(1)}),
+      Op(CPUI_COPY, Reg("r3"), {Reg("r4")}),
+  };
+  const std::vector<RemillPcodeOp> after = {
+      Op(CPUI_COPY, Reg("r3"), {Reg("r4")}),
+  };
+  EXPECT_EQ(Print(Optimize(before)), Print(after));
+}
+
+TEST_F(PcodeOptimizerTest, UserOpsMayUseRegisters) {
+  // `hyper` may read `r4` and write `r3` or `r4`.
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_COPY, Reg("r4"), {Reg("r3")}),
+      Op(CPUI_CALLOTHER, std::nullopt, {Const(1)}),
+      Op(CPUI_COPY, Reg("r5"), {Reg("r4")}),
+      Op(CPUI_COPY, Reg("r4"), {Const(0)}),
+  };
+  EXPECT_EQ(Print(Optimize(before)), Print(before));
+}
+
+TEST_F(PcodeOptimizerTest, ConstantEqualityClaimsAreFolded) {
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_CALLOTHER, std::nullopt,
+         {Const(0), Const(0x1000), Const(0x2000)}),
+      Op(CPUI_INT_ADD, Reg("r5"), {Reg("r3"), Const(0x1000)}),
+  };
+  const std::vector<RemillPcodeOp> after = {
+      Op(CPUI_INT_ADD, Reg("r5"), {Reg("r3"), Const(0x2000)}),
+  };
+  EXPECT_EQ(Print(Optimize(before)), Print(after));
+}
+
+TEST_F(PcodeOptimizerTest, VariableEqualityClaimsAreKept) {
+  // The lifter reads `r4` where the claimed constant is used, so neither the
+  // claim nor the copy into `r4` can go.
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_COPY, Reg("r4"), {Reg("r3")}),
+      Op(CPUI_CALLOTHER, std::nullopt, {Const(0), Const(0x1000), Reg("r4")}),
+      Op(CPUI_INT_ADD, Reg("r5"), {Reg("r3"), Const(0x1000)}),
+  };
+  EXPECT_EQ(Print(Optimize(before)), Print(before));
+}
+
+TEST_F(PcodeOptimizerTest, BranchTakenFollowsItsCBranch) {
+  const std::vector<RemillPcodeOp> before = {
+      Op(CPUI_INT_EQUAL, Unique(0x100, 1), {Reg("r3"), Const(0)}),
+      Op(CPUI_COPY, Unique(0x200), {Const(1)}),
+      Op(CPUI_COPY, Unique(0x300, 1), {Unique(0x100, 1)}),
+      Op(CPUI_CBRANCH, std::nullopt, {Ram(0x2000), Unique(0x300, 1)}),
+  };
+  const std::vector<RemillPcodeOp> after = {
+      Op(CPUI_INT_EQUAL, Unique(0x100, 1), {Reg("r3"), Const(0)}),
+      Op(CPUI_CBRANCH, std::nullopt, {Ram(0x2000), Unique(0x100, 1)}),
+  };
+
+  remill::sleigh::MaybeBranchTakenVar btaken =
+      remill::sleigh::BranchTakenVar{false, Unique(0x300, 1), 3};
+  EXPECT_EQ(Print(Optimize(before, btaken)), Print(after));
+  ASSERT_TRUE(btaken.has_value());
+  EXPECT_FALSE(btaken->invert);
+  EXPECT_EQ(btaken->index, 1u);
+  EXPECT_EQ(Print(btaken->target_vnode), Print(Unique(0x100, 1)));
+}
+
+}  // namespace
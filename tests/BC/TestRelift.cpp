@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstrTypes.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/TraceLifter.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+//  0x1000:  call 0x2000
+//  0x1005:  ret
+static constexpr std::string_view kCaller("\xe8\xfb\x0f\x00\x00\xc3", 6);
+
+//  0x2000:  mov eax, 1
+//  0x2005:  ret
+static constexpr std::string_view kCallee("\xb8\x01\x00\x00\x00\xc3", 6);
+
+//  0x3000:  mov eax, 3
+//  0x3005:  ret
+static constexpr std::string_view kOther("\xb8\x03\x00\x00\x00\xc3", 6);
+
+//  0x4000:  mov eax, 4
+//  0x4005:  <not yet written>
+static constexpr std::string_view kUnfinished("\xb8\x04\x00\x00\x00", 5);
+
+// ret
+static constexpr std::string_view kRet("\xc3", 1);
+
+class TestTraceManager : public remill::TraceManager {
+ public:
+  virtual ~TestTraceManager(void) = default;
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    traces[addr] = lifted_func;
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto trace_it = traces.find(addr);
+    if (trace_it != traces.end()) {
+      return trace_it->second;
+    } else {
+      return nullptr;
+    }
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    return GetLiftedTraceDeclaration(addr);
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto byte_it = memory.find(addr);
+    if (byte_it != memory.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  void Write(uint64_t addr, std::string_view bytes) {
+    for (auto byte : bytes) {
+      memory[addr++] = static_cast<uint8_t>(byte);
+    }
+  }
+
+ public:
+  std::unordered_map<uint64_t, uint8_t> memory;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+};
+
+class ReliftTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+    manager.Write(0x1000, kCaller);
+    manager.Write(0x2000, kCallee);
+    manager.Write(0x3000, kOther);
+    manager.Write(0x4000, kUnfinished);
+
+    // The callee is lifted first, so that the caller calls the callee's
+    // definition, as found through `GetLiftedTraceDeclaration`.
+    lifter = std::make_unique<remill::TraceLifter>(arch.get(), manager);
+    ASSERT_TRUE(lifter->Lift(0x2000));
+    ASSERT_TRUE(lifter->Lift(0x1000));
+    ASSERT_TRUE(lifter->Lift(0x3000));
+    ASSERT_TRUE(lifter->Lift(0x4000));
+    ASSERT_EQ(manager.traces.size(), 4u);
+  }
+
+  // Re-lift the traces using `[begin, end)`, and return the addresses of the
+  // traces passed to the callback.
+  std::set<uint64_t> Relift(uint64_t begin, uint64_t end,
+                            size_t expected_relifted) {
+    std::set<uint64_t> relifted;
+    EXPECT_EQ(lifter->Relift(begin, end,
+                             [&](uint64_t addr, llvm::Function *func) {
+                               EXPECT_EQ(func, manager.traces[addr]);
+                               relifted.insert(addr);
+                             }),
+              expected_relifted);
+    return relifted;
+  }
+
+  TestTraceManager manager;
+  std::unique_ptr<remill::TraceLifter> lifter;
+};
+
+TEST_F(ReliftTest, TracesUsingBytes) {
+  using Traces = std::vector<uint64_t>;
+  EXPECT_EQ(lifter->TracesUsingBytes(0x1000, 0x1001), Traces({0x1000}));
+  EXPECT_EQ(lifter->TracesUsingBytes(0x1005, 0x1006), Traces({0x1000}));
+  EXPECT_EQ(lifter->TracesUsingBytes(0x2004, 0x2005), Traces({0x2000}));
+  EXPECT_EQ(lifter->TracesUsingBytes(0x1006, 0x2000), Traces());
+  EXPECT_EQ(lifter->TracesUsingBytes(0x2006, 0x3000), Traces());
+  EXPECT_EQ(lifter->TracesUsingBytes(0x0, 0x10000),
+            Traces({0x1000, 0x2000, 0x3000, 0x4000}));
+}
+
+// Only the traces lifted from the changed bytes are lifted again, and the
+// index of the bytes that they use is updated.
+TEST_F(ReliftTest, OnlyOverlappingTracesAreRelifted) {
+  const auto callee = manager.traces[0x2000];
+  const auto other = manager.traces[0x3000];
+  ASSERT_EQ(test::CallsTo(callee, "__remill_function_return").size(), 1u);
+
+  manager.Write(0x2000, kRet);
+  EXPECT_EQ(Relift(0x2000, 0x2001, 1u), std::set<uint64_t>({0x2000}));
+
+  EXPECT_EQ(manager.traces[0x2000], callee);
+  EXPECT_EQ(manager.traces[0x3000], other);
+  EXPECT_FALSE(callee->isDeclaration());
+  EXPECT_TRUE(remill::VerifyFunction(callee));
+
+  // The callee is now only the `ret` at `0x2000`.
+  EXPECT_EQ(lifter->TracesUsingBytes(0x2000, 0x2001),
+            std::vector<uint64_t>({0x2000}));
+  EXPECT_TRUE(lifter->TracesUsingBytes(0x2001, 0x2006).empty());
+
+  // Nothing uses the old bytes of the callee anymore.
+  EXPECT_EQ(Relift(0x2001, 0x2006, 0u), std::set<uint64_t>());
+}
+
+// The caller keeps calling the function of the callee, which is lifted again
+// in place rather than replaced.
+TEST_F(ReliftTest, CallersStayValid) {
+  const auto caller = manager.traces[0x1000];
+  const auto callee = manager.traces[0x2000];
+
+  auto calls_callee = [&](void) {
+    for (auto &block : *caller) {
+      for (auto &inst : block) {
+        if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst);
+            call && call->getCalledFunction() == callee) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+  ASSERT_TRUE(calls_callee());
+
+  manager.Write(0x2000, kRet);
+  Relift(0x2000, 0x2001, 1u);
+
+  EXPECT_TRUE(calls_callee());
+  EXPECT_EQ(manager.traces[0x2000], callee);
+  EXPECT_FALSE(callee->isDeclaration());
+  EXPECT_TRUE(remill::VerifyFunction(caller));
+  EXPECT_TRUE(remill::VerifyFunction(callee));
+}
+
+// A trace that runs into bytes that can't be read depends on them, and is
+// lifted again once they are written. Bytes that become unreadable leave a
+// valid trace that reports the missing block.
+TEST_F(ReliftTest, UnreadableBytes) {
+  const auto unfinished = manager.traces[0x4000];
+  EXPECT_EQ(test::CallsTo(unfinished, "__remill_missing_block").size(), 1u);
+  EXPECT_EQ(lifter->TracesUsingBytes(0x4005, 0x4006),
+            std::vector<uint64_t>({0x4000}));
+
+  manager.Write(0x4005, kRet);
+  EXPECT_EQ(Relift(0x4005, 0x4006, 1u), std::set<uint64_t>({0x4000}));
+  EXPECT_TRUE(test::CallsTo(unfinished, "__remill_missing_block").empty());
+  EXPECT_EQ(test::CallsTo(unfinished, "__remill_function_return").size(), 1u);
+
+  const auto other = manager.traces[0x3000];
+  for (uint64_t addr = 0x3000; addr < 0x3006; ++addr) {
+    manager.memory.erase(addr);
+  }
+  EXPECT_EQ(Relift(0x3000, 0x3006, 1u), std::set<uint64_t>({0x3000}));
+  EXPECT_FALSE(other->isDeclaration());
+  EXPECT_EQ(test::CallsTo(other, "__remill_missing_block").size(), 1u);
+  EXPECT_TRUE(remill::VerifyFunction(other));
+
+  // Bytes that no trace was lifted from don't re-lift anything.
+  EXPECT_EQ(Relift(0x9000, 0x9100, 0u), std::set<uint64_t>());
+}
+
+}  // namespace
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+// save %sp, -176, %sp
+static constexpr std::string_view kSave("\x9d\xe3\xbf\x50", 4);
+
+// add %i0, 1, %i0
+static constexpr std::string_view kAdd("\xb0\x06\x20\x01", 4);
+
+// restore %i0, 0, %o0
+static constexpr std::string_view kRestore("\x91\xe6\x20\x00", 4);
+
+// Number of bytes between two registers of the register window bank.
+static constexpr uint64_t kBankRegSize = 16;
+
+class SPARCWindowBankTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchSparc64);
+    if (!remill::HasSPARCWindowBank(semantics.get())) {
+      GTEST_SKIP() << "Semantics weren't built with REMILL_SPARC_WINDOW_BANK";
+    }
+  }
+
+  remill::Instruction Decode(std::string_view bytes, uint64_t pc) {
+    remill::Instruction inst;
+    EXPECT_TRUE(
+        arch->DecodeInstruction(pc, bytes, inst, arch->CreateInitialContext()));
+    return inst;
+  }
+
+  // Lift `bytes` into a single block of a new lifted function.
+  llvm::Function *Lift(std::string_view bytes) {
+    remill::IntrinsicTable intrinsics(semantics.get());
+    auto func = arch->DefineLiftedFunction("lifted", semantics.get());
+    auto block = &(func->getEntryBlock());
+    for (uint64_t pc = 0x1000; !bytes.empty(); pc += 4) {
+      auto inst = Decode(bytes.substr(0, 4), pc);
+      EXPECT_EQ(inst.GetLifter()->LiftIntoBlock(inst, block),
+                remill::kLiftedInstruction);
+      bytes = bytes.substr(4);
+    }
+    remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                   intrinsics);
+    return func;
+  }
+
+  // Returns the register of the window bank that each access to the `State`
+  // structure in `func` refers to, counting from the start of the bank.
+  // Accesses to the windowed registers of `GPR` are returned as `-1`.
+  std::set<int> BankAccesses(llvm::Function *func) {
+    const auto bank = arch->RegisterByName("WINDOW_BANK")->offset;
+    const auto i0 = arch->RegisterByName("i0")->offset;
+    const auto o7 = arch->RegisterByName("o7")->offset;
+
+    std::set<int> regs;
+    auto add = [&](llvm::Value *ptr) {
+      const auto offset = test::StateOffset(func, ptr);
+      if (!offset) {
+        return;
+      } else if (*offset >= i0 && *offset <= o7) {
+        regs.insert(-1);
+      } else if (*offset >= bank && *offset < (bank + 128 * kBankRegSize)) {
+        regs.insert(static_cast<int>((*offset - bank) / kBankRegSize));
+      }
+    };
+
+    for (auto &inst : llvm::instructions(func)) {
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+        add(load->getPointerOperand());
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        add(store->getPointerOperand());
+      } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        for (auto &arg : call->args()) {
+          if (arg->getType()->isPointerTy()) {
+            add(arg.get());
+          }
+        }
+      }
+    }
+    return regs;
+  }
+};
+
+TEST_F(SPARCWindowBankTest, SaveAndRestoreOnlyMoveCWP) {
+  auto save = Decode(kSave, 0x1000);
+  auto restore = Decode(kRestore, 0x1004);
+  EXPECT_EQ(save.sparc_window_adjustment, 1);
+  EXPECT_EQ(restore.sparc_window_adjustment, -1);
+
+  // No stack-allocated register window is smuggled into the semantics.
+  for (const auto &inst : {save, restore}) {
+    for (const auto &op : inst.operands) {
+      EXPECT_NE(op.reg.name, "WINDOW") << inst.Serialize();
+      EXPECT_NE(op.reg.name, "PREV_WINDOW") << inst.Serialize();
+    }
+  }
+
+  auto func = Lift(std::string(kSave) + std::string(kRestore));
+  for (auto &inst : llvm::instructions(func)) {
+    if (llvm::isa<llvm::AllocaInst>(&inst)) {
+      EXPECT_NE(inst.getName(), "WINDOW");
+      EXPECT_NE(inst.getName(), "PREV_WINDOW");
+    }
+  }
+}
+
+TEST_F(SPARCWindowBankTest, SaveAndRestoreUseTheBank) {
+  auto func = Lift(std::string(kSave) + std::string(kAdd) +
+                   std::string(kRestore));
+  EXPECT_GT(remill::ResolveSPARCWindowOperands(arch.get(), func), 0u);
+  ASSERT_TRUE(remill::VerifyFunction(func));
+
+  // `CWP` is read once, on entry, as the trace doesn't call anything that
+  // could change it.
+  const auto cwp = arch->RegisterByName("cwp");
+  std::vector<llvm::LoadInst *> cwp_loads;
+  for (auto &inst : llvm::instructions(func)) {
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst);
+        load && test::StateOffset(func, load->getPointerOperand()) ==
+                    cwp->offset) {
+      cwp_loads.push_back(load);
+    }
+  }
+  ASSERT_EQ(cwp_loads.size(), 1u);
+
+  // Pretend that the trace is entered in window 3, so that the registers of
+  // the bank are at constant offsets.
+  const auto &dl = func->getParent()->getDataLayout();
+  cwp_loads[0]->replaceAllUsesWith(
+      llvm::ConstantInt::get(cwp_loads[0]->getType(), 3));
+  for (auto &inst : llvm::instructions(func)) {
+    if (auto folded = llvm::ConstantFoldInstruction(&inst, dl)) {
+      inst.replaceAllUsesWith(folded);
+    }
+  }
+
+  // `save` reads `%sp` of window 3 and writes `%sp` of window 4. `add` and
+  // `restore` read `%i0` of window 4, which `restore` writes into `%o0` of
+  // window 3, i.e. the same register.
+  EXPECT_EQ(BankAccesses(func),
+            (std::set<int>{3 * 16 + 22, 4 * 16 + 22, 4 * 16 + 0}));
+}
+
+}  // namespace
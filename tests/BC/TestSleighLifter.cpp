@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/AArch32/ArchContext.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/SleighLifter.h>
+#include <remill/BC/Util.h>
+
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+class SleighLifterTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAArch32LittleEndian);
+  }
+
+  // Lift the ARM instruction `bytes` into a new lifted function, and return
+  // the function that holds its p-code.
+  llvm::Function *Lift(std::string_view bytes, uint64_t pc) {
+    remill::IntrinsicTable intrinsics(semantics.get());
+    auto func = arch->DefineLiftedFunction("lifted", semantics.get());
+    auto block = &(func->getEntryBlock());
+
+    remill::Instruction inst;
+    EXPECT_TRUE(arch->DecodeInstruction(pc, bytes, inst, remill::kARMContext));
+    EXPECT_EQ(inst.GetLifter()->LiftIntoBlock(inst, block),
+              remill::kLiftedInstruction);
+    remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                   intrinsics);
+    EXPECT_TRUE(remill::VerifyFunction(func));
+
+    for (auto &sleigh_func : *semantics) {
+      if (!sleigh_func.isDeclaration() &&
+          sleigh_func.getName().startswith(
+              remill::SleighLifter::kInstructionFunctionPrefix)) {
+        return &sleigh_func;
+      }
+    }
+    return nullptr;
+  }
+
+  // Returns the stores in `func` to its argument named `name`.
+  static std::vector<llvm::StoreInst *> StoresTo(llvm::Function *func,
+                                                 std::string_view name) {
+    std::vector<llvm::StoreInst *> stores;
+    for (auto &inst : llvm::instructions(func)) {
+      if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+          store &&
+          store->getPointerOperand()->getName() == llvm::StringRef(name)) {
+        stores.push_back(store);
+      }
+    }
+    return stores;
+  }
+};
+
+// The branch taken variable is lifted at the p-code op that computes it. The
+// op indices of a block count from the start of the instruction, so the ops
+// of a later block at the same position within their block don't lift it a
+// second time.
+TEST_F(SleighLifterTest, BranchTakenLiftedOnce) {
+  // bxne r1
+  auto func = Lift(std::string_view("\x11\xff\x2f\x11", 4), 0x1000);
+  ASSERT_NE(func, nullptr);
+  EXPECT_EQ(StoresTo(func, "btaken").size(), 1u);
+}
+
+}  // namespace
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+static constexpr auto kDeclarations = R"(
+declare i8 @__remill_read_memory_8(ptr, i64)
+declare i16 @__remill_read_memory_16(ptr, i64)
+declare i32 @__remill_read_memory_32(ptr, i64)
+declare i64 @__remill_read_memory_64(ptr, i64)
+declare ptr @__remill_write_memory_8(ptr, i64, i8)
+declare ptr @__remill_write_memory_16(ptr, i64, i16)
+declare ptr @__remill_write_memory_32(ptr, i64, i32)
+declare ptr @__remill_write_memory_64(ptr, i64, i64)
+declare ptr @__remill_function_return(ptr, i64, ptr)
+declare ptr @__remill_jump(ptr, i64, ptr)
+declare void @escape(i64)
+)";
+
+// Writes the slot at `RSP - 8`, then reads it back along with the slot at
+// `RSP - 16`, which must come from memory.
+static constexpr auto kWriteThenRead = R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rsp = getelementptr inbounds i8, ptr %state, i64 {RSP}
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  %sp = load i64, ptr %rsp
+  %slot8 = sub i64 %sp, 8
+  %slot16 = sub i64 %sp, 16
+  %m1 = call ptr @__remill_write_memory_64(ptr %memory, i64 %slot8, i64 1)
+  %a = call i64 @__remill_read_memory_64(ptr %m1, i64 %slot8)
+  %b = call i64 @__remill_read_memory_64(ptr %m1, i64 %slot16)
+  store i64 %a, ptr %rax
+  store i64 %b, ptr %rbx
+)";
+
+class StackFrameRecovererTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+  }
+
+  // Parse `ir` and recover the stack frame of its trace. Returns the trace.
+  llvm::Function *Recover(const std::string &ir, size_t expected_recovered) {
+    module = Parse(std::string(kDeclarations) + ir);
+    auto trace = module->getFunction("trace");
+    EXPECT_EQ(remill::RecoverStackFrames(arch.get(), module.get(), {trace}),
+              expected_recovered);
+    EXPECT_TRUE(remill::VerifyFunction(trace));
+    return trace;
+  }
+
+  // Returns the offset of `addr` from the stack pointer on entry, if `addr`
+  // is the stack pointer plus or minus constants.
+  std::optional<int64_t> StackOffset(llvm::Function *func, llvm::Value *addr) {
+    int64_t offset = 0;
+    for (;;) {
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(addr)) {
+        if (test::StateOffset(func, load->getPointerOperand()) ==
+            arch->RegisterByName("RSP")->offset) {
+          return offset;
+        }
+        return std::nullopt;
+      }
+
+      auto bin = llvm::dyn_cast<llvm::BinaryOperator>(addr);
+      auto ci = bin ? llvm::dyn_cast<llvm::ConstantInt>(bin->getOperand(1))
+                    : nullptr;
+      if (!ci) {
+        return std::nullopt;
+      } else if (bin->getOpcode() == llvm::Instruction::Add) {
+        offset += ci->getSExtValue();
+      } else if (bin->getOpcode() == llvm::Instruction::Sub) {
+        offset -= ci->getSExtValue();
+      } else {
+        return std::nullopt;
+      }
+      addr = bin->getOperand(0);
+    }
+  }
+
+  // Returns the offsets from the stack pointer on entry of the calls to the
+  // memory intrinsic `name` in `func`, in program order.
+  std::vector<int64_t> Accesses(llvm::Function *func, std::string_view name) {
+    std::vector<int64_t> offsets;
+    for (auto call : test::CallsTo(func, name)) {
+      offsets.push_back(
+          StackOffset(func, call->getArgOperand(1)).value_or(INT64_MAX));
+    }
+    return offsets;
+  }
+
+  // Returns the constant that `func` stores into the register `name`, or
+  // `nullopt` if it doesn't store a constant into it.
+  std::optional<uint64_t> StoredConstant(llvm::Function *func,
+                                         std::string_view name) {
+    auto stores = test::StateStores(func, arch->RegisterByName(name)->offset);
+    if (stores.size() != 1u) {
+      return std::nullopt;
+    }
+    auto val = llvm::dyn_cast<llvm::ConstantInt>(stores[0]->getValueOperand());
+    if (!val) {
+      return std::nullopt;
+    }
+    return val->getZExtValue();
+  }
+
+  static bool HasFrame(llvm::Function *func) {
+    for (auto &inst : llvm::instructions(func)) {
+      if (llvm::isa<llvm::AllocaInst>(&inst) &&
+          inst.getName().startswith("STACK_FRAME")) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::unique_ptr<llvm::Module> module;
+};
+
+// Only the slot that is read before it's written is read from memory on
+// entry. Below the stack pointer, the frame is dead after a function return.
+TEST_F(StackFrameRecovererTest, EntryReadOfSlotsReadBeforeWritten) {
+  auto trace = Recover(std::string(kWriteThenRead) + R"(
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %m1)
+  ret ptr %ret
+}
+)",
+                       1u);
+
+  EXPECT_EQ(Accesses(trace, "__remill_read_memory_64"),
+            std::vector<int64_t>({-16}));
+  EXPECT_TRUE(Accesses(trace, "__remill_write_memory_64").empty());
+  EXPECT_EQ(StoredConstant(trace, "RAX"), 1u);
+
+  auto reads = test::CallsTo(trace, "__remill_read_memory_64");
+  ASSERT_EQ(reads.size(), 1u);
+  EXPECT_EQ(reads[0]->getParent(), &trace->getEntryBlock());
+  EXPECT_EQ(reads[0]->getArgOperand(0), trace->getArg(2));
+  auto rbx_stores =
+      test::StateStores(trace, arch->RegisterByName("RBX")->offset);
+  ASSERT_EQ(rbx_stores.size(), 1u);
+  EXPECT_EQ(rbx_stores[0]->getValueOperand(), reads[0]);
+}
+
+// At a function return, the part of the frame at or above the stack pointer
+// on exit is still live, and is written back.
+TEST_F(StackFrameRecovererTest, WriteBackAboveStackPointerAtReturn) {
+  auto trace = Recover(R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rsp = getelementptr inbounds i8, ptr %state, i64 {RSP}
+  %sp = load i64, ptr %rsp
+  %slot8 = sub i64 %sp, 8
+  %slot16 = sub i64 %sp, 16
+  %m1 = call ptr @__remill_write_memory_64(ptr %memory, i64 %slot8, i64 1)
+  %m2 = call ptr @__remill_write_memory_64(ptr %m1, i64 %slot16, i64 2)
+  store i64 %slot8, ptr %rsp
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %m2)
+  ret ptr %ret
+}
+)",
+                       1u);
+
+  EXPECT_TRUE(Accesses(trace, "__remill_read_memory_64").empty());
+  EXPECT_EQ(Accesses(trace, "__remill_write_memory_64"),
+            std::vector<int64_t>({-8}));
+
+  auto writes = test::CallsTo(trace, "__remill_write_memory_64");
+  ASSERT_EQ(writes.size(), 1u);
+  auto val = llvm::dyn_cast<llvm::ConstantInt>(writes[0]->getArgOperand(2));
+  ASSERT_NE(val, nullptr);
+  EXPECT_EQ(val->getZExtValue(), 1u);
+
+  auto rets = test::CallsTo(trace, "__remill_function_return");
+  ASSERT_EQ(rets.size(), 1u);
+  EXPECT_EQ(rets[0]->getArgOperand(2), writes[0]);
+}
+
+// Whatever comes after a jump may read the frame, so all of it is written
+// back.
+TEST_F(StackFrameRecovererTest, WriteBackAtJump) {
+  auto trace = Recover(std::string(kWriteThenRead) + R"(
+  %ret = tail call ptr @__remill_jump(ptr %state, i64 %pc, ptr %m1)
+  ret ptr %ret
+}
+)",
+                       1u);
+
+  EXPECT_EQ(Accesses(trace, "__remill_read_memory_64"),
+            std::vector<int64_t>({-16}));
+  EXPECT_EQ(Accesses(trace, "__remill_write_memory_64"),
+            std::vector<int64_t>({-16, -8}));
+
+  auto writes = test::CallsTo(trace, "__remill_write_memory_64");
+  auto jumps = test::CallsTo(trace, "__remill_jump");
+  ASSERT_EQ(writes.size(), 2u);
+  ASSERT_EQ(jumps.size(), 1u);
+  EXPECT_EQ(jumps[0]->getArgOperand(2), writes[1]);
+}
+
+// The same goes for returning the `Memory *` without leaving the trace
+// through a call.
+TEST_F(StackFrameRecovererTest, WriteBackAtRet) {
+  auto trace = Recover(std::string(kWriteThenRead) + R"(
+  ret ptr %m1
+}
+)",
+                       1u);
+
+  EXPECT_EQ(Accesses(trace, "__remill_write_memory_64"),
+            std::vector<int64_t>({-16, -8}));
+
+  auto writes = test::CallsTo(trace, "__remill_write_memory_64");
+  ASSERT_EQ(writes.size(), 2u);
+  auto ret = llvm::dyn_cast<llvm::ReturnInst>(trace->back().getTerminator());
+  ASSERT_NE(ret, nullptr);
+  EXPECT_EQ(ret->getReturnValue(), writes[1]);
+}
+
+// The frame can't be moved if anything other than a memory intrinsic sees the
+// address of one of its slots.
+TEST_F(StackFrameRecovererTest, EscapedFrameIsLeftInMemory) {
+  auto trace = Recover(R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rsp = getelementptr inbounds i8, ptr %state, i64 {RSP}
+  %sp = load i64, ptr %rsp
+  %slot8 = sub i64 %sp, 8
+  %m1 = call ptr @__remill_write_memory_64(ptr %memory, i64 %slot8, i64 1)
+  call void @escape(i64 %slot8)
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %m1)
+  ret ptr %ret
+}
+)",
+                       0u);
+
+  EXPECT_FALSE(HasFrame(trace));
+  EXPECT_EQ(Accesses(trace, "__remill_write_memory_64"),
+            std::vector<int64_t>({-8}));
+}
+
+// An access that covers bytes both below and above the stack pointer on entry
+// isn't entirely in the frame.
+TEST_F(StackFrameRecovererTest, StraddlingAccessIsLeftInMemory) {
+  auto trace = Recover(R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rsp = getelementptr inbounds i8, ptr %state, i64 {RSP}
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  %sp = load i64, ptr %rsp
+  %slot8 = sub i64 %sp, 8
+  %slot4 = sub i64 %sp, 4
+  %m1 = call ptr @__remill_write_memory_64(ptr %memory, i64 %slot8, i64 1)
+  %a = call i64 @__remill_read_memory_64(ptr %m1, i64 %slot4)
+  store i64 %a, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %m1)
+  ret ptr %ret
+}
+)",
+                       0u);
+
+  EXPECT_FALSE(HasFrame(trace));
+  EXPECT_EQ(Accesses(trace, "__remill_write_memory_64"),
+            std::vector<int64_t>({-8}));
+  EXPECT_EQ(Accesses(trace, "__remill_read_memory_64"),
+            std::vector<int64_t>({-4}));
+}
+
+}  // namespace
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+static constexpr auto kDeclarations = R"(
+declare ptr @__remill_function_return(ptr, i64, ptr)
+declare ptr @__remill_jump(ptr, i64, ptr)
+declare ptr @__remill_sync_hyper_call(ptr, ptr, i32)
+)";
+
+class StateScalarizerTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+  }
+
+  uint64_t Offset(std::string_view name) {
+    return arch->RegisterByName(name)->offset;
+  }
+
+  // Returns the values spilled into the register `name` by the stores that
+  // precede `call` in its block.
+  std::vector<llvm::Value *> SpilledBefore(llvm::CallBase *call,
+                                           std::string_view name) {
+    std::vector<llvm::Value *> values;
+    auto func = call->getFunction();
+    for (auto &inst : *call->getParent()) {
+      if (&inst == call) {
+        break;
+      }
+      if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+          store && test::StateOffset(func, store->getPointerOperand()) ==
+                       Offset(name)) {
+        values.push_back(store->getValueOperand());
+      }
+    }
+    return values;
+  }
+};
+
+static bool IsConstant(llvm::Value *val, uint64_t expected) {
+  auto ci = llvm::dyn_cast<llvm::ConstantInt>(val);
+  return ci && ci->getZExtValue() == expected;
+}
+
+// The last value written into `RAX` is spilled right before the trace
+// tail-calls out, and the overwritten value never reaches `State`.
+TEST_F(StateScalarizerTest, SpillsBeforeExitTailCall) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  store i64 2, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  ASSERT_EQ(remill::ScalarizeState(arch.get(), module.get(), {trace}), 1u);
+  EXPECT_TRUE(remill::VerifyFunction(trace));
+
+  auto calls = test::CallsTo(trace, "__remill_function_return");
+  ASSERT_EQ(calls.size(), 1u);
+  auto spills = SpilledBefore(calls[0], "RAX");
+  ASSERT_EQ(spills.size(), 1u);
+  EXPECT_TRUE(IsConstant(spills[0], 2));
+}
+
+// Each exit spills the value that reaches it.
+TEST_F(StateScalarizerTest, SpillsBeforeEveryExit) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+entry:
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  %cond = icmp eq i64 %pc, 0
+  br i1 %cond, label %left, label %right
+
+left:
+  store i64 2, ptr %rax
+  %ret_left = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret_left
+
+right:
+  %ret_right = tail call ptr @__remill_jump(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret_right
+}
+)");
+  auto trace = module->getFunction("trace");
+  ASSERT_EQ(remill::ScalarizeState(arch.get(), module.get(), {trace}), 1u);
+  EXPECT_TRUE(remill::VerifyFunction(trace));
+
+  auto returns = test::CallsTo(trace, "__remill_function_return");
+  ASSERT_EQ(returns.size(), 1u);
+  auto left_spills = SpilledBefore(returns[0], "RAX");
+  ASSERT_EQ(left_spills.size(), 1u);
+  EXPECT_TRUE(IsConstant(left_spills[0], 2));
+
+  auto jumps = test::CallsTo(trace, "__remill_jump");
+  ASSERT_EQ(jumps.size(), 1u);
+  auto right_spills = SpilledBefore(jumps[0], "RAX");
+  ASSERT_EQ(right_spills.size(), 1u);
+  EXPECT_TRUE(IsConstant(right_spills[0], 1));
+}
+
+// Registers that are only read are reloaded, but never spilled.
+TEST_F(StateScalarizerTest, ReadOnlyRegistersAreNotSpilled) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  %val = load i64, ptr %rbx
+  %inc = add i64 %val, 1
+  store i64 %inc, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  ASSERT_EQ(remill::ScalarizeState(arch.get(), module.get(), {trace}), 1u);
+  EXPECT_TRUE(remill::VerifyFunction(trace));
+
+  EXPECT_TRUE(test::StateStores(trace, Offset("RBX")).empty());
+
+  auto calls = test::CallsTo(trace, "__remill_function_return");
+  ASSERT_EQ(calls.size(), 1u);
+  EXPECT_EQ(SpilledBefore(calls[0], "RAX").size(), 1u);
+}
+
+// A hyper call sees the spilled registers, and whatever it writes is
+// reloaded after it.
+TEST_F(StateScalarizerTest, SpillsAndReloadsAroundHyperCall) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  %rbx = getelementptr inbounds i8, ptr %state, i64 {RBX}
+  store i64 1, ptr %rax
+  %mem = call ptr @__remill_sync_hyper_call(ptr %state, ptr %memory, i32 0)
+  %val = load i64, ptr %rax
+  store i64 %val, ptr %rbx
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %mem)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  ASSERT_EQ(remill::ScalarizeState(arch.get(), module.get(), {trace}), 1u);
+  EXPECT_TRUE(remill::VerifyFunction(trace));
+
+  auto hyper_calls = test::CallsTo(trace, "__remill_sync_hyper_call");
+  ASSERT_EQ(hyper_calls.size(), 1u);
+  auto spills = SpilledBefore(hyper_calls[0], "RAX");
+  ASSERT_EQ(spills.size(), 1u);
+  EXPECT_TRUE(IsConstant(spills[0], 1));
+
+  // `RBX` gets the value of `RAX` as reloaded after the hyper call, not the
+  // constant stored before it.
+  auto returns = test::CallsTo(trace, "__remill_function_return");
+  ASSERT_EQ(returns.size(), 1u);
+  auto rbx_spills = SpilledBefore(returns[0], "RBX");
+  ASSERT_EQ(rbx_spills.size(), 1u);
+  auto reload = llvm::dyn_cast<llvm::LoadInst>(rbx_spills[0]);
+  ASSERT_TRUE(reload != nullptr);
+  EXPECT_EQ(test::StateOffset(trace, reload->getPointerOperand()),
+            Offset("RAX"));
+  EXPECT_TRUE(hyper_calls[0]->comesBefore(reload));
+}
+
+// A `State` pointer that escapes leaves the trace untouched.
+TEST_F(StateScalarizerTest, EscapingStateIsNotScalarized) {
+  auto module = Parse(std::string(kDeclarations) + R"(
+define ptr @trace(ptr %state, i64 %pc, ptr %memory) {
+  %slot = alloca ptr
+  store ptr %state, ptr %slot
+  %rax = getelementptr inbounds i8, ptr %state, i64 {RAX}
+  store i64 1, ptr %rax
+  store i64 2, ptr %rax
+  %ret = tail call ptr @__remill_function_return(ptr %state, i64 %pc, ptr %memory)
+  ret ptr %ret
+}
+)");
+  auto trace = module->getFunction("trace");
+  EXPECT_EQ(remill::ScalarizeState(arch.get(), module.get(), {trace}), 0u);
+  EXPECT_EQ(test::StateStores(trace, Offset("RAX")).size(), 2u);
+}
+
+}  // namespace
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/JSON.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Context.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/Arch/Statistics.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "TestUtil.h"
+
+namespace {
+
+// Parse the JSON export of `stats`.
+static llvm::json::Value ParseJSON(const remill::LiftingStatistics &stats) {
+  auto parsed = llvm::json::parse(stats.ToJSON());
+  EXPECT_TRUE(static_cast<bool>(parsed));
+  if (!parsed) {
+    llvm::consumeError(parsed.takeError());
+    return llvm::json::Object();
+  }
+  return std::move(*parsed);
+}
+
+// Returns the integer at `path` of nested objects in `val`, or `-1` if there
+// is none.
+static int64_t GetInteger(const llvm::json::Value &val,
+                          std::initializer_list<llvm::StringRef> path) {
+  auto obj = val.getAsObject();
+  auto last = path.end() - 1;
+  for (auto it = path.begin(); obj && it != last; ++it) {
+    obj = obj->getObject(*it);
+  }
+  if (!obj) {
+    return -1;
+  }
+  if (auto num = obj->getInteger(*last)) {
+    return *num;
+  }
+  return -1;
+}
+
+// Counts of decodes, lifts by status and ISEL, and equality claims are all
+// exported as JSON.
+TEST(LiftingStatisticsTest, JSONExport) {
+  remill::LiftingStatistics stats;
+  const auto start = remill::LiftingStatistics::Clock::now();
+  stats.RecordDecode(true, start);
+  stats.RecordDecode(true, start);
+  stats.RecordDecode(false, start);
+  stats.RecordLift("ADD_GPRv_IMMz_32", remill::kLiftedInstruction, start);
+  stats.RecordLift("ADD_GPRv_IMMz_32", remill::kLiftedInstruction, start);
+  stats.RecordLift("FOO", remill::kLiftedUnsupportedInstruction, start);
+  stats.RecordEqualityClaim();
+
+  const auto json = ParseJSON(stats);
+  EXPECT_EQ(GetInteger(json, {"decode", "decoded"}), 2);
+  EXPECT_EQ(GetInteger(json, {"decode", "failed"}), 1);
+  EXPECT_EQ(GetInteger(json, {"decode", "latency", "count"}), 3);
+  EXPECT_EQ(GetInteger(json, {"lift", "lifted"}), 2);
+  EXPECT_EQ(GetInteger(json, {"lift", "unsupported"}), 1);
+  EXPECT_EQ(GetInteger(json, {"lift", "invalid"}), 0);
+  EXPECT_EQ(GetInteger(json, {"lift", "latency", "count"}), 3);
+  EXPECT_EQ(GetInteger(json, {"equality_claims"}), 1);
+  EXPECT_EQ(GetInteger(json, {"isels", "ADD_GPRv_IMMz_32", "lifted"}), 2);
+  EXPECT_EQ(GetInteger(json, {"isels", "FOO", "unsupported"}), 1);
+
+  // Only the statuses that an ISEL had are exported for it.
+  EXPECT_EQ(GetInteger(json, {"isels", "FOO", "lifted"}), -1);
+
+  // Percentiles are upper bounds on the latencies, so they can't be below
+  // the average.
+  auto latency =
+      json.getAsObject()->getObject("lift")->getObject("latency");
+  ASSERT_NE(latency, nullptr);
+  const auto sum = latency->getNumber("sum_seconds");
+  const auto p99 = latency->getNumber("p99");
+  ASSERT_TRUE(sum && p99);
+  EXPECT_GE(*p99 * 3, *sum);
+
+  stats.Reset();
+  const auto reset_json = ParseJSON(stats);
+  EXPECT_EQ(GetInteger(reset_json, {"decode", "decoded"}), 0);
+  EXPECT_EQ(GetInteger(reset_json, {"lift", "lifted"}), 0);
+  EXPECT_EQ(GetInteger(reset_json, {"lift", "latency", "count"}), 0);
+  EXPECT_EQ(GetInteger(reset_json, {"isels", "FOO", "unsupported"}), -1);
+}
+
+// The Prometheus export has a typed metric family for every counter, with
+// one sample per label value.
+TEST(LiftingStatisticsTest, PrometheusExport) {
+  remill::LiftingStatistics stats;
+  const auto start = remill::LiftingStatistics::Clock::now();
+  stats.RecordDecode(true, start);
+  stats.RecordDecode(false, start);
+  stats.RecordLift("FOO", remill::kLiftedLifterError, start);
+  stats.RecordEqualityClaim();
+  stats.RecordEqualityClaim();
+
+  const auto text = stats.ToPrometheus("test");
+  auto has_line = [&text](std::string_view line) {
+    return text.find(std::string(line) + "\n") != std::string::npos;
+  };
+
+  EXPECT_TRUE(has_line("# TYPE test_decoded_instructions_total counter"));
+  EXPECT_TRUE(
+      has_line("test_decoded_instructions_total{result=\"decoded\"} 1"));
+  EXPECT_TRUE(
+      has_line("test_decoded_instructions_total{result=\"failed\"} 1"));
+  EXPECT_TRUE(has_line("# TYPE test_decode_latency_seconds summary"));
+  EXPECT_TRUE(has_line("test_decode_latency_seconds_count 2"));
+  EXPECT_TRUE(
+      has_line("test_lifted_instructions_total{status=\"lifter_error\"} 1"));
+  EXPECT_TRUE(has_line("test_lifted_instructions_total{status=\"lifted\"} 0"));
+  EXPECT_TRUE(has_line("test_lift_latency_seconds_count 1"));
+  EXPECT_TRUE(has_line("test_equality_claims_total 2"));
+  EXPECT_TRUE(has_line(
+      "test_isel_lifts_total{isel=\"FOO\",status=\"lifter_error\"} 1"));
+  EXPECT_EQ(text.find("test_isel_lifts_total{isel=\"FOO\",status=\"lifted\"}"),
+            std::string::npos);
+
+  // Every sample belongs to a metric family declared before it.
+  EXPECT_EQ(text.rfind("# TYPE ", 0), 0u);
+  EXPECT_EQ(stats.ToPrometheus().find("# TYPE remill_"), 0u);
+}
+
+class ArchStatisticsTest : public test::LiftedCodeTest {};
+
+// Decoders and lifters record into the statistics attached to their `Arch`.
+TEST_F(ArchStatisticsTest, RecordsDecodeAndLift) {
+  BuildArch(remill::kArchAMD64);
+  auto stats = std::make_shared<remill::LiftingStatistics>();
+  arch->SetStatistics(stats);
+
+  // mov eax, 1
+  const std::string_view mov_eax("\xb8\x01\x00\x00\x00", 5);
+  remill::Instruction inst;
+  ASSERT_TRUE(arch->DecodeInstruction(0x1000, mov_eax, inst,
+                                      arch->CreateInitialContext()));
+
+  remill::Instruction truncated;
+  EXPECT_FALSE(arch->DecodeInstruction(0x1000, mov_eax.substr(0, 2), truncated,
+                                       arch->CreateInitialContext()));
+
+  remill::IntrinsicTable intrinsics(semantics.get());
+  auto func = arch->DefineLiftedFunction("sub_1000", semantics.get());
+  ASSERT_EQ(inst.GetLifter()->LiftIntoBlock(inst, &(func->getEntryBlock())),
+            remill::kLiftedInstruction);
+
+  const auto json = ParseJSON(*stats);
+  EXPECT_EQ(GetInteger(json, {"decode", "decoded"}), 1);
+  EXPECT_EQ(GetInteger(json, {"decode", "failed"}), 1);
+  EXPECT_EQ(GetInteger(json, {"lift", "lifted"}), 1);
+  EXPECT_EQ(GetInteger(json, {"isels", inst.function, "lifted"}), 1);
+
+  // Detaching the statistics stops recording.
+  arch->SetStatistics(nullptr);
+  remill::Instruction again;
+  ASSERT_TRUE(arch->DecodeInstruction(0x1000, mov_eax, again,
+                                      arch->CreateInitialContext()));
+  EXPECT_EQ(GetInteger(ParseJSON(*stats), {"decode", "decoded"}), 1);
+}
+
+}  // namespace
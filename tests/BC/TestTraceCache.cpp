@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Type.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Context.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/TraceCache.h>
+#include <remill/BC/TraceLifter.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+// mov eax, 1
+static constexpr std::string_view kMovEax("\xb8\x01\x00\x00\x00", 5);
+
+// Address of the lifted trace.
+static constexpr uint64_t kTraceAddr = 0x1000;
+
+class MemoryTraceManager : public remill::TraceManager {
+ public:
+  virtual ~MemoryTraceManager(void) = default;
+
+  void SetLiftedTraceDefinition(uint64_t, llvm::Function *) override {}
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto byte_it = memory.find(addr);
+    if (byte_it != memory.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ public:
+  std::unordered_map<uint64_t, uint8_t> memory;
+};
+
+class TraceCacheTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+
+    std::random_device rd;
+    std::stringstream ss;
+    ss << "remill-trace-cache-test." << std::hex << rd() << rd();
+    cache_dir = std::filesystem::temp_directory_path() / ss.str();
+
+    // The caches hash this module instead of the semantics, so that lifting
+    // into the semantics doesn't change the keys from one cache to the next.
+    hashed_semantics = std::make_unique<llvm::Module>("semantics", context);
+
+    // Put a copy of `kMovEax` every 16 bytes.
+    for (uint64_t addr = kTraceAddr; addr < kTraceAddr + 0x100u; addr += 16u) {
+      for (uint64_t i = 0; i < kMovEax.size(); ++i) {
+        manager.memory[addr + i] = static_cast<uint8_t>(kMovEax[i]);
+      }
+    }
+  }
+
+  void TearDown(void) override {
+    std::error_code ec;
+    std::filesystem::remove_all(cache_dir, ec);
+  }
+
+  std::unique_ptr<remill::TraceCache> MakeCache(uint64_t max_size_bytes = 0) {
+    return std::make_unique<remill::TraceCache>(
+        arch.get(), hashed_semantics.get(), cache_dir, max_size_bytes);
+  }
+
+  // Lift `kMovEax` into a new trace named `name` that then returns.
+  llvm::Function *LiftTrace(const std::string &name) {
+    remill::IntrinsicTable intrinsics(semantics.get());
+    auto func = arch->DefineLiftedFunction(name, semantics.get());
+    auto block = &(func->getEntryBlock());
+    remill::Instruction inst;
+    EXPECT_TRUE(arch->DecodeInstruction(kTraceAddr, kMovEax, inst,
+                                        arch->CreateInitialContext()));
+    EXPECT_EQ(inst.GetLifter()->LiftIntoBlock(inst, block),
+              remill::kLiftedInstruction);
+    remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                   intrinsics);
+    return func;
+  }
+
+  // Store `func` as the trace of the copy of `kMovEax` at `addr`.
+  bool Store(remill::TraceCache &cache, llvm::Function *func,
+             uint64_t addr = kTraceAddr) {
+    const std::map<uint64_t, std::string> trace_bytes = {
+        {addr, std::string(kMovEax)}};
+    return cache.Store(addr, arch->CreateInitialContext(), trace_bytes, func,
+                       {});
+  }
+
+  llvm::Function *Load(remill::TraceCache &cache, llvm::Module *module,
+                       uint64_t addr = kTraceAddr) {
+    std::vector<uint64_t> called_traces;
+    return cache.Load(addr, arch->CreateInitialContext(), manager, module,
+                      manager.TraceName(addr), called_traces);
+  }
+
+  // Returns the paths and total size of the entries in the cache directory.
+  std::vector<std::filesystem::path> Entries(uint64_t *total_size = nullptr) {
+    std::vector<std::filesystem::path> entries;
+    uint64_t size = 0;
+    for (auto &entry :
+         std::filesystem::recursive_directory_iterator(cache_dir)) {
+      if (entry.is_regular_file() && entry.path().extension() == ".trace") {
+        entries.push_back(entry.path());
+        size += entry.file_size();
+      }
+    }
+    if (total_size) {
+      *total_size = size;
+    }
+    return entries;
+  }
+
+  std::filesystem::path cache_dir;
+  std::unique_ptr<llvm::Module> hashed_semantics;
+  MemoryTraceManager manager;
+};
+
+// An entry written by one cache is found by another cache over the same
+// semantics, and is materialized without any of the semantics.
+TEST_F(TraceCacheTest, HitAcrossCaches) {
+  auto func = LiftTrace("sub_1000");
+  ASSERT_TRUE(Store(*MakeCache(), func));
+
+  auto cache = MakeCache();
+  llvm::Module dest("dest", context);
+  arch->PrepareModuleDataLayout(&dest);
+  auto loaded = Load(*cache, &dest);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->getParent(), &dest);
+  EXPECT_EQ(loaded->getName(), "sub_1000");
+  EXPECT_FALSE(loaded->isDeclaration());
+  EXPECT_TRUE(remill::VerifyModule(&dest));
+
+  const auto stats = cache->Statistics();
+  EXPECT_EQ(stats.num_lookups, 1u);
+  EXPECT_EQ(stats.num_hits, 1u);
+  EXPECT_EQ(stats.num_misses, 0u);
+  EXPECT_EQ(stats.num_stale, 0u);
+}
+
+// Changing the semantics changes every key, so old entries are never found.
+TEST_F(TraceCacheTest, StaleSemanticsMiss) {
+  auto func = LiftTrace("sub_1000");
+  ASSERT_TRUE(Store(*MakeCache(), func));
+
+  auto i8_type = llvm::Type::getInt8Ty(context);
+  new llvm::GlobalVariable(*hashed_semantics, i8_type, true,
+                           llvm::GlobalValue::ExternalLinkage,
+                           llvm::ConstantInt::get(i8_type, 0), "changed");
+
+  auto cache = MakeCache();
+  llvm::Module dest("dest", context);
+  EXPECT_EQ(Load(*cache, &dest), nullptr);
+
+  const auto stats = cache->Statistics();
+  EXPECT_EQ(stats.num_hits, 0u);
+  EXPECT_EQ(stats.num_misses, 1u);
+}
+
+// Changing the bytes of the trace makes its entry stale.
+TEST_F(TraceCacheTest, StaleBytesMiss) {
+  auto func = LiftTrace("sub_1000");
+  auto cache = MakeCache();
+  ASSERT_TRUE(Store(*cache, func));
+
+  manager.memory[kTraceAddr + 1] = 2;
+  llvm::Module dest("dest", context);
+  EXPECT_EQ(Load(*cache, &dest), nullptr);
+
+  const auto stats = cache->Statistics();
+  EXPECT_EQ(stats.num_hits, 0u);
+  EXPECT_EQ(stats.num_stale, 1u);
+}
+
+// Truncated entries, whether in their header or in their bitcode, are
+// ignored, and can be replaced by storing the trace again.
+TEST_F(TraceCacheTest, TruncatedEntryMiss) {
+  auto func = LiftTrace("sub_1000");
+  auto cache = MakeCache();
+
+  for (auto keep_size : {10u, 0u}) {
+    ASSERT_TRUE(Store(*cache, func));
+    const auto entries = Entries();
+    ASSERT_EQ(entries.size(), 1u);
+
+    const auto size = std::filesystem::file_size(entries[0]);
+    std::filesystem::resize_file(entries[0], keep_size ? keep_size : size - 16);
+
+    llvm::Module dest("dest", context);
+    EXPECT_EQ(Load(*cache, &dest), nullptr) << "Kept " << keep_size;
+  }
+
+  const auto stats = cache->Statistics();
+  EXPECT_EQ(stats.num_hits, 0u);
+  EXPECT_EQ(stats.num_misses, 2u);
+
+  ASSERT_TRUE(Store(*cache, func));
+  llvm::Module dest("dest", context);
+  EXPECT_NE(Load(*cache, &dest), nullptr);
+}
+
+// Storing a trace again replaces its entry without counting it twice.
+TEST_F(TraceCacheTest, OverwriteIsCountedOnce) {
+  auto func = LiftTrace("sub_1000");
+  auto cache = MakeCache();
+  ASSERT_TRUE(Store(*cache, func));
+  ASSERT_TRUE(Store(*cache, func));
+
+  uint64_t disk_size = 0;
+  EXPECT_EQ(Entries(&disk_size).size(), 1u);
+  EXPECT_EQ(cache->Statistics().num_bytes_on_disk, disk_size);
+}
+
+// Once the cache grows beyond its maximum size, the least recently used
+// entries are evicted, and the most recently used ones are kept.
+TEST_F(TraceCacheTest, EvictionUnderMaxSize) {
+  auto func = LiftTrace("sub_1000");
+
+  uint64_t entry_size = 0;
+  ASSERT_TRUE(Store(*MakeCache(), func));
+  ASSERT_EQ(Entries(&entry_size).size(), 1u);
+  std::filesystem::remove_all(cache_dir);
+
+  const auto max_size = entry_size * 4u + entry_size / 2u;
+  auto cache = MakeCache(max_size);
+  for (uint64_t i = 0; i < 8u; ++i) {
+    ASSERT_TRUE(Store(*cache, func, kTraceAddr + i * 16u));
+  }
+
+  uint64_t disk_size = 0;
+  const auto entries = Entries(&disk_size);
+  const auto stats = cache->Statistics();
+  EXPECT_GT(stats.num_evictions, 0u);
+  EXPECT_EQ(stats.num_bytes_on_disk, disk_size);
+  EXPECT_LE(disk_size, max_size);
+  EXPECT_EQ(entries.size() + stats.num_evictions, 8u);
+
+  // The first entry stored is gone, and the last one is still there.
+  llvm::Module dest("dest", context);
+  EXPECT_EQ(Load(*cache, &dest, kTraceAddr), nullptr);
+  EXPECT_NE(Load(*cache, &dest, kTraceAddr + 7u * 16u), nullptr);
+}
+
+}  // namespace
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Context.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/InstructionLifter.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/TraceChunkWriter.h>
+#include <remill/BC/Util.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+// mov eax, 1
+static constexpr std::string_view kMovEax("\xb8\x01\x00\x00\x00", 5);
+
+class TraceChunkWriterTest : public test::LiftedCodeTest {
+ protected:
+  void SetUp(void) override {
+    BuildArch(remill::kArchAMD64);
+
+    std::random_device rd;
+    std::stringstream ss;
+    ss << "remill-trace-chunk-test." << std::hex << rd() << rd();
+    out_dir = std::filesystem::temp_directory_path() / ss.str();
+  }
+
+  void TearDown(void) override {
+    std::error_code ec;
+    std::filesystem::remove_all(out_dir, ec);
+  }
+
+  // Lift `kMovEax` at `addr` into a new trace named `name` that then returns.
+  llvm::Function *LiftTrace(uint64_t addr, const std::string &name) {
+    remill::IntrinsicTable intrinsics(semantics.get());
+    auto func = arch->DefineLiftedFunction(name, semantics.get());
+    auto block = &(func->getEntryBlock());
+    remill::Instruction inst;
+    EXPECT_TRUE(arch->DecodeInstruction(addr, kMovEax, inst,
+                                        arch->CreateInitialContext()));
+    EXPECT_EQ(inst.GetLifter()->LiftIntoBlock(inst, block),
+              remill::kLiftedInstruction);
+    remill::AddTerminatingTailCall(block, intrinsics.function_return,
+                                   intrinsics);
+    return func;
+  }
+
+  // Returns the lines of the chunk index.
+  std::vector<std::string> IndexLines(void) {
+    std::vector<std::string> lines;
+    std::ifstream index(out_dir / "index.txt");
+    for (std::string line; std::getline(index, line);) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  std::filesystem::path out_dir;
+};
+
+// Traces are written `traces_per_chunk` at a time to `chunk_N.bc`, and the
+// last, partial chunk is written upon `Flush`.
+TEST_F(TraceChunkWriterTest, ChunksAndIndex) {
+  remill::TraceChunkWriter writer(arch.get(), out_dir, 2);
+  const std::vector<uint64_t> addrs = {0x1000, 0x1010, 0x1020};
+  for (auto addr : addrs) {
+    std::stringstream ss;
+    ss << "sub_" << std::hex << addr;
+    auto func = LiftTrace(addr, ss.str());
+    ASSERT_TRUE(writer.AddTrace(addr, func));
+
+    // The lifting module keeps a declaration of each moved trace.
+    auto decl = semantics->getFunction(ss.str());
+    ASSERT_NE(decl, nullptr);
+    EXPECT_TRUE(decl->isDeclaration());
+  }
+
+  // The first chunk is only written once the third trace doesn't fit in it.
+  ASSERT_EQ(writer.ChunkPaths().size(), 1u);
+  EXPECT_EQ(writer.ChunkPaths()[0], out_dir / "chunk_0.bc");
+
+  ASSERT_TRUE(writer.Flush());
+  ASSERT_EQ(writer.ChunkPaths().size(), 2u);
+  EXPECT_EQ(writer.ChunkPaths()[1], out_dir / "chunk_1.bc");
+
+  // Flushing an empty chunk writes nothing.
+  ASSERT_TRUE(writer.Flush());
+  EXPECT_EQ(writer.ChunkPaths().size(), 2u);
+
+  const std::vector<std::string> expected_index = {
+      "1000 sub_1000 chunk_0.bc", "1010 sub_1010 chunk_0.bc",
+      "1020 sub_1020 chunk_1.bc"};
+  EXPECT_EQ(IndexLines(), expected_index);
+
+  // Each chunk defines exactly its own traces, and stands on its own.
+  const std::vector<std::vector<std::string>> expected_traces = {
+      {"sub_1000", "sub_1010"}, {"sub_1020"}};
+  for (auto i = 0u; i < expected_traces.size(); ++i) {
+    auto chunk = remill::LoadModuleFromFile(&context, writer.ChunkPaths()[i]);
+    ASSERT_NE(chunk, nullptr);
+    EXPECT_TRUE(remill::VerifyModule(chunk.get()));
+
+    std::vector<std::string> defined;
+    for (auto &func : *chunk) {
+      if (!func.isDeclaration()) {
+        defined.push_back(func.getName().str());
+      }
+    }
+    EXPECT_EQ(defined, expected_traces[i]);
+  }
+}
+
+// Chunks smaller than one trace still hold one trace each.
+TEST_F(TraceChunkWriterTest, ZeroTracesPerChunk) {
+  {
+    remill::TraceChunkWriter writer(arch.get(), out_dir, 0);
+    ASSERT_TRUE(writer.AddTrace(0x1000, LiftTrace(0x1000, "sub_1000")));
+    ASSERT_TRUE(writer.AddTrace(0x1010, LiftTrace(0x1010, "sub_1010")));
+    EXPECT_EQ(writer.ChunkPaths().size(), 1u);
+  }
+
+  // The destructor flushes the last chunk.
+  EXPECT_TRUE(std::filesystem::exists(out_dir / "chunk_1.bc"));
+  const std::vector<std::string> expected_index = {
+      "1000 sub_1000 chunk_0.bc", "1010 sub_1010 chunk_1.bc"};
+  EXPECT_EQ(IndexLines(), expected_index);
+}
+
+}  // namespace
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "TestUtil.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <remill/BC/ABI.h>
+#include <remill/BC/Util.h>
+#include <remill/OS/OS.h>
+
+#include <string>
+
+namespace test {
+
+void LiftedCodeTest::BuildArch(remill::ArchName arch_name) {
+  arch = remill::Arch::Build(&context, remill::kOSLinux, arch_name);
+  ASSERT_TRUE(arch != nullptr);
+  semantics = remill::LoadArchSemantics(arch.get());
+  ASSERT_TRUE(semantics != nullptr);
+}
+
+std::unique_ptr<llvm::Module> LiftedCodeTest::Parse(std::string_view ir) {
+  std::string text;
+  for (size_t i = 0; i < ir.size();) {
+    const auto begin = ir.find('{', i);
+    if (begin == std::string_view::npos) {
+      text.append(ir.substr(i));
+      break;
+    }
+
+    const auto end = ir.find('}', begin);
+    CHECK(end != std::string_view::npos)
+        << "Unterminated register name in: " << ir.substr(begin);
+
+    const auto name = ir.substr(begin + 1, end - begin - 1);
+    const auto reg = arch->RegisterByName(name);
+    CHECK(reg != nullptr) << "Unknown register: " << name;
+
+    text.append(ir.substr(i, begin - i));
+    text.append(std::to_string(reg->offset));
+    i = end + 1;
+  }
+
+  llvm::SMDiagnostic err;
+  auto module = llvm::parseIR(
+      llvm::MemoryBuffer::getMemBuffer(text, "lifted")->getMemBufferRef(),
+      err, context);
+  CHECK(module != nullptr) << "Unable to parse IR: "
+                           << err.getMessage().str() << " in:\n"
+                           << text;
+
+  arch->PrepareModuleDataLayout(module.get());
+  return module;
+}
+
+std::optional<uint64_t> StateOffset(llvm::Function *func, llvm::Value *ptr) {
+  const auto &dl = func->getParent()->getDataLayout();
+  llvm::APInt offset(dl.getIndexTypeSizeInBits(ptr->getType()), 0);
+  auto base = ptr->stripAndAccumulateConstantOffsets(dl, offset, true);
+  if (base != remill::NthArgument(func, remill::kStatePointerArgNum) ||
+      offset.isNegative()) {
+    return std::nullopt;
+  }
+  return offset.getZExtValue();
+}
+
+std::vector<llvm::StoreInst *> StateStores(llvm::Function *func,
+                                           uint64_t offset) {
+  std::vector<llvm::StoreInst *> stores;
+  for (auto &inst : llvm::instructions(func)) {
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+      if (StateOffset(func, store->getPointerOperand()) == offset) {
+        stores.push_back(store);
+      }
+    }
+  }
+  return stores;
+}
+
+std::vector<llvm::CallBase *> CallsTo(llvm::Function *func,
+                                      std::string_view name) {
+  std::vector<llvm::CallBase *> calls;
+  for (auto &inst : llvm::instructions(func)) {
+    if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+      if (auto callee = call->getCalledFunction();
+          callee && callee->getName() == llvm::StringRef(name)) {
+        calls.push_back(call);
+      }
+    }
+  }
+  return calls;
+}
+
+}  // namespace test
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <gtest/gtest.h>
+#include <llvm/IR/LLVMContext.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Name.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace llvm {
+class CallBase;
+class Function;
+class Module;
+class StoreInst;
+class Value;
+}  // namespace llvm
+
+namespace test {
+
+// Fixture for tests of the passes over lifted code. It builds an
+// architecture and loads its semantics, so that the `State` structure is
+// known, and then parses hand-written lifted traces against it.
+class LiftedCodeTest : public ::testing::Test {
+ protected:
+  void BuildArch(remill::ArchName arch_name);
+
+  // Parse the LLVM assembly `ir` into a new module. Each `{NAME}` in `ir` is
+  // replaced with the offset of the register `NAME` in the `State` structure.
+  std::unique_ptr<llvm::Module> Parse(std::string_view ir);
+
+  llvm::LLVMContext context;
+  remill::Arch::ArchPtr arch;
+  std::unique_ptr<llvm::Module> semantics;
+};
+
+// Returns the offset of `ptr` from the `State` pointer of `func`, if `ptr` is
+// the `State` pointer plus a constant.
+std::optional<uint64_t> StateOffset(llvm::Function *func, llvm::Value *ptr);
+
+// Returns the stores in `func` into the `State` structure at `offset`, in
+// program order.
+std::vector<llvm::StoreInst *> StateStores(llvm::Function *func,
+                                           uint64_t offset);
+
+// Returns the calls in `func` to the function named `name`, in program order.
+std::vector<llvm::CallBase *> CallsTo(llvm::Function *func,
+                                      std::string_view name);
+
+}  // namespace test
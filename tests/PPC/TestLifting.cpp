@@ -18,6 +18,7 @@
 #include <llvm/IR/LLVMContext.h>
 #include <remill/Arch/Arch.h>
 #include <remill/Arch/Instruction.h>
+#include <remill/Arch/InstructionEncoding.h>
 #include <remill/Arch/Name.h>
 #include <remill/Arch/PPC/Runtime/State.h>
 #include <remill/BC/Optimizer.h>
@@ -811,3 +812,44 @@ TEST(PPCVLELifts, PPCVLESyscall) {
   TestSpecRunner<PPCState> runner(curr_context);
   runner.RunTestSpec(spec, kVLEContext);
 }
+
+// Decoded instructions survive a trip through their binary encoding
+TEST(PPCVLELifts, PPCInstructionEncoding) {
+  llvm::LLVMContext context;
+  auto arch = remill::Arch::Build(&context, remill::OSName::kOSLinux,
+                                  remill::ArchName::kArchPPC);
+  auto sems = remill::LoadArchSemantics(arch.get());
+
+  // add r5, r4, r3
+  std::string insn_data("\x7C\xA4\x1A\x14", 4);
+  remill::Instruction insn;
+  ASSERT_TRUE(arch->DecodeInstruction(0x12, insn_data, insn, kVLEContext));
+
+  std::string buff;
+  ASSERT_TRUE(remill::EncodedInstruction::Encode(insn, kVLEContext, buff));
+  EXPECT_FALSE(remill::EncodedInstruction::Read(buff.substr(0, 16)));
+  EXPECT_FALSE(
+      remill::EncodedInstruction::Read(buff.substr(0, buff.size() - 1)));
+
+  auto encoded = remill::EncodedInstruction::Read(buff);
+  ASSERT_TRUE(encoded.has_value());
+  EXPECT_EQ(encoded->Size(), buff.size());
+  EXPECT_EQ(encoded->GetPC(), 0x12);
+  EXPECT_EQ(encoded->GetNextPC(), insn.next_pc);
+  EXPECT_EQ(encoded->GetCategory(), insn.category);
+  EXPECT_EQ(encoded->GetBytes(), insn_data);
+  EXPECT_EQ(encoded->GetFunction(), insn.function);
+  EXPECT_TRUE(encoded->GetContext() == kVLEContext);
+
+  llvm::LLVMContext other_context;
+  auto other_arch = remill::Arch::Build(
+      &other_context, remill::OSName::kOSLinux, remill::ArchName::kArchPPC);
+  auto other_sems = remill::LoadArchSemantics(other_arch.get());
+
+  remill::Instruction decoded;
+  ASSERT_TRUE(encoded->Decode(other_arch.get(), decoded));
+  EXPECT_EQ(decoded.Serialize(), insn.Serialize());
+  EXPECT_TRUE(decoded.flows == insn.flows);
+  EXPECT_EQ(decoded.arch, other_arch.get());
+  EXPECT_NE(decoded.GetLifter(), nullptr);
+}
@@ -32,6 +32,7 @@
 #include <remill/BC/ABI.h>
 #include <remill/BC/IntrinsicTable.h>
 #include <remill/BC/Optimizer.h>
+#include <remill/BC/SleighLifter.h>
 #include <remill/BC/Util.h>
 #include <remill/BC/Version.h>
 #include <remill/OS/OS.h>
@@ -725,3 +726,45 @@ TEST(ArmContextTests, ThumbBPLRegressionTest) {
 
   EXPECT_EQ(expect_cond_flow, act_insn.flows);
 }
+
+
+// Counts the Sleigh instruction functions defined in `module`.
+static size_t CountInstructionFunctions(const llvm::Module &module) {
+  size_t num_funcs = 0;
+  for (const auto &func : module) {
+    if (!func.isDeclaration() &&
+        func.getName().startswith(
+            remill::SleighLifter::kInstructionFunctionPrefix)) {
+      ++num_funcs;
+    }
+  }
+  return num_funcs;
+}
+
+TEST(SharedInstructionFunctions, AddressIndependentInstructionsShare) {
+  llvm::LLVMContext context;
+  test_runner::LiftingTester lifter(context, remill::OSName::kOSLinux,
+                                    remill::kArchThumb2LittleEndian);
+
+  // push {r4, lr}
+  std::string insn_data("\x10\xb5", 2);
+  auto first = lifter.LiftInstructionFunction("first", insn_data, 0x1000);
+  auto second = lifter.LiftInstructionFunction("second", insn_data, 0x2000);
+  ASSERT_TRUE(first.has_value());
+  ASSERT_TRUE(second.has_value());
+  EXPECT_EQ(CountInstructionFunctions(*first->first->getParent()), 1u);
+}
+
+TEST(SharedInstructionFunctions, AddressDependentInstructionsDontShare) {
+  llvm::LLVMContext context;
+  test_runner::LiftingTester lifter(context, remill::OSName::kOSLinux,
+                                    remill::kArchThumb2LittleEndian);
+
+  // b #0, i.e. a branch to itself, whose target is relative to `inst_start`.
+  std::string insn_data("\xfe\xe7", 2);
+  auto first = lifter.LiftInstructionFunction("first", insn_data, 0x1000);
+  auto second = lifter.LiftInstructionFunction("second", insn_data, 0x2000);
+  ASSERT_TRUE(first.has_value());
+  ASSERT_TRUE(second.has_value());
+  EXPECT_EQ(CountInstructionFunctions(*first->first->getParent()), 2u);
+}
@@ -899,6 +899,17 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
   lifted_state->x87.fxsave.swd.ue = lifted_state->sw.ue;
   lifted_state->x87.fxsave.swd.pe = lifted_state->sw.pe;
 
+#if defined(REMILL_X87_ROTATING_STACK)
+
+  // The lifted `st` is the physical register file, whereas the native one was
+  // imported in stack order, so put the lifted registers in stack order too.
+  auto lifted_st = lifted_state->st;
+  for (auto i = 0U; i < 8U; ++i) {
+    lifted_state->st.elems[i] =
+        lifted_st.elems[(lifted_state->x87.fxsave.swd.top + i) % 8U];
+  }
+#endif  // defined(REMILL_X87_ROTATING_STACK)
+
   lifted_state->x87.fxsave.swd.flat = 0;
   native_state->x87.fxsave.swd.flat = 0;
 
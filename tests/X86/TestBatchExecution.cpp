@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Name.h>
+#include <remill/Arch/X86/Runtime/State.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+#include <remill/OS/OS.h>
+#include <test_runner/TestRunner.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+static constexpr uint64_t kInsnAddr = 0xdeadbe00;
+
+static constexpr size_t kNumStates = 7;
+
+class BatchExecutionTest : public ::testing::Test {
+ protected:
+  BatchExecutionTest(void)
+      : lifter(context, remill::kOSLinux, remill::kArchX86),
+        pc_reg(lifter.GetArch()->RegisterByName(
+            lifter.GetArch()->ProgramCounterRegisterName())) {}
+
+  // Lift `bytes` into a function of its own, optimized the same way as in
+  // `lift-and-compare`.
+  llvm::Function *Lift(std::string_view bytes) {
+    auto maybe_func = lifter.LiftInstructionFunction(
+        "test_func_" + std::to_string(modules.size()), bytes, kInsnAddr);
+    if (!maybe_func) {
+      return nullptr;
+    }
+
+    auto func = maybe_func->first;
+    auto cloned = llvm::CloneModule(*func->getParent());
+    remill::OptimizeBareModule(cloned);
+    modules.push_back(std::make_unique<llvm::Module>("", context));
+    return test_runner::CopyFunctionIntoNewModule(modules.back().get(), func,
+                                                  cloned);
+  }
+
+  // Produce random initial states in which the segment bases are zero and
+  // the program counter is at the instruction.
+  std::vector<X86State> RandomInitialStates(void) {
+    std::vector<X86State> states(kNumStates);
+    for (auto &state : states) {
+      test_runner::RandomizeState(state, rbe);
+      state.addr.ds_base.dword = 0;
+      state.addr.ss_base.dword = 0;
+      state.addr.es_base.dword = 0;
+      state.addr.cs_base.dword = 0;
+      state.aflag.af = test_runner::random_boolean_flag(rbe);
+      state.aflag.cf = test_runner::random_boolean_flag(rbe);
+      state.aflag.df = test_runner::random_boolean_flag(rbe);
+      state.aflag.of = test_runner::random_boolean_flag(rbe);
+      state.aflag.pf = test_runner::random_boolean_flag(rbe);
+      state.aflag.sf = test_runner::random_boolean_flag(rbe);
+      state.aflag.zf = test_runner::random_boolean_flag(rbe);
+      state.gpr.rip.qword = kInsnAddr;
+    }
+    return states;
+  }
+
+  // Run `func` over `init_states` one state at a time, and then as a single
+  // batch, and check that both produce the same states and memory. Returns
+  // the final states.
+  std::vector<X86State> RunBoth(llvm::Function *func, size_t insn_length,
+                                const std::vector<X86State> &init_states) {
+    std::vector<X86State> single_states = init_states;
+    std::vector<std::unique_ptr<test_runner::MemoryHandler>> single_handlers;
+    for (auto &state : single_states) {
+      single_handlers.push_back(std::make_unique<test_runner::MemoryHandler>(
+          llvm::support::endianness::little));
+      test_runner::ExecuteLiftedFunction<X86State, uint64_t>(
+          func, insn_length, &state, single_handlers.back().get(),
+          [](X86State *st) { return st->gpr.rip.qword; });
+    }
+
+    // Each state of the batch must see the same memory as its single run.
+    std::vector<X86State> batch_states = init_states;
+    std::vector<std::unique_ptr<test_runner::MemoryHandler>> batch_handlers;
+    std::vector<test_runner::MemoryHandler *> handler_ptrs;
+    for (auto &handler : single_handlers) {
+      batch_handlers.push_back(std::make_unique<test_runner::MemoryHandler>(
+          llvm::support::endianness::little,
+          handler->GetUninitializedReads()));
+      handler_ptrs.push_back(batch_handlers.back().get());
+    }
+    test_runner::ExecuteLiftedFunctionBatch(func, pc_reg, batch_states.data(),
+                                            handler_ptrs.data(),
+                                            batch_states.size());
+
+    for (size_t i = 0; i < init_states.size(); ++i) {
+      EXPECT_EQ(std::memcmp(&single_states[i], &batch_states[i],
+                            sizeof(X86State)),
+                0)
+          << "State " << i << " differs between single and batch runs";
+      EXPECT_EQ(single_handlers[i]->GetMemory(),
+                batch_handlers[i]->GetMemory())
+          << "Memory " << i << " differs between single and batch runs";
+    }
+    return batch_states;
+  }
+
+  llvm::LLVMContext context;
+  test_runner::LiftingTester lifter;
+  const remill::Register *const pc_reg;
+  test_runner::random_bytes_engine rbe;
+  std::vector<std::unique_ptr<llvm::Module>> modules;
+};
+
+// Every state of a batch is run through the instruction, and not just the
+// first one.
+TEST_F(BatchExecutionTest, RegisterInstruction) {
+
+  // add eax, ebx
+  const std::string_view add_eax_ebx("\x01\xd8", 2);
+  auto func = Lift(add_eax_ebx);
+  ASSERT_NE(func, nullptr);
+
+  const auto init_states = RandomInitialStates();
+  const auto final_states = RunBoth(func, add_eax_ebx.size(), init_states);
+  for (size_t i = 0; i < init_states.size(); ++i) {
+    EXPECT_EQ(final_states[i].gpr.rax.dword,
+              init_states[i].gpr.rax.dword + init_states[i].gpr.rbx.dword);
+    EXPECT_EQ(final_states[i].gpr.rip.dword, kInsnAddr + add_eax_ebx.size());
+  }
+}
+
+// Each state of a batch reads and writes its own memory handler.
+TEST_F(BatchExecutionTest, MemoryInstruction) {
+
+  // xchg [ebx], eax
+  const std::string_view xchg_mem_eax("\x87\x03", 2);
+  auto func = Lift(xchg_mem_eax);
+  ASSERT_NE(func, nullptr);
+
+  const auto init_states = RandomInitialStates();
+  const auto final_states = RunBoth(func, xchg_mem_eax.size(), init_states);
+  for (size_t i = 0; i < init_states.size(); ++i) {
+    EXPECT_EQ(final_states[i].gpr.rip.dword, kInsnAddr + xchg_mem_eax.size());
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2022 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Runs `export-insns` over small ELF files, and checks the corpus shards that
+// it writes.
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/Object/ELFTypes.h>
+#include <llvm/Support/JSON.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using ELFT = llvm::object::ELF32LE;
+
+// A section of a test ELF file.
+struct TestSection {
+  std::string name;
+  uint32_t flags;
+  uint32_t addr;
+  std::string data;
+};
+
+// Returns a 32-bit x86 ELF file made of `sections`, followed by a section
+// name string table.
+static std::string MakeElf(const std::vector<TestSection> &sections) {
+  std::string strtab(1, '\0');
+  std::vector<uint32_t> name_offsets;
+  for (const auto &sec : sections) {
+    name_offsets.push_back(static_cast<uint32_t>(strtab.size()));
+    strtab += sec.name + '\0';
+  }
+  const auto strtab_name = static_cast<uint32_t>(strtab.size());
+  strtab += std::string(".shstrtab") + '\0';
+
+  // Lay out the header, then the section contents, then the section headers.
+  std::string contents;
+  std::vector<uint32_t> offsets;
+  for (const auto &sec : sections) {
+    offsets.push_back(static_cast<uint32_t>(sizeof(ELFT::Ehdr) +
+                                            contents.size()));
+    contents += sec.data;
+  }
+  const auto strtab_offset =
+      static_cast<uint32_t>(sizeof(ELFT::Ehdr) + contents.size());
+  contents += strtab;
+  contents.resize((contents.size() + 3u) & ~3u, '\0');
+
+  ELFT::Ehdr ehdr;
+  std::memset(&ehdr, 0, sizeof(ehdr));
+  std::memcpy(ehdr.e_ident, llvm::ELF::ElfMagic, 4);
+  ehdr.e_ident[llvm::ELF::EI_CLASS] = llvm::ELF::ELFCLASS32;
+  ehdr.e_ident[llvm::ELF::EI_DATA] = llvm::ELF::ELFDATA2LSB;
+  ehdr.e_ident[llvm::ELF::EI_VERSION] = llvm::ELF::EV_CURRENT;
+  ehdr.e_type = llvm::ELF::ET_EXEC;
+  ehdr.e_machine = llvm::ELF::EM_386;
+  ehdr.e_version = llvm::ELF::EV_CURRENT;
+  ehdr.e_shoff = static_cast<uint32_t>(sizeof(ehdr) + contents.size());
+  ehdr.e_ehsize = sizeof(ehdr);
+  ehdr.e_shentsize = sizeof(ELFT::Shdr);
+  ehdr.e_shnum = static_cast<uint16_t>(sections.size() + 2u);
+  ehdr.e_shstrndx = static_cast<uint16_t>(sections.size() + 1u);
+
+  std::string elf(reinterpret_cast<const char *>(&ehdr), sizeof(ehdr));
+  elf += contents;
+
+  auto add_shdr = [&elf](uint32_t name, uint32_t type, uint32_t flags,
+                         uint32_t addr, uint32_t offset, uint32_t size) {
+    ELFT::Shdr shdr;
+    std::memset(&shdr, 0, sizeof(shdr));
+    shdr.sh_name = name;
+    shdr.sh_type = type;
+    shdr.sh_flags = flags;
+    shdr.sh_addr = addr;
+    shdr.sh_offset = offset;
+    shdr.sh_size = size;
+    shdr.sh_addralign = 1;
+    elf.append(reinterpret_cast<const char *>(&shdr), sizeof(shdr));
+  };
+
+  add_shdr(0, llvm::ELF::SHT_NULL, 0, 0, 0, 0);
+  for (size_t i = 0; i < sections.size(); ++i) {
+    add_shdr(name_offsets[i], llvm::ELF::SHT_PROGBITS, sections[i].flags,
+             sections[i].addr, offsets[i],
+             static_cast<uint32_t>(sections[i].data.size()));
+  }
+  add_shdr(strtab_name, llvm::ELF::SHT_STRTAB, 0, 0, strtab_offset,
+           static_cast<uint32_t>(strtab.size()));
+  return elf;
+}
+
+static constexpr uint32_t kCodeFlags =
+    llvm::ELF::SHF_ALLOC | llvm::ELF::SHF_EXECINSTR;
+static constexpr uint32_t kDataFlags =
+    llvm::ELF::SHF_ALLOC | llvm::ELF::SHF_WRITE;
+
+class ExportInstructionsTest : public ::testing::Test {
+ protected:
+  void SetUp(void) override {
+    std::random_device rd;
+    std::stringstream ss;
+    ss << "remill-export-insns-test." << std::hex << rd() << rd();
+    work_dir = std::filesystem::temp_directory_path() / ss.str();
+    in_dir = work_dir / "in";
+    std::filesystem::create_directories(in_dir / "nested");
+
+    // add eax, ebx; nop; add eax, ebx; ret; followed by two bytes that don't
+    // decode. The `int3` in `.data` is never swept.
+    Write(in_dir / "a.elf",
+          MakeElf({{".text", kCodeFlags, 0x1000,
+                    std::string("\x01\xd8\x90\x01\xd8\xc3\xff\xff", 8)},
+                   {".data", kDataFlags, 0x2000, "\xcc"}}));
+
+    // nop; mov eax, [ebx]; ret
+    Write(in_dir / "nested" / "b.elf",
+          MakeElf({{".text", kCodeFlags, 0x1000,
+                    std::string("\x90\x8b\x03\xc3", 4)}}));
+
+    // Not an ELF file, and so skipped.
+    Write(in_dir / "notes.txt", "\xcc\xcc\xcc\xcc");
+  }
+
+  void TearDown(void) override {
+    std::error_code ec;
+    std::filesystem::remove_all(work_dir, ec);
+  }
+
+  static void Write(const std::filesystem::path &path,
+                    const std::string &data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << data;
+  }
+
+  // Run `export-insns` over the input directory, writing `num_shards` shards
+  // into `out_dir`. Returns the shards.
+  std::vector<std::vector<std::string>> Export(const std::string &out_name,
+                                               unsigned num_shards,
+                                               unsigned num_workers) {
+    std::stringstream cmd;
+    cmd << EXPORT_INSNS_PATH << " --arch x86 --os linux --out_dir "
+        << (work_dir / "out") << " --out_name " << out_name
+        << " --num_shards " << num_shards << " --num_workers " << num_workers
+        << ' ' << in_dir;
+    EXPECT_EQ(std::system(cmd.str().c_str()), 0) << cmd.str();
+
+    std::vector<std::vector<std::string>> shards;
+    for (auto i = 0u; i < num_shards; ++i) {
+      const auto path =
+          work_dir / "out" / (out_name + "_" + std::to_string(i) + ".json");
+      std::ifstream in(path);
+      std::stringstream ss;
+      ss << in.rdbuf();
+
+      auto parsed = llvm::json::parse(ss.str());
+      EXPECT_TRUE(static_cast<bool>(parsed)) << path;
+      if (!parsed) {
+        llvm::consumeError(parsed.takeError());
+        return {};
+      }
+
+      auto &shard = shards.emplace_back();
+      for (const auto &val : *parsed->getAsArray()) {
+        shard.push_back(val.getAsString()->str());
+      }
+    }
+    return shards;
+  }
+
+  std::filesystem::path work_dir;
+  std::filesystem::path in_dir;
+};
+
+// Every unique encoding in the code sections of all ELF files is exported
+// exactly once, to sorted shards.
+TEST_F(ExportInstructionsTest, UniqueSortedShards) {
+  const auto shards = Export("insn_file", 3, 1);
+  ASSERT_EQ(shards.size(), 3u);
+
+  std::vector<std::string> all;
+  for (const auto &shard : shards) {
+    EXPECT_TRUE(std::is_sorted(shard.begin(), shard.end()));
+    all.insert(all.end(), shard.begin(), shard.end());
+  }
+  std::sort(all.begin(), all.end());
+
+  const std::vector<std::string> expected = {"01d8", "8b03", "90", "c3"};
+  EXPECT_EQ(all, expected);
+}
+
+// The corpus doesn't depend on how many workers swept the files.
+TEST_F(ExportInstructionsTest, Reproducible) {
+  const auto one_worker = Export("one", 2, 1);
+  const auto two_workers = Export("two", 2, 2);
+  EXPECT_EQ(one_worker, two_workers);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  return RUN_ALL_TESTS();
+}